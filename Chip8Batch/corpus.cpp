@@ -0,0 +1,263 @@
+//
+//  corpus.cpp
+//  Chip8Batch
+//
+//  Created by Ruijing Li on 10/23/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "corpus.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include "chip8.hpp"
+#include "chip8aot.hpp"
+#include "chip8jit.hpp"
+#include "inputlog.hpp"
+#include "romstore.hpp"
+#include "scheduler.hpp"
+#include "threadpool.hpp"
+
+static bool byCycles(const CorpusCheck &a, const CorpusCheck &b)
+{
+    return a.cycles < b.cycles;
+}
+
+// "rom cycles hash [log]" lines, # starts a comment. A hash that isn't hex (like "?") is still to be blessed.
+static bool readManifest(const std::string &path, std::vector<CorpusRun> &runs)
+{
+    std::ifstream in(path.c_str());
+    if(!in)
+        return false;
+    std::map<std::pair<std::string, std::string>, size_t> index;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        size_t comment = line.find('#');
+        if(comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream fields(line);
+        std::string rom, hash, log;
+        CorpusCheck check;
+        if(!(fields >> rom >> check.cycles >> hash))
+            continue;
+        fields >> log;
+        char *end;
+        check.expected = strtoull(hash.c_str(), &end, 16);
+        if(*end)
+            check.expected = 0;
+        check.got = 0;
+
+        std::pair<std::string, std::string> key(rom, log);
+        if(!index.count(key))
+        {
+            index[key] = runs.size();
+            CorpusRun run;
+            run.rom = rom;
+            run.log = log;
+            runs.push_back(run);
+        }
+        runs[index[key]].checks.push_back(check);
+    }
+    for(size_t i = 0; i < runs.size(); ++i)
+        std::stable_sort(runs[i].checks.begin(), runs[i].checks.end(), byCycles);
+    return true;
+}
+
+static bool endsWith(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && !strcasecmp(s.c_str() + s.size() - n, suffix);
+}
+
+// Blessing: every ROM in dir the manifest doesn't mention yet, checked at cycles / 10 and cycles,
+// with name.c8in as its input log if there is one
+static void addUnlisted(const char *dir, unsigned long cycles, std::vector<CorpusRun> &runs)
+{
+    std::set<std::string> listed, files;
+    for(size_t i = 0; i < runs.size(); ++i)
+        listed.insert(runs[i].rom);
+    DIR *d = opendir(dir);
+    if(!d)
+        return;
+    while(struct dirent *entry = readdir(d))
+        files.insert(entry->d_name);
+    closedir(d);
+
+    for(std::set<std::string>::iterator it = files.begin(); it != files.end(); ++it)
+    {
+        if(!endsWith(*it, ".ch8") || listed.count(*it))
+            continue;
+        CorpusRun run;
+        run.rom = *it;
+        std::string log = it->substr(0, it->size() - 4) + ".c8in";
+        if(files.count(log))
+            run.log = log;
+        CorpusCheck check;
+        check.expected = check.got = 0;
+        check.cycles = cycles / 10;
+        run.checks.push_back(check);
+        check.cycles = cycles;
+        run.checks.push_back(check);
+        runs.push_back(run);
+    }
+}
+
+static bool writeManifest(const std::string &path, const std::vector<CorpusRun> &runs)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", path.c_str());
+        return false;
+    }
+    fprintf(file, "# rom cycles hash [input log], written by Chip8Batch --check --bless\n");
+    for(size_t i = 0; i < runs.size(); ++i)
+    {
+        const CorpusRun &run = runs[i];
+        if(!run.loaded)
+            continue; // nothing to bless, the ROM is gone
+        for(size_t c = 0; c < run.checks.size(); ++c)
+            fprintf(file, "%s %llu %016llx%s%s\n", run.rom.c_str(), run.checks[c].cycles, run.checks[c].got,
+                    run.log.empty() ? "" : " ", run.log.c_str());
+    }
+    return fclose(file) == 0;
+}
+
+static void runOne(CorpusRun &run, const std::string &dir, RomStore &store, const CorpusOptions &options)
+{
+    run.ran = 0;
+    run.seconds = 0;
+    const Rom *image = store.get((dir + "/" + run.rom).c_str());
+    InputLog log;
+    run.loaded = image && (run.log.empty() || log.load((dir + "/" + run.log).c_str()));
+    if(!run.loaded)
+        return;
+
+    Chip8 *c8 = new Chip8();
+    c8->loadRom(image->data, image->size);
+    const AotModule *aot = options.useAot ? findAotModule(image->hash) : NULL;
+    Chip8Backend *backend = NULL;
+    if(aot)
+        backend = new Chip8Aot(*c8, *aot);
+    else if(options.useJit)
+        backend = new Chip8Jit(*c8);
+    Scheduler scheduler(*c8, backend);
+    scheduler.throttle = false;
+    scheduler.skipIdleLoops = options.skipIdle;
+    InputReplay *replay = run.log.empty() ? NULL : new InputReplay(log);
+    if(replay)
+        replay->prepare(*c8, scheduler);
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < run.checks.size(); ++i)
+    {
+        CorpusCheck &check = run.checks[i];
+        while(c8->cycles < check.cycles)
+        {
+            unsigned long n = (unsigned long)(check.cycles - c8->cycles);
+            if(replay && !replay->finished(*c8))
+            {
+                replay->run(*c8, scheduler, n);
+                continue;
+            }
+            // past the log (or without one) nobody presses anything, time just passes on FX0A
+            scheduler.runInstructions(n);
+            if(c8->waitingForKey)
+                scheduler.idle(check.cycles - c8->cycles);
+        }
+        check.got = c8->displayHash();
+    }
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    run.ran = c8->cycles;
+    delete replay;
+    delete backend;
+    delete c8;
+}
+
+int checkCorpus(const char *dir, const CorpusOptions &options, std::vector<CorpusRun> *results)
+{
+    std::string manifest = std::string(dir) + "/" + CORPUS_MANIFEST;
+    std::vector<CorpusRun> runs;
+    if(!readManifest(manifest, runs) && !options.bless)
+    {
+        fprintf(stderr, "No %s in %s, --bless makes one\n", CORPUS_MANIFEST, dir);
+        return 1;
+    }
+    if(options.bless)
+        addUnlisted(dir, options.cycles, runs);
+    if(runs.empty())
+    {
+        fprintf(stderr, "No ROMs to check in %s\n", dir);
+        return 1;
+    }
+
+    RomStore store;
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool *pool = new ThreadPool(options.threads);
+    int workerCount = pool->size();
+    // longest runs first, so one big ROM doesn't start last and hold up the end
+    std::vector<CorpusRun *> order;
+    for(size_t i = 0; i < runs.size(); ++i)
+        order.push_back(&runs[i]);
+    std::stable_sort(order.begin(), order.end(), [](const CorpusRun *a, const CorpusRun *b) {
+        return a->checks.back().cycles > b->checks.back().cycles;
+    });
+    std::string base = dir;
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        CorpusRun *run = order[i];
+        pool->submit([run, &base, &store, &options] { runOne(*run, base, store, options); });
+    }
+    pool->wait();
+    delete pool;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned long long total = 0;
+    int checkpoints = 0, mismatched = 0, failed = 0;
+    for(size_t i = 0; i < runs.size(); ++i)
+    {
+        const CorpusRun &run = runs[i];
+        std::string name = run.log.empty() ? run.rom : run.rom + " + " + run.log;
+        if(!run.loaded)
+        {
+            ++failed;
+            printf("FAILED %s\n", name.c_str());
+            continue;
+        }
+        total += run.ran;
+        int bad = 0;
+        for(size_t c = 0; c < run.checks.size(); ++c)
+        {
+            const CorpusCheck &check = run.checks[c];
+            ++checkpoints;
+            if(options.bless || check.got == check.expected)
+                continue;
+            ++bad;
+            printf("MISMATCH %s at %llu: expected %016llx got %016llx\n", name.c_str(), check.cycles, check.expected, check.got);
+        }
+        mismatched += bad;
+        if(!bad && !options.quiet)
+            printf("ok %s (%zu checkpoints, %.3fs)\n", name.c_str(), run.checks.size(), run.seconds);
+    }
+    printf("runs=%zu checkpoints=%d mismatched=%d failed=%d threads=%d instructions=%llu time=%.3fs ips=%.0f\n",
+           runs.size(), checkpoints, mismatched, failed, workerCount, total, seconds, total / seconds);
+    if(results)
+        *results = runs;
+
+    if(options.bless)
+    {
+        if(!writeManifest(manifest, runs))
+            return 1;
+        printf("blessed %s\n", manifest.c_str());
+        return failed ? 1 : 0;
+    }
+    return mismatched || failed ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+//
+//  corpus.hpp
+//  Chip8Batch
+//
+//  Created by Ruijing Li on 10/23/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef corpus_hpp
+#define corpus_hpp
+
+#include <string>
+#include <vector>
+
+/* Regression check over a directory of ROMs.
+ * The directory holds the ROMs and a manifest, expected.txt, with one "rom cycles hash [log]" per
+ * line: the display hash the ROM must show after that many instructions, optionally playing an
+ * input log (inputlog.hpp) from the same directory. Lines with the same rom and log are checkpoints
+ * of one run. Without a log a run gets seed 0 and the default speed and nobody presses any keys.
+ *
+ * Every run goes on the thread pool, so a few hundred ROMs take seconds. --bless writes the hashes
+ * the current build gets back into the manifest, adding any ROM in the directory that isn't in it.
+ */
+
+#define CORPUS_MANIFEST "expected.txt"
+
+struct CorpusCheck
+{
+    unsigned long long cycles;
+    unsigned long long expected; // from the manifest
+    unsigned long long got; // what this build showed
+};
+
+struct CorpusRun
+{
+    std::string rom; // file names, relative to the corpus directory
+    std::string log; // empty for none
+    std::vector<CorpusCheck> checks; // ascending cycles
+
+    // results
+    bool loaded;
+    unsigned long long ran;
+    double seconds;
+};
+
+struct CorpusOptions
+{
+    bool bless;
+    unsigned long cycles; // checkpoint for ROMs new to the manifest when blessing
+    int threads;
+    bool useJit;
+    bool useAot; // recompiled code for the ROMs that have some built in
+    bool skipIdle;
+    bool quiet; // only mismatches and the summary
+};
+
+// Runs or blesses the corpus in dir, returns the exit code: 0 if everything matched.
+// Every run and what it got also go in results if it's given.
+int checkCorpus(const char *dir, const CorpusOptions &, std::vector<CorpusRun> *results = NULL);
+
+#endif /* corpus_hpp */
@@ -0,0 +1,746 @@
+//
+//  main.cpp
+//  Chip8Batch
+//
+//  Created by Ruijing Li on 10/9/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "audio.hpp"
+#include "chip8.hpp"
+#include "chip8aot.hpp"
+#include "chip8jit.hpp"
+#include "corpus.hpp"
+#include "framestream.hpp"
+#include "lanes.hpp"
+#include "inputlog.hpp"
+#include "pixels.hpp"
+#include "recompiler.hpp"
+#include "romstore.hpp"
+#ifdef CHIP8_PROFILE
+#include <mutex>
+#include "profiler.hpp"
+#endif
+#include "scheduler.hpp"
+#include "threadpool.hpp"
+#include "trace.hpp"
+
+/* Headless batch runner, no GLUT in here.
+ * Runs a list of jobs (a ROM plus how many cycles to run it for) across every core and prints
+ * the final framebuffer hash for each job, plus the overall instructions/sec.
+ *
+ * A job can also have an input queue: a string of hex keys. Each time the ROM waits for a key (FX0A)
+ * the next one is pressed and released. When the queue runs dry the job is parked, it stops using
+ * the CPU and is reported as waiting.
+ *
+ * With --frames every job also records what its screen showed to a frame stream (framestream.hpp),
+ * --export turns one of those into raw video. --wav records what it sounded like (audio.hpp).
+ * --screenshot saves the screen each job ended on (pixels.hpp).
+ *
+ * With --lanes, jobs running the same ROM are put together in groups of up to 32 and each group
+ * runs in lockstep on one Chip8Lanes (lanes.hpp) instead of one machine per job.
+ *
+ * Job n's random numbers come from seed --seed + n, so a run is repeatable and no two jobs get
+ * the same numbers.
+ *
+ * With --replay every job plays back a recorded session (inputlog.hpp) instead: its seed, speed,
+ * key presses and length, and checks it ends on the same screen.
+ *
+ * --check runs a regression corpus instead of jobs (corpus.hpp).
+ *
+ * --recompile writes a ROM out as C++ (recompiler.hpp). Built into this program, --aot runs it.
+ *
+ * Every job keeps its own trace (trace.hpp) of unknown opcodes, or whatever --trace-filter picks,
+ * and reports how many it hit. --trace saves them, --dump-trace decodes one.
+ */
+
+#define DEFAULT_CYCLES 1000000
+
+// --screenshot: palette, filter and size (--scale is main.cpp's modifier, 128 x 64 times it)
+static PixelOptions screenshotOptions;
+static int screenshotModifier = 4;
+
+#ifdef CHIP8_PROFILE
+// --profile: every job's counts get merged into one profile per ROM
+static bool profiling = false;
+static std::mutex profileLock;
+static std::map<std::string, Chip8Profile *> profiles;
+#endif
+
+struct Job
+{
+    std::string rom;
+    const Rom *image; // mapped once in the RomStore, shared by every job running this ROM
+    unsigned long cycles;
+    std::string keys; // input queue for FX0A
+    std::string frameFile; // where to record the frame stream, empty for none
+    std::string wavFile; // where to record the sound, empty for none
+    std::string traceFile; // where to save the trace, empty for none
+    std::string screenshotFile; // where to save the last screen, empty for none
+    unsigned int traceFilter; // TraceType bits
+    uint64_t seed; // for CXNN, --seed plus the job's number
+    const InputLog *replay; // session to play back, NULL for none
+
+    // results
+    bool loaded;
+    bool parked; // stopped waiting for a key with nothing left in the queue
+    unsigned long ran;
+    unsigned long long hash;
+    unsigned short pc;
+    double seconds;
+    unsigned long long frames; // frames recorded
+    unsigned long long soundEdges, lateEdges; // tone on / offs, and ones that arrived after their sample was out
+    unsigned long droppedEdges; // lost to a full ring
+    unsigned long long unknownOpcodes;
+    unsigned long long traceEvents; // recorded, kept or not
+    bool replayMatched; // ended on the recorded screen
+};
+
+void usage()
+{
+    printf("Usage: ./Chip8Batch [options] rom1 rom2 ...\n\n");
+    printf("  -f jobfile   read jobs from a file, one \"rom [cycles [keys]]\" per line\n");
+    printf("               keys are hex digits pressed in turn whenever the ROM waits for a key\n");
+    printf("  -c cycles    cycles per job when not given (default %d)\n", DEFAULT_CYCLES);
+    printf("  -n copies    run every job this many times\n");
+    printf("  -j threads   worker threads (default: one per core)\n");
+    printf("  --jit        run on the JIT backend\n");
+    printf("  --aot        run ROMs that have recompiled code built in on it (see --recompile)\n");
+    printf("  --seed n     seed job i's random numbers with n + i (default 0)\n");
+    printf("  --replay log play a recorded session (Chip8emu --record) on every ROM and check the result\n");
+    printf("  --lanes      run jobs with the same ROM %d at a time in lockstep, in SIMD lanes\n", Chip8Lanes::LANES);
+    printf("  --no-skip    run wait loops instruction by instruction instead of skipping them\n");
+    printf("  --frames prefix\n");
+    printf("               record every job's screen to prefix<job>.c8fs\n");
+    printf("  --wav prefix record every job's sound to prefix<job>.wav\n");
+    printf("  --trace prefix\n");
+    printf("               save every job's trace to prefix<job>.c8tr\n");
+    printf("  --trace-filter list\n");
+    printf("               what gets traced: all or any of unknown,calls,returns,draws (default unknown)\n");
+    printf("               calls and returns turn --aot off, lanes only trace unknown opcodes\n");
+    printf("  --dump-trace trace.c8tr\n");
+    printf("               print a saved trace and exit\n");
+    printf("  --screenshot prefix\n");
+    printf("               save the screen every job ends on to prefix<job>.pam\n");
+    printf("  --scale n    screenshots are 128n x 64n (default 4)\n");
+    printf("  --palette gray|green|amber\n");
+    printf("  --filter sharp|scanlines|smooth\n");
+    printf("  --export stream.c8fs video.gray\n");
+    printf("               convert a recording to raw 128x64 8 bit gray video at 60 fps and exit\n");
+    printf("  --recompile rom.ch8 out.cpp\n");
+    printf("               write the ROM out as C++ to build into a program, and exit\n");
+    printf("  --check dir  run the ROMs in dir and compare their screens with dir/%s\n", CORPUS_MANIFEST);
+    printf("  --bless      with --check, write this build's screens to the manifest instead\n");
+    printf("  -q           only print the summary\n");
+#ifdef CHIP8_PROFILE
+    printf("  --profile    print a hot spot and loop report for every ROM (interpreter only)\n");
+#endif
+}
+
+// Reads "rom [cycles [keys]]" lines, # starts a comment
+bool readJobFile(const char *filename, unsigned long defaultCycles, std::vector<Job> &jobs)
+{
+    std::ifstream in(filename);
+    if(!in)
+    {
+        std::cout << "Could not open job file " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while(std::getline(in, line))
+    {
+        size_t comment = line.find('#');
+        if(comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream fields(line);
+        Job job;
+        if(!(fields >> job.rom))
+            continue;
+        if(!(fields >> job.cycles))
+            job.cycles = defaultCycles;
+        fields >> job.keys;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Runs c8 on until the job has had its cycles, pressing the job's keys from nextKey on whenever it waits
+static void continueJob(Job &job, Chip8 &c8, Scheduler &scheduler, InputReplay *replay, FrameWriter *recorder,
+                        SoundSynth *sound, size_t nextKey)
+{
+    while(job.ran < job.cycles)
+    {
+        // recording goes a frame's worth of instructions at a time, so each frame gets its own record
+        // and the sound ring gets emptied long before it fills up
+        unsigned long chunk = job.cycles - job.ran;
+        if((recorder || sound) && chunk > scheduler.batch)
+            chunk = scheduler.batch;
+        job.ran += replay ? replay->run(c8, scheduler, chunk) : scheduler.runInstructions(chunk);
+        if(recorder)
+            recorder->capture(c8);
+        if(sound)
+            sound->update();
+        if(replay)
+            continue; // the log has the keys
+
+        if(!c8.waitingForKey)
+            continue;
+        if(nextKey >= job.keys.size())
+        {
+            job.parked = true;
+            break;
+        }
+        unsigned char k = strtol(job.keys.substr(nextKey++, 1).c_str(), NULL, 16);
+        c8.keyDown(k);
+        c8.keyUp(k);
+    }
+}
+
+static void saveJobScreenshot(const Job &job, const Chip8 &c8)
+{
+    if(job.screenshotFile.empty())
+        return;
+    PixelOptions options = screenshotOptions;
+    options.scale = displayScale(c8.hires, screenshotModifier);
+    if(!saveScreenshot(job.screenshotFile.c_str(), c8.gfx, c8.hires, options))
+        fprintf(stderr, "Could not write %s\n", job.screenshotFile.c_str());
+}
+
+// Takes the job's counts from its trace, and saves it with --trace
+static void finishTrace(Job &job, const Chip8Trace &trace)
+{
+    job.unknownOpcodes = trace.count(TRACE_UNKNOWN);
+    job.traceEvents = trace.recorded;
+    if(!job.traceFile.empty() && !trace.save(job.traceFile.c_str()))
+        fprintf(stderr, "Could not write %s\n", job.traceFile.c_str());
+}
+
+void runJob(Job &job, bool useJit, bool useAot, bool skipIdle)
+{
+    Chip8 *c8 = new Chip8();
+    c8->seedRandom(job.seed);
+    job.loaded = job.image != NULL;
+    if(job.loaded)
+        c8->loadRom(job.image->data, job.image->size);
+    job.ran = 0;
+    if(job.loaded)
+    {
+#ifdef CHIP8_PROFILE
+        if(profiling)
+        {
+            c8->profile = new Chip8Profile();
+            useJit = useAot = false; // translated code isn't counted
+        }
+#endif
+        Chip8Trace *trace = new Chip8Trace(TRACE_CAPACITY, job.traceFilter);
+        c8->trace = trace;
+        if(job.traceFilter & (TRACE_CALL | TRACE_RETURN))
+            useAot = false; // recompiled blocks do those inline
+        const AotModule *aot = useAot ? findAotModule(job.image->hash) : NULL;
+        Chip8Backend *backend = NULL;
+        if(aot)
+            backend = new Chip8Aot(*c8, *aot);
+        else if(useJit)
+            backend = new Chip8Jit(*c8);
+        Scheduler scheduler(*c8, backend);
+        scheduler.throttle = false;
+        scheduler.skipIdleLoops = skipIdle;
+        InputReplay *replay = job.replay ? new InputReplay(*job.replay) : NULL;
+        if(replay)
+            replay->prepare(*c8, scheduler);
+        FrameWriter *recorder = NULL;
+        if(!job.frameFile.empty())
+        {
+            recorder = new FrameWriter();
+            if(!recorder->open(job.frameFile.c_str(), scheduler.getIPS()))
+            {
+                delete recorder;
+                recorder = NULL;
+            }
+        }
+        WavWriter *wav = NULL;
+        SoundRing *ring = NULL;
+        SoundSynth *sound = NULL;
+        if(!job.wavFile.empty())
+        {
+            wav = new WavWriter();
+            if(wav->open(job.wavFile.c_str()))
+            {
+                ring = new SoundRing();
+                c8->audio = ring;
+                sound = new SoundSynth(*ring, *wav, scheduler.getIPS());
+            }
+            else
+            {
+                delete wav;
+                wav = NULL;
+            }
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        job.parked = false;
+        continueJob(job, *c8, scheduler, replay, recorder, sound, 0);
+        auto end = std::chrono::steady_clock::now();
+        job.frames = recorder ? recorder->frames : 0;
+        job.soundEdges = sound ? sound->edges : 0;
+        job.lateEdges = sound ? sound->lateEdges : 0;
+        job.droppedEdges = ring ? ring->dropped : 0;
+        if(wav && !wav->close())
+            fprintf(stderr, "Could not write %s\n", job.wavFile.c_str());
+        c8->audio = NULL;
+        finishTrace(job, *trace);
+        c8->trace = NULL;
+        delete trace;
+        delete sound;
+        delete ring;
+        delete wav;
+        job.replayMatched = replay && replay->matches(*c8);
+        delete replay;
+        delete recorder;
+        delete backend;
+        job.seconds = std::chrono::duration<double>(end - start).count();
+        job.hash = c8->displayHash();
+        job.pc = c8->pc;
+        saveJobScreenshot(job, *c8);
+#ifdef CHIP8_PROFILE
+        if(c8->profile)
+        {
+            std::lock_guard<std::mutex> guard(profileLock);
+            Chip8Profile *&total = profiles[job.rom];
+            if(!total)
+                total = c8->profile;
+            else
+            {
+                total->merge(*c8->profile);
+                delete c8->profile;
+            }
+        }
+#endif
+    }
+    delete c8;
+}
+
+// --recompile: the ROM as a C++ file, the module is named after the ROM's file name
+static int recompileRom(const char *path, const char *outPath)
+{
+    RomStore store;
+    const Rom *image = store.get(path);
+    if(!image)
+        return 1;
+    Recompiler recompiler(image->data, image->size);
+    std::string name = path;
+    name = name.substr(name.find_last_of('/') + 1);
+    name = name.substr(0, name.find_last_of('.'));
+
+    std::ofstream out(outPath);
+    recompiler.emit(out, name);
+    out.close();
+    if(!out)
+    {
+        fprintf(stderr, "Could not write %s\n", outPath);
+        return 1;
+    }
+    fprintf(stderr, "%zu blocks, %zu bytes of code, %zu of data, %d indirect jumps\n", recompiler.blocks.size(),
+            recompiler.codeBytes, recompiler.dataBytes, recompiler.indirectJumps);
+    return 0;
+}
+
+// --lanes totals, how many lanes shared each step on average
+static std::atomic<unsigned long long> laneSteps(0), laneInstructions(0);
+
+// Jobs that all run the same ROM, at most Chip8Lanes::LANES of them, one lane each
+void runLaneJobs(const std::vector<Job *> &group, bool skipIdle)
+{
+    Chip8Lanes *lanes = new Chip8Lanes();
+    Chip8 *c8 = new Chip8();
+    std::vector<size_t> nextKey(group.size(), 0);
+    std::vector<Chip8Trace *> traces(group.size());
+    for(size_t l = 0; l < group.size(); ++l)
+    {
+        Job &job = *group[l];
+        traces[l] = new Chip8Trace(TRACE_CAPACITY, job.traceFilter);
+        lanes->trace[l] = traces[l];
+        job.loaded = true;
+        job.parked = false;
+        c8->seedRandom(job.seed);
+        c8->initialize();
+        c8->loadRom(job.image->data, job.image->size);
+        lanes->load((int)l, *c8);
+        lanes->budget[l] = job.cycles;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    bool woke = true;
+    while(woke)
+    {
+        lanes->run();
+        // same input queue as runJob, one key each time a lane waits
+        woke = false;
+        for(size_t l = 0; l < group.size(); ++l)
+        {
+            Job &job = *group[l];
+            uint32_t bit = 1u << l;
+            if(!(lanes->waiting & lanes->active & bit) || lanes->budget[l] == 0)
+                continue;
+            if(nextKey[l] >= job.keys.size())
+            {
+                job.parked = true;
+                lanes->active &= ~bit;
+                continue;
+            }
+            unsigned char k = strtol(job.keys.substr(nextKey[l]++, 1).c_str(), NULL, 16);
+            lanes->keyDown((int)l, k);
+            lanes->keyUp((int)l, k);
+            woke = true;
+        }
+    }
+    
+    for(size_t l = 0; l < group.size(); ++l)
+    {
+        Job &job = *group[l];
+        // a lane only holds 4K and 64x32, the rest of the machine comes from a fresh load
+        c8->initialize();
+        c8->loadRom(job.image->data, job.image->size);
+        lanes->store((int)l, *c8);
+        job.ran = c8->cycles;
+        if(lanes->fallback & (1u << l))
+        {
+            // it got to something lanes don't run (SUPER-CHIP / XO-CHIP), a Chip8 does the rest
+            Scheduler scheduler(*c8);
+            scheduler.throttle = false;
+            scheduler.skipIdleLoops = skipIdle;
+            c8->trace = traces[l];
+            continueJob(job, *c8, scheduler, NULL, NULL, NULL, nextKey[l]);
+            c8->trace = NULL;
+        }
+        finishTrace(job, *traces[l]);
+        delete traces[l];
+        job.frames = 0;
+        job.hash = c8->displayHash();
+        job.pc = c8->pc;
+        saveJobScreenshot(job, *c8);
+    }
+    auto end = std::chrono::steady_clock::now();
+    for(size_t l = 0; l < group.size(); ++l)
+        group[l]->seconds = std::chrono::duration<double>(end - start).count(); // the whole group's time
+    laneSteps += lanes->steps;
+    laneInstructions += lanes->laneInstructions;
+    delete c8;
+    delete lanes;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned long cycles = DEFAULT_CYCLES;
+    int copies = 1;
+    int threads = 0;
+    uint64_t seed = 0;
+    bool useJit = false;
+    bool useAot = false;
+    bool useLanes = false;
+    bool skipIdle = true;
+    InputLog *replayLog = NULL;
+    bool quiet = false;
+    const char *framePrefix = NULL;
+    const char *wavPrefix = NULL;
+    const char *tracePrefix = NULL;
+    const char *screenshotPrefix = NULL;
+    unsigned int traceFilter = TRACE_UNKNOWN;
+    const char *corpus = NULL;
+    bool bless = false;
+    std::vector<const char *> jobFiles;
+    std::vector<const char *> roms;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-f") && i + 1 < argc)
+            jobFiles.push_back(argv[++i]);
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+            cycles = strtoul(argv[++i], NULL, 0);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            copies = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if(!strcmp(argv[i], "--replay") && i + 1 < argc)
+        {
+            replayLog = new InputLog();
+            if(!replayLog->load(argv[++i]))
+                return 1;
+        }
+        else if(!strcmp(argv[i], "--jit"))
+            useJit = true;
+        else if(!strcmp(argv[i], "--aot"))
+            useAot = true;
+        else if(!strcmp(argv[i], "--lanes"))
+            useLanes = true;
+        else if(!strcmp(argv[i], "--no-skip"))
+            skipIdle = false;
+        else if(!strcmp(argv[i], "-q"))
+            quiet = true;
+#ifdef CHIP8_PROFILE
+        else if(!strcmp(argv[i], "--profile"))
+            profiling = true;
+#endif
+        else if(!strcmp(argv[i], "--check") && i + 1 < argc)
+            corpus = argv[++i];
+        else if(!strcmp(argv[i], "--bless"))
+            bless = true;
+        else if(!strcmp(argv[i], "--frames") && i + 1 < argc)
+            framePrefix = argv[++i];
+        else if(!strcmp(argv[i], "--wav") && i + 1 < argc)
+            wavPrefix = argv[++i];
+        else if(!strcmp(argv[i], "--trace") && i + 1 < argc)
+            tracePrefix = argv[++i];
+        else if(!strcmp(argv[i], "--trace-filter") && i + 1 < argc)
+        {
+            traceFilter = parseTraceFilter(argv[++i]);
+            if(!traceFilter)
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--dump-trace") && i + 1 < argc)
+            return dumpTrace(argv[++i], stdout) < 0 ? 1 : 0;
+        else if(!strcmp(argv[i], "--screenshot") && i + 1 < argc)
+            screenshotPrefix = argv[++i];
+        else if(!strcmp(argv[i], "--scale") && i + 1 < argc)
+            screenshotModifier = std::max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "--palette") && i + 1 < argc)
+        {
+            screenshotOptions.palette = findPalette(argv[++i]);
+            if(!screenshotOptions.palette)
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--filter") && i + 1 < argc)
+        {
+            const char *filter = argv[++i];
+            if(!strcmp(filter, "sharp"))
+                screenshotOptions.filter = PIXEL_SHARP;
+            else if(!strcmp(filter, "scanlines"))
+                screenshotOptions.filter = PIXEL_SCANLINES;
+            else if(!strcmp(filter, "smooth"))
+                screenshotOptions.filter = PIXEL_SMOOTH;
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--export") && i + 2 < argc)
+        {
+            long frames = exportGrayVideo(argv[i + 1], argv[i + 2]);
+            if(frames < 0)
+                return 1;
+            fprintf(stderr, "%ld frames\n", frames);
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--recompile") && i + 2 < argc)
+            return recompileRom(argv[i + 1], argv[i + 2]);
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+            roms.push_back(argv[i]);
+    }
+
+    if(corpus)
+    {
+        CorpusOptions options;
+        options.bless = bless;
+        options.cycles = cycles;
+        options.threads = threads;
+        options.useJit = useJit;
+        options.useAot = useAot;
+        options.skipIdle = skipIdle;
+        options.quiet = quiet;
+        return checkCorpus(corpus, options);
+    }
+
+    std::vector<Job> jobs;
+    for(size_t i = 0; i < jobFiles.size(); ++i)
+        if(!readJobFile(jobFiles[i], cycles, jobs))
+            return 1;
+    for(size_t i = 0; i < roms.size(); ++i)
+    {
+        Job job;
+        job.rom = roms[i];
+        job.cycles = cycles;
+        jobs.push_back(job);
+    }
+    if(jobs.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    // -n copies: same jobs over and over
+    size_t unique = jobs.size();
+    for(int c = 1; c < copies; ++c)
+        for(size_t i = 0; i < unique; ++i)
+            jobs.push_back(jobs[i]);
+
+    // every job running the same ROM shares one mapping of it
+    RomStore store;
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        jobs[i].image = store.get(jobs[i].rom.c_str());
+        jobs[i].seed = seed + i;
+        jobs[i].traceFilter = traceFilter;
+        jobs[i].replay = replayLog;
+        if(!replayLog)
+            continue;
+        if(replayLog->length())
+            jobs[i].cycles = replayLog->length();
+        if(jobs[i].image && jobs[i].image->hash != replayLog->romHash)
+            fprintf(stderr, "%s isn't the ROM the session was recorded on\n", jobs[i].rom.c_str());
+    }
+    
+    if(useAot && !useLanes)
+    {
+        std::map<const Rom *, bool> warned;
+        for(size_t i = 0; i < jobs.size(); ++i)
+            if(jobs[i].image && !findAotModule(jobs[i].image->hash) && !warned[jobs[i].image])
+            {
+                warned[jobs[i].image] = true;
+                fprintf(stderr, "%s has no recompiled code built in, it runs on the %s\n", jobs[i].rom.c_str(),
+                        useJit ? "JIT" : "interpreter");
+            }
+    }
+
+    if(framePrefix)
+        for(size_t i = 0; i < jobs.size(); ++i)
+            jobs[i].frameFile = framePrefix + std::to_string(i) + ".c8fs";
+    if(wavPrefix)
+        for(size_t i = 0; i < jobs.size(); ++i)
+            jobs[i].wavFile = wavPrefix + std::to_string(i) + ".wav";
+    if(tracePrefix)
+        for(size_t i = 0; i < jobs.size(); ++i)
+            jobs[i].traceFile = tracePrefix + std::to_string(i) + ".c8tr";
+    if(screenshotPrefix)
+        for(size_t i = 0; i < jobs.size(); ++i)
+            jobs[i].screenshotFile = screenshotPrefix + std::to_string(i) + ".pam";
+    
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool *pool = new ThreadPool(threads);
+    int workerCount = pool->size();
+    if(useLanes)
+    {
+        if(useJit || useAot || framePrefix || wavPrefix || replayLog)
+            fprintf(stderr, "--lanes runs on its own, ignoring --jit, --aot, --frames, --wav and --replay\n");
+        // group the jobs by ROM, then cut each group into lane sized pieces
+        std::map<const Rom *, std::vector<Job *> > byRom;
+        for(size_t i = 0; i < jobs.size(); ++i)
+        {
+            jobs[i].frameFile.clear();
+            jobs[i].wavFile.clear();
+            jobs[i].replay = NULL;
+            if(jobs[i].image && jobs[i].image->size <= 4096 - 512)
+                byRom[jobs[i].image].push_back(&jobs[i]);
+            else
+            {
+                // missing, or an XO-CHIP ROM bigger than a lane's memory: on its own
+                Job *job = &jobs[i];
+                pool->submit([job, skipIdle] { runJob(*job, false, false, skipIdle); });
+            }
+        }
+        for(std::map<const Rom *, std::vector<Job *> >::iterator it = byRom.begin(); it != byRom.end(); ++it)
+        {
+            for(size_t first = 0; first < it->second.size(); first += Chip8Lanes::LANES)
+            {
+                size_t last = std::min(first + Chip8Lanes::LANES, it->second.size());
+                std::vector<Job *> group(it->second.begin() + first, it->second.begin() + last);
+                pool->submit([group, skipIdle] { runLaneJobs(group, skipIdle); });
+            }
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < jobs.size(); ++i)
+        {
+            Job *job = &jobs[i];
+            pool->submit([job, useJit, useAot, skipIdle] { runJob(*job, useJit, useAot, skipIdle); });
+        }
+    }
+    pool->wait();
+    unsigned long steals = pool->steals();
+    delete pool;
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    unsigned long long total = 0;
+    int failed = 0, parked = 0, mismatched = 0;
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        const Job &job = jobs[i];
+        if(!job.loaded)
+            ++failed;
+        if(job.loaded && job.parked)
+            ++parked;
+        if(job.loaded && job.replay && !job.replayMatched)
+            ++mismatched;
+        total += job.ran;
+        if(quiet)
+            continue;
+        if(job.loaded)
+        {
+            printf("%zu %s cycles=%lu hash=%016llx pc=0x%03X time=%.3fs%s", i, job.rom.c_str(), job.ran, job.hash, job.pc, job.seconds,
+                   job.parked ? " waiting-for-key" : "");
+            if(!job.frameFile.empty())
+                printf(" frames=%llu", job.frames);
+            if(!job.wavFile.empty())
+                printf(" sound-edges=%llu late=%llu dropped=%lu", job.soundEdges, job.lateEdges, job.droppedEdges);
+            if(job.unknownOpcodes)
+                printf(" unknown-opcodes=%llu", job.unknownOpcodes);
+            if(!job.traceFile.empty())
+                printf(" traced=%llu", job.traceEvents);
+            if(job.replay)
+                printf(" replay=%s", job.replayMatched ? "ok" : "MISMATCH");
+            printf("\n");
+        }
+        else
+            printf("%zu %s FAILED\n", i, job.rom.c_str());
+    }
+    printf("jobs=%zu failed=%d parked=%d threads=%d steals=%lu instructions=%llu time=%.3fs ips=%.0f\n",
+           jobs.size(), failed, parked, workerCount, steals, total, seconds, total / seconds);
+    if(useLanes && laneSteps)
+        printf("lockstep: steps=%llu lanes per step=%.2f\n", (unsigned long long)laneSteps, (double)laneInstructions / laneSteps);
+    if(replayLog && !useLanes)
+        printf("replays: events=%zu mismatched=%d\n", replayLog->events.size(), mismatched);
+    delete replayLog;
+
+#ifdef CHIP8_PROFILE
+    for(std::map<std::string, Chip8Profile *>::iterator it = profiles.begin(); it != profiles.end(); ++it)
+    {
+        // load the ROM again so the report can show the opcodes
+        Chip8 *c8 = new Chip8();
+        const Rom *image = store.get(it->first.c_str());
+        if(image)
+            c8->loadRom(image->data, image->size);
+        printf("\nProfile of %s: ", it->first.c_str());
+        it->second->report(stdout, c8->memory);
+        delete c8;
+        delete it->second;
+    }
+#endif
+    
+    return failed || mismatched ? 1 : 0;
+}
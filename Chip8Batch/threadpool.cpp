@@ -0,0 +1,116 @@
+//
+//  threadpool.cpp
+//  Chip8Batch
+//
+//  Created by Ruijing Li on 10/9/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(int threads) : pending(0), stealCount(0), stopping(false), nextQueue(0)
+{
+    if(threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    if(threads <= 0)
+        threads = 1;
+
+    for(int i = 0; i < threads; ++i)
+        queues.push_back(new Queue());
+    for(int i = 0; i < threads; ++i)
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    for(size_t i = 0; i < queues.size(); ++i)
+        delete queues[i];
+}
+
+void ThreadPool::submit(const Task &task)
+{
+    ++pending;
+    Queue *q = queues[nextQueue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> guard(q->lock);
+        q->tasks.push_back(task);
+    }
+    // take sleepLock so a worker that just found nothing can't miss this
+    std::lock_guard<std::mutex> guard(sleepLock);
+    wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(sleepLock);
+    done.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::popLocal(int index, Task &task)
+{
+    Queue *q = queues[index];
+    std::lock_guard<std::mutex> guard(q->lock);
+    if(q->tasks.empty())
+        return false;
+    task = q->tasks.back();
+    q->tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(int index, Task &task)
+{
+    int n = (int)queues.size();
+    for(int i = 1; i < n; ++i)
+    {
+        Queue *victim = queues[(index + i) % n];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if(!victim->tasks.empty())
+        {
+            // oldest work from the other end, the owner keeps what it touched last
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            ++stealCount;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    while(true)
+    {
+        Task task;
+        if(popLocal(index, task) || steal(index, task))
+        {
+            task();
+            if(--pending == 0)
+            {
+                std::lock_guard<std::mutex> guard(sleepLock);
+                done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleepLock);
+        if(stopping)
+            return;
+        // re-check under the lock: submit() notifies while holding it
+        bool anyWork = false;
+        for(size_t i = 0; i < queues.size() && !anyWork; ++i)
+        {
+            std::lock_guard<std::mutex> qguard(queues[i]->lock);
+            anyWork = !queues[i]->tasks.empty();
+        }
+        if(!anyWork)
+            wake.wait(guard);
+    }
+}
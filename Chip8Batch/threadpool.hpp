@@ -0,0 +1,64 @@
+//
+//  threadpool.hpp
+//  Chip8Batch
+//
+//  Created by Ruijing Li on 10/9/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef threadpool_hpp
+#define threadpool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work-stealing thread pool.
+ * Every worker has its own deque. It pops its own work from the back and, when that runs out,
+ * steals from the front of the other workers' deques, so long jobs don't leave cores idle.
+ */
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(int threads = 0); // 0 means one per core
+    ~ThreadPool(); // waits for everything queued
+
+    // Hands tasks out round robin, workers balance the rest by stealing
+    void submit(const Task &);
+    // Blocks until every submitted task has finished
+    void wait();
+
+    int size() const { return (int)workers.size(); }
+    unsigned long steals() const { return stealCount; }
+
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Queue *> queues;
+    std::atomic<unsigned long> pending; // submitted but not finished
+    std::atomic<unsigned long> stealCount;
+    std::atomic<bool> stopping;
+    unsigned int nextQueue;
+
+    // sleeping workers wait on this instead of spinning
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    void workerLoop(int index);
+    bool popLocal(int index, Task &);
+    bool steal(int index, Task &);
+};
+
+#endif /* threadpool_hpp */
@@ -0,0 +1,193 @@
+//
+//  main.cpp
+//  Chip8Bench
+//
+//  Created by Ruijing Li on 10/2/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <iostream>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "chip8.hpp"
+#include "chip8aot.hpp"
+#include "chip8jit.hpp"
+#include "microbench.hpp"
+#include "romstore.hpp"
+
+// How many cycles to run each ROM for
+#define BENCH_CYCLES 20000000
+
+/* Little loop used when no ROMs are passed in, so the bench can always run.
+ * Counts V0 up and draws a font sprite every time it wraps.
+ */
+static const unsigned char builtinRom[] =
+{
+    0x60, 0x00, // 200: V0 = 0
+    0x61, 0x05, // 202: V1 = 5
+    0x70, 0x01, // 204: V0 += 1
+    0x80, 0x14, // 206: V0 += V1
+    0x82, 0x03, // 208: V2 ^= V0
+    0x30, 0x00, // 20A: skip if V0 == 0
+    0x12, 0x04, // 20C: jump 204
+    0xF2, 0x29, // 20E: I = font(V2)
+    0xD0, 0x15, // 210: draw
+    0x12, 0x04  // 212: jump 204
+};
+
+enum BenchMode { DECODE, PREDECODE, THREADED, JIT, AOT };
+
+// Returns cycles per second, the machine is left in result. AOT runs aot's recompiled code.
+double runBench(const Chip8 &loaded, BenchMode mode, unsigned long cycles, Chip8 *result, const AotModule *aot = NULL)
+{
+    *result = loaded;
+    result->predecode = mode != DECODE;
+    
+    auto start = std::chrono::steady_clock::now();
+    if(mode == JIT)
+    {
+        Chip8Jit *jit = new Chip8Jit(*result);
+        jit->run(cycles);
+        delete jit;
+    }
+    else if(mode == AOT)
+    {
+        Chip8Aot *recompiled = new Chip8Aot(*result, *aot);
+        recompiled->run(cycles);
+        delete recompiled;
+    }
+    else if(mode == THREADED)
+    {
+        // run() goes through the computed goto loop when it's built in
+        result->run(cycles);
+    }
+    else
+    {
+        for(unsigned long i = 0; i < cycles; ++i)
+            result->emulateCycle();
+    }
+    auto end = std::chrono::steady_clock::now();
+    
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return cycles / seconds;
+}
+
+// aot is the ROM's recompiled code if it's built in, NULL if not
+void benchRom(const char *name, const Chip8 &loaded, unsigned long cycles, const AotModule *aot)
+{
+    Chip8 *reference = new Chip8();
+    Chip8 *jitted = new Chip8();
+    double before = runBench(loaded, DECODE, cycles, reference);
+    double after = runBench(loaded, PREDECODE, cycles, reference);
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+    Chip8 *threaded = new Chip8();
+    double computed = runBench(loaded, THREADED, cycles, threaded);
+#endif
+    double jit = runBench(loaded, JIT, cycles, jitted);
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+    printf("%-32s %14.0f %14.0f %14.0f %14.0f %7.2fx\n", name, before, after, computed, jit, after / before);
+    
+    if(memcmp(reference->gfx, threaded->gfx, sizeof(reference->gfx)) != 0 || reference->pc != threaded->pc)
+        printf("  threaded interpreter differs from the switch!\n");
+    delete threaded;
+#else
+    printf("%-32s %14.0f %14.0f %14.0f %7.2fx\n", name, before, after, jit, after / before);
+#endif
+    
+    if(memcmp(reference->gfx, jitted->gfx, sizeof(reference->gfx)) != 0)
+        printf("  JIT framebuffer differs from the interpreter!\n");
+    
+    if(aot)
+    {
+        Chip8 *recompiled = new Chip8();
+        double speed = runBench(loaded, AOT, cycles, recompiled, aot);
+        printf("  recompiled: %.0f c/s, %.2fx predecode, %.2fx jit\n", speed, speed / after, speed / jit);
+        if(memcmp(reference->gfx, recompiled->gfx, sizeof(reference->gfx)) != 0 || reference->pc != recompiled->pc)
+            printf("  recompiled code differs from the interpreter!\n");
+        delete recompiled;
+    }
+    
+    delete reference;
+    delete jitted;
+}
+
+void usage()
+{
+    printf("Usage: ./Chip8Bench [rom1 rom2 ...]\n");
+    printf("       ./Chip8Bench --micro [options]\n\n");
+    printf("  --micro            run the microbenchmark suite, prints one JSON object per line\n");
+    printf("  --runs n           runs per benchmark, the median is reported (default 11)\n");
+    printf("  --min-time ms      shortest run, iterations are scaled up to reach it (default 20)\n");
+    printf("  --filter text      only benchmarks with text in their name\n");
+    printf("  --baseline file    compare against the output of an earlier --micro run,\n");
+    printf("                     exits with 2 if anything got slower than the threshold\n");
+    printf("  --threshold pct    how much slower counts as a regression (default 10)\n");
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned long cycles = BENCH_CYCLES;
+    bool micro = false;
+    MicroOptions options;
+    options.runs = 11;
+    options.minRunTime = 0.02;
+    options.threshold = 10;
+    std::vector<const char *> roms;
+    
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "--micro"))
+            micro = true;
+        else if(!strcmp(argv[i], "--runs") && i + 1 < argc)
+            options.runs = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+        else if(!strcmp(argv[i], "--min-time") && i + 1 < argc)
+            options.minRunTime = atof(argv[++i]) / 1000;
+        else if(!strcmp(argv[i], "--filter") && i + 1 < argc)
+            options.filter = argv[++i];
+        else if(!strcmp(argv[i], "--baseline") && i + 1 < argc)
+            options.baseline = argv[++i];
+        else if(!strcmp(argv[i], "--threshold") && i + 1 < argc)
+            options.threshold = atof(argv[++i]);
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+            roms.push_back(argv[i]);
+    }
+    
+    if(micro)
+        return runMicrobenchmarks(options) ? 2 : 0;
+    
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+    printf("%-32s %14s %14s %14s %14s %8s\n", "rom", "decode c/s", "predecode c/s", "threaded c/s", "jit c/s", "speedup");
+#else
+    printf("%-32s %14s %14s %14s %8s\n", "rom", "decode c/s", "predecode c/s", "jit c/s", "speedup");
+#endif
+    if(roms.empty())
+    {
+        Chip8 *c8 = new Chip8();
+        for(unsigned int i = 0; i < sizeof(builtinRom); ++i)
+            c8->memory[0x200 + i] = builtinRom[i];
+        c8->invalidateAllDecoded();
+        benchRom("(builtin loop)", *c8, cycles, findAotModule(RomStore::hash(builtinRom, sizeof(builtinRom))));
+        delete c8;
+        return 0;
+    }
+    
+    RomStore store;
+    for(size_t i = 0; i < roms.size(); ++i)
+    {
+        const Rom *image = store.get(roms[i]);
+        if(!image)
+            continue;
+        Chip8 *c8 = new Chip8();
+        c8->loadRom(image->data, image->size);
+        benchRom(roms[i], *c8, cycles, findAotModule(image->hash));
+        delete c8;
+    }
+    return 0;
+}
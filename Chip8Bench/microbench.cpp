@@ -0,0 +1,492 @@
+//
+//  microbench.cpp
+//  Chip8Bench
+//
+//  Created by Ruijing Li on 10/17/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "microbench.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "audio.hpp"
+#include "chip8.hpp"
+#include "pixels.hpp"
+#include "render.hpp"
+#include "romstore.hpp"
+#include "runahead.hpp"
+#include "scheduler.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+
+// results get folded in here so the compiler can't throw the work away
+static volatile unsigned long long sink;
+
+// Times body(iterations), returning seconds
+template <typename F>
+static double timeRun(F &body, unsigned long iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+template <typename F>
+static MicroResult measure(const MicroOptions &options, const char *name, F body)
+{
+    MicroResult result;
+    result.name = name;
+
+    // double the iterations until a run is long enough for the clock to be meaningful,
+    // this also warms up caches and the predecode cache
+    unsigned long iterations = 1;
+    while(timeRun(body, iterations) < options.minRunTime && iterations < (1UL << 40))
+        iterations *= 2;
+    result.iterations = iterations;
+
+    std::vector<double> times;
+    for(int r = 0; r < options.runs; ++r)
+        times.push_back(timeRun(body, iterations) * 1e9 / iterations);
+    std::sort(times.begin(), times.end());
+    result.median = times[times.size() / 2];
+    result.min = times.front();
+    result.max = times.back();
+    return result;
+}
+
+/* Fills 0x200-0x3FF with as many copies of the body as fit and jumps back to 0x200 after them,
+ * so the jump costs under half a percent
+ */
+static void loadLoop(Chip8 &c8, const unsigned short *body, int count)
+{
+    c8.initialize();
+    unsigned short addr = 0x200;
+    for(; addr + count * 2 <= 0x3FE; addr += count * 2)
+        for(int i = 0; i < count; ++i)
+        {
+            c8.memory[addr + i * 2] = body[i] >> 8;
+            c8.memory[addr + i * 2 + 1] = body[i] & 0xFF;
+        }
+    c8.memory[addr] = 0x12;
+    c8.memory[addr + 1] = 0x00;
+    c8.invalidateAllDecoded();
+}
+
+// Same area, but every instruction jumps to the next one
+static void loadJumpChain(Chip8 &c8)
+{
+    c8.initialize();
+    for(unsigned short addr = 0x200; addr < 0x3FE; addr += 2)
+    {
+        c8.memory[addr] = 0x10 | ((addr + 2) >> 8);
+        c8.memory[addr + 1] = (addr + 2) & 0xFF;
+    }
+    c8.memory[0x3FE] = 0x12;
+    c8.memory[0x3FF] = 0x00;
+    c8.invalidateAllDecoded();
+}
+
+static void emulateLoop(Chip8 &c8, unsigned long iterations)
+{
+    for(unsigned long i = 0; i < iterations; ++i)
+        c8.emulateCycle();
+    sink += c8.V[0] + c8.pc;
+}
+
+struct Family
+{
+    const char *name;
+    unsigned short body[8];
+    int count;
+};
+
+// one entry per opcode family, all registers start at 0 and no keys are held
+static const Family families[] =
+{
+    {"emulate/00E0-clear", {0x00E0}, 1},
+    {"emulate/1NNN-jump", {0}, 0}, // chain of jumps, built below
+    {"emulate/2NNN-00EE-call-return", {0x2600}, 1},
+    {"emulate/3XNN-4XNN-5XY0-9XY0-skip", {0x3000, 0x6000, 0x4000, 0x5010, 0x6000, 0x9010}, 6}, // taken and not taken
+    {"emulate/6XNN-7XNN-immediate", {0x6012, 0x7103, 0x6234, 0x7305}, 4},
+    {"emulate/8XYN-alu", {0x8014, 0x8125, 0x8236, 0x830E, 0x8011, 0x8122, 0x8233, 0x8017}, 8},
+    {"emulate/ANNN-BNNN-FX1E-index", {0xA800, 0xF01E}, 2},
+    {"emulate/CXNN-random", {0xC0FF}, 1},
+    {"emulate/EX9E-EXA1-key", {0xE09E, 0xE1A1, 0x6000}, 3},
+    {"emulate/FX07-FX15-FX18-timers", {0xF007, 0xF015, 0xF018}, 3},
+    {"emulate/FX29-FX33-FX55-FX65-memory", {0xA800, 0xF229, 0xA800, 0xF233, 0xF255, 0xF265}, 6},
+};
+
+// Sound goes nowhere, for timing the synth on its own
+class NullSink : public SoundSink
+{
+public:
+    void write(const int16_t *samples, size_t n) override { sink += samples[n - 1]; }
+};
+
+static void emit(const MicroResult &r)
+{
+    printf("{\"name\":\"%s\",\"unit\":\"ns/op\",\"median\":%.3f,\"min\":%.3f,\"max\":%.3f,\"iterations\":%lu}\n",
+           r.name.c_str(), r.median, r.min, r.max, r.iterations);
+    fflush(stdout);
+}
+
+static bool wanted(const MicroOptions &options, const std::string &name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+bool readBaseline(const char *filename, std::vector<MicroResult> &results)
+{
+    std::ifstream in(filename);
+    if(!in)
+        return false;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        size_t name = line.find("\"name\":\"");
+        size_t median = line.find("\"median\":");
+        if(name == std::string::npos || median == std::string::npos)
+            continue;
+        MicroResult r;
+        name += 8;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.median = strtod(line.c_str() + median + 9, NULL);
+        r.min = r.max = r.median;
+        r.iterations = 0;
+        results.push_back(r);
+    }
+    return true;
+}
+
+int runMicrobenchmarks(const MicroOptions &options)
+{
+    std::vector<MicroResult> results;
+    Chip8 *c8 = new Chip8();
+
+    // emulateCycle per opcode family, with the predecode cache on like the real thing
+    for(size_t f = 0; f < sizeof(families) / sizeof(families[0]); ++f)
+    {
+        const Family &family = families[f];
+        if(!wanted(options, family.name))
+            continue;
+        if(family.count)
+            loadLoop(*c8, family.body, family.count);
+        else
+            loadJumpChain(*c8);
+        c8->memory[0x600] = 0x00; // the subroutine for call-return
+        c8->memory[0x601] = 0xEE;
+        c8->invalidateDecoded(0x600, 2);
+        results.push_back(measure(options, family.name, [c8](unsigned long n) { emulateLoop(*c8, n); }));
+        emit(results.back());
+    }
+
+    /* What the sound costs the core: the tone going on and off every other instruction, without and
+     * with a ring attached (emptied every 64 instructions, as a consumer would)
+     */
+    const unsigned short beeps[] = {0x6001, 0xF018, 0x6000, 0xF018};
+    for(int attached = 0; attached < 2; ++attached)
+    {
+        const char *name = attached ? "audio/FX18-edges-ring" : "audio/FX18-edges-no-ring";
+        if(!wanted(options, name))
+            continue;
+        loadLoop(*c8, beeps, 4);
+        SoundRing *ring = attached ? new SoundRing() : NULL;
+        c8->audio = ring;
+        results.push_back(measure(options, name, [c8, ring](unsigned long n) {
+            SoundEdge edge;
+            for(unsigned long i = 0; i < n; ++i)
+            {
+                c8->emulateCycle();
+                if(ring && !(i & 63))
+                    while(ring->pop(edge))
+                        ;
+            }
+            sink += c8->pc;
+        }));
+        emit(results.back());
+        c8->audio = NULL;
+        delete ring;
+    }
+
+    // The consumer: ns per sample with the tone on
+    if(wanted(options, "audio/synth-sample"))
+    {
+        SoundRing *ring = new SoundRing();
+        NullSink *out = new NullSink();
+        SoundSynth *synth = new SoundSynth(*ring, *out);
+        SoundEdge on;
+        memset(&on, 0, sizeof(on));
+        on.on = true;
+        ring->push(on);
+        unsigned long long cycle = 0;
+        results.push_back(measure(options, "audio/synth-sample", [ring, synth, &cycle](unsigned long n) {
+            cycle += (unsigned long long)n * DEFAULT_IPS / SOUND_RATE + 1; // about n samples' worth
+            ring->advance(cycle);
+            synth->update();
+        }));
+        emit(results.back());
+        delete synth;
+        delete out;
+        delete ring;
+    }
+
+    /* Tracing: a call and return with no trace, with one that filters them out, and recording both.
+     * Then an unknown opcode, which leaves pc where it is, recorded over and over.
+     */
+    const struct { const char *name; unsigned int filter; bool attached; } traces[] =
+    {
+        {"trace/2NNN-00EE-off", 0, false},
+        {"trace/2NNN-00EE-filtered", TRACE_UNKNOWN, true},
+        {"trace/2NNN-00EE-recorded", TRACE_CALL | TRACE_RETURN, true},
+        {"trace/unknown-recorded", TRACE_UNKNOWN, true},
+    };
+    for(size_t t = 0; t < sizeof(traces) / sizeof(traces[0]); ++t)
+    {
+        if(!wanted(options, traces[t].name))
+            continue;
+        const unsigned short call = 0x2600, unknown = 0x0123;
+        loadLoop(*c8, t == 3 ? &unknown : &call, 1);
+        c8->memory[0x600] = 0x00;
+        c8->memory[0x601] = 0xEE;
+        c8->invalidateDecoded(0x600, 2);
+        Chip8Trace *trace = traces[t].attached ? new Chip8Trace(TRACE_CAPACITY, traces[t].filter) : NULL;
+        c8->trace = trace;
+        results.push_back(measure(options, traces[t].name, [c8](unsigned long n) { emulateLoop(*c8, n); }));
+        emit(results.back());
+        c8->trace = NULL;
+        delete trace;
+    }
+
+    // DXYN kernel on its own: sprite height x how much of the screen is already lit
+    const int heights[] = {1, 5, 15};
+    const struct { const char *name; uint64_t fill; } densities[] =
+    {
+        {"empty", 0},
+        {"half", 0xAAAAAAAAAAAAAAAAULL},
+        {"full", ~0ULL},
+    };
+    for(int h = 0; h < 3; ++h)
+        for(int d = 0; d < 3; ++d)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "draw/DXYN-h%d-%s", heights[h], densities[d].name);
+            if(!wanted(options, name))
+                continue;
+            c8->initialize();
+            for(int y = 0; y < 32; ++y)
+                c8->gfx[y] = densities[d].fill;
+            c8->I = 0x300;
+            for(int i = 0; i < 15; ++i)
+                c8->memory[0x300 + i] = 0xFF;
+            c8->V[0] = 27; // somewhere in the middle, nothing clipped
+            c8->V[1] = 8;
+            DecodedOp op = Chip8::decode(0xD010 | heights[h]);
+            // drawing twice puts the screen back, so density stays put
+            results.push_back(measure(options, name, [c8, op](unsigned long n) {
+                for(unsigned long i = 0; i < n; ++i)
+                    c8->opDraw(op);
+                sink += c8->V[0xF];
+            }));
+            emit(results.back());
+        }
+
+    if(wanted(options, "initialize"))
+    {
+        results.push_back(measure(options, "initialize", [c8](unsigned long n) {
+            for(unsigned long i = 0; i < n; ++i)
+                c8->initialize();
+            sink += c8->pc;
+        }));
+        emit(results.back());
+    }
+
+    if(wanted(options, "loadGame") || wanted(options, "loadRom"))
+    {
+        // a full size ROM, so we measure the worst case
+        char path[] = "/tmp/chip8benchXXXXXX";
+        int fd = mkstemp(path);
+        if(fd >= 0)
+        {
+            unsigned char rom[4096 - 512];
+            for(size_t i = 0; i < sizeof(rom); ++i)
+                rom[i] = i * 7;
+            bool ok = write(fd, rom, sizeof(rom)) == (ssize_t)sizeof(rom);
+            close(fd);
+            if(ok && wanted(options, "loadGame"))
+            {
+                results.push_back(measure(options, "loadGame", [c8, &path](unsigned long n) {
+                    for(unsigned long i = 0; i < n; ++i)
+                        c8->loadGame(path);
+                    sink += c8->memory[0x200];
+                }));
+                emit(results.back());
+            }
+            // starting an instance from the shared mapping instead: reset plus one copy
+            RomStore store;
+            const Rom *image = ok ? store.get(path) : NULL;
+            if(image && wanted(options, "loadRom"))
+            {
+                results.push_back(measure(options, "initialize+loadRom", [c8, image](unsigned long n) {
+                    for(unsigned long i = 0; i < n; ++i)
+                    {
+                        c8->initialize();
+                        c8->loadRom(image->data, image->size);
+                    }
+                    sink += c8->memory[0x200];
+                }));
+                emit(results.back());
+            }
+            unlink(path);
+        }
+    }
+
+    if(wanted(options, "render/rgb"))
+    {
+        static unsigned char rgb[32 * 64 * 3];
+        for(int y = 0; y < 32; ++y)
+            c8->gfx[y] = 0x0123456789ABCDEFULL * (y + 1);
+        results.push_back(measure(options, "render/rgb", [c8](unsigned long n) {
+            for(unsigned long i = 0; i < n; ++i)
+                renderRGB(*c8, rgb);
+            sink += rgb[100];
+        }));
+        emit(results.back());
+    }
+
+    if(wanted(options, "render/gray-rows"))
+    {
+        // what the frontend does after a typical 5 row sprite
+        static unsigned char gray[32 * 64];
+        results.push_back(measure(options, "render/gray-rows", [c8](unsigned long n) {
+            for(unsigned long i = 0; i < n; ++i)
+                renderGrayRows(*c8, 0x1Fu << 8, gray);
+            sink += gray[8 * 64];
+        }));
+        emit(results.back());
+    }
+
+    /* The pixel kernels, a whole 64x32 screen per op on every path the build has: as they are,
+     * doubled to gray for --export, at main.cpp's default size (modifier 5), and with each filter
+     */
+    const struct { const char *name; PixelFormat format; int scale; PixelFilter filter; } pixelCases[] =
+    {
+        {"rgba-x1", PIXEL_RGBA8, 1, PIXEL_SHARP},
+        {"gray-x2", PIXEL_GRAY8, 2, PIXEL_SHARP},
+        {"argb-x10", PIXEL_ARGB32, 10, PIXEL_SHARP},
+        {"rgba-x4-scanlines", PIXEL_RGBA8, 4, PIXEL_SCANLINES},
+        {"rgba-x2-smooth", PIXEL_RGBA8, 2, PIXEL_SMOOTH},
+    };
+    const char *pathNames[] = {"scalar", "sse2", "avx2"};
+    std::vector<unsigned char> image(64 * 10 * 32 * 10 * 4);
+    for(int y = 0; y < 32; ++y)
+        c8->gfx[y] = 0x0123456789ABCDEFULL * (y + 1);
+    for(size_t p = 0; p < sizeof(pixelCases) / sizeof(pixelCases[0]); ++p)
+        for(int path = PIXEL_SCALAR; path <= bestPixelPath(); ++path)
+        {
+            std::string name = std::string("pixels/") + pixelCases[p].name + "/" + pathNames[path];
+            if(!wanted(options, name.c_str()))
+                continue;
+            PixelOptions pixels;
+            pixels.format = pixelCases[p].format;
+            pixels.scale = pixelCases[p].scale;
+            pixels.filter = pixelCases[p].filter;
+            pixels.path = (PixelPath)path;
+            unsigned char *out = image.data();
+            results.push_back(measure(options, name.c_str(), [c8, pixels, out](unsigned long n) {
+                for(unsigned long i = 0; i < n; ++i)
+                    renderPixels(*c8, pixels, out);
+                sink += out[1000];
+            }));
+            emit(results.back());
+        }
+
+    /* Run-ahead: what a save and restore costs with one line of memory changed in between, against
+     * a full snapshot, then a whole host frame (ips / 60 instructions of a loop that stores and
+     * draws) with nothing, one, two and three frames run ahead
+     */
+    const unsigned short game[] = {0x7001, 0xA800, 0xF033, 0xF265, 0xF029, 0xD125};
+    loadLoop(*c8, game, 6);
+    if(wanted(options, "checkpoint/save+restore"))
+    {
+        Chip8Checkpoint *checkpoint = new Chip8Checkpoint();
+        checkpoint->save(*c8);
+        results.push_back(measure(options, "checkpoint/save+restore", [c8, checkpoint](unsigned long n) {
+            for(unsigned long i = 0; i < n; ++i)
+            {
+                checkpoint->save(*c8);
+                c8->emulateCycle();
+                checkpoint->restore(*c8);
+            }
+            sink += c8->pc;
+        }));
+        emit(results.back());
+        delete checkpoint;
+    }
+    if(wanted(options, "snapshot/save+load"))
+    {
+        std::vector<unsigned char> buf(snapshotSize());
+        unsigned char *state = buf.data();
+        results.push_back(measure(options, "snapshot/save+load", [c8, state](unsigned long n) {
+            for(unsigned long i = 0; i < n; ++i)
+            {
+                saveSnapshot(*c8, state);
+                c8->emulateCycle();
+                loadSnapshot(*c8, state, snapshotSize());
+            }
+            sink += c8->pc;
+        }));
+        emit(results.back());
+    }
+    for(int frames = 0; frames <= 3; ++frames)
+    {
+        std::string name = "runahead/frame-x" + std::to_string(frames);
+        if(!wanted(options, name))
+            continue;
+        Scheduler *scheduler = new Scheduler(*c8);
+        RunAhead *ahead = new RunAhead(*c8, *scheduler);
+        ahead->frames = frames;
+        results.push_back(measure(options, name.c_str(), [c8, scheduler, ahead](unsigned long n) {
+            for(unsigned long i = 0; i < n; ++i)
+            {
+                scheduler->runInstructions(DEFAULT_IPS / 60);
+                if(ahead->frames)
+                    ahead->step();
+            }
+            sink += c8->V[0];
+        }));
+        emit(results.back());
+        delete ahead;
+        delete scheduler;
+    }
+    delete c8;
+
+    if(options.baseline.empty())
+        return 0;
+    std::vector<MicroResult> baseline;
+    if(!readBaseline(options.baseline.c_str(), baseline))
+    {
+        fprintf(stderr, "Could not open baseline %s\n", options.baseline.c_str());
+        return 1;
+    }
+    int regressions = 0;
+    for(size_t i = 0; i < results.size(); ++i)
+        for(size_t j = 0; j < baseline.size(); ++j)
+        {
+            if(baseline[j].name != results[i].name || baseline[j].median <= 0)
+                continue;
+            double change = (results[i].median / baseline[j].median - 1) * 100;
+            if(change > options.threshold)
+            {
+                fprintf(stderr, "REGRESSION %s: %.3f -> %.3f ns/op (+%.1f%%)\n", results[i].name.c_str(),
+                        baseline[j].median, results[i].median, change);
+                ++regressions;
+            }
+        }
+    return regressions;
+}
@@ -0,0 +1,44 @@
+//
+//  microbench.hpp
+//  Chip8Bench
+//
+//  Created by Ruijing Li on 10/17/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef microbench_hpp
+#define microbench_hpp
+
+#include <string>
+#include <vector>
+
+/* Microbenchmarks for the hot paths: emulateCycle per opcode family, DXYN, initialize(),
+ * loadGame and the texture conversion.
+ *
+ * Every benchmark is calibrated until one run takes at least minRunTime, then run `runs` times.
+ * We report the median (plus min and max) in ns per operation, one JSON object per line, so
+ * results can be diffed, graphed or compared against a baseline file from an earlier build.
+ */
+struct MicroOptions
+{
+    int runs;
+    double minRunTime; // seconds
+    std::string filter; // only benchmarks whose name contains this
+    std::string baseline; // JSON lines from an earlier run to compare against
+    double threshold; // percent slower than the baseline that counts as a regression
+};
+
+struct MicroResult
+{
+    std::string name;
+    unsigned long iterations; // per run
+    double median, min, max; // ns per operation
+};
+
+// Runs the suite, prints a JSON line per benchmark. Returns how many regressed against the baseline.
+int runMicrobenchmarks(const MicroOptions &);
+
+// Reads "name" and "median" back out of JSON lines we printed
+bool readBaseline(const char *filename, std::vector<MicroResult> &results);
+
+#endif /* microbench_hpp */
@@ -0,0 +1,293 @@
+// Generated by Chip8Batch --recompile, don't edit.
+// aotsample: 125 bytes, 96 of code and 29 of data, 23 blocks, 3 indirect jumps
+
+#include "chip8aot.hpp"
+
+namespace {
+
+const unsigned char rom[] =
+{
+    0x00, 0xE0, 0x6A, 0x00, 0x22, 0x40, 0x80, 0x70, 0x61, 0x03, 0x80, 0x12,
+    0x80, 0x04, 0xB2, 0x50, 0xA2, 0x71, 0x80, 0xA0, 0xF0, 0x55, 0x22, 0x70,
+    0xFC, 0x29, 0xDA, 0xB5, 0x7A, 0x01, 0x4A, 0x40, 0xF0, 0x00, 0x03, 0x00,
+    0x3A, 0x40, 0x12, 0x04, 0xF1, 0x65, 0x6A, 0x00, 0x12, 0x04, 0x3C, 0x42,
+    0x81, 0xA5, 0x81, 0x99, 0x42, 0x3C, 0x18, 0x3C, 0x7E, 0xFF, 0xFF, 0x7E,
+    0x3C, 0x18, 0x00, 0xFF, 0x81, 0x74, 0x77, 0x13, 0x82, 0x75, 0x83, 0x27,
+    0x84, 0x16, 0x85, 0x1E, 0xC6, 0x3F, 0x00, 0xEE, 0x12, 0x58, 0x12, 0x5C,
+    0x12, 0x60, 0x12, 0x64, 0x8F, 0x14, 0x12, 0x10, 0x86, 0xF4, 0x12, 0x10,
+    0x8F, 0xF5, 0x12, 0x10, 0xF7, 0x18, 0xF8, 0x07, 0x12, 0x10, 0xAA, 0x55,
+    0xAA, 0x55, 0xAA, 0x55, 0x6C, 0x11, 0x4C, 0x20, 0x6C, 0x00, 0x00, 0xEE,
+    0xF0, 0x90, 0xF0, 0x90, 0x90
+};
+
+// 0x200-0x203
+unsigned int block_200(Chip8 &c8)
+{
+    // 200: 00E0
+    static const DecodedOp op_200 = {Chip8::H_ClearScreen, 0x0, 0xE, 0x0E0, 0x00E0};
+    c8.opClearScreen(op_200);
+    // 202: 6A00
+    c8.V[0xA] = 0x00;
+    return 0x204;
+}
+
+// 0x204-0x205
+unsigned int block_204(Chip8 &c8)
+{
+    // 204: 2240
+    c8.stack[c8.sp] = 0x204;
+    c8.sp = (c8.sp + 1) & 0xF;
+    return 0x240;
+}
+
+// 0x206-0x20F
+unsigned int block_206(Chip8 &c8)
+{
+    // 206: 8070
+    c8.V[0x0] = c8.V[0x7];
+    // 208: 6103
+    c8.V[0x1] = 0x03;
+    // 20A: 8012
+    c8.V[0x0] &= c8.V[0x1];
+    // 20C: 8004
+    c8.V[0xF] = c8.V[0x0] > 0xFF - c8.V[0x0];
+    c8.V[0x0] += c8.V[0x0];
+    // 20E: B250
+    return (unsigned short)(c8.V[0x0] + 0x250);
+}
+
+// 0x210-0x215
+unsigned int block_210(Chip8 &c8)
+{
+    // 210: A271
+    c8.I = 0x271;
+    // 212: 80A0
+    c8.V[0x0] = c8.V[0xA];
+    // 214: F055
+    static const DecodedOp op_214 = {Chip8::H_StoreRegs, 0x0, 0x5, 0x055, 0xF055};
+    c8.opStoreRegs(op_214);
+    return 0x216;
+}
+
+// 0x216-0x217
+unsigned int block_216(Chip8 &c8)
+{
+    // 216: 2270
+    c8.stack[c8.sp] = 0x216;
+    c8.sp = (c8.sp + 1) & 0xF;
+    return 0x270;
+}
+
+// 0x218-0x221
+unsigned int block_218(Chip8 &c8)
+{
+    // 218: FC29
+    c8.I = c8.V[0xC] * 5;
+    // 21A: DAB5
+    static const DecodedOp op_21A = {Chip8::H_Draw, 0xA, 0xB, 0x005, 0xDAB5};
+    c8.opDraw(op_21A);
+    // 21C: 7A01
+    c8.V[0xA] += 0x01;
+    // 21E: 4A40
+    if(c8.V[0xA] != 0x40)
+        return 0x224;
+    return 0x220;
+}
+
+// 0x220-0x223
+unsigned int block_220(Chip8 &c8)
+{
+    // 220: F000
+    c8.I = 0x0300;
+    return 0x224;
+}
+
+// 0x224-0x227
+unsigned int block_224(Chip8 &c8)
+{
+    // 224: 3A40
+    if(c8.V[0xA] == 0x40)
+        return 0x228;
+    return 0x226;
+}
+
+// 0x226-0x227
+unsigned int block_226(Chip8 &c8)
+{
+    // 226: 1204
+    return 0x204;
+}
+
+// 0x228-0x22D
+unsigned int block_228(Chip8 &c8)
+{
+    // 228: F165
+    for(int i = 0; i <= 1; ++i)
+        c8.V[i] = c8.memory[(c8.I + i) & 0xFFFF];
+    // 22A: 6A00
+    c8.V[0xA] = 0x00;
+    // 22C: 1204
+    return 0x204;
+}
+
+// 0x240-0x24F
+unsigned int block_240(Chip8 &c8)
+{
+    // 240: 8174
+    c8.V[0xF] = c8.V[0x1] > 0xFF - c8.V[0x7];
+    c8.V[0x1] += c8.V[0x7];
+    // 242: 7713
+    c8.V[0x7] += 0x13;
+    // 244: 8275
+    c8.V[0xF] = c8.V[0x2] > c8.V[0x7];
+    c8.V[0x2] -= c8.V[0x7];
+    // 246: 8327
+    c8.V[0xF] = c8.V[0x3] < c8.V[0x2];
+    c8.V[0x3] = c8.V[0x2] - c8.V[0x3];
+    // 248: 8416
+    c8.V[0xF] = c8.V[0x4] & 1;
+    c8.V[0x4] >>= 1;
+    // 24A: 851E
+    c8.V[0xF] = c8.V[0x5] >> 7;
+    c8.V[0x5] <<= 1;
+    // 24C: C63F
+    c8.V[0x6] = Chip8::nextRandom(c8.rng) & 0x3F;
+    // 24E: 00EE
+    c8.sp = (c8.sp - 1) & 0xF;
+    return (unsigned short)(c8.stack[c8.sp] + 2);
+}
+
+// 0x250-0x251
+unsigned int block_250(Chip8 &c8)
+{
+    // 250: 1258
+    return 0x258;
+}
+
+// 0x252-0x253
+unsigned int block_252(Chip8 &c8)
+{
+    // 252: 125C
+    return 0x25C;
+}
+
+// 0x254-0x255
+unsigned int block_254(Chip8 &c8)
+{
+    // 254: 1260
+    return 0x260;
+}
+
+// 0x256-0x257
+unsigned int block_256(Chip8 &c8)
+{
+    // 256: 1264
+    return 0x264;
+}
+
+// 0x258-0x25B
+unsigned int block_258(Chip8 &c8)
+{
+    // 258: 8F14
+    c8.V[0xF] = c8.V[0xF] > 0xFF - c8.V[0x1];
+    c8.V[0xF] += c8.V[0x1];
+    // 25A: 1210
+    return 0x210;
+}
+
+// 0x25C-0x25F
+unsigned int block_25C(Chip8 &c8)
+{
+    // 25C: 86F4
+    c8.V[0xF] = c8.V[0x6] > 0xFF - c8.V[0xF];
+    c8.V[0x6] += c8.V[0xF];
+    // 25E: 1210
+    return 0x210;
+}
+
+// 0x260-0x263
+unsigned int block_260(Chip8 &c8)
+{
+    // 260: 8FF5
+    c8.V[0xF] = c8.V[0xF] > c8.V[0xF];
+    c8.V[0xF] -= c8.V[0xF];
+    // 262: 1210
+    return 0x210;
+}
+
+// 0x264-0x265
+unsigned int block_264(Chip8 &c8)
+{
+    // 264: F718
+    static const DecodedOp op_264 = {Chip8::H_SetSound, 0x7, 0x1, 0x718, 0xF718};
+    c8.opSetSound(op_264);
+    return 0x266;
+}
+
+// 0x266-0x269
+unsigned int block_266(Chip8 &c8)
+{
+    // 266: F807
+    c8.V[0x8] = c8.delay_timer;
+    // 268: 1210
+    return 0x210;
+}
+
+// 0x270-0x275
+unsigned int block_270(Chip8 &c8)
+{
+    // 270: 6C11
+    c8.V[0xC] = 0x11;
+    // 272: 4C20
+    if(c8.V[0xC] != 0x20)
+        return 0x276;
+    return 0x274;
+}
+
+// 0x274-0x275
+unsigned int block_274(Chip8 &c8)
+{
+    // 274: 6C00
+    c8.V[0xC] = 0x00;
+    return 0x276;
+}
+
+// 0x276-0x277
+unsigned int block_276(Chip8 &c8)
+{
+    // 276: 00EE
+    c8.sp = (c8.sp - 1) & 0xF;
+    return (unsigned short)(c8.stack[c8.sp] + 2);
+}
+
+const AotBlock blocks[] =
+{
+    {0x200, 0x204, 2, 0x6A00, block_200},
+    {0x204, 0x206, 1, 0x2240, block_204},
+    {0x206, 0x210, 5, 0xB250, block_206},
+    {0x210, 0x216, 3, 0xF055, block_210},
+    {0x216, 0x218, 1, 0x2270, block_216},
+    {0x218, 0x222, 4, 0x4A40, block_218},
+    {0x220, 0x224, 1, 0xF000, block_220},
+    {0x224, 0x228, 1, 0x3A40, block_224},
+    {0x226, 0x228, 1, 0x1204, block_226},
+    {0x228, 0x22E, 3, 0x1204, block_228},
+    {0x240, 0x250, 8, 0x00EE, block_240},
+    {0x250, 0x252, 1, 0x1258, block_250},
+    {0x252, 0x254, 1, 0x125C, block_252},
+    {0x254, 0x256, 1, 0x1260, block_254},
+    {0x256, 0x258, 1, 0x1264, block_256},
+    {0x258, 0x25C, 2, 0x1210, block_258},
+    {0x25C, 0x260, 2, 0x1210, block_25C},
+    {0x260, 0x264, 2, 0x1210, block_260},
+    {0x264, 0x266, 1, 0xF718, block_264},
+    {0x266, 0x26A, 2, 0x1210, block_266},
+    {0x270, 0x276, 2, 0x4C20, block_270},
+    {0x274, 0x276, 1, 0x6C00, block_274},
+    {0x276, 0x278, 1, 0x00EE, block_276},
+};
+
+const AotModule module = {"aotsample", 0x788D1CAE267991F7ULL, rom, sizeof(rom), blocks, sizeof(blocks) / sizeof(blocks[0])};
+AotRegistration registration(module);
+
+}  // namespace
@@ -0,0 +1,30 @@
+// Generated by Chip8Batch --recompile, don't edit.
+// stackcall: 2 bytes, 2 of code and 0 of data, 1 blocks, 0 indirect jumps
+
+#include "chip8aot.hpp"
+
+namespace {
+
+const unsigned char rom[] =
+{
+    0x22, 0x00
+};
+
+// 0x200-0x201
+unsigned int block_200(Chip8 &c8)
+{
+    // 200: 2200
+    c8.stack[c8.sp] = 0x200;
+    c8.sp = (c8.sp + 1) & 0xF;
+    return 0x200;
+}
+
+const AotBlock blocks[] =
+{
+    {0x200, 0x202, 1, 0x2200, block_200},
+};
+
+const AotModule module = {"stackcall", 0x07CC9407B494D11FULL, rom, sizeof(rom), blocks, sizeof(blocks) / sizeof(blocks[0])};
+AotRegistration registration(module);
+
+}  // namespace
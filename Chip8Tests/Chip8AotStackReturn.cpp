@@ -0,0 +1,29 @@
+// Generated by Chip8Batch --recompile, don't edit.
+// stackreturn: 2 bytes, 2 of code and 0 of data, 1 blocks, 1 indirect jumps
+
+#include "chip8aot.hpp"
+
+namespace {
+
+const unsigned char rom[] =
+{
+    0x00, 0xEE
+};
+
+// 0x200-0x201
+unsigned int block_200(Chip8 &c8)
+{
+    // 200: 00EE
+    c8.sp = (c8.sp - 1) & 0xF;
+    return (unsigned short)(c8.stack[c8.sp] + 2);
+}
+
+const AotBlock blocks[] =
+{
+    {0x200, 0x202, 1, 0x00EE, block_200},
+};
+
+const AotModule module = {"stackreturn", 0x0831DA07B4EA4843ULL, rom, sizeof(rom), blocks, sizeof(blocks) / sizeof(blocks[0])};
+AotRegistration registration(module);
+
+}  // namespace
@@ -0,0 +1,169 @@
+//
+//  Chip8AotTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/26/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include "chip8.hpp"
+#include "chip8aot.hpp"
+#include "recompiler.hpp"
+#include "romstore.hpp"
+#include "scheduler.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    /* Chip8AotSample.cpp is this ROM through Chip8Batch --recompile (saved as aotsample.ch8).
+     * Regenerate it after changing either the ROM or the recompiler's output.
+     * Calls, a BNNN jump table, a skip over F000 NNNN, and a routine whose immediate the main loop
+     * rewrites every time round, with sprite data in between.
+     */
+    const unsigned char sample[] = {
+        0x00, 0xE0, // 200: clear
+        0x6A, 0x00, // 202: VA = 0
+        0x22, 0x40, // 204: call 240
+        0x80, 0x70, // 206: V0 = V7
+        0x61, 0x03, // 208: V1 = 3
+        0x80, 0x12, // 20A: V0 &= V1
+        0x80, 0x04, // 20C: V0 += V0
+        0xB2, 0x50, // 20E: jump 250 + V0
+        0xA2, 0x71, // 210: I = 271
+        0x80, 0xA0, // 212: V0 = VA
+        0xF0, 0x55, // 214: [271] = V0, the immediate at 270
+        0x22, 0x70, // 216: call 270
+        0xFC, 0x29, // 218: I = font(VC)
+        0xDA, 0xB5, // 21A: draw
+        0x7A, 0x01, // 21C: VA += 1
+        0x4A, 0x40, // 21E: skip if VA != 40
+        0xF0, 0x00, // 220: I = 0300
+        0x03, 0x00,
+        0x3A, 0x40, // 224: skip if VA == 40
+        0x12, 0x04, // 226: jump 204
+        0xF1, 0x65, // 228: V0, V1 = [I]
+        0x6A, 0x00, // 22A: VA = 0
+        0x12, 0x04, // 22C: jump 204
+        0x3C, 0x42, 0x81, 0xA5, 0x81, 0x99, 0x42, 0x3C, // 22E: data
+        0x18, 0x3C, 0x7E, 0xFF, 0xFF, 0x7E, 0x3C, 0x18,
+        0x00, 0xFF,
+        0x81, 0x74, // 240: V1 += V7, carry
+        0x77, 0x13, // 242: V7 += 13
+        0x82, 0x75, // 244: V2 -= V7
+        0x83, 0x27, // 246: V3 = V2 - V3
+        0x84, 0x16, // 248: V4 >>= 1
+        0x85, 0x1E, // 24A: V5 <<= 1
+        0xC6, 0x3F, // 24C: V6 = random & 3F
+        0x00, 0xEE, // 24E: return
+        0x12, 0x58, // 250: jump 258, the jump table
+        0x12, 0x5C, // 252: jump 25C
+        0x12, 0x60, // 254: jump 260
+        0x12, 0x64, // 256: jump 264
+        0x8F, 0x14, // 258: VF += V1
+        0x12, 0x10, // 25A: jump 210
+        0x86, 0xF4, // 25C: V6 += VF
+        0x12, 0x10, // 25E: jump 210
+        0x8F, 0xF5, // 260: VF -= VF
+        0x12, 0x10, // 262: jump 210
+        0xF7, 0x18, // 264: sound = V7
+        0xF8, 0x07, // 266: V8 = delay
+        0x12, 0x10, // 268: jump 210
+        0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, // 26A: data
+        0x6C, 0x11, // 270: VC = 11, rewritten
+        0x4C, 0x20, // 272: skip if VC != 20
+        0x6C, 0x00, // 274: VC = 0
+        0x00, 0xEE, // 276: return
+        0xF0, 0x90, 0xF0, 0x90, 0x90 // 278: data
+    };
+
+    TEST(Chip8AotTest, FindsCodeAndData) {
+        Recompiler recompiler(sample, sizeof(sample));
+        EXPECT_EQ(recompiler.codeBytes, 96u);
+        EXPECT_EQ(recompiler.dataBytes, 29u);
+        EXPECT_EQ(recompiler.indirectJumps, 3);
+        EXPECT_TRUE(recompiler.code[0x222 - 0x200]); // F000's NNNN
+        EXPECT_TRUE(recompiler.code[0x264 - 0x200]); // only reached through the jump table
+        EXPECT_FALSE(recompiler.code[0x22E - 0x200]);
+        EXPECT_FALSE(recompiler.code[0x26A - 0x200]);
+        EXPECT_FALSE(recompiler.code[0x278 - 0x200]);
+
+        const unsigned short starts[] = {0x200, 0x204, 0x206, 0x210, 0x216, 0x218, 0x220, 0x224, 0x226, 0x228,
+                                         0x240, 0x250, 0x252, 0x254, 0x256, 0x258, 0x25C, 0x260, 0x264, 0x266,
+                                         0x270, 0x274, 0x276};
+        ASSERT_EQ(recompiler.blocks.size(), sizeof(starts) / sizeof(starts[0]));
+        for(size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); ++i)
+            EXPECT_EQ(recompiler.blocks.count(starts[i]), 1u) << std::hex << starts[i];
+
+        // the write ends its block, the skip's block covers the F000 it may jump over
+        EXPECT_EQ(recompiler.blocks[0x210].ops.size(), 3u);
+        EXPECT_EQ(recompiler.blocks[0x210].next, 0x216);
+        EXPECT_EQ(recompiler.blocks[0x218].end, 0x222);
+    }
+
+    TEST(Chip8AotTest, Emit) {
+        Recompiler recompiler(sample, sizeof(sample));
+        std::ostringstream out;
+        recompiler.emit(out, "aotsample");
+        std::string text = out.str();
+        EXPECT_NE(text.find("unsigned int block_270(Chip8 &c8)"), std::string::npos);
+        EXPECT_NE(text.find("        return 0x224;"), std::string::npos); // the skip at 21E lands past F000 NNNN
+        EXPECT_NE(text.find("c8.opDraw(op_21A);"), std::string::npos);
+        EXPECT_NE(text.find("c8.sp = (c8.sp - 1) & 0xF;"), std::string::npos); // the stack wraps as in the interpreter
+        EXPECT_EQ(text.find("block_22E"), std::string::npos);
+        EXPECT_NE(text.find("AotRegistration registration(module);"), std::string::npos);
+
+        const unsigned char keys[] = {0xE7, 0x9E, 0x12, 0x00};
+        Recompiler keyRecompiler(keys, sizeof(keys));
+        std::ostringstream keyOut;
+        keyRecompiler.emit(keyOut, "keys");
+        EXPECT_NE(keyOut.str().find("if(c8.key[c8.V[0x7] & 0xF] != 0)"), std::string::npos); // as the interpreter
+    }
+
+    // Scheduled side by side with the interpreter, timers and all, in uneven chunks
+    TEST(Chip8AotTest, MatchesInterpreter) {
+        const AotModule *module = findAotModule(RomStore::hash(sample, sizeof(sample)));
+        ASSERT_TRUE(module != NULL) << "Chip8AotSample.cpp is out of date";
+
+        Chip8 *recompiled = new Chip8();
+        Chip8 *interpreted = new Chip8();
+        recompiled->loadRom(sample, sizeof(sample));
+        interpreted->loadRom(sample, sizeof(sample));
+        Chip8Aot aot(*recompiled, *module);
+        Scheduler aotScheduler(*recompiled, &aot);
+        Scheduler scheduler(*interpreted);
+        unsigned long chunk = 1;
+        for(int i = 0; i < 300; ++i)
+        {
+            EXPECT_EQ(aotScheduler.runInstructions(chunk), scheduler.runInstructions(chunk));
+            chunk = chunk * 7 % 997;
+        }
+
+        EXPECT_EQ(recompiled->pc, interpreted->pc);
+        EXPECT_EQ(recompiled->I, interpreted->I);
+        EXPECT_EQ(recompiled->sp, interpreted->sp);
+        EXPECT_EQ(recompiled->cycles, interpreted->cycles);
+        EXPECT_EQ(recompiled->rng, interpreted->rng);
+        EXPECT_EQ(recompiled->sound_timer, interpreted->sound_timer);
+        EXPECT_THAT(recompiled->V, testing::ElementsAreArray(interpreted->V, 16));
+        EXPECT_THAT(recompiled->stack, testing::ElementsAreArray(interpreted->stack, 16));
+        EXPECT_THAT(recompiled->gfx, testing::ElementsAreArray(interpreted->gfx));
+        EXPECT_THAT(recompiled->memory, testing::ElementsAreArray(interpreted->memory));
+
+        EXPECT_GT(aot.compiledInstructions, aot.interpretedInstructions);
+        EXPECT_GT(aot.interpretedInstructions, 0u); // the rewritten routine
+        EXPECT_GT(aot.modifiedBlocks, 0u);
+        delete recompiled;
+        delete interpreted;
+    }
+
+    TEST(Chip8AotTest, OnlyForItsRom) {
+        unsigned char other[sizeof(sample)];
+        memcpy(other, sample, sizeof(sample));
+        other[sizeof(other) - 1] ^= 1; // a byte of data is enough
+        EXPECT_TRUE(findAotModule(RomStore::hash(other, sizeof(other))) == NULL);
+    }
+
+}  // namespace
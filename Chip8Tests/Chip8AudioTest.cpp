@@ -0,0 +1,254 @@
+//
+//  Chip8AudioTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/27/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "chip8.hpp"
+#include "audio.hpp"
+#include "scheduler.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Beeps for 3 ticks, waits on the delay timer for 8, over and over
+    const unsigned char beeper[] = {
+        0x60, 0x03, // 200: V0 = 3
+        0xF0, 0x18, // 202: sound = V0
+        0x61, 0x08, // 204: V1 = 8
+        0xF1, 0x15, // 206: delay = V1
+        0xF1, 0x07, // 208: V1 = delay
+        0x31, 0x00, // 20A: skip if V1 == 0
+        0x12, 0x08, // 20C: jump 208
+        0x12, 0x00  // 20E: jump 200
+    };
+
+    class CaptureSink : public SoundSink
+    {
+    public:
+        void write(const int16_t *data, size_t n) override { samples.insert(samples.end(), data, data + n); }
+        std::vector<int16_t> samples;
+    };
+
+    std::vector<SoundEdge> drain(SoundRing &ring)
+    {
+        std::vector<SoundEdge> edges;
+        SoundEdge edge;
+        while(ring.pop(edge))
+            edges.push_back(edge);
+        return edges;
+    }
+
+    TEST(Chip8AudioTest, Ring) {
+        SoundRing *ring = new SoundRing();
+        SoundEdge edge;
+        memset(&edge, 0, sizeof(edge));
+        for(int i = 0; i < SoundRing::CAPACITY; ++i)
+        {
+            edge.cycle = i;
+            EXPECT_TRUE(ring->push(edge));
+        }
+        EXPECT_FALSE(ring->push(edge));
+        EXPECT_EQ(ring->dropped, 1u);
+        for(int i = 0; i < SoundRing::CAPACITY; ++i)
+        {
+            ASSERT_TRUE(ring->pop(edge));
+            EXPECT_EQ(edge.cycle, (unsigned long long)i);
+        }
+        EXPECT_FALSE(ring->pop(edge));
+        ring->advance(1234);
+        EXPECT_EQ(ring->time(), 1234u);
+        delete ring;
+    }
+
+    // On once FX18 is done, off at the tick that takes the timer to 0
+    TEST(Chip8AudioTest, EdgesOnCycles) {
+        Chip8 c8;
+        SoundRing ring;
+        c8.audio = &ring;
+        c8.loadRom(beeper, sizeof(beeper));
+        Scheduler scheduler(c8); // 600 ips, a tick every 10 instructions
+        scheduler.runInstructions(100);
+        std::vector<SoundEdge> edges = drain(ring);
+        ASSERT_GE(edges.size(), 2u);
+        EXPECT_TRUE(edges[0].on);
+        EXPECT_EQ(edges[0].cycle, 2u);
+        EXPECT_FALSE(edges[1].on);
+        EXPECT_EQ(edges[1].cycle, 30u); // ticks at 10, 20 and 30
+        EXPECT_EQ(edges[0].pitch, 64);
+        EXPECT_EQ(ring.time(), c8.cycles);
+    }
+
+    // Skipped wait loops, the threaded interpreter and plain emulateCycle all stamp the same cycles
+    TEST(Chip8AudioTest, SameEdgesEveryWay) {
+        std::vector<SoundEdge> runs[3];
+        for(int way = 0; way < 3; ++way)
+        {
+            Chip8 *c8 = new Chip8();
+            SoundRing *ring = new SoundRing();
+            c8->audio = ring;
+            c8->predecode = way != 2;
+            c8->loadRom(beeper, sizeof(beeper));
+            Scheduler scheduler(*c8);
+            scheduler.skipIdleLoops = way == 0;
+            for(int frame = 0; frame < 60; ++frame)
+            {
+                scheduler.runInstructions(scheduler.batch);
+                std::vector<SoundEdge> edges = drain(*ring);
+                runs[way].insert(runs[way].end(), edges.begin(), edges.end());
+            }
+            delete ring;
+            delete c8;
+        }
+        ASSERT_GE(runs[0].size(), 10u); // a beep every nine ticks or so
+        for(int way = 1; way < 3; ++way)
+        {
+            ASSERT_EQ(runs[way].size(), runs[0].size());
+            for(size_t i = 0; i < runs[0].size(); ++i)
+            {
+                EXPECT_EQ(runs[way][i].cycle, runs[0][i].cycle);
+                EXPECT_EQ(runs[way][i].on, runs[0][i].on);
+            }
+        }
+    }
+
+    TEST(Chip8AudioTest, SamplesWhereTheyBelong) {
+        SoundRing ring;
+        CaptureSink out;
+        SoundSynth synth(ring, out, 600, 44100);
+        SoundEdge edge;
+        memset(&edge, 0, sizeof(edge));
+        edge.cycle = 2;
+        edge.on = true;
+        ring.push(edge);
+        edge.cycle = 50;
+        edge.on = false;
+        ring.push(edge);
+        ring.advance(60);
+        EXPECT_EQ(synth.update(), 4410u);
+        ASSERT_EQ(out.samples.size(), 4410u);
+
+        // cycle c starts at sample c * 44100 / 600
+        EXPECT_EQ(out.samples[146], 0);
+        EXPECT_EQ(out.samples[147], synth.volume);
+        EXPECT_EQ(out.samples[3674] != 0, true);
+        EXPECT_EQ(out.samples[3675], 0);
+        // 440 Hz square wave: about 50 samples high then 50 low
+        EXPECT_EQ(out.samples[147 + 49], synth.volume);
+        EXPECT_EQ(out.samples[147 + 52], -synth.volume);
+        EXPECT_EQ(synth.edges, 2u);
+        EXPECT_EQ(synth.lateEdges, 0u);
+
+        EXPECT_EQ(synth.update(), 0u); // nothing new
+    }
+
+    // F002 / FX3A: the pattern's bits at 4000 * 2^((pitch - 64) / 48) a second
+    TEST(Chip8AudioTest, Pattern) {
+        SoundRing ring;
+        CaptureSink out;
+        SoundSynth synth(ring, out, 4000, 4000); // a cycle is a sample
+        SoundEdge edge;
+        memset(&edge, 0, sizeof(edge));
+        edge.on = true;
+        edge.pitch = 64; // one bit per sample
+        edge.pattern[0] = 0xA0; // 1010 0000
+        ring.push(edge);
+        ring.advance(130);
+        synth.update();
+        ASSERT_EQ(out.samples.size(), 130u);
+        EXPECT_EQ(out.samples[0], synth.volume);
+        EXPECT_EQ(out.samples[1], -synth.volume);
+        EXPECT_EQ(out.samples[2], synth.volume);
+        EXPECT_EQ(out.samples[3], -synth.volume);
+        EXPECT_EQ(out.samples[4], -synth.volume);
+        EXPECT_EQ(out.samples[128], synth.volume); // round again
+        EXPECT_EQ(out.samples[130 - 1], -synth.volume);
+    }
+
+    TEST(Chip8AudioTest, Wav) {
+        char name[] = "/tmp/chip8audioXXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        WavWriter wav;
+        ASSERT_TRUE(wav.open(name, 22050));
+        int16_t samples[1000];
+        for(int i = 0; i < 1000; ++i)
+            samples[i] = i * 37 - 20000;
+        wav.write(samples, 1000);
+        wav.write(samples, 300);
+        EXPECT_TRUE(wav.close());
+
+        FILE *file = fopen(name, "rb");
+        unsigned char data[44 + 2600 + 1];
+        size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        remove(name);
+        ASSERT_EQ(size, 44u + 2600u);
+        EXPECT_EQ(memcmp(data, "RIFF", 4), 0);
+        EXPECT_EQ(data[4] | data[5] << 8 | data[6] << 16, 36 + 2600);
+        EXPECT_EQ(memcmp(data + 8, "WAVEfmt ", 8), 0);
+        EXPECT_EQ(data[24] | data[25] << 8 | data[26] << 16, 22050);
+        EXPECT_EQ(memcmp(data + 36, "data", 4), 0);
+        EXPECT_EQ(data[40] | data[41] << 8, 2600);
+        EXPECT_EQ((int16_t)(data[44 + 2 * 999] | data[45 + 2 * 999] << 8), samples[999]);
+    }
+
+    // The synth on its own thread gets exactly what rendering afterwards does, nothing late or lost
+    TEST(Chip8AudioTest, ConsumerThread) {
+        const int frames = 300;
+        CaptureSink expected;
+        unsigned long long expectedEdges;
+        {
+            Chip8 *c8 = new Chip8();
+            SoundRing *ring = new SoundRing();
+            c8->audio = ring;
+            c8->loadRom(beeper, sizeof(beeper));
+            Scheduler scheduler(*c8);
+            SoundSynth synth(*ring, expected);
+            for(int frame = 0; frame < frames; ++frame)
+            {
+                scheduler.runInstructions(scheduler.batch);
+                synth.update();
+            }
+            expectedEdges = synth.edges;
+            delete ring;
+            delete c8;
+        }
+
+        Chip8 *c8 = new Chip8();
+        SoundRing *ring = new SoundRing();
+        c8->audio = ring;
+        c8->loadRom(beeper, sizeof(beeper));
+        Scheduler scheduler(*c8);
+        CaptureSink out;
+        SoundSynth synth(*ring, out);
+        std::atomic<bool> done(false);
+        std::thread consumer([&] {
+            while(!done)
+                synth.update();
+            synth.update();
+        });
+        for(int frame = 0; frame < frames; ++frame)
+            scheduler.runInstructions(scheduler.batch);
+        done = true;
+        consumer.join();
+
+        EXPECT_EQ(ring->dropped, 0u);
+        EXPECT_EQ(synth.lateEdges, 0u);
+        EXPECT_GT(synth.edges, 50u);
+        EXPECT_EQ(synth.edges, expectedEdges);
+        EXPECT_TRUE(out.samples == expected.samples);
+        EXPECT_EQ(out.samples.size(), (size_t)(frames * 10 * 44100ULL / 600));
+        delete ring;
+        delete c8;
+    }
+
+}  // namespace
@@ -52,8 +52,8 @@ namespace {
         EXPECT_EQ(myChip8.opcode, 0);
         EXPECT_EQ(myChip8.sp, 0);
         EXPECT_EQ(myChip8.I, 0);
-        unsigned char testarr1[2048] = { };
-        EXPECT_THAT(myChip8.gfx, testing::ElementsAreArray(testarr1, 2048));
+        uint64_t testarr1[DISPLAY_PLANES * 2 * DISPLAY_ROWS] = { };
+        EXPECT_THAT(myChip8.gfx, testing::ElementsAreArray(testarr1));
 
         
         // <TechnicalDetails>
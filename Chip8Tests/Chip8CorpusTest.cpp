@@ -0,0 +1,114 @@
+//
+//  Chip8CorpusTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/23/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "corpus.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Draws the digit in V1 over and over, counting it up, so every checkpoint has its own screen
+    const unsigned char counter[] = {
+        0x00, 0xE0, // 200: clear
+        0xF1, 0x29, // 202: I = font(V1)
+        0xD0, 0x05, // 204: draw
+        0x71, 0x01, // 206: V1 += 1
+        0x12, 0x00  // 208: jump 200
+    };
+
+    // Waits for a key nobody presses, time has to pass anyway
+    const unsigned char waits[] = {
+        0xF0, 0x0A, // 200: V0 = key
+        0x12, 0x00  // 202: jump 200
+    };
+
+    void writeFile(const std::string &path, const void *data, size_t size)
+    {
+        FILE *file = fopen(path.c_str(), "wb");
+        ASSERT_TRUE(file != NULL);
+        EXPECT_EQ(fwrite(data, 1, size, file), size);
+        fclose(file);
+    }
+
+    CorpusOptions quietOptions(bool bless)
+    {
+        CorpusOptions options;
+        options.bless = bless;
+        options.cycles = 1000;
+        options.threads = 2;
+        options.useJit = false;
+        options.useAot = false;
+        options.skipIdle = true;
+        options.quiet = true;
+        return options;
+    }
+
+    // Blesses two ROMs, then checks them against a manifest with one hash wrong and a ROM missing
+    TEST(Chip8CorpusTest, BlessThenCatchMismatch) {
+        char dir[] = "/tmp/chip8corpusXXXXXX";
+        ASSERT_TRUE(mkdtemp(dir) != NULL);
+        std::string base = dir;
+        writeFile(base + "/counter.ch8", counter, sizeof(counter));
+        writeFile(base + "/waits.ch8", waits, sizeof(waits));
+
+        std::vector<CorpusRun> runs;
+        EXPECT_EQ(checkCorpus(dir, quietOptions(false), &runs), 1); // no manifest yet
+        ASSERT_EQ(checkCorpus(dir, quietOptions(true), &runs), 0);
+        ASSERT_EQ(runs.size(), 2u);
+        EXPECT_EQ(runs[0].rom, "counter.ch8");
+        EXPECT_EQ(runs[1].rom, "waits.ch8");
+        ASSERT_EQ(runs[0].checks.size(), 2u);
+        EXPECT_EQ(runs[0].checks[0].cycles, 100u);
+        EXPECT_EQ(runs[0].checks[1].cycles, 1000u);
+        EXPECT_NE(runs[0].checks[0].got, runs[0].checks[1].got);
+        EXPECT_EQ(runs[1].ran, 1000u); // ran the clock out on FX0A
+        unsigned long long counter100 = runs[0].checks[0].got, counter1000 = runs[0].checks[1].got;
+        unsigned long long waits1000 = runs[1].checks[1].got;
+
+        // the blessed manifest passes as it is
+        EXPECT_EQ(checkCorpus(dir, quietOptions(false), &runs), 0);
+
+        char manifest[512];
+        snprintf(manifest, sizeof(manifest),
+                 "# hand edited\n"
+                 "waits.ch8 1000 %016llx\n"
+                 "counter.ch8 1000 %016llx # wrong on purpose\n"
+                 "counter.ch8 100 %016llx\n"
+                 "missing.ch8 50 0\n",
+                 waits1000, counter1000 ^ 1, counter100);
+        writeFile(base + "/" CORPUS_MANIFEST, manifest, strlen(manifest));
+        EXPECT_EQ(checkCorpus(dir, quietOptions(false), &runs), 1);
+        ASSERT_EQ(runs.size(), 3u);
+
+        EXPECT_EQ(runs[0].rom, "waits.ch8");
+        EXPECT_TRUE(runs[0].loaded);
+        ASSERT_EQ(runs[0].checks.size(), 1u);
+        EXPECT_EQ(runs[0].checks[0].got, runs[0].checks[0].expected);
+
+        EXPECT_EQ(runs[1].rom, "counter.ch8");
+        ASSERT_EQ(runs[1].checks.size(), 2u); // sorted by cycles
+        EXPECT_EQ(runs[1].checks[0].cycles, 100u);
+        EXPECT_EQ(runs[1].checks[0].got, runs[1].checks[0].expected);
+        EXPECT_EQ(runs[1].checks[1].expected, counter1000 ^ 1);
+        EXPECT_EQ(runs[1].checks[1].got, counter1000);
+
+        EXPECT_EQ(runs[2].rom, "missing.ch8");
+        EXPECT_FALSE(runs[2].loaded);
+
+        unlink((base + "/" CORPUS_MANIFEST).c_str());
+        unlink((base + "/counter.ch8").c_str());
+        unlink((base + "/waits.ch8").c_str());
+        rmdir(dir);
+    }
+
+}  // namespace
@@ -0,0 +1,116 @@
+//
+//  Chip8DisplayTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/11/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "chip8.hpp"
+#include "render.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+    
+    // Runs DXYN with VX = x, VY = y and I pointing at sprite
+    void draw(Chip8 &c8, int x, int y, int height, unsigned short sprite)
+    {
+        c8.V[1] = x;
+        c8.V[2] = y;
+        c8.I = sprite;
+        c8.execute(Chip8::decode(0xD120 | height));
+    }
+    
+    // Font "0" is F0 90 90 90 F0 at address 0
+    TEST(Chip8DisplayTest, DrawSprite) {
+        Chip8 c8;
+        draw(c8, 0, 0, 5, 0);
+        EXPECT_EQ(c8.gfx[0], 0xF0ULL << 56);
+        EXPECT_EQ(c8.gfx[1], 0x90ULL << 56);
+        EXPECT_EQ(c8.gfx[4], 0xF0ULL << 56);
+        EXPECT_EQ(c8.V[0xF], 0);
+        EXPECT_EQ(c8.pixel(0, 1), 1);
+        EXPECT_EQ(c8.pixel(1, 1), 0);
+        EXPECT_TRUE(c8.drawFlag);
+        
+        // Drawing it again erases it and reports the collision
+        draw(c8, 0, 0, 5, 0);
+        EXPECT_EQ(c8.V[0xF], 1);
+        uint64_t blank[DISPLAY_PLANES * 2 * DISPLAY_ROWS] = { };
+        EXPECT_THAT(c8.gfx, testing::ElementsAreArray(blank));
+    }
+    
+    // Sprites are clipped at the right and bottom edges, the start position wraps
+    TEST(Chip8DisplayTest, ClipAndWrap) {
+        Chip8 c8;
+        draw(c8, 60, 30, 5, 0);
+        EXPECT_EQ(c8.gfx[30], 0xFULL);
+        EXPECT_EQ(c8.gfx[31], 0x9ULL);
+        EXPECT_EQ(c8.gfx[0], 0ULL);
+        
+        Chip8 wrapped;
+        draw(wrapped, 64 + 3, 32 + 1, 1, 0);
+        EXPECT_EQ(wrapped.gfx[1], 0xF0ULL << 53);
+    }
+    
+    // Tall sprites go down the wide path, check it against pixel at a time drawing
+    TEST(Chip8DisplayTest, TallSpriteMatchesPixelDraw) {
+        Chip8 c8;
+        unsigned char expected[64*32] = { };
+        for(int i = 0; i < 15; ++i)
+            c8.memory[0x300 + i] = (i * 37) ^ 0x5A;
+        
+        int positions[][2] = { {0, 0}, {13, 5}, {59, 20}, {30, 9}, {13, 6} };
+        for(int p = 0; p < 5; ++p)
+        {
+            int x = positions[p][0], y = positions[p][1];
+            bool collision = false;
+            for(int row = 0; row < 15 && y + row < 32; ++row)
+                for(int bit = 0; bit < 8 && x + bit < 64; ++bit)
+                    if(c8.memory[0x300 + row] & (0x80 >> bit))
+                    {
+                        unsigned char &pix = expected[(y + row) * 64 + x + bit];
+                        collision |= pix == 1;
+                        pix ^= 1;
+                    }
+            draw(c8, x, y, 15, 0x300);
+            EXPECT_EQ(c8.V[0xF], collision ? 1 : 0);
+        }
+        
+        unsigned char actual[64*32];
+        c8.unpackDisplay(actual);
+        EXPECT_THAT(actual, testing::ElementsAreArray(expected, 64*32));
+    }
+    
+    // DXYN and 00E0 mark just the rows they touch, the frontend redraws only those
+    TEST(Chip8DisplayTest, DirtyRows) {
+        Chip8 c8;
+        EXPECT_EQ(c8.dirtyRows, ~0ULL); // fresh machine, redraw everything
+        c8.dirtyRows = 0;
+        
+        draw(c8, 10, 3, 5, 0);
+        EXPECT_EQ(c8.dirtyRows, 0x1Fu << 3);
+        draw(c8, 0, 30, 5, 0); // clipped at the bottom
+        EXPECT_EQ(c8.dirtyRows, (0x1Fu << 3) | (3u << 30));
+        
+        unsigned char gray[64*32];
+        memset(gray, 7, sizeof(gray));
+        renderGrayRows(c8, 1u << 3, gray);
+        EXPECT_EQ(gray[3 * 64 + 10], 255);
+        EXPECT_EQ(gray[3 * 64 + 14], 0);
+        EXPECT_EQ(gray[4 * 64 + 10], 7); // not asked for, left alone
+        
+        // clearing only dirties rows that had something on them
+        c8.dirtyRows = 0;
+        c8.drawFlag = false;
+        c8.execute(Chip8::decode(0x00E0));
+        EXPECT_EQ(c8.dirtyRows, (0x1Fu << 3) | (3u << 30));
+        EXPECT_TRUE(c8.drawFlag);
+        c8.dirtyRows = 0;
+        c8.execute(Chip8::decode(0x00E0));
+        EXPECT_EQ(c8.dirtyRows, 0u);
+    }
+    
+}  // namespace
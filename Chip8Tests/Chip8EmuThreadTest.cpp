@@ -0,0 +1,191 @@
+//
+//  Chip8EmuThreadTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/21/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "emuthread.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    InputEvent keyEvent(unsigned char k)
+    {
+        InputEvent event;
+        event.type = InputEvent::KEY_DOWN;
+        event.key = k;
+        event.time = k;
+        return event;
+    }
+
+    TEST(Chip8EmuThreadTest, RingInOrderUntilFull) {
+        InputRing *ring = new InputRing();
+        InputEvent event;
+        EXPECT_FALSE(ring->pop(event));
+        for(int i = 0; i < InputRing::CAPACITY; ++i)
+            EXPECT_TRUE(ring->push(keyEvent(i)));
+        EXPECT_FALSE(ring->push(keyEvent(0)));
+        for(int i = 0; i < InputRing::CAPACITY; ++i)
+        {
+            ASSERT_TRUE(ring->pop(event));
+            EXPECT_EQ(event.time, i);
+        }
+        EXPECT_FALSE(ring->pop(event));
+        delete ring;
+    }
+
+    // One thread pushing, one popping, nothing lost or reordered
+    TEST(Chip8EmuThreadTest, RingAcrossThreads) {
+        InputRing *ring = new InputRing();
+        const uint64_t count = 200000;
+        std::thread producer([ring, count] {
+            for(uint64_t i = 0; i < count; )
+            {
+                InputEvent event = keyEvent(0);
+                event.time = i;
+                if(ring->push(event))
+                    ++i;
+                else
+                    std::this_thread::yield();
+            }
+        });
+        uint64_t expected = 0;
+        while(expected < count)
+        {
+            InputEvent event;
+            if(!ring->pop(event))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if(event.time != expected)
+                break;
+            ++expected;
+        }
+        producer.join();
+        EXPECT_EQ(expected, count);
+        delete ring;
+    }
+
+    TEST(Chip8EmuThreadTest, MailboxKeepsNewest) {
+        FrameMailbox *mailbox = new FrameMailbox();
+        EXPECT_FALSE(mailbox->receive());
+        for(int i = 1; i <= 3; ++i)
+        {
+            mailbox->back().gfx[0] = i;
+            mailbox->publish();
+        }
+        ASSERT_TRUE(mailbox->receive());
+        EXPECT_EQ(mailbox->front().gfx[0], 3);
+        EXPECT_EQ(mailbox->front().number, 3);
+        EXPECT_FALSE(mailbox->receive());
+        delete mailbox;
+    }
+
+    TEST(Chip8EmuThreadTest, MailboxKeepsSkippedRows) {
+        FrameMailbox *mailbox = new FrameMailbox();
+        mailbox->back().dirtyRows = ~0ULL;
+        mailbox->publish();
+        ASSERT_TRUE(mailbox->receive());
+        EXPECT_EQ(mailbox->front().dirtyRows, ~0ULL);
+        for(int i = 0; i < 3; ++i)
+        {
+            mailbox->back().dirtyRows = 1ULL << i;
+            mailbox->publish();
+        }
+        ASSERT_TRUE(mailbox->receive());
+        EXPECT_EQ(mailbox->front().number, 4);
+        EXPECT_EQ(mailbox->front().dirtyRows, 7u); // frames 2 and 3 were never picked up
+        mailbox->back().dirtyRows = 1ULL << 5;
+        mailbox->publish();
+        ASSERT_TRUE(mailbox->receive());
+        EXPECT_EQ(mailbox->front().dirtyRows, 1ULL << 5);
+        for(int i = 0; i < 70; ++i)
+        {
+            mailbox->back().dirtyRows = 0;
+            mailbox->publish();
+        }
+        ASSERT_TRUE(mailbox->receive());
+        EXPECT_EQ(mailbox->front().dirtyRows, ~0ULL); // too far behind to tell
+        delete mailbox;
+    }
+
+    // The consumer never sees a frame that's half written or older than the one before
+    TEST(Chip8EmuThreadTest, MailboxAcrossThreads) {
+        FrameMailbox *mailbox = new FrameMailbox();
+        std::atomic<bool> done(false);
+        std::thread producer([mailbox, &done] {
+            for(uint64_t i = 1; i <= 100000; ++i)
+            {
+                Frame &frame = mailbox->back();
+                for(int y = 0; y < 32; ++y)
+                    frame.gfx[y] = i;
+                mailbox->publish();
+            }
+            done = true;
+        });
+        uint64_t last = 0;
+        bool torn = false, backwards = false;
+        for(;;)
+        {
+            bool finished = done;
+            if(!mailbox->receive())
+            {
+                if(finished)
+                    break;
+                std::this_thread::yield();
+                continue;
+            }
+            const Frame &frame = mailbox->front();
+            for(int y = 1; y < 32; ++y)
+                torn |= frame.gfx[y] != frame.gfx[0];
+            backwards |= frame.gfx[0] <= last;
+            last = frame.gfx[0];
+        }
+        producer.join();
+        EXPECT_EQ(last, 100000); // the last one always gets through
+        EXPECT_FALSE(torn);
+        EXPECT_FALSE(backwards);
+        delete mailbox;
+    }
+
+    // Waits for a key, then draws it
+    TEST(Chip8EmuThreadTest, KeyToFrame) {
+        const unsigned char prog[] = {
+            0xF0, 0x0A, // 200: V0 = key
+            0xF0, 0x29, // 202: I = font(V0)
+            0xD1, 0x15, // 204: draw
+            0x12, 0x06  // 206: jump 206
+        };
+        Chip8 *c8 = new Chip8();
+        memcpy(c8->memory + 0x200, prog, sizeof(prog));
+        c8->invalidateAllDecoded();
+        Scheduler scheduler(*c8);
+        EmulationThread *emulator = new EmulationThread(*c8, scheduler);
+        emulator->start();
+        
+        EXPECT_TRUE(emulator->send(InputEvent::KEY_DOWN, 0xA));
+        bool drawn = false;
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(!drawn && std::chrono::steady_clock::now() < give_up)
+        {
+            if(emulator->frames.receive())
+                drawn = emulator->frames.front().gfx[0] != 0;
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        emulator->stop();
+        EXPECT_TRUE(drawn);
+        EXPECT_EQ(c8->V[0], 0xA);
+        EXPECT_EQ(emulator->events, 1);
+        EXPECT_LE(emulator->maxLatency, emulator->totalLatency);
+        delete emulator;
+        delete c8;
+    }
+
+}  // namespace
@@ -0,0 +1,115 @@
+//
+//  Chip8FrameStreamTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "chip8.hpp"
+#include "delta.hpp"
+#include "framestream.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    TEST(Chip8FrameStreamTest, DeltaRoundTrip) {
+        unsigned char a[300] = { }, b[300] = { };
+        b[0] = 1;
+        b[5] = 2; b[6] = 3;
+        b[200] = 0xFF;
+        b[299] = 9;
+        std::vector<unsigned char> encoded;
+        deltaEncode(b, a, sizeof(b), encoded);
+        EXPECT_LT(encoded.size(), 20u);
+
+        unsigned char out[300];
+        memcpy(out, a, sizeof(out));
+        EXPECT_EQ(deltaDecode(encoded.data(), encoded.size(), out, sizeof(out)), encoded.size());
+        EXPECT_EQ(memcmp(out, b, sizeof(b)), 0);
+        // cut short is an error, not a crash
+        EXPECT_EQ(deltaDecode(encoded.data(), encoded.size() - 1, out, sizeof(out)), 0u);
+    }
+
+    // Only frames where drawFlag is set and the screen really changed get written, and they read back
+    TEST(Chip8FrameStreamTest, WriteAndRead) {
+        FILE *f = tmpfile();
+        ASSERT_TRUE(f != NULL);
+        Chip8 c8;
+        FrameWriter writer;
+        writer.open(f, 600);
+
+        std::vector<std::vector<uint64_t> > expected;
+        std::vector<unsigned long long> cycles;
+        for(int i = 0; i < 50; ++i)
+        {
+            c8.cycles += 10;
+            c8.V[1] = i;
+            c8.V[2] = i / 2;
+            c8.I = (i % 16) * 5; // font sprites
+            c8.execute(Chip8::decode(0xD125));
+            if(writer.capture(c8))
+            {
+                expected.push_back(std::vector<uint64_t>(c8.gfx, c8.gfx + sizeof(c8.gfx) / sizeof(c8.gfx[0])));
+                cycles.push_back(c8.cycles);
+            }
+            EXPECT_FALSE(c8.drawFlag);
+            EXPECT_FALSE(writer.capture(c8)); // nothing new
+        }
+        writer.close();
+        EXPECT_EQ(writer.frames, expected.size());
+        EXPECT_GT(writer.frames, 40u);
+
+        rewind(f);
+        FrameReader reader;
+        ASSERT_TRUE(reader.open(f));
+        EXPECT_EQ(reader.ips, 600u);
+        for(size_t i = 0; i < expected.size(); ++i)
+        {
+            ASSERT_TRUE(reader.next());
+            EXPECT_EQ(reader.cycle, cycles[i]);
+            EXPECT_THAT(reader.gfx, testing::ElementsAreArray(expected[i]));
+        }
+        EXPECT_FALSE(reader.next());
+        fclose(f);
+    }
+
+    // Every 60th of a second gets a frame, and a write that fails is an error rather than a short video
+    TEST(Chip8FrameStreamTest, ExportGrayVideo) {
+        char stream[] = "/tmp/chip8streamXXXXXX", video[] = "/tmp/chip8videoXXXXXX";
+        int fd = mkstemp(stream);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        fd = mkstemp(video);
+        ASSERT_GE(fd, 0);
+        close(fd);
+
+        Chip8 c8;
+        FrameWriter writer;
+        ASSERT_TRUE(writer.open(stream, 600));
+        c8.cycles = 10;
+        c8.execute(Chip8::decode(0xD005));
+        EXPECT_TRUE(writer.capture(c8));
+        c8.cycles = 600; // a second in
+        c8.execute(Chip8::decode(0xD005));
+        EXPECT_TRUE(writer.capture(c8));
+        writer.close();
+
+        EXPECT_EQ(exportGrayVideo(stream, video), 61);
+        FILE *f = fopen(video, "rb");
+        ASSERT_TRUE(f != NULL);
+        fseek(f, 0, SEEK_END);
+        EXPECT_EQ(ftell(f), 61 * 128 * 64);
+        fclose(f);
+
+        // a full disk (or no such device, where there isn't one)
+        EXPECT_EQ(exportGrayVideo(stream, "/dev/full"), -1);
+        remove(stream);
+        remove(video);
+    }
+
+}  // namespace
@@ -0,0 +1,158 @@
+//
+//  Chip8IdleTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/20/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <string.h>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    void expectSame(const Chip8 &a, const Chip8 &b)
+    {
+        EXPECT_EQ(a.pc, b.pc);
+        EXPECT_EQ(a.I, b.I);
+        EXPECT_EQ(a.opcode, b.opcode);
+        EXPECT_EQ(a.cycles, b.cycles);
+        EXPECT_EQ(a.delay_timer, b.delay_timer);
+        EXPECT_EQ(a.sound_timer, b.sound_timer);
+        EXPECT_THAT(a.V, testing::ElementsAreArray(b.V, 16));
+        EXPECT_THAT(a.gfx, testing::ElementsAreArray(b.gfx));
+    }
+
+    // Runs prog with and without skipping in steps of step instructions, the two must never differ
+    void expectSameAsPlain(const unsigned char *prog, int size, unsigned long step, int steps, unsigned int ips)
+    {
+        Chip8 fast, plain;
+        fast.loadRom(prog, size);
+        plain.loadRom(prog, size);
+        Scheduler fastScheduler(fast), plainScheduler(plain);
+        fastScheduler.setIPS(ips);
+        plainScheduler.setIPS(ips);
+        plainScheduler.skipIdleLoops = false;
+        for(int i = 0; i < steps; ++i)
+        {
+            EXPECT_EQ(fastScheduler.runInstructions(step), plainScheduler.runInstructions(step));
+            SCOPED_TRACE(i);
+            expectSame(fast, plain);
+        }
+    }
+
+    const unsigned char delayWait[] = {
+        0x60, 0x20, // 200: V0 = 20
+        0xF0, 0x15, // 202: delay = V0
+        0xF1, 0x07, // 204: V1 = delay
+        0x31, 0x00, // 206: skip if V1 == 0
+        0x12, 0x04, // 208: jump 204
+        0x72, 0x01, // 20A: V2 += 1
+        0xA0, 0x00, // 20C: I = 0
+        0xD2, 0x25, // 20E: draw
+        0x12, 0x00  // 210: jump 200
+    };
+
+    TEST(Chip8IdleTest, DelayWaitMatchesPlainRun) {
+        expectSameAsPlain(delayWait, sizeof(delayWait), 1, 2000, 600);
+        expectSameAsPlain(delayWait, sizeof(delayWait), 7, 1000, 600);
+        expectSameAsPlain(delayWait, sizeof(delayWait), 1000, 50, 1000);
+        expectSameAsPlain(delayWait, sizeof(delayWait), 100000, 5, 100000);
+    }
+
+    TEST(Chip8IdleTest, FindsDelayWait) {
+        Chip8 c8;
+        c8.loadRom(delayWait, sizeof(delayWait));
+        c8.run(3); // in the loop at 206, V1 = 20
+        IdleLoop loop;
+        ASSERT_TRUE(c8.findIdleLoop(loop));
+        EXPECT_EQ(loop.length, 3);
+        EXPECT_EQ(loop.last, 0xF107);
+        EXPECT_TRUE(loop.readsDelay);
+        EXPECT_EQ(loop.minDelay, 1); // at 0 it leaves
+
+        // V1 has to hold a reading that still goes round
+        c8.V[1] = 0;
+        EXPECT_FALSE(c8.findIdleLoop(loop));
+    }
+
+    TEST(Chip8IdleTest, SkipsDelayWait) {
+        Chip8 c8;
+        c8.loadRom(delayWait, sizeof(delayWait));
+        Scheduler scheduler(c8);
+        scheduler.runInstructions(3);
+        // waits out the 32 ticks, draws once and starts waiting again
+        scheduler.runInstructions(400);
+        EXPECT_EQ(c8.cycles, 403);
+        EXPECT_EQ(c8.V[2], 1);
+        EXPECT_EQ(c8.delay_timer, 0x20 - 8);
+    }
+
+    // Spins until key 5 comes down, a sound plays meanwhile
+    const unsigned char keyWait[] = {
+        0x63, 0x05, // 200: V3 = 5
+        0xF3, 0x18, // 202: sound = V3
+        0xE3, 0xA1, // 204: skip if key V3 is up
+        0x12, 0x0A, // 206: jump 20A
+        0x12, 0x04, // 208: jump 204
+        0x74, 0x01, // 20A: V4 += 1
+        0x12, 0x0A  // 20C: jump 20A
+    };
+
+    TEST(Chip8IdleTest, KeyWaitMatchesPlainRun) {
+        expectSameAsPlain(keyWait, sizeof(keyWait), 3, 500, 600);
+        expectSameAsPlain(keyWait, sizeof(keyWait), 10000, 5, 600);
+    }
+
+    TEST(Chip8IdleTest, SkipsKeyWaitAcrossTicks) {
+        Chip8 c8;
+        c8.loadRom(keyWait, sizeof(keyWait));
+        Scheduler scheduler(c8);
+        scheduler.runInstructions(2);
+        IdleLoop loop;
+        ASSERT_TRUE(c8.findIdleLoop(loop));
+        EXPECT_FALSE(loop.readsDelay);
+        EXPECT_EQ(scheduler.runInstructions(1000000), 1000000);
+        EXPECT_EQ(c8.pc, 0x204);
+        EXPECT_EQ(c8.sound_timer, 0); // ticked down on the way
+        
+        c8.keyDown(5);
+        EXPECT_FALSE(c8.findIdleLoop(loop));
+        scheduler.runInstructions(10);
+        EXPECT_GT(c8.V[4], 0);
+    }
+
+    // Loops that do something are never skipped
+    TEST(Chip8IdleTest, BusyLoopsRunNormally) {
+        const unsigned char count[] = {
+            0x70, 0x01, // 200: V0 += 1
+            0x12, 0x00  // 202: jump 200
+        };
+        Chip8 c8;
+        IdleLoop loop;
+        c8.loadRom(count, sizeof(count));
+        EXPECT_FALSE(c8.findIdleLoop(loop));
+
+        const unsigned char draw[] = {
+            0xD0, 0x15, // 200: draw
+            0x12, 0x00  // 202: jump 200
+        };
+        c8.loadRom(draw, sizeof(draw));
+        EXPECT_FALSE(c8.findIdleLoop(loop));
+
+        // sets V0 to something new every time round
+        const unsigned char toggle[] = {
+            0x80, 0x10, // 200: V0 = V1
+            0x81, 0x20, // 202: V1 = V2
+            0x82, 0x00, // 204: V2 = V0
+            0x12, 0x00  // 206: jump 200
+        };
+        c8.loadRom(toggle, sizeof(toggle));
+        c8.V[1] = 1;
+        EXPECT_FALSE(c8.findIdleLoop(loop));
+        expectSameAsPlain(toggle, sizeof(toggle), 10, 10, 600);
+    }
+
+}  // namespace
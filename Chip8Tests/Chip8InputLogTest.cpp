@@ -0,0 +1,194 @@
+//
+//  Chip8InputLogTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/22/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include "inputlog.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Waits for a key, draws its digit somewhere random, waits on the delay timer, and goes
+    // back to waiting once the key is let go
+    const unsigned char game[] = {
+        0x00, 0xE0, // 200: clear
+        0xF0, 0x0A, // 202: V0 = key
+        0xC1, 0x3F, // 204: V1 = random & 3F
+        0xC2, 0x1F, // 206: V2 = random & 1F
+        0xF0, 0x29, // 208: I = font(V0)
+        0xD1, 0x25, // 20A: draw
+        0x63, 0x05, // 20C: V3 = 5
+        0xF3, 0x15, // 20E: delay = V3
+        0xF4, 0x07, // 210: V4 = delay
+        0x34, 0x00, // 212: skip if V4 == 0
+        0x12, 0x10, // 214: jump 210
+        0xE0, 0x9E, // 216: skip if key V0
+        0x12, 0x02, // 218: jump 202
+        0x75, 0x01, // 21A: V5 += 1
+        0x12, 0x0C  // 21C: jump 20C
+    };
+
+    // Plays a session the way EmulationThread does: input between batches, time passing while
+    // the machine waits for a key. Keys go down and up at a few chosen batches.
+    void playSession(Chip8 &c8, Scheduler &scheduler, InputLog &log)
+    {
+        const struct { int batch; bool down; unsigned char key; } keys[] = {
+            {3, true, 0x7}, {9, false, 0x7}, {20, true, 0xA}, {21, true, 0x3},
+            {40, false, 0xA}, {41, false, 0x3}, {60, true, 0xF}, {61, false, 0xF}
+        };
+        size_t next = 0;
+        for(int batch = 0; batch < 80; ++batch)
+        {
+            for(; next < sizeof(keys) / sizeof(keys[0]) && keys[next].batch == batch; ++next)
+            {
+                if(keys[next].down)
+                {
+                    c8.keyDown(keys[next].key);
+                    log.keyDown(c8, keys[next].key);
+                }
+                else
+                {
+                    c8.keyUp(keys[next].key);
+                    log.keyUp(c8, keys[next].key);
+                }
+            }
+            unsigned long long start = c8.cycles;
+            scheduler.runInstructions(97);
+            if(c8.waitingForKey)
+                scheduler.idle(start + 97 - c8.cycles);
+        }
+        log.finish(c8);
+    }
+
+    void expectSame(const Chip8 &a, const Chip8 &b)
+    {
+        EXPECT_EQ(a.pc, b.pc);
+        EXPECT_EQ(a.I, b.I);
+        EXPECT_EQ(a.cycles, b.cycles);
+        EXPECT_EQ(a.rng, b.rng);
+        EXPECT_EQ(a.delay_timer, b.delay_timer);
+        EXPECT_EQ(a.waitingForKey, b.waitingForKey);
+        EXPECT_THAT(a.V, testing::ElementsAreArray(b.V, 16));
+        EXPECT_THAT(a.key, testing::ElementsAreArray(b.key, 16));
+        EXPECT_THAT(a.gfx, testing::ElementsAreArray(b.gfx));
+    }
+
+    TEST(Chip8InputLogTest, ReplayMatchesSession) {
+        Chip8 live;
+        live.seedRandom(1234);
+        live.loadRom(game, sizeof(game));
+        Scheduler liveScheduler(live);
+        liveScheduler.setIPS(900);
+        InputLog log;
+        log.ips = 900;
+        log.seed = 1234;
+        playSession(live, liveScheduler, log);
+        EXPECT_EQ(log.length(), live.cycles);
+        EXPECT_NE(live.V[5], 0); // keys were seen held down
+
+        Chip8 replayed;
+        replayed.loadRom(game, sizeof(game));
+        Scheduler scheduler(replayed);
+        InputReplay replay(log);
+        replay.prepare(replayed, scheduler);
+        EXPECT_EQ(scheduler.getIPS(), 900u);
+        while(!replay.finished(replayed))
+            replay.run(replayed, scheduler, 1000);
+        EXPECT_TRUE(replay.matches(replayed));
+        expectSame(replayed, live);
+    }
+
+    // Replays don't depend on how the run is cut up
+    TEST(Chip8InputLogTest, ReplayInAnyChunks) {
+        Chip8 live;
+        live.loadRom(game, sizeof(game));
+        Scheduler liveScheduler(live);
+        InputLog log;
+        playSession(live, liveScheduler, log);
+
+        Chip8 replayed;
+        replayed.loadRom(game, sizeof(game));
+        Scheduler scheduler(replayed);
+        InputReplay replay(log);
+        replay.prepare(replayed, scheduler);
+        unsigned long chunk = 1;
+        while(!replay.finished(replayed))
+        {
+            unsigned long long left = log.length() - replayed.cycles;
+            EXPECT_EQ(replay.run(replayed, scheduler, chunk), chunk < left ? chunk : left);
+            chunk = chunk * 3 % 1001;
+        }
+        EXPECT_EQ(replay.run(replayed, scheduler, 100), 0u); // nothing past the END
+        EXPECT_TRUE(replay.matches(replayed));
+        expectSame(replayed, live);
+    }
+
+    TEST(Chip8InputLogTest, SaveLoad) {
+        Chip8 live;
+        live.seedRandom(0xDEADBEEFCAFEULL);
+        live.loadRom(game, sizeof(game));
+        Scheduler scheduler(live);
+        InputLog log;
+        log.ips = 700;
+        log.romHash = 0x0123456789ABCDEFULL;
+        log.seed = 0xDEADBEEFCAFEULL;
+        playSession(live, scheduler, log);
+
+        char name[] = "/tmp/chip8inputlogXXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        ASSERT_TRUE(log.save(name));
+        InputLog loaded;
+        ASSERT_TRUE(loaded.load(name));
+        FILE *file = fopen(name, "rb");
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+        remove(name);
+
+        EXPECT_EQ(loaded.ips, 700u);
+        EXPECT_EQ(loaded.romHash, log.romHash);
+        EXPECT_EQ(loaded.seed, log.seed);
+        EXPECT_EQ(loaded.finalHash, live.displayHash());
+        EXPECT_EQ(loaded.length(), log.length());
+        ASSERT_EQ(loaded.events.size(), log.events.size());
+        for(size_t i = 0; i < log.events.size(); ++i)
+        {
+            EXPECT_EQ(loaded.events[i].cycle, log.events[i].cycle);
+            EXPECT_EQ(loaded.events[i].type, log.events[i].type);
+            EXPECT_EQ(loaded.events[i].key, log.events[i].key);
+        }
+        EXPECT_LE(size, 25 + 8 + 3 * (long)log.events.size()); // a few bytes an event
+    }
+
+    TEST(Chip8InputLogTest, RewoundDropsUndoneInput) {
+        Chip8 c8;
+        InputLog log;
+        c8.cycles = 10;
+        log.keyDown(c8, 1);
+        c8.cycles = 20;
+        log.keyDown(c8, 2);
+        c8.cycles = 30;
+        log.keyUp(c8, 1);
+        c8.cycles = 20; // back to a snapshot taken before the key at 20 came in
+        log.rewound(c8);
+        ASSERT_EQ(log.events.size(), 1u);
+        EXPECT_EQ(log.events[0].cycle, 10u);
+        log.finish(c8);
+        EXPECT_EQ(log.length(), 20u);
+        c8.cycles = 25;
+        log.finish(c8); // finishing again moves the END
+        EXPECT_EQ(log.events.size(), 2u);
+        EXPECT_EQ(log.length(), 25u);
+    }
+
+}  // namespace
@@ -0,0 +1,120 @@
+//
+//  Chip8JitTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/6/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include "chip8.hpp"
+#include "chip8jit.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+    
+    // Runs the program for the same number of cycles under the JIT and the interpreter
+    void expectSameAsInterpreter(const unsigned char *prog, int size, unsigned long cycles)
+    {
+        Chip8 *jitted = new Chip8();
+        Chip8 *interpreted = new Chip8();
+        jitted->loadRom(prog, size);
+        interpreted->loadRom(prog, size);
+        
+        Chip8Jit jit(*jitted);
+        EXPECT_EQ(jit.run(cycles), cycles);
+        interpreted->run(cycles);
+        
+        EXPECT_EQ(jitted->pc, interpreted->pc);
+        EXPECT_EQ(jitted->I, interpreted->I);
+        EXPECT_EQ(jitted->delay_timer, interpreted->delay_timer);
+        EXPECT_THAT(jitted->V, testing::ElementsAreArray(interpreted->V, 16));
+        EXPECT_THAT(jitted->gfx, testing::ElementsAreArray(interpreted->gfx));
+        EXPECT_THAT(jitted->memory, testing::ElementsAreArray(interpreted->memory));
+#if CHIP8_JIT_SUPPORTED
+        EXPECT_GT(jit.jitInstructions, 0);
+#endif
+        delete jitted;
+        delete interpreted;
+    }
+    
+    // ALU ops, flags (including X or Y == F), skips and draws
+    TEST(Chip8JitTest, MatchesInterpreter) {
+        const unsigned char prog[] = {
+            0x60, 0x05, // 200: V0 = 5
+            0x61, 0xF0, // 202: V1 = F0
+            0x6F, 0x33, // 204: VF = 33
+            0x70, 0x07, // 206: V0 += 7
+            0x81, 0x04, // 208: V1 += V0, carry
+            0x82, 0x15, // 20A: V2 -= V1
+            0x83, 0x27, // 20C: V3 = V2 - V3
+            0x84, 0x16, // 20E: V4 = V1 >> 1
+            0x85, 0x0E, // 210: V5 <<= 1
+            0x8F, 0x14, // 212: VF += V1
+            0x86, 0xF4, // 214: V6 += VF
+            0x87, 0x31, // 216: V7 |= V3
+            0x87, 0x42, // 218: V7 &= V4
+            0x88, 0x23, // 21A: V8 ^= V2
+            0xF0, 0x1E, // 21C: I += V0
+            0xA2, 0x40, // 21E: I = 240
+            0xF0, 0x1E, // 220: I += V0
+            0xF0, 0x15, // 222: delay = V0
+            0x40, 0x00, // 224: skip if V0 != 0
+            0x12, 0x2E, // 226: jump 22E
+            0x50, 0x10, // 228: skip if V0 == V1
+            0xD3, 0x45, // 22A: draw
+            0x90, 0x20, // 22C: skip if V0 != V2
+            0x30, 0x80, // 22E: skip if V0 == 80
+            0x12, 0x06, // 230: jump 206
+            0x12, 0x00  // 232: jump 200
+        };
+        expectSameAsInterpreter(prog, sizeof(prog), 20000);
+    }
+    
+    // The bit shifted out goes in VF, as the interpreter
+    TEST(Chip8JitTest, ShiftFlags) {
+        const unsigned char prog[] = {
+            0x60, 0x81, // 200: V0 = 0x81
+            0x80, 0x06, // 202: V0 >>= 1
+            0x81, 0xF0, // 204: V1 = VF
+            0x80, 0x06, // 206: V0 >>= 1, bit 0 clear
+            0x82, 0xF0, // 208: V2 = VF
+            0x63, 0x81, // 20A: V3 = 0x81
+            0x83, 0x0E, // 20C: V3 <<= 1
+            0x84, 0xF0, // 20E: V4 = VF
+            0x83, 0x0E, // 210: V3 <<= 1, bit 7 clear
+            0x85, 0xF0, // 212: V5 = VF
+            0x12, 0x14  // 214: jump 214
+        };
+        expectSameAsInterpreter(prog, sizeof(prog), 11);
+
+        Chip8 c8;
+        c8.loadRom(prog, sizeof(prog));
+        Chip8Jit jit(c8);
+        jit.run(11); // the whole block at once
+        EXPECT_EQ(c8.V[0], 0x20);
+        EXPECT_EQ(c8.V[1], 1);
+        EXPECT_EQ(c8.V[2], 0);
+        EXPECT_EQ(c8.V[3], 0x04);
+        EXPECT_EQ(c8.V[4], 1);
+        EXPECT_EQ(c8.V[5], 0);
+    }
+    
+    // FX55 overwriting a translated block has to be picked up
+    TEST(Chip8JitTest, SelfModifyingCode) {
+        const unsigned char prog[] = {
+            0x60, 0x71, // 200: V0 = 71
+            0x61, 0x01, // 202: V1 = 01
+            0xA2, 0x0C, // 204: I = 20C
+            0x63, 0x00, // 206: V3 = 0
+            0x12, 0x0C, // 208: jump 20C
+            0x00, 0x00,
+            0x73, 0x10, // 20C: V3 += 10, becomes V1 += 1 after the store
+            0x72, 0x01, // 20E: V2 += 1
+            0xF1, 0x55, // 210: store V0, V1 at 20C
+            0x12, 0x0C  // 212: jump 20C
+        };
+        expectSameAsInterpreter(prog, sizeof(prog), 1000);
+    }
+    
+}  // namespace
@@ -0,0 +1,188 @@
+//
+//  Chip8LanesTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include "chip8.hpp"
+#include "lanes.hpp"
+#include "scheduler.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Gives every lane a different V0 and key, so they take different paths through prog
+    void setupLane(Chip8 &c8, int lane, const unsigned char *prog, int size)
+    {
+        c8.loadRom(prog, size);
+        c8.V[0] = 0x61 + lane % 15; // a 6XNN opcode for SelfModifyingCode
+        c8.V[7] = lane % 16;
+        if(lane % 3)
+            c8.keyDown(lane % 16);
+    }
+
+    void expectSame(const Chip8 &a, const Chip8 &b)
+    {
+        EXPECT_EQ(a.pc, b.pc);
+        EXPECT_EQ(a.I, b.I);
+        EXPECT_EQ(a.sp, b.sp);
+        EXPECT_EQ(a.cycles, b.cycles);
+        EXPECT_EQ(a.delay_timer, b.delay_timer);
+        EXPECT_EQ(a.waitingForKey, b.waitingForKey);
+        EXPECT_THAT(a.V, testing::ElementsAreArray(b.V, 16));
+        EXPECT_THAT(a.stack, testing::ElementsAreArray(b.stack, 16));
+        EXPECT_THAT(a.gfx, testing::ElementsAreArray(b.gfx));
+        EXPECT_THAT(a.memory, testing::ElementsAreArray(b.memory));
+    }
+
+    // Runs prog in every lane and on its own through a Scheduler, they have to agree
+    void expectSameAsScheduler(const unsigned char *prog, int size, unsigned long cycles)
+    {
+        Chip8Lanes *lanes = new Chip8Lanes();
+        Chip8 *c8 = new Chip8();
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            c8->initialize();
+            setupLane(*c8, l, prog, size);
+            lanes->load(l, *c8);
+        }
+        lanes->run(cycles);
+        EXPECT_GT(lanes->laneInstructions, lanes->steps); // some lockstep happened
+
+        Chip8 *out = new Chip8();
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            c8->initialize();
+            setupLane(*c8, l, prog, size);
+            Scheduler scheduler(*c8);
+            scheduler.throttle = false;
+            scheduler.runInstructions(cycles);
+            lanes->store(l, *out);
+            SCOPED_TRACE(l);
+            expectSame(*out, *c8);
+        }
+        delete out;
+        delete c8;
+        delete lanes;
+    }
+
+    // Arithmetic, skips, keys, calls, timers and draws, with lanes splitting up on V0 and keys.
+    TEST(Chip8LanesTest, MatchesScheduler) {
+        const unsigned char prog[] = {
+            0xA2, 0x40, // 200: I = 240
+            0x71, 0x01, // 202: V1 += 1
+            0x80, 0x14, // 204: V0 += V1
+            0x82, 0x03, // 206: V2 ^= V0
+            0x83, 0x26, // 208: V3 >>= 1
+            0x84, 0x0E, // 20A: V4 <<= 1
+            0x84, 0x35, // 20C: V4 -= V3
+            0x85, 0x17, // 20E: V5 = V1 - V5
+            0x47, 0x05, // 210: skip if V7 != 5
+            0x22, 0x30, // 212: call 230
+            0xE7, 0x9E, // 214: skip if key V7
+            0x76, 0x03, // 216: V6 += 3
+            0xE7, 0xA1, // 218: skip if not key V7
+            0xF6, 0x15, // 21A: delay = V6
+            0xF8, 0x07, // 21C: V8 = delay
+            0x38, 0x00, // 21E: skip if V8 == 0
+            0x12, 0x02, // 220: jump 202
+            0xF7, 0x29, // 222: I = font(V7)
+            0xD1, 0x25, // 224: draw
+            0x12, 0x02, // 226: jump 202
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0xA3, 0x00, // 230: I = 300
+            0xF0, 0x33, // 232: BCD V0 at 300
+            0xF2, 0x65, // 234: V0-V2 = 300
+            0xC9, 0x3F, // 236: V9 = random & 3F
+            0x00, 0xEE  // 238: return
+        };
+        expectSameAsScheduler(prog, sizeof(prog), 5000);
+    }
+
+    // A key number past F only looks at its low nibble, on its own and in the lanes alike
+    TEST(Chip8LanesTest, KeyAboveF) {
+        const unsigned char prog[] = {
+            0x77, 0x10, // 200: V7 += 0x10, past F from here on
+            0xE7, 0x9E, // 202: skip if key V7
+            0x71, 0x01, // 204: V1 += 1
+            0xE7, 0xA1, // 206: skip if not key V7
+            0x72, 0x01, // 208: V2 += 1
+            0x12, 0x00  // 20A: jump 200
+        };
+        expectSameAsScheduler(prog, sizeof(prog), 300);
+
+        Chip8 c8;
+        setupLane(c8, 4, prog, sizeof(prog)); // V7 = 4, key 4 down
+        c8.run(5);
+        EXPECT_EQ(c8.V[7], 0x14);
+        EXPECT_EQ(c8.V[1], 0); // skipped, key 4 is down
+        EXPECT_EQ(c8.V[2], 1);
+    }
+
+    // Calls deeper than 16 levels and returns off an empty stack wrap round, in the lanes as on their own
+    TEST(Chip8LanesTest, StackWraps) {
+        const unsigned char recursion[] = {
+            0x71, 0x01, // 200: V1 += 1
+            0x51, 0x70, // 202: skip if V1 == V7, lane 0 goes 256 deep
+            0x22, 0x00, // 204: call 200
+            0x00, 0xEE  // 206: return, more often than it was called
+        };
+        expectSameAsScheduler(recursion, sizeof(recursion), 2000);
+
+        const unsigned char empty[] = {
+            0x00, 0xEE  // 200: return with nothing called
+        };
+        expectSameAsScheduler(empty, sizeof(empty), 100);
+    }
+
+    // Each lane patches its own code differently, the shared decoding must not leak between lanes.
+    TEST(Chip8LanesTest, SelfModifyingCode) {
+        const unsigned char prog[] = {
+            0x61, 0x23, // 200: V1 = 0x23
+            0xA2, 0x0A, // 202: I = 20A
+            0x12, 0x0A, // 204: jump 20A
+            0x00, 0x00,
+            0x00, 0x00,
+            0x62, 0x01, // 20A: V2 = 1, gets patched to 6X23 (X from V0)
+            0xF1, 0x55, // 20C: store V0, V1 at 20A
+            0x12, 0x0A  // 20E: jump 20A
+        };
+        expectSameAsScheduler(prog, sizeof(prog), 100);
+    }
+
+    // Lanes without a key park on FX0A, the rest carry on. A key later wakes them up.
+    TEST(Chip8LanesTest, WaitKey) {
+        const unsigned char prog[] = {
+            0xF3, 0x0A, // 200: V3 = key
+            0x74, 0x01, // 202: V4 += 1
+            0x12, 0x02  // 204: jump 202
+        };
+        Chip8Lanes *lanes = new Chip8Lanes();
+        Chip8 c8;
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            c8.initialize();
+            setupLane(c8, l, prog, sizeof(prog));
+            lanes->load(l, c8);
+        }
+        lanes->run(10);
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            lanes->store(l, c8);
+            EXPECT_EQ(c8.waitingForKey, l % 3 == 0);
+            EXPECT_EQ(c8.V[4], l % 3 ? 5 : 0);
+            EXPECT_EQ(c8.V[3], l % 3 ? l % 16 : 0);
+        }
+        lanes->keyDown(0, 0xB);
+        lanes->run();
+        lanes->store(0, c8);
+        EXPECT_FALSE(c8.waitingForKey);
+        EXPECT_EQ(c8.V[3], 0xB);
+        EXPECT_EQ(c8.V[4], 5);
+        delete lanes;
+    }
+
+}  // namespace
@@ -0,0 +1,190 @@
+//
+//  Chip8PixelsTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/29/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "chip8.hpp"
+#include "pixels.hpp"
+#include "render.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Something on both planes in both halves of the screen, so every palette entry shows up
+    void fillScreen(Chip8 &c8)
+    {
+        uint64_t seed = 12345;
+        for(int i = 0; i < DISPLAY_PLANES * 2 * DISPLAY_ROWS; ++i)
+            c8.gfx[i] = (uint64_t)Chip8::nextRandom(seed) << 56 ^ (uint64_t)Chip8::nextRandom(seed) << 29 ^
+                        Chip8::nextRandom(seed) * 0x0101010101ULL;
+    }
+
+    std::vector<unsigned char> render(const Chip8 &c8, PixelOptions options)
+    {
+        size_t rowBytes = (size_t)pixelWidth(c8.hires, options.scale) * bytesPerPixel(options.format);
+        size_t pitch = options.pitch ? options.pitch : rowBytes;
+        std::vector<unsigned char> out(pitch * pixelHeight(c8.hires, options.scale), 0xCD);
+        renderPixels(c8, options, out.data());
+        return out;
+    }
+
+    TEST(Chip8PixelsTest, GrayMatchesRenderGrayRows) {
+        Chip8 c8;
+        fillScreen(c8);
+        for(int hires = 0; hires < 2; ++hires)
+        {
+            c8.hires = hires;
+            unsigned char gray[128 * 64];
+            renderGrayRows(c8, ~0ULL, gray);
+            PixelOptions options;
+            options.format = PIXEL_GRAY8;
+            options.path = PIXEL_SCALAR;
+            std::vector<unsigned char> out = render(c8, options);
+            ASSERT_EQ(out.size(), (size_t)c8.width() * c8.height());
+            EXPECT_EQ(memcmp(out.data(), gray, out.size()), 0);
+        }
+    }
+
+    TEST(Chip8PixelsTest, FormatsAndScale) {
+        Chip8 c8;
+        fillScreen(c8);
+        PixelOptions options;
+        options.path = PIXEL_SCALAR;
+        options.palette = &amberPalette;
+        options.scale = 3;
+        options.format = PIXEL_RGBA8;
+        std::vector<unsigned char> rgba = render(c8, options);
+        options.format = PIXEL_ARGB32;
+        std::vector<unsigned char> argb = render(c8, options);
+        int width = pixelWidth(false, 3);
+        for(int y = 0; y < pixelHeight(false, 3); ++y)
+            for(int x = 0; x < width; ++x)
+            {
+                uint32_t color = amberPalette.colors[c8.pixel(x / 3, y / 3)];
+                const unsigned char *p = &rgba[(y * width + x) * 4];
+                ASSERT_EQ(p[0], color >> 16 & 0xFF) << x << "," << y;
+                ASSERT_EQ(p[1], color >> 8 & 0xFF);
+                ASSERT_EQ(p[2], color & 0xFF);
+                ASSERT_EQ(p[3], color >> 24);
+                uint32_t word;
+                memcpy(&word, &argb[(y * width + x) * 4], 4);
+                ASSERT_EQ(word, color);
+            }
+        EXPECT_EQ(displayScale(false, 5), 10);
+        EXPECT_EQ(displayScale(true, 5), 5);
+    }
+
+    TEST(Chip8PixelsTest, Pitch) {
+        Chip8 c8;
+        fillScreen(c8);
+        PixelOptions options;
+        options.scale = 2;
+        std::vector<unsigned char> tight = render(c8, options);
+        options.pitch = 128 * 4 + 40;
+        std::vector<unsigned char> padded = render(c8, options);
+        for(int y = 0; y < 64; ++y)
+        {
+            EXPECT_EQ(memcmp(&padded[y * options.pitch], &tight[y * 128 * 4], 128 * 4), 0);
+            EXPECT_EQ(padded[y * options.pitch + 128 * 4 + 39], 0xCD); // left alone
+        }
+    }
+
+    TEST(Chip8PixelsTest, Scanlines) {
+        Chip8 c8;
+        c8.gfx[0] = ~0ULL; // the top row lit
+        PixelOptions options;
+        options.path = PIXEL_SCALAR;
+        options.scale = 3;
+        options.filter = PIXEL_SCANLINES;
+        std::vector<unsigned char> out = render(c8, options);
+        size_t row = 64 * 3 * 4;
+        EXPECT_EQ(out[0], 255);
+        EXPECT_EQ(out[row], 255);
+        EXPECT_EQ(out[2 * row], 127); // the last of the three
+        EXPECT_EQ(out[2 * row + 3], 255); // alpha isn't touched
+        EXPECT_EQ(out[3 * row], 0);
+    }
+
+    TEST(Chip8PixelsTest, Smooth) {
+        Chip8 c8;
+        c8.gfx[1] = 1ULL << 62; // pixel (1, 1)
+        PixelOptions options;
+        options.path = PIXEL_SCALAR;
+        options.format = PIXEL_GRAY8;
+        options.filter = PIXEL_SMOOTH;
+        std::vector<unsigned char> out = render(c8, options);
+        // 1 2 1 each way: 255 / 2 at the pixel, 255 / 4 beside it, 255 / 8 at the corners (rounded up)
+        EXPECT_EQ(out[1 * 64 + 1], 64);
+        EXPECT_EQ(out[1 * 64 + 0], 32);
+        EXPECT_EQ(out[1 * 64 + 2], 32);
+        EXPECT_EQ(out[0 * 64 + 1], 32);
+        EXPECT_EQ(out[0 * 64 + 0], 16);
+        EXPECT_EQ(out[2 * 64 + 2], 16);
+        EXPECT_EQ(out[1 * 64 + 3], 0);
+    }
+
+    // Every SIMD path gives exactly what the plain one does, in every combination
+    TEST(Chip8PixelsTest, PathsAgree) {
+        Chip8 c8;
+        fillScreen(c8);
+        const PixelFormat formats[] = {PIXEL_GRAY8, PIXEL_RGBA8, PIXEL_ARGB32};
+        const PixelFilter filters[] = {PIXEL_SHARP, PIXEL_SCANLINES, PIXEL_SMOOTH};
+        const int scales[] = {1, 2, 3, 5, 8, 10};
+        EXPECT_GE(bestPixelPath(), PIXEL_SCALAR);
+        for(int hires = 0; hires < 2; ++hires)
+            for(PixelFormat format : formats)
+                for(PixelFilter filter : filters)
+                    for(int scale : scales)
+                    {
+                        c8.hires = hires;
+                        PixelOptions options;
+                        options.format = format;
+                        options.filter = filter;
+                        options.scale = scale;
+                        options.palette = &greenPalette;
+                        options.path = PIXEL_SCALAR;
+                        std::vector<unsigned char> expected = render(c8, options);
+                        for(int path = PIXEL_SSE2; path <= PIXEL_AVX2; ++path)
+                        {
+                            options.path = (PixelPath)path; // falls back if the build doesn't have it
+                            EXPECT_TRUE(render(c8, options) == expected)
+                                << "path " << path << " format " << format << " filter " << filter << " scale " << scale
+                                << " hires " << hires;
+                        }
+                    }
+    }
+
+    TEST(Chip8PixelsTest, Screenshot) {
+        Chip8 c8;
+        fillScreen(c8);
+        char name[] = "/tmp/chip8pixelsXXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        PixelOptions options;
+        options.scale = 2;
+        ASSERT_TRUE(saveScreenshot(name, c8.gfx, false, options));
+
+        FILE *file = fopen(name, "rb");
+        std::vector<unsigned char> data(200000);
+        data.resize(fread(data.data(), 1, data.size(), file));
+        fclose(file);
+        remove(name);
+        const char header[] = "P7\nWIDTH 128\nHEIGHT 64\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+        ASSERT_EQ(data.size(), strlen(header) + 128 * 64 * 4);
+        EXPECT_EQ(memcmp(data.data(), header, strlen(header)), 0);
+        std::vector<unsigned char> image = render(c8, options);
+        EXPECT_EQ(memcmp(data.data() + strlen(header), image.data(), image.size()), 0);
+
+        EXPECT_TRUE(findPalette("green") == &greenPalette);
+        EXPECT_TRUE(findPalette("purple") == NULL);
+    }
+
+}  // namespace
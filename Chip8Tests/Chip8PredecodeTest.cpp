@@ -0,0 +1,168 @@
+//
+//  Chip8PredecodeTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/2/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include "chip8.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+    
+    // Decoding pulls out the handler and operands.
+    TEST(Chip8PredecodeTest, Decode) {
+        DecodedOp op = Chip8::decode(0x8AB4);
+        EXPECT_EQ(op.handler, Chip8::H_AddReg);
+        EXPECT_EQ(op.x, 0xA);
+        EXPECT_EQ(op.y, 0xB);
+        
+        op = Chip8::decode(0x3C42);
+        EXPECT_EQ(op.handler, Chip8::H_SkipEqImm);
+        EXPECT_EQ(op.x, 0xC);
+        EXPECT_EQ(op.imm, 0x42);
+        
+        op = Chip8::decode(0x5121); // 5XY0 needs a zero low nibble
+        EXPECT_EQ(op.handler, Chip8::H_Unknown);
+    }
+    
+    // Cached and uncached runs end up in the same state.
+    TEST(Chip8PredecodeTest, MatchesUncached) {
+        const unsigned char prog[] = {
+            0x60, 0x07, // V0 = 7
+            0x61, 0xFE, // V1 = 0xFE
+            0x80, 0x14, // V0 += V1
+            0x70, 0x03, // V0 += 3
+            0x30, 0x10, // skip if V0 == 0x10
+            0x12, 0x04, // jump 204
+            0x12, 0x0C  // jump 20C (park)
+        };
+        Chip8 cached, uncached;
+        uncached.predecode = false;
+        cached.loadRom(prog, sizeof(prog));
+        uncached.loadRom(prog, sizeof(prog));
+        for(int i = 0; i < 500; ++i)
+        {
+            cached.emulateCycle();
+            uncached.emulateCycle();
+        }
+        EXPECT_EQ(cached.pc, uncached.pc);
+        EXPECT_THAT(cached.V, testing::ElementsAreArray(uncached.V, 16));
+    }
+    
+    // 8XY6 and 8XYE put the bit shifted out in VF
+    TEST(Chip8PredecodeTest, ShiftFlags) {
+        const unsigned char prog[] = {
+            0x60, 0x81, // 200: V0 = 0x81
+            0x80, 0x06, // 202: V0 >>= 1
+            0x81, 0xF0, // 204: V1 = VF
+            0x80, 0x06, // 206: V0 >>= 1, bit 0 clear
+            0x82, 0xF0, // 208: V2 = VF
+            0x63, 0x81, // 20A: V3 = 0x81
+            0x83, 0x0E, // 20C: V3 <<= 1
+            0x84, 0xF0, // 20E: V4 = VF
+            0x83, 0x0E, // 210: V3 <<= 1, bit 7 clear
+            0x85, 0xF0  // 212: V5 = VF
+        };
+        Chip8 c8;
+        c8.loadRom(prog, sizeof(prog));
+        c8.run(10);
+        EXPECT_EQ(c8.V[0], 0x20);
+        EXPECT_EQ(c8.V[1], 1);
+        EXPECT_EQ(c8.V[2], 0);
+        EXPECT_EQ(c8.V[3], 0x04);
+        EXPECT_EQ(c8.V[4], 1);
+        EXPECT_EQ(c8.V[5], 0);
+    }
+    
+    // FX55 rewriting the next instruction has to be picked up.
+    TEST(Chip8PredecodeTest, SelfModifyingCode) {
+        const unsigned char prog[] = {
+            0x60, 0x61, // 200: V0 = 0x61
+            0x61, 0x23, // 202: V1 = 0x23
+            0xA2, 0x0A, // 204: I = 20A
+            0x12, 0x0A, // 206: jump 20A (decodes 20A before it's patched)
+            0x00, 0x00,
+            0x62, 0x01, // 20A: V2 = 1, gets patched to 6123 (V1 = 0x23)
+            0xF1, 0x55, // 20C: store V0, V1 at 20A
+            0x12, 0x0A  // 20E: jump 20A
+        };
+        Chip8 c8;
+        c8.loadRom(prog, sizeof(prog));
+        for(int i = 0; i < 7; ++i)
+            c8.emulateCycle();
+        EXPECT_EQ(c8.V[2], 1);
+        EXPECT_EQ(c8.pc, 0x20A);
+        c8.emulateCycle(); // runs the patched instruction
+        EXPECT_EQ(c8.opcode, 0x6123);
+        EXPECT_EQ(c8.V[1], 0x23);
+    }
+    
+    // The compile time table agrees with handlerFor for every opcode, X included.
+    TEST(Chip8PredecodeTest, HandlerTable) {
+        for(int opcode = 0; opcode <= 0xFFFF; ++opcode)
+            ASSERT_EQ(Chip8::decode(opcode).handler, Chip8::handlerFor(opcode)) << std::hex << opcode;
+        EXPECT_EQ(Chip8::decode(0x00E0).handler, Chip8::H_ClearScreen);
+        EXPECT_EQ(Chip8::decode(0x00EE).handler, Chip8::H_Return);
+        EXPECT_EQ(Chip8::decode(0xF30A).handler, Chip8::H_WaitKey);
+        EXPECT_EQ(Chip8::decode(0xE59F).handler, Chip8::H_Unknown);
+        EXPECT_EQ(Chip8::decode(0xD125).imm, 5);
+    }
+    
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+    // The computed goto loop ends up where emulateCycle's switch does, self-modifying code included.
+    TEST(Chip8PredecodeTest, ThreadedMatchesSwitch) {
+        const unsigned char prog[] = {
+            0x60, 0x61, // 200: V0 = 0x61
+            0x61, 0x23, // 202: V1 = 0x23
+            0xA2, 0x0A, // 204: I = 20A
+            0x12, 0x0A, // 206: jump 20A
+            0x00, 0x00,
+            0x62, 0x01, // 20A: V2 = 1, gets patched to 6123
+            0xF1, 0x55, // 20C: store V0, V1 at 20A
+            0x72, 0x05, // 20E: V2 += 5
+            0x82, 0x04, // 210: V2 += V0
+            0xF2, 0x29, // 212: I = font(V2)
+            0xD0, 0x15, // 214: draw
+            0xA2, 0x0A, // 216: I = 20A
+            0x12, 0x0A  // 218: jump 20A
+        };
+        Chip8 *threaded = new Chip8();
+        Chip8 *switched = new Chip8();
+        threaded->loadRom(prog, sizeof(prog));
+        switched->loadRom(prog, sizeof(prog));
+        
+        EXPECT_EQ(threaded->runThreaded(1000), 1000u);
+        for(int i = 0; i < 1000; ++i)
+            switched->emulateCycle();
+        
+        EXPECT_EQ(threaded->pc, switched->pc);
+        EXPECT_EQ(threaded->I, switched->I);
+        EXPECT_EQ(threaded->cycles, switched->cycles);
+        EXPECT_THAT(threaded->V, testing::ElementsAreArray(switched->V, 16));
+        EXPECT_THAT(threaded->gfx, testing::ElementsAreArray(switched->gfx));
+        delete threaded;
+        delete switched;
+    }
+    
+    // Stops on FX0A like run() does.
+    TEST(Chip8PredecodeTest, ThreadedStopsOnWaitKey) {
+        const unsigned char prog[] = {
+            0x60, 0x01, // 200: V0 = 1
+            0xF3, 0x0A, // 202: V3 = key
+            0x12, 0x00  // 204: jump 200
+        };
+        Chip8 c8;
+        c8.loadRom(prog, sizeof(prog));
+        EXPECT_EQ(c8.runThreaded(100), 2u);
+        EXPECT_TRUE(c8.waitingForKey);
+        c8.keyDown(7);
+        EXPECT_EQ(c8.V[3], 7);
+        EXPECT_EQ(c8.runThreaded(2), 2u);
+        EXPECT_EQ(c8.pc, 0x202);
+    }
+#endif
+    
+}  // namespace
@@ -0,0 +1,59 @@
+//
+//  Chip8ProfilerTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/20/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "chip8.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+// The test target is built with CHIP8_PROFILE, the other targets aren't
+#ifdef CHIP8_PROFILE
+#include "profiler.hpp"
+
+namespace {
+
+    TEST(Chip8ProfilerTest, CountsAndLoops) {
+        // 200: V0 += 1
+        // 202: skip if V0 == 4 (taken once every 4 times round, after wrapping at 4 below)
+        // 204: jump 200
+        // 206: V0 = 0
+        // 208: jump 200
+        const unsigned char rom[] = {0x70, 0x01, 0x30, 0x04, 0x12, 0x00, 0x60, 0x00, 0x12, 0x00};
+        Chip8 c8;
+        memcpy(&c8.memory[0x200], rom, sizeof(rom));
+        c8.invalidateAllDecoded();
+        Chip8Profile profile;
+        c8.profile = &profile;
+        c8.run(4000);
+
+        EXPECT_EQ(profile.total(), 4000u);
+        EXPECT_EQ(profile.pcCount[0x200] + profile.pcCount[0x202] + profile.pcCount[0x204] +
+                  profile.pcCount[0x206] + profile.pcCount[0x208], 4000u);
+        EXPECT_EQ(profile.handlerCount[Chip8::H_AddImm], profile.pcCount[0x200]);
+        EXPECT_EQ(profile.handlerCount[Chip8::H_SkipEqImm], profile.pcCount[0x202]);
+        // every fourth skip is taken
+        EXPECT_NEAR((double)profile.skipTaken[0x202] / profile.pcCount[0x202], 0.25, 0.01);
+        EXPECT_EQ(profile.skipTaken[0x200], 0u);
+        // both jumps go back to 200
+        EXPECT_EQ(profile.backJumps[0x204], profile.pcCount[0x204]);
+        EXPECT_EQ(profile.backTarget[0x208], 0x200);
+
+        Chip8Profile twice;
+        twice.merge(profile);
+        twice.merge(profile);
+        EXPECT_EQ(twice.total(), 8000u);
+
+        FILE *out = tmpfile();
+        profile.report(out, c8.memory);
+        long size = ftell(out);
+        EXPECT_GT(size, 100);
+        fclose(out);
+    }
+
+}  // namespace
+#endif
@@ -0,0 +1,107 @@
+//
+//  Chip8RandomTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/19/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "chip8.hpp"
+#include "lanes.hpp"
+#include "snapshot.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // C0FF: V0 = random, 8104: V1 += V0, 1200: loop
+    void loadRandomLoop(Chip8 &c8)
+    {
+        const unsigned char rom[] = {0xC0, 0xFF, 0x81, 0x04, 0x12, 0x00};
+        memcpy(c8.memory + 0x200, rom, sizeof(rom));
+        c8.invalidateAllDecoded();
+    }
+
+    // the values V0 takes over n trips round the loop
+    std::vector<int> draws(Chip8 &c8, int n)
+    {
+        std::vector<int> values;
+        for(int i = 0; i < n; ++i)
+        {
+            c8.run(3);
+            values.push_back(c8.V[0]);
+        }
+        return values;
+    }
+
+    TEST(Chip8RandomTest, SameSeedSameNumbers) {
+        Chip8 a, b;
+        a.seedRandom(42);
+        b.seedRandom(42);
+        loadRandomLoop(a);
+        loadRandomLoop(b);
+        std::vector<int> first = draws(a, 100);
+        EXPECT_EQ(first, draws(b, 100));
+        
+        // initialize() starts over from the same seed
+        a.initialize();
+        loadRandomLoop(a);
+        EXPECT_EQ(first, draws(a, 100));
+    }
+
+    TEST(Chip8RandomTest, SeedsDiffer) {
+        Chip8 a, b;
+        a.seedRandom(1);
+        b.seedRandom(2);
+        loadRandomLoop(a);
+        loadRandomLoop(b);
+        std::vector<int> values = draws(a, 100);
+        EXPECT_NE(values, draws(b, 100));
+        
+        // and it's not stuck on one value
+        std::sort(values.begin(), values.end());
+        EXPECT_GT(std::unique(values.begin(), values.end()) - values.begin(), 50);
+    }
+
+    TEST(Chip8RandomTest, SnapshotKeepsGenerator) {
+        Chip8 c8;
+        c8.seedRandom(7);
+        loadRandomLoop(c8);
+        draws(c8, 10);
+        std::vector<unsigned char> buf(snapshotSize());
+        saveSnapshot(c8, &buf[0]);
+
+        Chip8 restored;
+        ASSERT_TRUE(loadSnapshot(restored, &buf[0], buf.size()));
+        EXPECT_EQ(draws(c8, 100), draws(restored, 100));
+    }
+
+    TEST(Chip8RandomTest, LanesDrawLikeMachines) {
+        Chip8Lanes *lanes = new Chip8Lanes();
+        Chip8 c8;
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            c8.seedRandom(l);
+            c8.initialize();
+            loadRandomLoop(c8);
+            lanes->load(l, c8);
+        }
+        lanes->run(300);
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            Chip8 alone;
+            alone.seedRandom(l);
+            loadRandomLoop(alone);
+            alone.run(300);
+            lanes->store(l, c8);
+            SCOPED_TRACE(l);
+            EXPECT_EQ(c8.V[0], alone.V[0]);
+            EXPECT_EQ(c8.V[1], alone.V[1]);
+            EXPECT_EQ(c8.rng, alone.rng);
+        }
+        delete lanes;
+    }
+
+}  // namespace
@@ -0,0 +1,74 @@
+//
+//  Chip8RomStoreTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/19/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chip8.hpp"
+#include "romstore.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Writes a small ROM to a temp file, returns its name
+    std::string writeRom(const unsigned char *data, size_t size)
+    {
+        char path[] = "/tmp/chip8romXXXXXX";
+        int fd = mkstemp(path);
+        EXPECT_GE(fd, 0);
+        EXPECT_EQ(write(fd, data, size), (ssize_t)size);
+        close(fd);
+        return path;
+    }
+
+    const unsigned char shortRom[] = {0x60, 0x05, 0x12, 0x02};
+
+    // A short ROM must not leave whatever was in memory before behind it
+    TEST(Chip8RomStoreTest, LoadGameClearsTheRest) {
+        std::string path = writeRom(shortRom, sizeof(shortRom));
+        Chip8 c8;
+        memset(&c8.memory[0x200], 0xAB, 4096 - 0x200);
+        EXPECT_EQ(c8.loadGame(path.c_str()), 0);
+        EXPECT_EQ(c8.memory[0x200], 0x60);
+        EXPECT_EQ(c8.memory[0x203], 0x02);
+        EXPECT_EQ(c8.memory[0x204], 0);
+        EXPECT_EQ(c8.memory[0xFFF], 0);
+        unlink(path.c_str());
+    }
+
+    TEST(Chip8RomStoreTest, SharedImage) {
+        std::string path = writeRom(shortRom, sizeof(shortRom));
+        RomStore store;
+        const Rom *rom = store.get(path.c_str());
+        ASSERT_TRUE(rom != NULL);
+        EXPECT_EQ(rom->size, sizeof(shortRom));
+        EXPECT_EQ(rom->hash, RomStore::hash(shortRom, sizeof(shortRom)));
+        EXPECT_EQ(store.get(path.c_str()), rom); // mapped once
+        EXPECT_EQ(store.size(), 1u);
+        EXPECT_TRUE(store.get("/nonexistent/rom.ch8") == NULL);
+
+        Chip8 a, b;
+        memset(&b.memory[0x200], 0xAB, 4096 - 0x200);
+        EXPECT_TRUE(a.loadRom(rom->data, rom->size));
+        EXPECT_TRUE(b.loadRom(rom->data, rom->size));
+        EXPECT_EQ(memcmp(a.memory, b.memory, sizeof(a.memory)), 0);
+        a.run(10);
+        EXPECT_EQ(a.V[0], 5);
+        unlink(path.c_str());
+    }
+
+    TEST(Chip8RomStoreTest, TooBig) {
+        std::vector<unsigned char> big(MEMORY_SIZE, 0x11);
+        Chip8 c8;
+        EXPECT_FALSE(c8.loadRom(big.data(), big.size()));
+        EXPECT_EQ(c8.memory[MEMORY_SIZE - 1], 0x11);
+        EXPECT_EQ(c8.memory[0x1FF], 0); // nothing below 0x200 touched
+    }
+
+}  // namespace
@@ -0,0 +1,169 @@
+//
+//  Chip8RunAheadTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/30/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <string.h>
+#include <vector>
+#include "chip8.hpp"
+#include "audio.hpp"
+#include "runahead.hpp"
+#include "scheduler.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    /* A little game that touches everything a checkpoint has to put back: BCD of a counter at 0x300,
+     * a digit drawn at VA (which moves while key 0 is held), random numbers, the sound timer,
+     * XO-CHIP memory at 0x2000 and an instruction at 0x22A rewritten every time round (7D <VB>)
+     */
+    void loadGame(Chip8 &c8)
+    {
+        const unsigned char rom[] = {
+            0x6A, 0x00, 0x6B, 0x00,             // 200: VA = 0, VB = 0
+            0x7B, 0x01, 0xA3, 0x00, 0xFB, 0x33, // 204: VB += 1, I = 300, BCD VB
+            0xF2, 0x65, 0xF0, 0x29, 0xDA, 0x15, // 20A: V0-V2 = digits, I = font V0, draw at VA, V1
+            0xC3, 0x07, 0xE5, 0xA1, 0x7A, 0x04, // 210: V3 = random, unless key 0 is up VA += 4
+            0xF3, 0x18,                         // 216: sound = V3
+            0xF0, 0x00, 0x20, 0x00, 0xF3, 0x55, // 218: I = 2000, store V0-V3
+            0x6C, 0x7D, 0x8D, 0xB0, 0xA2, 0x2A, // 21E: VC = 7D, VD = VB, I = 22A
+            0x5C, 0xD2, 0x64, 0x00, 0x64, 0x00, // 224: store VC-VD, V4 = 0 twice
+            0x7D, 0x00, 0x8E, 0xD4, 0x12, 0x04  // 22A: VD += (rewritten), VE += VD, loop
+        };
+        c8.seedRandom(99);
+        c8.loadRom(rom, sizeof(rom));
+    }
+
+    std::vector<unsigned char> state(const Chip8 &c8)
+    {
+        std::vector<unsigned char> buf(snapshotSize());
+        saveSnapshot(c8, &buf[0]);
+        return buf;
+    }
+
+    // Restoring gives back exactly what was saved, and running on from there goes exactly as it did
+    TEST(Chip8RunAheadTest, CheckpointRoundTrip) {
+        Chip8 c8;
+        loadGame(c8);
+        Scheduler scheduler(c8);
+        scheduler.runInstructions(500);
+        while(c8.pc != 0x228) // the next instruction but one is the rewritten one
+            c8.run(1);
+
+        Chip8Checkpoint checkpoint;
+        checkpoint.save(c8);
+        std::vector<unsigned char> saved = state(c8);
+        scheduler.runInstructions(1500);
+        c8.keyDown(0);
+        scheduler.runInstructions(1500);
+        EXPECT_TRUE(state(c8) != saved);
+        ASSERT_TRUE(checkpoint.restore(c8));
+        EXPECT_TRUE(state(c8) == saved);
+        EXPECT_EQ(c8.writtenPages, 0u);
+
+        // the predecoded 7D NN at 0x22A must not be the one from the run that got undone
+        Chip8 fresh;
+        ASSERT_TRUE(loadSnapshot(fresh, &saved[0], saved.size()));
+        Scheduler freshScheduler(fresh);
+        c8.keyDown(0);
+        fresh.keyDown(0);
+        scheduler.runInstructions(2000);
+        freshScheduler.runInstructions(2000);
+        EXPECT_TRUE(state(c8) == state(fresh));
+    }
+
+    // Only the pages instructions write get marked, saving starts them over
+    TEST(Chip8RunAheadTest, WrittenPages) {
+        Chip8 c8;
+        loadGame(c8);
+        EXPECT_EQ(c8.writtenPages, ~0ULL); // just loaded, anything goes
+        Chip8Checkpoint checkpoint;
+        EXPECT_FALSE(checkpoint.restore(c8));
+        checkpoint.save(c8);
+        EXPECT_EQ(c8.writtenPages, 0u);
+        c8.run(100);
+        EXPECT_EQ(c8.writtenPages, 1ULL | 1ULL << 8); // 0x22A and 0x300, 0x2000
+    }
+
+    TEST(Chip8RunAheadTest, RestoreOntoAnotherMachine) {
+        Chip8 c8;
+        loadGame(c8);
+        c8.run(777);
+        Chip8Checkpoint checkpoint;
+        checkpoint.save(c8);
+
+        Chip8 other;
+        other.run(50);
+        ASSERT_TRUE(checkpoint.restore(other));
+        EXPECT_TRUE(state(other) == state(c8));
+        other.run(1000);
+        c8.run(1000);
+        EXPECT_TRUE(state(other) == state(c8));
+    }
+
+    // The screen ahead is the one the machine gets to frames later, and the machine doesn't move
+    TEST(Chip8RunAheadTest, ShowsTheFrameAhead) {
+        Chip8 c8;
+        loadGame(c8);
+        SoundRing ring;
+        Chip8Trace trace(TRACE_CAPACITY, TRACE_ALL);
+        c8.audio = &ring;
+        c8.trace = &trace;
+        Scheduler scheduler(c8);
+        RunAhead ahead(c8, scheduler);
+        ahead.frames = 3;
+        const int frame = DEFAULT_IPS / 60;
+
+        for(int i = 0; i < 40; ++i)
+        {
+            if(i == 10)
+                c8.keyDown(0);
+            if(i == 25)
+                c8.keyUp(0);
+            scheduler.runInstructions(frame);
+            SoundEdge edge;
+            while(ring.pop(edge))
+                ;
+            std::vector<unsigned char> before = state(c8);
+            unsigned long long traced = trace.recorded;
+
+            ahead.step();
+            EXPECT_TRUE(state(c8) == before) << "frame " << i;
+            EXPECT_EQ(trace.recorded, traced);
+            EXPECT_FALSE(ring.pop(edge));
+
+            Chip8 later;
+            ASSERT_TRUE(loadSnapshot(later, &before[0], before.size()));
+            Scheduler laterScheduler(later);
+            laterScheduler.runInstructions(3 * frame);
+            EXPECT_EQ(memcmp(ahead.gfx, later.gfx, sizeof(later.gfx)), 0) << "frame " << i;
+            EXPECT_EQ(ahead.cycles, later.cycles);
+        }
+        EXPECT_EQ(ahead.steps, 40u);
+        EXPECT_EQ(ahead.instructions, 40u * 3 * frame);
+        EXPECT_GT(ahead.nanoseconds, ahead.checkpointNanoseconds);
+    }
+
+    // step() only says the screen changed when it did
+    TEST(Chip8RunAheadTest, ReportsChanges) {
+        Chip8 c8;
+        c8.memory[0x200] = 0x12; // 1200: spin
+        c8.memory[0x201] = 0x00;
+        c8.invalidateAllDecoded();
+        Scheduler scheduler(c8);
+        RunAhead ahead(c8, scheduler);
+        ahead.frames = 2;
+        EXPECT_TRUE(ahead.step()); // the first always goes out
+        scheduler.runInstructions(10);
+        EXPECT_FALSE(ahead.step());
+        c8.gfx[0] = 1;
+        EXPECT_TRUE(ahead.step());
+        EXPECT_FALSE(ahead.step());
+    }
+
+}  // namespace
@@ -0,0 +1,90 @@
+//
+//  Chip8SchedulerTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/13/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+    
+    // 1200: jump 200 forever
+    void loadSpin(Chip8 &c8)
+    {
+        c8.memory[0x200] = 0x12;
+        c8.memory[0x201] = 0x00;
+        c8.invalidateAllDecoded();
+    }
+    
+    // Timers tick once per ips / 60 instructions, not once per instruction
+    TEST(Chip8SchedulerTest, TimersTickAt60Hz) {
+        Chip8 c8;
+        loadSpin(c8);
+        c8.delay_timer = 20;
+        Scheduler scheduler(c8);
+        scheduler.setIPS(600);
+        
+        EXPECT_EQ(scheduler.runInstructions(9), 9);
+        EXPECT_EQ(c8.delay_timer, 20);
+        scheduler.runInstructions(1);
+        EXPECT_EQ(c8.delay_timer, 19);
+        scheduler.runInstructions(190);
+        EXPECT_EQ(c8.delay_timer, 0);
+        EXPECT_EQ(c8.cycles, 200);
+    }
+    
+    // ips that doesn't divide by 60 still gets exactly 60 ticks per emulated second
+    TEST(Chip8SchedulerTest, UnevenIPS) {
+        Chip8 c8;
+        loadSpin(c8);
+        c8.delay_timer = 200;
+        Scheduler scheduler(c8);
+        scheduler.setIPS(1000);
+        scheduler.runInstructions(1000);
+        EXPECT_EQ(c8.delay_timer, 140);
+    }
+    
+    // Unthrottled update runs one batch straight away
+    TEST(Chip8SchedulerTest, Unthrottled) {
+        Chip8 c8;
+        loadSpin(c8);
+        Scheduler scheduler(c8);
+        scheduler.throttle = false;
+        scheduler.batch = 5000;
+        EXPECT_EQ(scheduler.update(), 5000);
+        EXPECT_EQ(c8.cycles, 5000);
+    }
+    
+    // FX0A parks the machine, timers keep going, keyDown wakes it with the key in VX
+    TEST(Chip8SchedulerTest, WaitForKey) {
+        Chip8 c8;
+        c8.memory[0x200] = 0xF3; // FX0A
+        c8.memory[0x201] = 0x0A;
+        c8.memory[0x202] = 0x12; // jump 202
+        c8.memory[0x203] = 0x02;
+        c8.invalidateAllDecoded();
+        c8.delay_timer = 5;
+        Scheduler scheduler(c8);
+        scheduler.setIPS(600);
+        
+        EXPECT_EQ(scheduler.runInstructions(100), 1);
+        EXPECT_TRUE(c8.waitingForKey);
+        EXPECT_EQ(c8.pc, 0x200);
+        EXPECT_EQ(scheduler.runInstructions(100), 0);
+        
+        scheduler.idle(30);
+        EXPECT_EQ(c8.delay_timer, 2);
+        
+        c8.keyDown(0xF);
+        EXPECT_FALSE(c8.waitingForKey);
+        EXPECT_EQ(c8.V[3], 0xF);
+        EXPECT_EQ(c8.pc, 0x202);
+        EXPECT_EQ(scheduler.runInstructions(100), 100);
+    }
+    
+}  // namespace
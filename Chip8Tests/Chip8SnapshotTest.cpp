@@ -0,0 +1,100 @@
+//
+//  Chip8SnapshotTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/16/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <string.h>
+#include <vector>
+#include "chip8.hpp"
+#include "snapshot.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // 7001: V0 += 1, 6105: V1 = 5, F129: I = font(V1), D015: draw, 1200: loop
+    void loadCounter(Chip8 &c8)
+    {
+        const unsigned char rom[] = {0x70, 0x01, 0x61, 0x05, 0xF1, 0x29, 0x00, 0xE0, 0xD0, 0x15, 0x12, 0x00};
+        memcpy(c8.memory + 0x200, rom, sizeof(rom));
+        c8.invalidateAllDecoded();
+    }
+
+    void expectSameState(const Chip8 &a, const Chip8 &b)
+    {
+        EXPECT_EQ(memcmp(a.memory, b.memory, sizeof(a.memory)), 0);
+        EXPECT_EQ(memcmp(a.V, b.V, sizeof(a.V)), 0);
+        EXPECT_EQ(memcmp(a.gfx, b.gfx, sizeof(a.gfx)), 0);
+        EXPECT_EQ(memcmp(a.stack, b.stack, sizeof(a.stack)), 0);
+        EXPECT_EQ(a.pc, b.pc);
+        EXPECT_EQ(a.I, b.I);
+        EXPECT_EQ(a.sp, b.sp);
+        EXPECT_EQ(a.cycles, b.cycles);
+    }
+
+    TEST(Chip8SnapshotTest, RoundTrip) {
+        Chip8 c8;
+        loadCounter(c8);
+        c8.run(123);
+        c8.delay_timer = 7;
+        std::vector<unsigned char> buf(snapshotSize());
+        saveSnapshot(c8, &buf[0]);
+
+        Chip8 restored;
+        ASSERT_TRUE(loadSnapshot(restored, &buf[0], buf.size()));
+        expectSameState(c8, restored);
+        EXPECT_EQ(restored.delay_timer, 7);
+
+        // both carry on identically, restore must not leave stale predecoded ops behind
+        c8.run(1000);
+        restored.run(1000);
+        expectSameState(c8, restored);
+    }
+
+    TEST(Chip8SnapshotTest, RejectsBadData) {
+        Chip8 c8;
+        std::vector<unsigned char> buf(snapshotSize());
+        saveSnapshot(c8, &buf[0]);
+        EXPECT_FALSE(loadSnapshot(c8, &buf[0], buf.size() - 1));
+        buf[4] = SNAPSHOT_VERSION + 1; // version from the future
+        EXPECT_FALSE(loadSnapshot(c8, &buf[0], buf.size()));
+    }
+
+    // Rewinding to any frame gives back exactly the state pushed then, and frames stay small
+    TEST(Chip8SnapshotTest, Rewind) {
+        Chip8 c8;
+        loadCounter(c8);
+        RewindBuffer rewind(100, 10);
+        std::vector<std::vector<unsigned char> > frames;
+        for(int f = 0; f < 150; ++f)
+        {
+            c8.run(10);
+            rewind.push(c8);
+            frames.push_back(std::vector<unsigned char>(snapshotSize()));
+            saveSnapshot(c8, &frames.back()[0]);
+        }
+        // oldest keyframe groups went to make room
+        EXPECT_LE(rewind.frames(), 100);
+        EXPECT_GT(rewind.frames(), 90);
+        EXPECT_LT(rewind.bytesUsed(), rewind.frames() * 100);
+        EXPECT_FALSE(rewind.rewind(c8, rewind.frames()));
+
+        std::vector<unsigned char> now(snapshotSize());
+        ASSERT_TRUE(rewind.rewind(c8, 37));
+        saveSnapshot(c8, &now[0]);
+        EXPECT_EQ(now, frames[149 - 37]);
+
+        // newer frames are gone, pushing carries on from here
+        ASSERT_TRUE(rewind.rewind(c8, 5));
+        saveSnapshot(c8, &now[0]);
+        EXPECT_EQ(now, frames[149 - 42]);
+        c8.run(10);
+        rewind.push(c8);
+        ASSERT_TRUE(rewind.rewind(c8, 1));
+        saveSnapshot(c8, &now[0]);
+        EXPECT_EQ(now, frames[149 - 42]);
+    }
+
+}
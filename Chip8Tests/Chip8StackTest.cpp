@@ -0,0 +1,111 @@
+//
+//  Chip8StackTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/30/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include "chip8.hpp"
+#include "chip8aot.hpp"
+#include "chip8jit.hpp"
+#include "lanes.hpp"
+#include "romstore.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    /* Chip8AotStackReturn.cpp and Chip8AotStackCall.cpp are these ROMs through Chip8Batch --recompile
+     * (saved as stackreturn.ch8 and stackcall.ch8).
+     */
+    const unsigned char emptyReturn[] = {
+        0x00, 0xEE  // 200: return with nothing called
+    };
+
+    const unsigned char endlessCall[] = {
+        0x22, 0x00  // 200: call 200, 16 levels are gone in 16 cycles
+    };
+
+    void expectSame(const Chip8 &a, const Chip8 &b)
+    {
+        EXPECT_EQ(a.pc, b.pc);
+        EXPECT_EQ(a.sp, b.sp);
+        EXPECT_EQ(a.cycles, b.cycles);
+        EXPECT_EQ(a.displayHash(), b.displayHash());
+        EXPECT_THAT(a.V, testing::ElementsAreArray(b.V, 16));
+        EXPECT_THAT(a.stack, testing::ElementsAreArray(b.stack, 16));
+        EXPECT_THAT(a.memory, testing::ElementsAreArray(b.memory));
+    }
+
+    // The interpreter, the JIT, recompiled code and the lanes all keep sp inside the 16 levels
+    void expectSameEverywhere(const unsigned char *rom, int size, unsigned long cycles)
+    {
+        Chip8 *interpreted = new Chip8();
+        interpreted->loadRom(rom, size);
+        interpreted->run(cycles);
+        EXPECT_LT(interpreted->sp, 16);
+        Chip8 blank;
+        EXPECT_EQ(interpreted->displayHash(), blank.displayHash()); // nothing drawn, nothing overwritten
+
+        Chip8 *jitted = new Chip8();
+        jitted->loadRom(rom, size);
+        Chip8Jit jit(*jitted);
+        EXPECT_EQ(jit.run(cycles), cycles);
+        {
+            SCOPED_TRACE("jit");
+            expectSame(*jitted, *interpreted);
+        }
+
+        const AotModule *module = findAotModule(RomStore::hash(rom, size));
+        ASSERT_TRUE(module != NULL) << "Chip8AotStack*.cpp are out of date";
+        Chip8 *recompiled = new Chip8();
+        recompiled->loadRom(rom, size);
+        Chip8Aot aot(*recompiled, *module);
+        EXPECT_EQ(aot.run(cycles), cycles);
+        {
+            SCOPED_TRACE("aot");
+            expectSame(*recompiled, *interpreted);
+        }
+
+        Chip8Lanes *lanes = new Chip8Lanes();
+        Chip8 *laned = new Chip8();
+        laned->loadRom(rom, size);
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+            lanes->load(l, *laned);
+        lanes->run(cycles);
+        lanes->store(Chip8Lanes::LANES - 1, *laned);
+        {
+            SCOPED_TRACE("lanes");
+            expectSame(*laned, *interpreted);
+        }
+
+        delete laned;
+        delete lanes;
+        delete recompiled;
+        delete jitted;
+        delete interpreted;
+    }
+
+    TEST(Chip8StackTest, ReturnWithEmptyStack) {
+        expectSameEverywhere(emptyReturn, sizeof(emptyReturn), 1000);
+
+        Chip8 c8;
+        c8.loadRom(emptyReturn, sizeof(emptyReturn));
+        c8.run(1);
+        EXPECT_EQ(c8.sp, 15);
+        EXPECT_EQ(c8.pc, 2); // stack[15] + 2
+    }
+
+    TEST(Chip8StackTest, CallPastSixteenLevels) {
+        expectSameEverywhere(endlessCall, sizeof(endlessCall), 1000);
+
+        Chip8 c8;
+        c8.loadRom(endlessCall, sizeof(endlessCall));
+        c8.run(17);
+        EXPECT_EQ(c8.sp, 1); // the 17th call went back to the bottom
+        EXPECT_EQ(c8.pc, 0x200);
+        EXPECT_EQ(c8.stack[0], 0x200);
+    }
+
+}  // namespace
@@ -0,0 +1,305 @@
+//
+//  Chip8SuperChipTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/24/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "chip8.hpp"
+#include "chip8jit.hpp"
+#include "lanes.hpp"
+#include "scheduler.hpp"
+#include "snapshot.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    void run(Chip8 &c8, unsigned short opcode)
+    {
+        c8.execute(Chip8::decode(opcode));
+    }
+
+    // DXYN / DXY0 with VX = x, VY = y and I = sprite
+    void draw(Chip8 &c8, int x, int y, int height, unsigned short sprite)
+    {
+        c8.V[1] = x;
+        c8.V[2] = y;
+        c8.I = sprite;
+        run(c8, 0xD120 | height);
+    }
+
+    TEST(Chip8SuperChipTest, Resolution) {
+        Chip8 c8;
+        EXPECT_FALSE(c8.hires);
+        draw(c8, 0, 0, 5, 0);
+        c8.dirtyRows = 0;
+        unsigned short pc = c8.pc;
+        run(c8, 0x00FF);
+        EXPECT_TRUE(c8.hires);
+        EXPECT_EQ(c8.width(), 128);
+        EXPECT_EQ(c8.height(), 64);
+        EXPECT_EQ(c8.gfx[0], 0u); // switching clears the screen
+        EXPECT_EQ(c8.dirtyRows, ~0ULL);
+        EXPECT_EQ(c8.pc, pc + 2);
+
+        // the start position wraps at 128x64 now
+        draw(c8, 130, 65, 5, 0);
+        EXPECT_EQ(c8.pixel(2, 1), 1);
+        EXPECT_EQ(c8.pixel(5, 5), 1);
+        run(c8, 0x00FE);
+        EXPECT_FALSE(c8.hires);
+        EXPECT_EQ(c8.pixel(2, 1), 0);
+    }
+
+    // A 16x16 sprite straddling the two words of a row, and clipped at the right edge
+    TEST(Chip8SuperChipTest, LargeSprite) {
+        Chip8 c8;
+        run(c8, 0x00FF);
+        for(int i = 0; i < 32; ++i)
+            c8.memory[0x300 + i] = i & 1 ? 0x01 : 0x80; // 1000000000000001
+        draw(c8, 56, 10, 0, 0x300);
+        EXPECT_EQ(c8.V[0xF], 0);
+        EXPECT_EQ(c8.plane(0, 0)[10], 0x80ULL);
+        EXPECT_EQ(c8.plane(0, 1)[10], 0x01ULL << 56);
+        EXPECT_EQ(c8.plane(0, 0)[25], 0x80ULL);
+        EXPECT_EQ(c8.plane(0, 0)[26], 0u);
+        EXPECT_EQ(c8.dirtyRows, ~0ULL); // from 00FF
+        c8.dirtyRows = 0;
+        draw(c8, 56, 10, 0, 0x300);
+        EXPECT_EQ(c8.V[0xF], 1);
+        EXPECT_EQ(c8.plane(0, 0)[10] | c8.plane(0, 1)[10], 0u);
+        EXPECT_EQ(c8.dirtyRows, 0xFFFFULL << 10);
+
+        draw(c8, 120, 60, 0, 0x300);
+        EXPECT_EQ(c8.pixel(120, 60), 1);
+        EXPECT_EQ(c8.pixel(0, 61), 0); // clipped, not wrapped
+        EXPECT_EQ(c8.dirtyRows, (0xFFFFULL << 10) | (0xFULL << 60));
+
+        // 8x10 font
+        c8.V[3] = 0xA;
+        run(c8, 0xF330);
+        EXPECT_EQ(c8.memory[c8.I], 0x7E); // top of "A"
+    }
+
+    TEST(Chip8SuperChipTest, Scrolling) {
+        Chip8 c8;
+        run(c8, 0x00FF);
+        draw(c8, 62, 0, 1, 0); // F0 across the word boundary: pixels 62-65
+        run(c8, 0x00C3); // down 3
+        EXPECT_EQ(c8.plane(0, 0)[0], 0u);
+        EXPECT_EQ(c8.plane(0, 0)[3], 0x3ULL);
+        EXPECT_EQ(c8.plane(0, 1)[3], 0x3ULL << 62);
+        run(c8, 0x00FB); // right 4: 66-69
+        EXPECT_EQ(c8.plane(0, 0)[3], 0u);
+        EXPECT_EQ(c8.plane(0, 1)[3], 0xFULL << 58);
+        run(c8, 0x00FC);
+        run(c8, 0x00FC); // left 8: 58-61
+        EXPECT_EQ(c8.plane(0, 0)[3], 0xFULL << 2);
+        EXPECT_EQ(c8.plane(0, 1)[3], 0u);
+        run(c8, 0x00D2); // up 2
+        EXPECT_EQ(c8.plane(0, 0)[1], 0xFULL << 2);
+        EXPECT_EQ(c8.plane(0, 0)[3], 0u);
+
+        // at 64x32 it's one word and 32 rows
+        Chip8 lores;
+        draw(lores, 0, 30, 2, 0);
+        run(lores, 0x00C1);
+        EXPECT_EQ(lores.gfx[31], 0xF0ULL << 56);
+        EXPECT_EQ(lores.gfx[32], 0u);
+        run(lores, 0x00FB);
+        EXPECT_EQ(lores.gfx[31], 0xF0ULL << 52);
+        EXPECT_EQ(lores.plane(0, 1)[31], 0u);
+    }
+
+    // FN01 picks planes, a sprite has one set of rows per selected plane
+    TEST(Chip8SuperChipTest, TwoPlanes) {
+        Chip8 c8;
+        const unsigned char sprite[] = {0xF0, 0xF0, 0xFF, 0x00}; // plane 0 rows, plane 1 rows
+        memcpy(c8.memory + 0x1000, sprite, sizeof(sprite));
+        run(c8, 0xF301);
+        EXPECT_EQ(c8.planes, 3);
+        draw(c8, 0, 0, 2, 0x1000);
+        EXPECT_EQ(c8.pixel(0, 0), 3);
+        EXPECT_EQ(c8.pixel(4, 0), 2);
+        EXPECT_EQ(c8.pixel(0, 1), 1);
+        EXPECT_EQ(c8.pixel(4, 1), 0);
+        unsigned char screen[64 * 32];
+        c8.unpackDisplay(screen);
+        EXPECT_EQ(screen[0], 3);
+        EXPECT_EQ(screen[64], 1);
+
+        // clearing plane 0 leaves plane 1
+        run(c8, 0xF101);
+        run(c8, 0x00E0);
+        EXPECT_EQ(c8.pixel(0, 0), 2);
+        EXPECT_EQ(c8.pixel(0, 1), 0);
+        run(c8, 0xF201);
+        run(c8, 0x00E0);
+        EXPECT_EQ(c8.pixel(0, 0), 0);
+    }
+
+    // A plain CHIP-8 screen hashes as it always did (FNV-1a over the 32 rows), plane 1 changes it
+    TEST(Chip8SuperChipTest, DisplayHash) {
+        Chip8 c8;
+        draw(c8, 3, 4, 5, 0);
+        unsigned long long hash = 14695981039346656037ULL;
+        for(int y = 0; y < 32; ++y)
+        {
+            hash ^= c8.gfx[y];
+            hash *= 1099511628211ULL;
+        }
+        EXPECT_EQ(c8.displayHash(), hash);
+        c8.plane(1, 0)[0] = 1;
+        EXPECT_NE(c8.displayHash(), hash);
+    }
+
+    // Skips step over all four bytes of F000 NNNN, on the interpreter and the JIT
+    TEST(Chip8SuperChipTest, SkipLongInstruction) {
+        const unsigned char prog[] = {
+            0x30, 0x00, // 200: skip if V0 == 0
+            0xF0, 0x00, // 202: I = 1234
+            0x12, 0x34,
+            0x71, 0x01, // 206: V1 += 1
+            0x40, 0x00, // 208: skip if V0 != 0
+            0xF0, 0x00, // 20A: I = 2345
+            0x23, 0x45,
+            0x72, 0x01, // 20E: V2 += 1
+            0x12, 0x00  // 210: jump 200
+        };
+        Chip8 *interpreted = new Chip8();
+        Chip8 *jitted = new Chip8();
+        interpreted->loadRom(prog, sizeof(prog));
+        jitted->loadRom(prog, sizeof(prog));
+        interpreted->run(2);
+        EXPECT_EQ(interpreted->pc, 0x208);
+        EXPECT_EQ(interpreted->V[1], 1);
+        interpreted->run(2);
+        EXPECT_EQ(interpreted->pc, 0x20E);
+        EXPECT_EQ(interpreted->I, 0x2345);
+        interpreted->run(1000);
+        Chip8Jit jit(*jitted);
+        jit.run(1004);
+        EXPECT_EQ(jitted->pc, interpreted->pc);
+        EXPECT_EQ(jitted->I, interpreted->I);
+        EXPECT_THAT(jitted->V, testing::ElementsAreArray(interpreted->V, 16));
+        delete jitted;
+        delete interpreted;
+    }
+
+    TEST(Chip8SuperChipTest, MemoryAndRegisters) {
+        Chip8 c8;
+        const unsigned char prog[] = {0xF0, 0x00, 0xFF, 0xF8}; // I = FFF8
+        c8.loadRom(prog, sizeof(prog));
+        c8.run(1);
+        EXPECT_EQ(c8.I, 0xFFF8);
+        EXPECT_EQ(c8.pc, 0x204);
+        for(int i = 0; i < 16; ++i)
+            c8.V[i] = i + 1;
+        run(c8, 0xF955); // V0-V9 at FFF8, wraps at 64K
+        EXPECT_EQ(c8.memory[0xFFFF], 8);
+        EXPECT_EQ(c8.memory[0x0001], 10);
+
+        // 5XY2 / 5XY3 leave I alone and go either way round
+        c8.I = 0x1000;
+        run(c8, 0x5362);
+        EXPECT_EQ(c8.I, 0x1000);
+        EXPECT_EQ(c8.memory[0x1000], 4);
+        EXPECT_EQ(c8.memory[0x1003], 7);
+        run(c8, 0x5A73); // VA = 4 ... V7 = 7
+        EXPECT_EQ(c8.V[0xA], 4);
+        EXPECT_EQ(c8.V[0x7], 7);
+        EXPECT_EQ(c8.V[0x9], 5);
+
+        // flag registers
+        run(c8, 0xF275);
+        memset(c8.V, 0, sizeof(c8.V));
+        run(c8, 0xF185);
+        EXPECT_EQ(c8.V[0], 1);
+        EXPECT_EQ(c8.V[1], 2);
+        EXPECT_EQ(c8.V[2], 0);
+
+        // audio
+        c8.V[5] = 200;
+        run(c8, 0xF53A);
+        EXPECT_EQ(c8.pitch, 200);
+        c8.I = 0x1000;
+        run(c8, 0xF002);
+        EXPECT_EQ(c8.audioPattern[0], 4);
+    }
+
+    TEST(Chip8SuperChipTest, Snapshot) {
+        Chip8 c8;
+        run(c8, 0x00FF);
+        run(c8, 0xF201);
+        draw(c8, 100, 50, 0, 0);
+        c8.memory[0xF000] = 0x42;
+        c8.flags[3] = 9;
+        c8.pitch = 77;
+        std::vector<unsigned char> buf(snapshotSize());
+        saveSnapshot(c8, &buf[0]);
+        Chip8 restored;
+        ASSERT_TRUE(loadSnapshot(restored, &buf[0], buf.size()));
+        EXPECT_TRUE(restored.hires);
+        EXPECT_EQ(restored.planes, 2);
+        EXPECT_EQ(restored.memory[0xF000], 0x42);
+        EXPECT_EQ(restored.flags[3], 9);
+        EXPECT_EQ(restored.pitch, 77);
+        EXPECT_EQ(restored.displayHash(), c8.displayHash());
+    }
+
+    // Lanes run the CHIP-8 part and stop at 00FF, a Chip8 finishes and gets what a Scheduler got
+    TEST(Chip8SuperChipTest, LanesFallBack) {
+        const unsigned char prog[] = {
+            0x71, 0x01, // 200: V1 += 1
+            0x31, 0x40, // 202: skip if V1 == 40
+            0x12, 0x00, // 204: jump 200
+            0x00, 0xFF, // 206: hires
+            0xF3, 0x30, // 208: I = big font(V3)
+            0xD1, 0x2A, // 20A: draw 8x10
+            0x00, 0xC1, // 20C: scroll down 1
+            0x12, 0x0A  // 20E: jump 20A
+        };
+        Chip8Lanes *lanes = new Chip8Lanes();
+        Chip8 *c8 = new Chip8();
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            c8->initialize();
+            c8->loadRom(prog, sizeof(prog));
+            c8->V[1] = l;
+            c8->V[3] = l;
+            lanes->load(l, *c8);
+        }
+        lanes->run(500);
+        EXPECT_EQ(lanes->fallback, 0xFFFFFFFFu);
+
+        for(int l = 0; l < Chip8Lanes::LANES; ++l)
+        {
+            SCOPED_TRACE(l);
+            Chip8 *expected = new Chip8();
+            expected->loadRom(prog, sizeof(prog));
+            expected->V[1] = l;
+            expected->V[3] = l;
+            Scheduler scheduler(*expected);
+            scheduler.runInstructions(500);
+
+            c8->initialize();
+            c8->loadRom(prog, sizeof(prog));
+            lanes->store(l, *c8);
+            EXPECT_EQ(c8->pc, 0x206);
+            Scheduler rest(*c8);
+            rest.runInstructions(lanes->budget[l]);
+            EXPECT_EQ(c8->cycles, 500u);
+            EXPECT_EQ(c8->delay_timer, expected->delay_timer);
+            EXPECT_THAT(c8->V, testing::ElementsAreArray(expected->V, 16));
+            EXPECT_EQ(c8->displayHash(), expected->displayHash());
+            delete expected;
+        }
+        delete c8;
+        delete lanes;
+    }
+
+}  // namespace
@@ -0,0 +1,60 @@
+//
+//  Chip8ThreadPoolTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/9/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "threadpool.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    // Many more jobs than workers, every fourth one slow. Handed out round robin the slow ones all
+    // land on worker 0's deque, so the others run out and steal from it.
+    TEST(Chip8ThreadPoolTest, EveryJobRunsOnce) {
+        const int jobs = 400;
+        std::atomic<int> *ran = new std::atomic<int>[jobs];
+        for(int i = 0; i < jobs; ++i)
+            ran[i] = 0;
+        std::atomic<int> finished(0);
+
+        ThreadPool *pool = new ThreadPool(4);
+        ASSERT_EQ(pool->size(), 4);
+        for(int round = 0; round < 2; ++round)
+        {
+            for(int i = 0; i < jobs; ++i)
+                pool->submit([i, ran, &finished] {
+                    if(i % 4 == 0)
+                        std::this_thread::sleep_for(std::chrono::microseconds(500));
+                    ++ran[i];
+                    ++finished;
+                });
+            pool->wait();
+            // wait() only comes back once the last one is done, and it can be used again after
+            EXPECT_EQ(finished, jobs * (round + 1));
+            for(int i = 0; i < jobs; ++i)
+                EXPECT_EQ(ran[i], round + 1) << "job " << i;
+        }
+        EXPECT_GT(pool->steals(), 0u);
+        delete pool;
+        delete[] ran;
+    }
+
+    TEST(Chip8ThreadPoolTest, DestructorFinishesQueuedJobs) {
+        std::atomic<int> finished(0);
+        ThreadPool *pool = new ThreadPool(2);
+        for(int i = 0; i < 50; ++i)
+            pool->submit([&finished] {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                ++finished;
+            });
+        delete pool;
+        EXPECT_EQ(finished, 50);
+    }
+
+}  // namespace
@@ -0,0 +1,218 @@
+//
+//  Chip8TraceTest.cpp
+//  Chip8Tests
+//
+//  Created by Ruijing Li on 10/28/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include "chip8.hpp"
+#include "lanes.hpp"
+#include "trace.hpp"
+#include <GoogleMock/GoogleMock.h>
+
+namespace {
+
+    const unsigned char program[] = {
+        0x6A, 0x05, // 200: VA = 5
+        0x22, 0x08, // 202: call 208
+        0xD0, 0x01, // 204: draw
+        0x01, 0x23, // 206: unknown, pc stays here
+        0xA3, 0x00, // 208: I = 300
+        0x00, 0xEE  // 20A: return
+    };
+
+    TEST(Chip8TraceTest, OnlyUnknownByDefault) {
+        Chip8 c8;
+        Chip8Trace trace;
+        c8.trace = &trace;
+        c8.loadRom(program, sizeof(program));
+        c8.run(10);
+        EXPECT_EQ(trace.recorded, 5u); // the unknown opcode, over and over
+        EXPECT_EQ(trace.count(TRACE_UNKNOWN), 5u);
+        ASSERT_EQ(trace.size(), 5u);
+        const TraceEvent &event = trace.at(0);
+        EXPECT_EQ(event.type, TRACE_UNKNOWN);
+        EXPECT_EQ(event.pc, 0x206);
+        EXPECT_EQ(event.opcode, 0x0123);
+        EXPECT_EQ(event.cycle, 5u);
+        EXPECT_EQ(event.I, 0x300);
+        EXPECT_EQ(event.V[0xA], 5);
+        EXPECT_EQ(trace.at(4).cycle, 9u);
+    }
+
+    TEST(Chip8TraceTest, Filter) {
+        Chip8 c8;
+        Chip8Trace trace(TRACE_CAPACITY, TRACE_CALL | TRACE_RETURN | TRACE_DRAW);
+        c8.trace = &trace;
+        c8.loadRom(program, sizeof(program));
+        c8.run(10);
+        ASSERT_EQ(trace.size(), 3u);
+        EXPECT_EQ(trace.at(0).type, TRACE_CALL);
+        EXPECT_EQ(trace.at(0).pc, 0x202);
+        EXPECT_EQ(trace.at(0).sp, 0);
+        EXPECT_EQ(trace.at(1).type, TRACE_RETURN);
+        EXPECT_EQ(trace.at(1).pc, 0x20A);
+        EXPECT_EQ(trace.at(1).sp, 1);
+        EXPECT_EQ(trace.at(2).type, TRACE_DRAW);
+        EXPECT_EQ(trace.at(2).opcode, 0xD001);
+        EXPECT_EQ(trace.count(TRACE_ALL), 3u);
+        EXPECT_EQ(trace.count(TRACE_UNKNOWN), 0u);
+
+        // emulateCycle goes through the same handlers
+        Chip8 other;
+        Chip8Trace otherTrace(TRACE_CAPACITY, TRACE_ALL);
+        other.trace = &otherTrace;
+        other.loadRom(program, sizeof(program));
+        for(int i = 0; i < 10; ++i)
+            other.emulateCycle();
+        EXPECT_EQ(otherTrace.recorded, 8u);
+        EXPECT_EQ(otherTrace.count(TRACE_DRAW), 1u);
+    }
+
+    TEST(Chip8TraceTest, KeepsTheNewest) {
+        Chip8 c8;
+        Chip8Trace trace(5); // rounded up to 8
+        c8.trace = &trace;
+        c8.loadRom(program, sizeof(program));
+        c8.run(104);
+        EXPECT_EQ(trace.recorded, 99u); // cycles 5 to 103
+        ASSERT_EQ(trace.size(), 8u);
+        for(size_t i = 0; i < trace.size(); ++i)
+            EXPECT_EQ(trace.at(i).cycle, 96u + i);
+        trace.clear();
+        EXPECT_EQ(trace.size(), 0u);
+        EXPECT_EQ(trace.count(TRACE_UNKNOWN), 0u);
+    }
+
+    TEST(Chip8TraceTest, SaveLoadAndDump) {
+        Chip8 c8;
+        Chip8Trace trace(4, TRACE_ALL);
+        c8.trace = &trace;
+        c8.loadRom(program, sizeof(program));
+        c8.run(20);
+
+        char name[] = "/tmp/chip8traceXXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        ASSERT_TRUE(trace.save(name));
+
+        Chip8Trace loaded(1);
+        ASSERT_TRUE(loaded.load(name));
+        EXPECT_EQ(loaded.filter, (unsigned int)TRACE_ALL);
+        EXPECT_EQ(loaded.recorded, trace.recorded);
+        ASSERT_EQ(loaded.size(), trace.size());
+        for(size_t i = 0; i < trace.size(); ++i)
+            EXPECT_EQ(memcmp(&loaded.at(i), &trace.at(i), sizeof(TraceEvent)), 0);
+
+        FILE *out = tmpfile();
+        EXPECT_EQ(dumpTrace(name, out), 4);
+        rewind(out);
+        char line[256];
+        ASSERT_TRUE(fgets(line, sizeof(line), out) != NULL);
+        EXPECT_STREQ(line, "# 18 events recorded, the last 4 kept\n");
+        ASSERT_TRUE(fgets(line, sizeof(line), out) != NULL);
+        EXPECT_STREQ(line, "16 pc=0x206 op=0123 unknown I=0x300 sp=0 V=00 00 00 00 00 00 00 00 00 00 05 00 00 00 00 00\n");
+        fclose(out);
+        remove(name);
+
+        EXPECT_EQ(dumpTrace("/nonexistent/trace.c8tr", stdout), -1);
+    }
+
+    TEST(Chip8TraceTest, LoadIntoABiggerRing) {
+        Chip8 c8;
+        Chip8Trace trace(256);
+        c8.trace = &trace;
+        c8.loadRom(program, sizeof(program));
+        c8.run(1005);
+        ASSERT_EQ(trace.recorded, 1000u);
+
+        char name[] = "/tmp/chip8traceXXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        ASSERT_TRUE(trace.save(name));
+
+        Chip8Trace loaded;
+        ASSERT_TRUE(loaded.load(name));
+        EXPECT_EQ(loaded.recorded, 1000u);
+        ASSERT_EQ(loaded.size(), 256u);
+        EXPECT_EQ(loaded.at(0).cycle, 749u);
+        EXPECT_EQ(loaded.at(255).cycle, 1004u);
+
+        // a header promising more events than the file has is turned away before anything grows
+        FILE *file = fopen(name, "r+b");
+        ASSERT_TRUE(file != NULL);
+        const unsigned char huge[4] = {0xFF, 0xFF, 0xFF, 0x0F};
+        fseek(file, 14, SEEK_SET);
+        fwrite(huge, sizeof(huge), 1, file);
+        fclose(file);
+        EXPECT_FALSE(loaded.load(name));
+        remove(name);
+    }
+
+    TEST(Chip8TraceTest, ParseFilter) {
+        EXPECT_EQ(parseTraceFilter("unknown"), (unsigned int)TRACE_UNKNOWN);
+        EXPECT_EQ(parseTraceFilter("calls,returns"), (unsigned int)(TRACE_CALL | TRACE_RETURN));
+        EXPECT_EQ(parseTraceFilter("draws,all"), (unsigned int)TRACE_ALL);
+        EXPECT_EQ(parseTraceFilter("calls,jumps"), 0u);
+        EXPECT_EQ(parseTraceFilter(""), 0u);
+    }
+
+    // Each lane records into its own trace
+    TEST(Chip8TraceTest, Lanes) {
+        Chip8Lanes *lanes = new Chip8Lanes();
+        Chip8 *c8 = new Chip8();
+        Chip8Trace traces[2];
+        for(int l = 0; l < 2; ++l)
+        {
+            c8->initialize();
+            c8->loadRom(program, sizeof(program));
+            c8->V[0xA] = l; // the first instruction overwrites it, different until then
+            lanes->load(l, *c8);
+            lanes->trace[l] = &traces[l];
+        }
+        lanes->run(10);
+        for(int l = 0; l < 2; ++l)
+        {
+            EXPECT_EQ(traces[l].count(TRACE_UNKNOWN), 5u);
+            ASSERT_GT(traces[l].size(), 0u);
+            EXPECT_EQ(traces[l].at(0).pc, 0x206);
+            EXPECT_EQ(traces[l].at(0).V[0xA], 5);
+        }
+        delete c8;
+        delete lanes;
+    }
+
+    // Machines on different threads, nothing shared
+    TEST(Chip8TraceTest, PerMachine) {
+        const int machines = 4;
+        Chip8Trace *traces[machines];
+        std::thread threads[machines];
+        for(int i = 0; i < machines; ++i)
+        {
+            traces[i] = new Chip8Trace();
+            Chip8Trace *trace = traces[i];
+            threads[i] = std::thread([trace, i] {
+                Chip8 *c8 = new Chip8();
+                c8->trace = trace;
+                c8->loadRom(program, sizeof(program));
+                c8->run(1000 * (i + 1));
+                delete c8;
+            });
+        }
+        for(int i = 0; i < machines; ++i)
+        {
+            threads[i].join();
+            EXPECT_EQ(traces[i]->recorded, 1000u * (i + 1) - 5);
+            EXPECT_EQ(traces[i]->at(traces[i]->size() - 1).cycle, 1000u * (i + 1) - 1);
+            delete traces[i];
+        }
+    }
+
+}  // namespace
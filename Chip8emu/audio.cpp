@@ -0,0 +1,169 @@
+//
+//  audio.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/27/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "audio.hpp"
+#include <math.h>
+#include <string.h>
+#include "delta.hpp"
+
+SoundRing::SoundRing() : dropped(0), reached(0)
+{
+}
+
+bool SoundRing::push(const SoundEdge &edge)
+{
+    if(SpscRing<SoundEdge, 256>::push(edge))
+        return true;
+    ++dropped;
+    return false;
+}
+
+WavWriter::WavWriter() : samples(0), file(NULL), failed(false)
+{
+}
+
+WavWriter::~WavWriter()
+{
+    if(file)
+        close();
+}
+
+bool WavWriter::open(const char *path, unsigned int rate)
+{
+    file = fopen(path, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+    samples = 0;
+    failed = false;
+    // RIFF header, the two lengths get filled in by close()
+    unsigned char header[44];
+    memcpy(header, "RIFF\0\0\0\0WAVEfmt ", 16);
+    putLE(header + 16, 16, 4); // fmt chunk size
+    putLE(header + 20, 1, 2); // PCM
+    putLE(header + 22, 1, 2); // mono
+    putLE(header + 24, rate, 4);
+    putLE(header + 28, rate * 2, 4); // bytes per second
+    putLE(header + 32, 2, 2); // bytes per sample
+    putLE(header + 34, 16, 2); // bits
+    memcpy(header + 36, "data\0\0\0\0", 8);
+    failed = fwrite(header, sizeof(header), 1, file) != 1;
+    return !failed;
+}
+
+void WavWriter::write(const int16_t *data, size_t n)
+{
+    if(!file)
+        return;
+    unsigned char out[2 * SOUND_BUFFER];
+    while(n)
+    {
+        size_t count = n < SOUND_BUFFER ? n : SOUND_BUFFER;
+        for(size_t i = 0; i < count; ++i)
+            putLE(out + i * 2, (uint16_t)data[i], 2);
+        failed |= fwrite(out, 2, count, file) != count;
+        samples += count;
+        data += count;
+        n -= count;
+    }
+}
+
+bool WavWriter::close()
+{
+    if(!file)
+        return false;
+    unsigned char length[4];
+    putLE(length, (unsigned int)(36 + samples * 2), 4);
+    failed |= fseek(file, 4, SEEK_SET) != 0 || fwrite(length, 4, 1, file) != 1;
+    putLE(length, (unsigned int)(samples * 2), 4);
+    failed |= fseek(file, 40, SEEK_SET) != 0 || fwrite(length, 4, 1, file) != 1;
+    failed |= fclose(file) != 0;
+    file = NULL;
+    return !failed;
+}
+
+SoundSynth::SoundSynth(SoundRing &r, SoundSink &s, unsigned int i, unsigned int sampleRate) : ring(r), sink(s)
+{
+    ips = i ? i : 1;
+    rate = sampleRate;
+    position = 0;
+    volume = 8000;
+    edges = lateEdges = maxLate = 0;
+    memset(&current, 0, sizeof(current));
+    hasNext = false;
+    pattern = false;
+    phase = step = 0;
+}
+
+void SoundSynth::start(const SoundEdge &edge, unsigned long long at)
+{
+    ++edges;
+    unsigned long long due = sampleAt(edge.cycle);
+    if(due < at)
+    {
+        ++lateEdges;
+        maxLate = at - due > maxLate ? at - due : maxLate;
+    }
+    current = edge;
+    phase = 0; // every tone starts the same way
+    pattern = false;
+    for(int i = 0; i < 16; ++i)
+        pattern |= edge.pattern[i] != 0;
+    // XO-CHIP plays the pattern's 128 bits at 4000 * 2^((pitch - 64) / 48) bits a second
+    step = pattern ? 4000 * pow(2.0, (edge.pitch - 64) / 48.0) / rate : (double)SOUND_TONE / rate;
+}
+
+int16_t SoundSynth::sample()
+{
+    if(!current.on)
+        return 0;
+    bool high;
+    if(pattern)
+    {
+        int bit = (int)phase;
+        high = current.pattern[bit >> 3] >> (7 - (bit & 7)) & 1;
+        phase += step;
+        if(phase >= 128)
+            phase -= 128;
+    }
+    else
+    {
+        high = phase < 0.5;
+        phase += step;
+        if(phase >= 1)
+            phase -= 1;
+    }
+    return high ? volume : -volume;
+}
+
+unsigned long SoundSynth::update()
+{
+    // everything before the producer's time is settled, read it before the edges so none are missed
+    unsigned long long end = sampleAt(ring.time());
+    unsigned long written = 0;
+    while(position < end)
+    {
+        size_t n = end - position < SOUND_BUFFER ? (size_t)(end - position) : SOUND_BUFFER;
+        for(size_t i = 0; i < n; ++i)
+        {
+            unsigned long long at = position + i;
+            while((hasNext || (hasNext = ring.pop(next))) && sampleAt(next.cycle) <= at)
+            {
+                start(next, at);
+                hasNext = false;
+            }
+            buffer[i] = sample();
+        }
+        sink.write(buffer, n);
+        position += n;
+        written += n;
+    }
+    return (unsigned long)written;
+}
@@ -0,0 +1,125 @@
+//
+//  audio.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/27/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef audio_hpp
+#define audio_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include "scheduler.hpp"
+#include "spscring.hpp"
+
+/* Sound. The core never makes any itself: with a SoundRing attached (Chip8::audio) it notes when
+ * the tone goes on or off, stamped with the cycle it happens at, and carries on. A SoundSynth at
+ * the other end of the ring, on another thread if need be, turns those edges into samples at
+ * exactly the sample they belong at and hands them to a SoundSink a fixed size buffer at a time.
+ * Emulated time maps to samples as cycles * rate / ips, so a run sounds the same however fast
+ * the host ran it.
+ */
+
+#define SOUND_RATE 44100
+// samples the synth renders at a time, the most the sound can trail emulation by
+#define SOUND_BUFFER 512
+// the buzzer, for ROMs that haven't given an XO-CHIP pattern
+#define SOUND_TONE 440
+
+// The tone going on or off
+struct SoundEdge
+{
+    unsigned long long cycle; // Chip8::cycles from which it holds
+    bool on;
+    unsigned char pitch; // XO-CHIP playback pitch (FX3A) as it went on
+    unsigned char pattern[16]; // XO-CHIP audio pattern (F002) as it went on, all zero for the buzzer
+};
+
+/* The edges go through an SpscRing, along with how far the producer has got, so the consumer
+ * knows which samples can't change any more.
+ */
+class SoundRing : public SpscRing<SoundEdge, 256>
+{
+public:
+    SoundRing();
+    // Producer side. False if the ring is full: the edge is lost and counted in dropped.
+    bool push(const SoundEdge &);
+    // Producer side: emulation has reached this cycle, every edge before it has been pushed
+    void advance(unsigned long long cycle) { reached.store(cycle, std::memory_order_release); }
+    unsigned long long time() const { return reached.load(std::memory_order_acquire); }
+
+    unsigned long dropped; // producer side only
+
+private:
+    std::atomic<unsigned long long> reached;
+};
+
+// Where finished samples go: 16 bit signed mono
+class SoundSink
+{
+public:
+    virtual ~SoundSink() {}
+    virtual void write(const int16_t *samples, size_t n) = 0;
+};
+
+// 16 bit mono WAV file, for headless runs
+class WavWriter : public SoundSink
+{
+public:
+    WavWriter();
+    ~WavWriter(); // closes the file if it's still open
+    bool open(const char *path, unsigned int rate = SOUND_RATE);
+    void write(const int16_t *samples, size_t n) override;
+    // Fills in the lengths in the header. False if anything failed to write.
+    bool close();
+
+    unsigned long long samples;
+
+private:
+    FILE *file;
+    bool failed;
+};
+
+/* Consumer end: renders the tone from the edges in a ring. update() writes out every sample up to
+ * where the producer has got, so call it as often as the sink wants samples (once a frame
+ * headless, from the audio thread for a device).
+ */
+class SoundSynth
+{
+public:
+    SoundSynth(SoundRing &, SoundSink &, unsigned int ips = DEFAULT_IPS, unsigned int rate = SOUND_RATE);
+    // Returns how many samples were written
+    unsigned long update();
+    // Sample number a cycle starts at
+    unsigned long long sampleAt(unsigned long long cycle) const { return cycle * rate / ips; }
+
+    unsigned long long position; // samples written so far
+    int16_t volume;
+
+    // stats
+    unsigned long long edges;
+    unsigned long long lateEdges; // came in after the sample they belong at had been written
+    unsigned long long maxLate; // worst of those, in samples
+    // longest the sound can trail the emulation by, in seconds
+    double latency() const { return (double)SOUND_BUFFER / rate; }
+
+private:
+    SoundRing &ring;
+    SoundSink &sink;
+    unsigned int ips, rate;
+    SoundEdge current; // what's playing
+    SoundEdge next;
+    bool hasNext; // popped but not due yet
+    bool pattern; // current has an XO-CHIP pattern
+    double phase; // through the buzzer's cycle or the pattern's 128 bits
+    double step; // per sample
+    int16_t buffer[SOUND_BUFFER];
+
+    void start(const SoundEdge &, unsigned long long sample);
+    int16_t sample();
+};
+
+#endif /* audio_hpp */
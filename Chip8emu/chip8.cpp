@@ -7,9 +7,34 @@
 //
 
 #include "chip8.hpp"
+#include <string.h>
+#include "audio.hpp"
+#include "trace.hpp"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#ifdef CHIP8_PROFILE
+#include "profiler.hpp"
+#define PROFILE(what) if(profile) { what; }
+#else
+#define PROFILE(what)
+#endif
+#define TRACE(type, op) if(trace && trace->wants(type)) trace->record(type, *this, op.opcode)
+
+// where FX30's 8x10 digits are
+#define BIG_FONT 0x50
 
 Chip8::Chip8()
 {
+    predecode = true;
+    randomSeed = 0;
+#ifdef CHIP8_PROFILE
+    profile = NULL;
+#endif
+    audio = NULL;
+    trace = NULL;
+    for(int page = 0; page < 16; ++page)
+        codeGeneration[page] = 0;
     initialize();
 }
 
@@ -27,19 +52,22 @@ void Chip8::initialize()
     I = 0; // reset index register
     sp = 0; // reset stack pointer
     
-    // Clear display
-    for(int i = 0; i < 64*32; ++i)
-        gfx[i] = 0;
+    // Clear display, back to 64x32 drawing on plane 0
+    memset(gfx, 0, sizeof(gfx));
+    hires = false;
+    planes = 1;
     
     for(int i = 0; i < 16; ++i)
     {
         stack[i] = 0;    // Clear stack
         V[i] = 0; // Clear registers V0-VF
+        flags[i] = 0;
     }
+    memset(audioPattern, 0, sizeof(audioPattern));
+    pitch = 64; // 4000 Hz
     
     // Clear memory (start at 80, since later will load fontset)
-    for(int i =  80; i < 4096; ++i)
-        memory[i] = 0;
+    memset(&memory[80], 0, MEMORY_SIZE - 80);
     
     // Load fontset
     unsigned char chip8_fontset[80] =
@@ -67,9 +95,55 @@ void Chip8::initialize()
     for(int i = 0; i < 80; ++i)
         memory[i] = chip8_fontset[i];
     
+    // SUPER-CHIP's big digits right after it, for FX30 (A-F as XO-CHIP has them)
+    static const unsigned char bigFont[160] =
+    {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    memcpy(&memory[BIG_FONT], bigFont, sizeof(bigFont));
+    
     // Reset Timers
     delay_timer = 0;
     sound_timer = 0;
+    cycles = 0;
+    seedRandom(randomSeed);
+    
+    // Release keys
+    for(int i = 0; i < 16; ++i)
+        key[i] = 0;
+    waitingForKey = false;
+    waitRegister = 0;
+    drawFlag = false;
+    dirtyRows = ~0ULL; // whatever the frontend shows is stale
+    
+    // memory changed under the cache
+    invalidateAllDecoded();
+}
+
+void Chip8::seedRandom(uint64_t seed)
+{
+    randomSeed = seed;
+    // splitmix64 the seed so nearby seeds (0, 1, 2...) still start far apart
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    rng = z ? z : 0x9E3779B97F4A7C15ULL; // xorshift never leaves 0
 }
 
 bool Chip8::loadGame(const char * filename)
@@ -78,378 +152,998 @@ bool Chip8::loadGame(const char * filename)
      load the program into the memory (use fopen in binary mode) and start filling the memory at
      location: 0x200 == 512.
      */
-    unsigned int bufferSize = 4096 - 512; // because chip8 progs use 0x200 to 0xFFF
-    unsigned char buffer[bufferSize];
+    unsigned int bufferSize = MEMORY_SIZE - 512; // because chip8 progs use 0x200 to 0xFFF (XO-CHIP ones go on to 0xFFFF)
     FILE *pfile = fopen(filename, "rb");
     if(!pfile)
     {
        std::cout << "Could not open file " << filename << std::endl;
         return 1;
     }
-    size_t bytesRead = fread(buffer, sizeof(char), bufferSize, pfile);
+    // straight into memory, then clear whatever the file didn't cover so nothing stale is left behind
+    size_t bytesRead = fread(&memory[512], sizeof(char), bufferSize, pfile);
+    fclose(pfile);
     if(bytesRead == 0)
     {
        std::cout << "Problem reading file" << std::endl;
         return 1;
     }
-    fclose(pfile);
-    
-    for(int i = 0; i < bufferSize; ++i)
-        memory[i+512] = buffer[i];
+    memset(&memory[512 + bytesRead], 0, bufferSize - bytesRead);
+    invalidateAllDecoded();
     
     return 0;
 }
 
+bool Chip8::loadRom(const unsigned char *rom, size_t size)
+{
+    size_t room = MEMORY_SIZE - 512;
+    size_t length = size < room ? size : room;
+    memcpy(&memory[512], rom, length);
+    memset(&memory[512 + length], 0, room - length);
+    invalidateAllDecoded();
+    return size <= room;
+}
+
+unsigned long long Chip8::displayHash() const
+{
+    // plane 0's visible words, then plane 1's if anything is on it, so a CHIP-8 screen hashes as it always did
+    unsigned long long hash = 14695981039346656037ULL;
+    int columns = hires ? 2 : 1;
+    uint64_t second = 0;
+    for(int c = 0; c < columns; ++c)
+        for(int y = 0; y < height(); ++y)
+        {
+            hash ^= plane(0, c)[y];
+            hash *= 1099511628211ULL;
+            second |= plane(1, c)[y];
+        }
+    if(second)
+        for(int c = 0; c < columns; ++c)
+            for(int y = 0; y < height(); ++y)
+            {
+                hash ^= plane(1, c)[y];
+                hash *= 1099511628211ULL;
+            }
+    return hash;
+}
+
+void Chip8::unpackDisplay(unsigned char *out) const
+{
+    for(int y = 0; y < height(); ++y)
+        for(int x = 0; x < width(); ++x)
+            *out++ = pixel(x, y);
+}
+
+void Chip8::invalidateDecoded(unsigned short address, unsigned short length)
+{
+    writtenPages |= 1ULL << (address >> 10) | 1ULL << (((address + length - 1) & 0xFFFF) >> 10);
+    
+    if(address >= 0x1000 && address + length <= MEMORY_SIZE)
+        return; // XO-CHIP data, code never runs from up there
+    
+    // an instruction starting one byte before the range also reads its first byte
+    for(int i = address - 1; i < address + length; ++i)
+        decoded[i & 0x0FFF].handler = H_Undecoded;
+    
+    // writes are at most 16 bytes so they touch the first and last page only
+    // (a block tracks the pages of every byte it covers, so unlike above the byte before doesn't matter)
+    ++codeGeneration[(address & 0x0FFF) >> 8];
+    ++codeGeneration[((address + length - 1) & 0x0FFF) >> 8];
+}
+
+void Chip8::invalidateAllDecoded()
+{
+    for(int i = 0; i < 4096; ++i)
+        decoded[i].handler = H_Undecoded;
+    
+    writtenPages = ~0ULL;
+    for(int page = 0; page < 16; ++page)
+        ++codeGeneration[page];
+}
+
+void Chip8::keyDown(unsigned char k)
+{
+    key[k & 0xF] = 1;
+    if(waitingForKey)
+    {
+        // finish the FX0A we stopped on
+        V[waitRegister] = k & 0xF;
+        waitingForKey = false;
+        pc += 2;
+    }
+}
+
+void Chip8::keyUp(unsigned char k)
+{
+    key[k & 0xF] = 0;
+}
+
 void Chip8::emulateCycle()
 {
+    if(waitingForKey)
+        return; // parked on FX0A until keyDown
+    
     // Fetch Opcode
     /* system will fetch 1 opcode from memory at loc specified by pc
      * data is stored in array in which each address contains 1 byte
      * fetch 2 sucessive bytes and merge
+     * With predecode on this only happens the first time we land on an address.
      */
-    opcode = memory[pc] << 8 | memory[pc+1];
+    if(predecode)
+    {
+        DecodedOp &op = decoded[pc & 0x0FFF];
+        if(op.handler == H_Undecoded)
+            op = decode(memory[pc & 0x0FFF] << 8 | memory[(pc + 1) & 0x0FFF]);
+        PROFILE(profile->count(pc, op.handler));
+        execute(op);
+    }
+    else
+    {
+        DecodedOp op = decode(memory[pc & 0x0FFF] << 8 | memory[(pc + 1) & 0x0FFF]);
+        PROFILE(profile->count(pc, op.handler));
+        execute(op);
+    }
+    ++cycles;
+}
+
+unsigned long Chip8::run(unsigned long n)
+{
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+#ifdef CHIP8_PROFILE
+    if(predecode && !profile) // the threaded loop has no profiling hooks
+#else
+    if(predecode)
+#endif
+        return runThreaded(n);
+#endif
+    unsigned long i;
+    for(i = 0; i < n && !waitingForKey; ++i)
+        emulateCycle();
+    return i;
+}
+
+unsigned long Chip8Backend::run(unsigned long n)
+{
+    unsigned long done = 0;
+    while(done < n && !c8.waitingForKey)
+        done += step(n - done);
+    return done;
+}
+
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+unsigned long Chip8::runThreaded(unsigned long n)
+{
+    // one label per handler, in enum order
+    static void *const labels[] =
+    {
+#define CHIP8_LABEL(name) &&L_##name,
+        CHIP8_HANDLERS(CHIP8_LABEL)
+#undef CHIP8_LABEL
+        &&L_Undecoded
+    };
     
-    // Decode Opcode
-    // check the opcode table to see what it means.
-    switch(opcode & 0xF000)
+    unsigned long done = 0;
+    DecodedOp *op;
+    
+    // Every handler ends in its own copy of this, so each one gets its own indirect jump
+    // and the branch predictor can learn which handler usually follows which
+#define DISPATCH() \
+    if(done == n || waitingForKey) \
+        return done; \
+    op = &decoded[pc & 0x0FFF]; \
+    ++done; \
+    goto *labels[op->handler]
+    
+    DISPATCH();
+    
+    // same op functions as execute(), they're in this file so they get inlined.
+    // cycles goes up after the op like in emulateCycle, so ops see the same count either way.
+#define CHIP8_THREAD(name) \
+L_##name: \
+    opcode = op->opcode; \
+    op##name(*op); \
+    ++cycles; \
+    DISPATCH();
+    CHIP8_HANDLERS(CHIP8_THREAD)
+#undef CHIP8_THREAD
+    
+L_Undecoded:
+    // first time here (or the code changed), fill the slot and go again
+    *op = decode(memory[pc & 0x0FFF] << 8 | memory[(pc + 1) & 0x0FFF]);
+    goto *labels[op->handler];
+#undef DISPATCH
+}
+#endif
+
+// longest wait loop findIdleLoop looks for, in instructions
+#define IDLE_LOOP_MAX 16
+
+bool Chip8::findIdleLoop(IdleLoop &loop) const
+{
+    if(waitingForKey)
+        return false;
+#ifdef CHIP8_PROFILE
+    if(profile)
+        return false; // skipped trips wouldn't get counted
+#endif
+    /* Goes round on copies of the registers. The first time finds which registers end up holding a
+     * reading of the delay timer, the second treats those as "any reading since the loop started"
+     * and works out how low the delay can go before a skip might go the other way.
+     */
+    unsigned short fromDelay = 0; // bit per register
+    for(int pass = 0; pass < 2; ++pass)
     {
-        case 0xA000: // ANNN: Sets I to address NNN
-            // Execute Opcode
-            I = opcode & 0x0FFF;
-            /*
-             * Because every instruction is 2 bytes long, we need to increment the program counter by
-             * two after
-             * every executed opcode. This is true unless you jump to a certain address in the memory or
-             * if you
-             * call a subroutine (in which case you need to store the program counter in the stack). If
-             * the next
-             * opcode should be skipped, increase the program counter by four.
-             */
-            pc += 2;
-            break;
-        
-        case 0x1000: // 1NNN: jumps to address NNN
-            pc = opcode & 0x0FFF;
-            break;
-            
-        case 0x2000: // 2NNN: Calls subroutine at NNN
-            stack[sp] = pc; // store current address
-            ++sp; // increase sp to avoid overwriting stack
-            pc = opcode & 0x0FFF; // set pc to NNN (jump)
-            break;
-        
-        case 0x3000: // 3XNN: Skips the next instruction if VX equals NN.
-            // shift by 8 to get X (shift is bits, hex is nibble)
-            if ( V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF) )
-                pc += 2; // skips
-            
-            pc += 2;
-            break;
-            
-        case 0x4000: // Skips next instruction if VX not equals NN
-            if ( V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
-                pc += 2; // skips
-            
-            pc += 2;
-            break;
-            
-        case 0x5000: // Skips the next instruction if VX equals VY.
-            if ( (opcode & 0x000F) != 0)
-                goto UNKNOWNOP;
-            
-            if ( V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
-                pc += 2;
-            
-            pc += 2;
-            break;
-        
-        case 0x6000: // Sets VX to NN.
-            V[(opcode & 0x0F00) >> 8] = (opcode & 0x00FF);
-            pc += 2;
-            break;
-            
-        case 0x7000: //Adds NN to VX
-            V[(opcode & 0x0F00) >> 8] += (opcode & 0x00FF);
-            pc += 2;
-            break;
-            
-        case 0x8000:
-            switch(opcode & 0x000F)
+        unsigned char regs[16];
+        memcpy(regs, V, 16);
+        unsigned short delayRegs = pass ? fromDelay : 0;
+        // the readings can be anything between the current delay and the oldest one still in a register
+        unsigned char high = delay_timer, low = delay_timer;
+        for(int r = 0; r < 16; ++r)
+            if(delayRegs >> r & 1)
             {
-                case 0x0000: // 8XY0
-                    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                
-                case 0x0001: // 8XY1
-                    V[(opcode & 0x0F00) >> 8] |= V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                    
-                case 0x0002: // 8XY2
-                    V[(opcode & 0x0F00) >> 8] &= V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                    
-                case 0x0003: // 8XY3
-                    V[(opcode & 0x0F00) >> 8] ^= V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                
-                case 0x0004: // 8XY4
-                    // solve case of carry (if sum is greater than FF)
-                    if ( V[(opcode & 0x0F00) >> 8] > (0xFF - V[opcode & 0x00F0]) )
-                        V[0xF] = 1;
-                    else
-                        V[0xF] = 0;
-                    
-                    V[(opcode & 0x0F00) >> 8] += V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                    
-                case 0x0005: // 8XY5
-                    if ( V[(opcode & 0x0F00) >> 8] > V[(opcode & 0x00F0) >> 4])
-                        V[0xF] = 1;
-                    else
-                        V[0xF] = 0;
-                    
-                    V[(opcode & 0x0F00) >> 8] -= V[(opcode & 0x00F0) >> 4];
-                    pc += 2;
-                    break;
-                    
-                case 0x0006: // 8XY6
-                    V[0xF] = (V[(opcode & 0x0F00) >> 8] & 0x0F);
-                    V[(opcode & 0x0F00) >> 8] >>= 1;
-                    pc += 2;
-                    break;
-                    
-                case 0x0007: // 8XY7
-                    if ( V[(opcode & 0x0F00) >> 8] < V[(opcode & 0x00F0) >> 4])
-                        V[0xF] = 1;
-                    else
-                        V[0xF] = 0;
-                    
-                    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4] - V[(opcode & 0x0F00) >> 8];
-                    pc += 2;
-                    break;
-                    
-                case 0x000E: // 8XYE
-                    V[0xF] = (V[(opcode & 0x0F00) >> 8] & 0xF0) >> 4;
-                    V[(opcode & 0x0F00) >> 8] <<= 1;
-                    pc += 2;
-                    break;
-                    
-                default:
-                    printf ("Unknown opcode for 8 [0x0000]: 0x%X\n", opcode);
+                high = regs[r] > high ? regs[r] : high;
+                low = regs[r] < low ? regs[r] : low;
             }
-            break;
-            
-        case 0x9000:
-            if ( (opcode & 0x000F) != 0)
-                goto UNKNOWNOP;
-            
-            if ( V[(opcode & 0x0F00) >> 8] != V[(opcode & 0x00F0) >> 4])
-                pc += 2;
-            
-            pc += 2;
-            break;
-
-        case 0xB000:
-            pc = V[0] + (opcode & 0x0FFF);
-            break;
-            
-        case 0xC000:
+        unsigned int floor = 0; // readings must stay at least this
+        bool pinned = false; // a reading is compared to high itself, only high will do
+        bool readsDelay = false;
+        unsigned short index = I;
+        unsigned short at = pc;
+        unsigned short last = opcode;
+        unsigned int length = 0;
+        do
         {
-            std::default_random_engine generator;
-            std::uniform_int_distribution<int> distribution(0,255); // [0,255]
-            V[(opcode & 0x0F00) >> 8] = distribution(generator) & (opcode & 0x00FF);
-            pc += 2;
-            break;
-        }
-            
-        case 0xD000:
-        {
-            /*
-             Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value doesn’t change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn’t happen
-             */
-            // 1 pixel = 1 bit
-            // The state of each pixel is set by using a bitwise XOR operation
-            // This means that it will compare the current pixel state with the current value in the memory. If the current value is different from the value in the memory, the bit value will be 1. If both values match, the bit value will be 0.
-            unsigned short x = V[(opcode & 0x0F00) >> 8];
-            unsigned short y = V[(opcode & 0x00F0) >> 4];
-            unsigned short height = opcode & 0x000F;
-            unsigned short pixel;
-            V[0xF] = 0;
-            
-            // loop over each row
-            for (int yline = 0; yline < height; ++yline)
-            {
-                // fetch pixel value from memory starting at I
-                pixel = memory[I + yline];
-                // loop over 8 pixels
-                for (int xline = 0; xline < 8; ++xline)
-                {
-                    // check if current evaluated pixel is set to 1 (0x80 >> xline scans through byte 1 bit at a time)
-                    if ( (pixel & (0x80 >> xline)) != 0)
-                    {
-                        // check if pixel on display is set to 1
-                        if (gfx[x + xline + ( (y + yline) * 64)] == 1)
-                            V[0xF] = 1; // collision
-                        
-                        //set pixel value
-                        gfx[x + xline + ((y + yline) * 64)] ^= 1;
-                    }
-                }
-            }
-            drawFlag = true;
-            pc += 2;
-            break;
-        }
-            
-        case 0xE000:
-            switch(opcode & 0x00FF)
+            if(length == IDLE_LOOP_MAX)
+                return false;
+            DecodedOp op = decode(memory[at & 0x0FFF] << 8 | memory[(at + 1) & 0x0FFF]);
+            at += 2;
+            bool xDelay = delayRegs >> op.x & 1, yDelay = delayRegs >> op.y & 1;
+            unsigned char compared = op.imm; // what a delay reading gets compared to
+            switch(op.handler)
             {
-                case 0x009E: // EX9E
-                    if (key[V[(opcode & 0x0F00) >> 8]] != 0)
-                        pc += 2;
-                        
-                    pc += 2;
-                    break;
-                
-                case 0x00A1:
-                    if (key[V[(opcode & 0x0F00) >> 8]] == 0)
-                        pc += 2;
-                    
-                    pc += 2;
-                    break;
-                    
-                default:
-                    printf ("Unknown opcode for E [0x0000]: 0x%X\n", opcode);
-            }
-          break;
-            
-        case 0xF000:
-            switch(opcode & 0x00FF)
-            {
-                case 0x0007:
-                    V[(opcode & 0x0F00) >> 8] = delay_timer;
-                    pc += 2;
-                    break;
-                    
-                case 0x000A:
-                    // blocking
-                    while(1)
-                    {
-                        for (int i = 0; i < 0xF; ++i)
-                        {
-                            if (key[i] == 1)
-                            {
-                                V[(opcode & 0x0F00) >> 8] = i;
-                                goto OUT;
-                            }
-                        }
-                    }
-                OUT:
-                    pc += 2;
-                    break;
-                    
-                case 0x0015:
-                    delay_timer = V[(opcode & 0x0F00) >> 8];
-                    pc += 2;
-                    break;
-                    
-                case 0x0018:
-                    sound_timer = V[(opcode & 0x0F00) >> 8];
-                    pc += 2;
-                    break;
-                    
-                case 0x001E:
-                    I += V[(opcode & 0x0F00) >> 8];
-                    pc += 2;
-                    break;
-                    
-                case 0x0029: // FX29: Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font
-                    I = V[(opcode & 0x0F00) >> 8] * 0x5; // Multiply by 5 because in memory array
-                                                        // each digit font spans 5 and has location 5*digit
-                                                        // see load fontset in initialize
-                    pc += 2;
-                    break;
-                    
-                case 0x0033:
-                    // take the decimal representation of VX, place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.)
-                    memory[I]     = V[(opcode & 0x0F00) >> 8] / 100;
-                    memory[I + 1] = (V[(opcode & 0x0F00) >> 8] / 10) % 10;
-                    memory[I + 2] = (V[(opcode & 0x0F00) >> 8] % 100) % 10;
-                    pc += 2;
-                    break;
-                    
-                case 0x0055:
+                case H_Jump: at = op.imm; break;
+                case H_SkipEqReg:
+                case H_SkipNeReg:
+                    if(xDelay && yDelay)
+                        return false; // two readings, possibly from different ticks
+                    compared = xDelay ? regs[op.y] : regs[op.x];
+                    xDelay |= yDelay;
+                    // fall through
+                case H_SkipEqImm:
+                case H_SkipNeImm:
                 {
-                    int j = I;
-                    for (int i = 0; i <= (opcode & 0x0F00) >> 8; ++i)
-                        memory[j++] = V[i];
-                    
-                    pc += 2;
+                    if(xDelay && compared == high)
+                        pinned = true;
+                    else if(xDelay && compared < high && compared + 1u > floor)
+                        floor = compared + 1;
+                    bool equal = op.handler == H_SkipEqImm || op.handler == H_SkipNeImm ?
+                        regs[op.x] == op.imm : regs[op.x] == regs[op.y];
+                    if(equal == (op.handler == H_SkipEqImm || op.handler == H_SkipEqReg))
+                        at += longInstructionAt(at) ? 4 : 2;
                     break;
                 }
-                    
-                case 0x0065:
-                {
-                    int j = I;
-                    for (int i = 0; i <= (opcode & 0x0F00) >> 8; ++i)
-                        V[i] = memory[j++];
-                    
-                    pc += 2;
+                case H_SetImm:
+                    regs[op.x] = op.imm;
+                    delayRegs &= ~(1 << op.x);
                     break;
-                }
-                default:
-                    printf ("Unknown opcode for F [0x0000]: 0x%X\n", opcode);
-            }
-          break;
-            
-        case 0x0000:
-            switch(opcode & 0x000F)
-            {
-                case 0x0000: // 0x00E0: Clears screen
-                    if ( (opcode & 0x00F0) != 0x00E0)
-                        goto UNKNOWNZERO;
-                        
-                    // Clear display
-                    for(int i = 0; i < 64*32; ++i)
-                        gfx[i] = 0;
-                    
-                    pc += 2;
+                case H_Mov:
+                    regs[op.x] = regs[op.y];
+                    delayRegs = (delayRegs & ~(1 << op.x)) | (yDelay << op.x);
+                    break;
+                case H_SetIndex: index = op.imm; break;
+                case H_GetDelay:
+                    regs[op.x] = delay_timer;
+                    delayRegs |= 1 << op.x;
+                    readsDelay = true;
                     break;
-                    
-                case 0x000E: //0x00EE: Returns from subroutine
-                    --sp; // go to past stack level
-                    pc = stack[sp];
-                    pc += 2;
+                case H_SkipKey:
+                case H_SkipNotKey:
+                    if(xDelay)
+                        return false;
+                    if((key[regs[op.x] & 0xF] != 0) == (op.handler == H_SkipKey))
+                        at += longInstructionAt(at) ? 4 : 2;
                     break;
-                
-                UNKNOWNZERO:
                 default:
-                    printf ("Unknown opcode for 0 [0x0000]: 0x%X\n", opcode);
+                    return false; // memory, screen, stack, sound or random: not just waiting
             }
-            break;
-            
-        UNKNOWNOP:
-        default:
-            printf ("Unknown opcode for all: 0x%X\n", opcode);
+            last = op.opcode;
+            ++length;
+        }
+        while(at != pc);
+        
+        if(!pass)
+        {
+            fromDelay = delayRegs;
+            continue;
+        }
+        // going round again must leave everything but the delay readings as it was
+        if(delayRegs != fromDelay || index != I)
+            return false;
+        for(int r = 0; r < 16; ++r)
+            if(!(delayRegs >> r & 1) && regs[r] != V[r])
+                return false;
+        // and every reading the registers hold now has to go the same way as the ones to come
+        if(pinned ? low != high : low < floor)
+            return false;
+        loop.length = length;
+        loop.last = last;
+        loop.readsDelay = readsDelay;
+        loop.minDelay = pinned ? high : floor;
     }
+    return true;
+}
 
-
+void Chip8::tickTimers(unsigned long long at)
+{
     // Update timers
     /* both timers count down to zero if they have been set to a value larger than zero. Since these timers count down at 60 Hz, you might want to implement something that slows down your emulation cycle (Execute 60 opcodes in one second).
+     * The Scheduler takes care of that, it calls this every ips / 60 instructions.
      */
     if(delay_timer > 0)
         --delay_timer;
     
     if(sound_timer > 0)
     {
-        if(sound_timer == 1)
-            printf("BEEP!\n");
+        if(sound_timer == 1 && audio)
+            soundEdge(false, at);
         --sound_timer;
     }
 }
 
+void Chip8::soundEdge(bool on, unsigned long long at)
+{
+    SoundEdge edge;
+    edge.cycle = at;
+    edge.on = on;
+    edge.pitch = pitch;
+    memcpy(edge.pattern, audioPattern, sizeof(edge.pattern));
+    audio->push(edge); // a full ring just loses it, the core never waits on the sound
+}
+
+void Chip8::execute(const DecodedOp &op)
+{
+    opcode = op.opcode;
+    switch(op.handler)
+    {
+#define CHIP8_CASE(name) case H_##name: op##name(op); break;
+        CHIP8_HANDLERS(CHIP8_CASE)
+#undef CHIP8_CASE
+        default:
+            opUnknown(op);
+    }
+}
+
+/* handlerFor worked out for every (top nibble, low byte) pair at compile time,
+ * the middle nibble (X) never changes which handler it is
+ */
+struct HandlerTable
+{
+    unsigned char handler[16][256];
+    constexpr HandlerTable() : handler()
+    {
+        for(int hi = 0; hi < 16; ++hi)
+            for(int lo = 0; lo < 256; ++lo)
+                handler[hi][lo] = Chip8::handlerFor(hi << 12 | lo);
+    }
+};
+static constexpr HandlerTable handlerTable;
+
+static const char *handlerNames[] =
+{
+#define CHIP8_NAME(name) #name,
+    CHIP8_HANDLERS(CHIP8_NAME)
+#undef CHIP8_NAME
+};
+
+const char *Chip8::handlerName(unsigned char handler)
+{
+    return handler < H_Undecoded ? handlerNames[handler] : "Undecoded";
+}
+
+DecodedOp Chip8::decode(unsigned short opcode)
+{
+    DecodedOp op;
+    op.opcode = opcode;
+    op.x = (opcode & 0x0F00) >> 8; // shift by 8 to get X (shift is bits, hex is nibble)
+    op.y = (opcode & 0x00F0) >> 4;
+    op.imm = opcode & 0x0FFF; // NNN
+    
+    // Decode Opcode
+    // check the opcode table to see what it means.
+    op.handler = handlerTable.handler[opcode >> 12][opcode & 0x00FF];
+    switch(op.handler)
+    {
+        case H_SkipEqImm: case H_SkipNeImm: case H_SetImm: case H_AddImm: case H_Random:
+            op.imm &= 0x00FF; // NN
+            break;
+        case H_Draw: case H_ScrollDown: case H_ScrollUp:
+            op.imm &= 0x000F; // N
+            break;
+    }
+    return op;
+}
+
+void Chip8::opUnknown(const DecodedOp &op)
+{
+    TRACE(TRACE_UNKNOWN, op);
+}
+
+void Chip8::opClearScreen(const DecodedOp &) // 00E0
+{
+    // Clear display (the selected planes), only rows that had something on them need redrawing
+    uint64_t lit = 0;
+    for(int p = 0; p < DISPLAY_PLANES; ++p)
+        for(int c = 0; c < (hires ? 2 : 1) && (planes >> p & 1); ++c)
+        {
+            uint64_t *column = plane(p, c);
+            for(int y = 0; y < height(); ++y)
+            {
+                lit |= (uint64_t)(column[y] != 0) << y;
+                column[y] = 0;
+            }
+        }
+    if(lit)
+    {
+        dirtyRows |= lit;
+        drawFlag = true;
+    }
+    
+    pc += 2;
+}
+
+void Chip8::opReturn(const DecodedOp &op) // 00EE: Returns from subroutine
+{
+    TRACE(TRACE_RETURN, op);
+    sp = (sp - 1) & 0xF; // go to past stack level, an empty stack wraps round to the top
+    pc = stack[sp];
+    pc += 2;
+}
+
+void Chip8::opJump(const DecodedOp &op) // 1NNN: jumps to address NNN
+{
+    PROFILE(profile->jumped(pc, op.imm));
+    pc = op.imm;
+}
+
+void Chip8::opCall(const DecodedOp &op) // 2NNN: Calls subroutine at NNN
+{
+    TRACE(TRACE_CALL, op);
+    stack[sp] = pc; // store current address
+    sp = (sp + 1) & 0xF; // increase sp to avoid overwriting stack, the 17th level overwrites the first
+    pc = op.imm; // set pc to NNN (jump)
+}
+
+void Chip8::opSkipEqImm(const DecodedOp &op) // 3XNN: Skips the next instruction if VX equals NN.
+{
+    if ( V[op.x] == op.imm )
+    {
+        PROFILE(profile->skipped(pc));
+        pc += longInstructionAt(pc + 2) ? 4 : 2; // skips
+    }
+    
+    /*
+     * Because every instruction is 2 bytes long, we need to increment the program counter by
+     * two after every executed opcode. This is true unless you jump to a certain address in the
+     * memory or if you call a subroutine (in which case you need to store the program counter in
+     * the stack). If the next opcode should be skipped, increase the program counter by four.
+     */
+    pc += 2;
+}
+
+void Chip8::opSkipNeImm(const DecodedOp &op) // 4XNN: Skips next instruction if VX not equals NN
+{
+    if ( V[op.x] != op.imm )
+    {
+        PROFILE(profile->skipped(pc));
+        pc += longInstructionAt(pc + 2) ? 4 : 2; // skips
+    }
+    
+    pc += 2;
+}
+
+void Chip8::opSkipEqReg(const DecodedOp &op) // 5XY0: Skips the next instruction if VX equals VY.
+{
+    if ( V[op.x] == V[op.y] )
+    {
+        PROFILE(profile->skipped(pc));
+        pc += longInstructionAt(pc + 2) ? 4 : 2;
+    }
+    
+    pc += 2;
+}
+
+void Chip8::opSetImm(const DecodedOp &op) // 6XNN: Sets VX to NN.
+{
+    V[op.x] = op.imm;
+    pc += 2;
+}
+
+void Chip8::opAddImm(const DecodedOp &op) // 7XNN: Adds NN to VX
+{
+    V[op.x] += op.imm;
+    pc += 2;
+}
+
+void Chip8::opMov(const DecodedOp &op) // 8XY0
+{
+    V[op.x] = V[op.y];
+    pc += 2;
+}
+
+void Chip8::opOr(const DecodedOp &op) // 8XY1
+{
+    V[op.x] |= V[op.y];
+    pc += 2;
+}
+
+void Chip8::opAnd(const DecodedOp &op) // 8XY2
+{
+    V[op.x] &= V[op.y];
+    pc += 2;
+}
+
+void Chip8::opXor(const DecodedOp &op) // 8XY3
+{
+    V[op.x] ^= V[op.y];
+    pc += 2;
+}
+
+void Chip8::opAddReg(const DecodedOp &op) // 8XY4
+{
+    // solve case of carry (if sum is greater than FF)
+    if ( V[op.x] > (0xFF - V[op.y]) )
+        V[0xF] = 1;
+    else
+        V[0xF] = 0;
+    
+    V[op.x] += V[op.y];
+    pc += 2;
+}
+
+void Chip8::opSubReg(const DecodedOp &op) // 8XY5
+{
+    if ( V[op.x] > V[op.y] )
+        V[0xF] = 1;
+    else
+        V[0xF] = 0;
+    
+    V[op.x] -= V[op.y];
+    pc += 2;
+}
+
+void Chip8::opShiftRight(const DecodedOp &op) // 8XY6
+{
+    V[0xF] = V[op.x] & 1; // the bit shifted out
+    V[op.x] >>= 1;
+    pc += 2;
+}
+
+void Chip8::opSubnReg(const DecodedOp &op) // 8XY7
+{
+    if ( V[op.x] < V[op.y] )
+        V[0xF] = 1;
+    else
+        V[0xF] = 0;
+    
+    V[op.x] = V[op.y] - V[op.x];
+    pc += 2;
+}
+
+void Chip8::opShiftLeft(const DecodedOp &op) // 8XYE
+{
+    V[0xF] = V[op.x] >> 7; // the bit shifted out
+    V[op.x] <<= 1;
+    pc += 2;
+}
+
+void Chip8::opSkipNeReg(const DecodedOp &op) // 9XY0
+{
+    if ( V[op.x] != V[op.y] )
+    {
+        PROFILE(profile->skipped(pc));
+        pc += longInstructionAt(pc + 2) ? 4 : 2;
+    }
+    
+    pc += 2;
+}
+
+void Chip8::opSetIndex(const DecodedOp &op) // ANNN: Sets I to address NNN
+{
+    I = op.imm;
+    pc += 2;
+}
+
+void Chip8::opJumpV0(const DecodedOp &op) // BNNN
+{
+    pc = V[0] + op.imm;
+}
+
+void Chip8::opRandom(const DecodedOp &op) // CXNN
+{
+    V[op.x] = nextRandom(rng) & op.imm;
+    pc += 2;
+}
+
+void Chip8::opDraw(const DecodedOp &op) // DXYN
+{
+    /*
+     Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value doesn’t change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn’t happen
+     */
+    // 1 pixel = 1 bit
+    // The state of each pixel is set by using a bitwise XOR operation
+    // This means that it will compare the current pixel state with the current value in the memory. If the current value is different from the value in the memory, the bit value will be 1. If both values match, the bit value will be 0.
+    /* With a packed screen a whole sprite row is one shift to line it up with the screen row,
+     * one AND to find collisions and one XOR to draw. The start position wraps around the screen,
+     * anything hanging off the right or bottom edge is clipped.
+     */
+    TRACE(TRACE_DRAW, op);
+    if(hires || planes != 1)
+    {
+        drawSprite(V[op.x], V[op.y], 8, op.imm);
+        pc += 2;
+        return;
+    }
+    unsigned int x = V[op.x] & 63;
+    unsigned int y = V[op.y] & 31;
+    int height = op.imm;
+    if(y + height > 32)
+        height = 32 - y;
+    
+    uint64_t collision = 0;
+    int row = 0;
+    if(I + height <= MEMORY_SIZE)
+    {
+#if defined(__AVX2__)
+        // four rows at a time: widen 4 sprite bytes to 64 bit lanes and shift them into place
+        __m256i hits = _mm256_setzero_si256();
+        __m128i shift = _mm_cvtsi32_si128(x);
+        for(; row + 4 <= height; row += 4)
+        {
+            int bytes;
+            memcpy(&bytes, &memory[I + row], 4);
+            __m256i sprite = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+            sprite = _mm256_srl_epi64(_mm256_slli_epi64(sprite, 56), shift);
+            __m256i screen = _mm256_loadu_si256((__m256i *)&gfx[y + row]);
+            hits = _mm256_or_si256(hits, _mm256_and_si256(screen, sprite));
+            _mm256_storeu_si256((__m256i *)&gfx[y + row], _mm256_xor_si256(screen, sprite));
+        }
+        collision |= !_mm256_testz_si256(hits, hits);
+#elif defined(__SSE2__)
+        // two rows at a time
+        __m128i hits = _mm_setzero_si128();
+        for(; row + 2 <= height; row += 2)
+        {
+            __m128i sprite = _mm_set_epi64x(((uint64_t)memory[I + row + 1] << 56) >> x,
+                                            ((uint64_t)memory[I + row] << 56) >> x);
+            __m128i screen = _mm_loadu_si128((__m128i *)&gfx[y + row]);
+            hits = _mm_or_si128(hits, _mm_and_si128(screen, sprite));
+            _mm_storeu_si128((__m128i *)&gfx[y + row], _mm_xor_si128(screen, sprite));
+        }
+        collision |= _mm_movemask_epi8(_mm_cmpeq_epi8(hits, _mm_setzero_si128())) != 0xFFFF;
+#endif
+    }
+    // whatever is left over (or the sprite wraps past the end of memory)
+    for(; row < height; ++row)
+    {
+        uint64_t sprite = ((uint64_t)memory[(I + row) & 0xFFFF] << 56) >> x;
+        collision |= gfx[y + row] & sprite;
+        gfx[y + row] ^= sprite;
+    }
+    
+    V[0xF] = collision != 0; // collision
+    if(height > 0)
+        dirtyRows |= ((1ULL << height) - 1) << y;
+    drawFlag = true;
+    pc += 2;
+}
+
+// Only the low nibble of VX picks the key, as the keypad has 16 (and every backend does the same)
+void Chip8::opSkipKey(const DecodedOp &op) // EX9E
+{
+    if (key[V[op.x] & 0xF] != 0)
+    {
+        PROFILE(profile->skipped(pc));
+        pc += longInstructionAt(pc + 2) ? 4 : 2;
+    }
+    
+    pc += 2;
+}
+
+void Chip8::opSkipNotKey(const DecodedOp &op) // EXA1
+{
+    if (key[V[op.x] & 0xF] == 0)
+    {
+        PROFILE(profile->skipped(pc));
+        pc += longInstructionAt(pc + 2) ? 4 : 2;
+    }
+    
+    pc += 2;
+}
+
+void Chip8::opGetDelay(const DecodedOp &op) // FX07
+{
+    V[op.x] = delay_timer;
+    pc += 2;
+}
+
+void Chip8::opWaitKey(const DecodedOp &op) // FX0A
+{
+    // a key that's already held counts
+    for (int i = 0; i <= 0xF; ++i)
+    {
+        if (key[i] == 1)
+        {
+            V[op.x] = i;
+            pc += 2;
+            return;
+        }
+    }
+    
+    // otherwise stop here (pc stays on this instruction) until keyDown finishes it
+    waitingForKey = true;
+    waitRegister = op.x;
+}
+
+void Chip8::opSetDelay(const DecodedOp &op) // FX15
+{
+    delay_timer = V[op.x];
+    pc += 2;
+}
+
+void Chip8::opSetSound(const DecodedOp &op) // FX18
+{
+    bool wasOn = sound_timer != 0;
+    sound_timer = V[op.x];
+    // cycles doesn't count this instruction yet, the tone changes once it's done
+    if(audio && wasOn != (sound_timer != 0))
+        soundEdge(!wasOn, cycles + 1);
+    pc += 2;
+}
+
+void Chip8::opAddIndex(const DecodedOp &op) // FX1E
+{
+    I += V[op.x];
+    pc += 2;
+}
+
+void Chip8::opFontChar(const DecodedOp &op) // FX29: Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font
+{
+    I = V[op.x] * 0x5; // Multiply by 5 because in memory array
+                       // each digit font spans 5 and has location 5*digit
+                       // see load fontset in initialize
+    pc += 2;
+}
+
+void Chip8::opStoreBCD(const DecodedOp &op) // FX33
+{
+    // take the decimal representation of VX, place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.)
+    memory[I]                = V[op.x] / 100;
+    memory[(I + 1) & 0xFFFF] = (V[op.x] / 10) % 10;
+    memory[(I + 2) & 0xFFFF] = (V[op.x] % 100) % 10;
+    invalidateDecoded(I, 3); // self-modifying code
+    pc += 2;
+}
+
+void Chip8::opStoreRegs(const DecodedOp &op) // FX55
+{
+    int j = I;
+    for (int i = 0; i <= op.x; ++i)
+        memory[j++ & 0xFFFF] = V[i];
+    
+    invalidateDecoded(I, op.x + 1);
+    pc += 2;
+}
+
+void Chip8::opLoadRegs(const DecodedOp &op) // FX65
+{
+    int j = I;
+    for (int i = 0; i <= op.x; ++i)
+        V[i] = memory[j++ & 0xFFFF];
+    
+    pc += 2;
+}
+
+
+// SUPER-CHIP and XO-CHIP
+
+void Chip8::drawSprite(unsigned int x, unsigned int y, int width, int rows)
+{
+    /* The general DXYN: either resolution, 8 or 16 pixels wide, on each selected plane in turn
+     * with that plane's rows following the previous one's in memory. A sprite row lined up on a
+     * 128 pixel row is two words, so a 16x16 sprite row is as many word ops as an 8 pixel one.
+     * The start position wraps around the screen, the rest is clipped like the 64x32 draw.
+     */
+    x &= this->width() - 1;
+    y &= height() - 1;
+    int visible = y + rows > (unsigned int)height() ? height() - y : rows;
+    int bytes = width / 8;
+    unsigned short address = I;
+    uint64_t collision = 0;
+    for(int p = 0; p < DISPLAY_PLANES; ++p)
+    {
+        if(!(planes >> p & 1))
+            continue;
+        uint64_t *left = plane(p, 0), *right = plane(p, 1);
+        for(int row = 0; row < visible; ++row)
+        {
+            uint64_t bits = memory[(address + row * bytes) & 0xFFFF];
+            if(bytes == 2)
+                bits = bits << 8 | memory[(address + row * 2 + 1) & 0xFFFF];
+            bits <<= 64 - width; // leftmost pixel in the top bit
+            uint64_t l = x < 64 ? bits >> x : 0;
+            uint64_t r = !hires || x == 0 ? 0 : x < 64 ? bits << (64 - x) : bits >> (x - 64);
+            collision |= (left[y + row] & l) | (right[y + row] & r);
+            left[y + row] ^= l;
+            right[y + row] ^= r;
+        }
+        address += rows * bytes;
+    }
+    
+    V[0xF] = collision != 0;
+    if(visible > 0)
+        dirtyRows |= (visible == 64 ? ~0ULL : (1ULL << visible) - 1) << y;
+    drawFlag = true;
+}
+
+void Chip8::opDrawLarge(const DecodedOp &op) // DXY0: 16x16 sprite
+{
+    TRACE(TRACE_DRAW, op);
+    drawSprite(V[op.x], V[op.y], 16, 16);
+    pc += 2;
+}
+
+void Chip8::scrolled()
+{
+    dirtyRows |= height() == 64 ? ~0ULL : (1ULL << height()) - 1;
+    drawFlag = true;
+}
+
+void Chip8::opScrollDown(const DecodedOp &op) // 00CN: scroll the selected planes down N rows
+{
+    int n = op.imm;
+    for(int p = 0; p < DISPLAY_PLANES; ++p)
+        for(int c = 0; c < (hires ? 2 : 1) && (planes >> p & 1); ++c)
+        {
+            uint64_t *column = plane(p, c);
+            memmove(column + n, column, (height() - n) * sizeof(uint64_t));
+            memset(column, 0, n * sizeof(uint64_t));
+        }
+    scrolled();
+    pc += 2;
+}
+
+void Chip8::opScrollUp(const DecodedOp &op) // 00DN: scroll the selected planes up N rows
+{
+    int n = op.imm;
+    for(int p = 0; p < DISPLAY_PLANES; ++p)
+        for(int c = 0; c < (hires ? 2 : 1) && (planes >> p & 1); ++c)
+        {
+            uint64_t *column = plane(p, c);
+            memmove(column, column + n, (height() - n) * sizeof(uint64_t));
+            memset(column + height() - n, 0, n * sizeof(uint64_t));
+        }
+    scrolled();
+    pc += 2;
+}
+
+void Chip8::opScrollRight(const DecodedOp &) // 00FB: scroll the selected planes right 4 pixels
+{
+    // the pixels shifted out of a row's left word go into its right word
+    for(int p = 0; p < DISPLAY_PLANES; ++p)
+    {
+        if(!(planes >> p & 1))
+            continue;
+        uint64_t *left = plane(p, 0), *right = plane(p, 1);
+        if(hires)
+            for(int y = 0; y < 64; ++y)
+                right[y] = right[y] >> 4 | left[y] << 60;
+        for(int y = 0; y < height(); ++y)
+            left[y] >>= 4;
+    }
+    scrolled();
+    pc += 2;
+}
+
+void Chip8::opScrollLeft(const DecodedOp &) // 00FC: scroll the selected planes left 4 pixels
+{
+    for(int p = 0; p < DISPLAY_PLANES; ++p)
+    {
+        if(!(planes >> p & 1))
+            continue;
+        uint64_t *left = plane(p, 0), *right = plane(p, 1);
+        if(hires)
+            for(int y = 0; y < 64; ++y)
+            {
+                left[y] = left[y] << 4 | right[y] >> 60;
+                right[y] <<= 4;
+            }
+        else
+            for(int y = 0; y < 32; ++y)
+                left[y] <<= 4;
+    }
+    scrolled();
+    pc += 2;
+}
+
+void Chip8::opExit(const DecodedOp &) // 00FD: the program is done, stay here
+{
+}
+
+void Chip8::opLowRes(const DecodedOp &) // 00FE: 64x32, clears the screen
+{
+    hires = false;
+    memset(gfx, 0, sizeof(gfx));
+    dirtyRows = ~0ULL;
+    drawFlag = true;
+    pc += 2;
+}
+
+void Chip8::opHighRes(const DecodedOp &) // 00FF: 128x64, clears the screen
+{
+    hires = true;
+    memset(gfx, 0, sizeof(gfx));
+    dirtyRows = ~0ULL;
+    drawFlag = true;
+    pc += 2;
+}
+
+void Chip8::opBigFont(const DecodedOp &op) // FX30: I = 8x10 sprite for digit VX
+{
+    I = BIG_FONT + (V[op.x] & 0xF) * 10;
+    pc += 2;
+}
+
+void Chip8::opSaveFlags(const DecodedOp &op) // FX75: flags = V0 to VX
+{
+    memcpy(flags, V, op.x + 1);
+    pc += 2;
+}
+
+void Chip8::opLoadFlags(const DecodedOp &op) // FX85: V0 to VX = flags
+{
+    memcpy(V, flags, op.x + 1);
+    pc += 2;
+}
+
+void Chip8::opSaveRange(const DecodedOp &op) // 5XY2: store VX to VY (either way round) at I, I stays
+{
+    int step = op.x <= op.y ? 1 : -1;
+    int count = (op.y - op.x) * step + 1;
+    for(int i = 0; i < count; ++i)
+        memory[(I + i) & 0xFFFF] = V[op.x + i * step];
+    invalidateDecoded(I, count);
+    pc += 2;
+}
+
+void Chip8::opLoadRange(const DecodedOp &op) // 5XY3: load VX to VY from I, I stays
+{
+    int step = op.x <= op.y ? 1 : -1;
+    int count = (op.y - op.x) * step + 1;
+    for(int i = 0; i < count; ++i)
+        V[op.x + i * step] = memory[(I + i) & 0xFFFF];
+    pc += 2;
+}
+
+void Chip8::opLongIndex(const DecodedOp &) // F000 NNNN: I = NNNN, the next two bytes
+{
+    I = memory[(pc + 2) & 0x0FFF] << 8 | memory[(pc + 3) & 0x0FFF];
+    pc += 4;
+}
+
+void Chip8::opPlanes(const DecodedOp &op) // FN01: draw, clear and scroll planes N
+{
+    planes = op.x & 3;
+    pc += 2;
+}
+
+void Chip8::opAudio(const DecodedOp &) // F002: audio pattern = 16 bytes at I
+{
+    for(int i = 0; i < 16; ++i)
+        audioPattern[i] = memory[(I + i) & 0xFFFF];
+    pc += 2;
+}
+
+void Chip8::opPitch(const DecodedOp &op) // FX3A: pattern playback pitch = VX
+{
+    pitch = V[op.x];
+    pc += 2;
+}
@@ -10,8 +10,79 @@
 #define chip8_hpp
 
 #include <stdio.h>
+#include <stdint.h>
 #include <iostream>
-#include <random>
+
+/* Every handler the decoder can produce. emulateCycle dispatches on these instead of
+ * re-walking the opcode switch, and each name X has a matching member function opX.
+ */
+#define CHIP8_HANDLERS(X) \
+    X(Unknown) \
+    X(ClearScreen)  X(Return)      X(Jump)        X(Call) \
+    X(SkipEqImm)    X(SkipNeImm)   X(SkipEqReg)   X(SetImm)      X(AddImm) \
+    X(Mov)          X(Or)          X(And)         X(Xor)         X(AddReg) \
+    X(SubReg)       X(ShiftRight)  X(SubnReg)     X(ShiftLeft)   X(SkipNeReg) \
+    X(SetIndex)     X(JumpV0)      X(Random)      X(Draw) \
+    X(SkipKey)      X(SkipNotKey) \
+    X(GetDelay)     X(WaitKey)     X(SetDelay)    X(SetSound)    X(AddIndex) \
+    X(FontChar)     X(StoreBCD)    X(StoreRegs)   X(LoadRegs) \
+    X(ScrollDown)   X(ScrollUp)    X(ScrollRight) X(ScrollLeft) \
+    X(Exit)         X(LowRes)      X(HighRes)     X(DrawLarge) \
+    X(BigFont)      X(SaveFlags)   X(LoadFlags) \
+    X(SaveRange)    X(LoadRange)   X(LongIndex)   X(Planes) \
+    X(Audio)        X(Pitch)
+
+// Display: up to 128x64 (SUPER-CHIP high resolution) in up to two bit planes (XO-CHIP)
+#define DISPLAY_PLANES 2
+#define DISPLAY_ROWS 64
+#define DISPLAY_COLUMNS 128
+// XO-CHIP's 64K. Code still runs from the first 4K (jumps and calls only reach that far).
+#define MEMORY_SIZE 0x10000
+
+// A decoded instruction. x/y are register numbers, imm is NNN, NN or N depending on the opcode
+struct DecodedOp
+{
+    unsigned char handler;
+    unsigned char x;
+    unsigned char y;
+    unsigned short imm;
+    unsigned short opcode; // raw opcode, kept for the opcode member and for error messages
+};
+
+class Chip8;
+
+/* Anything that can run instructions on a Chip8 (the JIT for example).
+ * The scheduler drives one of these, or the interpreter when it doesn't have one.
+ */
+class Chip8Backend
+{
+public:
+    explicit Chip8Backend(Chip8 &machine) : c8(machine) {}
+    virtual ~Chip8Backend() {}
+    // Runs one block (or one interpreted instruction). Returns how many instructions ran.
+    // Blocks longer than limit are interpreted one instruction instead.
+    virtual int step(unsigned long limit = ~0UL) = 0;
+    // Runs exactly n instructions, or fewer if the machine starts waiting for a key
+    virtual unsigned long run(unsigned long n);
+
+protected:
+    Chip8 &c8;
+};
+
+// A wait loop found by Chip8::findIdleLoop
+struct IdleLoop
+{
+    unsigned int length; // instructions per trip round it
+    unsigned short last; // opcode of the trip's last instruction
+    bool readsDelay; // has an FX07
+    unsigned char minDelay; // goes round the same way as long as the delay timer is at least this
+};
+
+#ifdef CHIP8_PROFILE
+struct Chip8Profile;
+#endif
+class SoundRing;
+class Chip8Trace;
 
 class Chip8
 {
@@ -24,22 +95,27 @@ public: // Yes, technically these member variables should be private, and I shou
     unsigned short I;
     // program counter (pc) with value from 0x000 to 0xFFF
     unsigned short pc;
-    // stack pointer remembers which of 16 levels of stack is used
+    // stack pointer remembers which of 16 levels of stack is used, always 0 to 15
+    // (calls and returns wrap round rather than run off either end)
     unsigned short sp;
     
-    // The Chip 8 has 4K memory
+    // The Chip 8 has 4K memory, XO-CHIP has 64K
     /*
      0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
-     0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
+     0x000-0x050 - Used for the built in 4x5 pixel font set (0-F)
+     0x050-0x0F0 - SUPER-CHIP's 8x10 font (0-F)
      0x200-0xFFF - Program ROM and work RAM
+     0x1000-0xFFFF - XO-CHIP data (reached through I)
      */
-    unsigned char memory[4096];
+    unsigned char memory[MEMORY_SIZE];
     /* CPU registers: The Chip 8 has 15 8-bit general purpose registers named V0,V1 up to VE. The 16th register is used  for the ‘carry flag’. Eight bits is one byte
      */
     unsigned char V[16];
     // stack used to remember current location before jump is performed
     // perform jump or call subroutine, store pc in stack
     unsigned short stack[16];
+    // SUPER-CHIP's "RPL" flag registers, FX75 / FX85 (XO-CHIP has all 16)
+    unsigned char flags[16];
     
     // No interrupt or hardware registers
     // 2 timer registers count at 60 Hz. count down to zero
@@ -47,6 +123,23 @@ public: // Yes, technically these member variables should be private, and I shou
     //system buzzer sounds whenever sound timer reaches zero
     unsigned char sound_timer;
     
+    /* CXNN's random number generator (xorshift64*). It's part of the machine state, so a snapshot
+     * or a replay with the same seed gets the same numbers.
+     */
+    uint64_t rng;
+    // the seed initialize() starts rng from, 0 unless seedRandom was called
+    uint64_t randomSeed;
+    // Sets randomSeed and restarts rng from it
+    void seedRandom(uint64_t seed);
+    // Next random byte from a generator state, advances the state
+    static unsigned char nextRandom(uint64_t &state)
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (state * 2685821657736338717ULL) >> 56;
+    }
+    
     void initialize();
 //public:
     Chip8(); // setup everything here
@@ -57,13 +150,233 @@ public: // Yes, technically these member variables should be private, and I shou
      VF register set. Collision detection
      */
     // graphics are b&w and screen has total of 2048 pixels with state (0, 1)
-    unsigned char gfx[64*32];
+    /* Packed one bit per pixel, one word per row. The leftmost pixel (x = 0) is the top bit.
+     * Each plane is two columns of DISPLAY_ROWS words, x 0-63 then x 64-127 (see plane()).
+     * At 64x32 only the first 32 words of plane 0 are used, so gfx[y] is row y of a CHIP-8 screen.
+     */
+    uint64_t gfx[DISPLAY_PLANES * 2 * DISPLAY_ROWS];
+    uint64_t *plane(int p, int column) { return &gfx[(p * 2 + column) * DISPLAY_ROWS]; }
+    const uint64_t *plane(int p, int column) const { return &gfx[(p * 2 + column) * DISPLAY_ROWS]; }
+    // 128x64 (00FF) instead of 64x32 (00FE)
+    bool hires;
+    int width() const { return hires ? 128 : 64; }
+    int height() const { return hires ? 64 : 32; }
+    // planes draws, clears and scrolls work on, bit per plane (FN01, 1 unless XO-CHIP changes it)
+    unsigned char planes;
+    /* Bit y is set when row y may have changed (DXYN, 00E0). The core only ever sets bits,
+     * the frontend clears them once it has redrawn those rows.
+     */
+    uint64_t dirtyRows;
+    // The pixel at (x, y): bit 0 from plane 0, bit 1 from plane 1
+    int pixel(int x, int y) const
+    {
+        int shift = 63 - (x & 63);
+        return (plane(0, x >> 6)[y] >> shift & 1) | (plane(1, x >> 6)[y] >> shift & 1) << 1;
+    }
+    // Expand the screen to width() * height() bytes of pixel(), row by row
+    void unpackDisplay(unsigned char *out) const;
+    // XO-CHIP audio: 16 byte pattern (F002) and pitch (FX3A)
+    unsigned char audioPattern[16];
+    unsigned char pitch;
     // Chip 8 HEX based keypad (0x0 - 0xF)
     unsigned char key[16];
+    // Press / release a key. Use these rather than writing key[] so FX0A wakes up.
+    void keyDown(unsigned char k);
+    void keyUp(unsigned char k);
+    
+    /* FX0A with no key held puts the machine in this state instead of spinning.
+     * emulateCycle does nothing and run() returns early until keyDown delivers a key,
+     * so the host can park the machine and get on with something else.
+     */
+    bool waitingForKey;
+    unsigned char waitRegister; // VX that gets the key
     
     bool loadGame(const char *);
+    /* Copies a ROM image that's already in memory (see RomStore) to 0x200 and zeroes the rest.
+     * Returns false if it was too big (more than 64K - 512) and got cut off.
+     */
+    bool loadRom(const unsigned char *rom, size_t size);
+    // Runs one instruction. Timers are ticked separately (see Scheduler), at 60 Hz of emulated time.
     void emulateCycle();
+    // Runs n instructions on the interpreter, returns how many ran (less if it starts waiting for a key)
+    unsigned long run(unsigned long n);
+#if defined(CHIP8_THREADED_DISPATCH) && defined(__GNUC__)
+    /* Threaded code version of run(): every handler jumps straight to the next one through a
+     * table of label addresses (computed goto), no loop and no switch. run() uses it whenever
+     * the predecode cache is on. Build with CHIP8_THREADED_DISPATCH to get it.
+     */
+    unsigned long runThreaded(unsigned long n);
+#endif
+    /* Checks whether pc is in a wait loop: one that only touches registers and reads the delay
+     * timer and the keys (FX07 / 3XNN / 1NNN, EX9E / 1NNN...), where going round again changes
+     * nothing but the delay readings. The Scheduler skips those (see Scheduler::skipIdleLoops).
+     */
+    bool findIdleLoop(IdleLoop &) const;
+    // instructions executed since initialize()
+    unsigned long long cycles;
+    // 64 bit FNV-1a hash of the screen, for comparing runs
+    unsigned long long displayHash() const;
     void debugRender(); // what's this???
+    
+    enum Handler
+    {
+#define CHIP8_ENUM(name) H_##name,
+        CHIP8_HANDLERS(CHIP8_ENUM)
+#undef CHIP8_ENUM
+        H_Undecoded // marks an empty predecode slot, never executed
+    };
+    // SUPER-CHIP and XO-CHIP handlers, everything from ScrollDown on
+    static bool isExtended(unsigned char handler) { return handler >= H_ScrollDown && handler < H_Undecoded; }
+    // The conditional skips: 3XNN, 4XNN, 5XY0, 9XY0, EX9E and EXA1
+    static bool isSkip(unsigned char handler)
+    {
+        return handler == H_SkipEqImm || handler == H_SkipNeImm || handler == H_SkipEqReg || handler == H_SkipNeReg ||
+               handler == H_SkipKey || handler == H_SkipNotKey;
+    }
+    // The handler's name in CHIP8_HANDLERS ("ClearScreen" for H_ClearScreen), for reports and generated code
+    static const char *handlerName(unsigned char handler);
+    
+    /* Which handler an opcode decodes to. Only depends on the top nibble and the low byte,
+     * constexpr so the compiler builds the 16x256 lookup table decode() uses.
+     */
+    static constexpr unsigned char handlerFor(unsigned short opcode)
+    {
+        switch(opcode & 0xF000)
+        {
+            case 0x0000:
+                switch(opcode & 0x00FF)
+                {
+                    case 0x00FB: return H_ScrollRight; // 00FB
+                    case 0x00FC: return H_ScrollLeft;  // 00FC
+                    case 0x00FD: return H_Exit;        // 00FD
+                    case 0x00FE: return H_LowRes;      // 00FE
+                    case 0x00FF: return H_HighRes;     // 00FF
+                }
+                if((opcode & 0x00F0) == 0x00C0) // 00CN: scroll down N rows
+                    return H_ScrollDown;
+                if((opcode & 0x00F0) == 0x00D0) // 00DN: scroll up N rows
+                    return H_ScrollUp;
+                if((opcode & 0x000F) == 0x0000) // 0x00E0: Clears screen
+                    return (opcode & 0x00F0) == 0x00E0 ? H_ClearScreen : H_Unknown;
+                if((opcode & 0x000F) == 0x000E) // 0x00EE: Returns from subroutine
+                    return H_Return;
+                return H_Unknown;
+            case 0x1000: return H_Jump;      // 1NNN
+            case 0x2000: return H_Call;      // 2NNN
+            case 0x3000: return H_SkipEqImm; // 3XNN
+            case 0x4000: return H_SkipNeImm; // 4XNN
+            case 0x5000:
+                switch(opcode & 0x000F)
+                {
+                    case 0x0000: return H_SkipEqReg; // 5XY0
+                    case 0x0002: return H_SaveRange; // 5XY2
+                    case 0x0003: return H_LoadRange; // 5XY3
+                }
+                return H_Unknown;
+            case 0x6000: return H_SetImm;    // 6XNN
+            case 0x7000: return H_AddImm;    // 7XNN
+            case 0x8000:
+                switch(opcode & 0x000F)
+                {
+                    case 0x0000: return H_Mov;        // 8XY0
+                    case 0x0001: return H_Or;         // 8XY1
+                    case 0x0002: return H_And;        // 8XY2
+                    case 0x0003: return H_Xor;        // 8XY3
+                    case 0x0004: return H_AddReg;     // 8XY4
+                    case 0x0005: return H_SubReg;     // 8XY5
+                    case 0x0006: return H_ShiftRight; // 8XY6
+                    case 0x0007: return H_SubnReg;    // 8XY7
+                    case 0x000E: return H_ShiftLeft;  // 8XYE
+                }
+                return H_Unknown;
+            case 0x9000: return (opcode & 0x000F) == 0 ? H_SkipNeReg : H_Unknown; // 9XY0
+            case 0xA000: return H_SetIndex;  // ANNN
+            case 0xB000: return H_JumpV0;    // BNNN
+            case 0xC000: return H_Random;    // CXNN
+            case 0xD000: return (opcode & 0x000F) ? H_Draw : H_DrawLarge; // DXYN, DXY0
+            case 0xE000:
+                switch(opcode & 0x00FF)
+                {
+                    case 0x009E: return H_SkipKey;    // EX9E
+                    case 0x00A1: return H_SkipNotKey; // EXA1
+                }
+                return H_Unknown;
+            case 0xF000:
+                switch(opcode & 0x00FF)
+                {
+                    case 0x0000: return H_LongIndex; // F000 NNNN
+                    case 0x0001: return H_Planes;    // FN01
+                    case 0x0002: return H_Audio;     // F002
+                    case 0x0007: return H_GetDelay;  // FX07
+                    case 0x000A: return H_WaitKey;   // FX0A
+                    case 0x0015: return H_SetDelay;  // FX15
+                    case 0x0018: return H_SetSound;  // FX18
+                    case 0x001E: return H_AddIndex;  // FX1E
+                    case 0x0029: return H_FontChar;  // FX29
+                    case 0x0030: return H_BigFont;   // FX30
+                    case 0x0033: return H_StoreBCD;  // FX33
+                    case 0x003A: return H_Pitch;     // FX3A
+                    case 0x0055: return H_StoreRegs; // FX55
+                    case 0x0065: return H_LoadRegs;  // FX65
+                    case 0x0075: return H_SaveFlags; // FX75
+                    case 0x0085: return H_LoadFlags; // FX85
+                }
+                return H_Unknown;
+        }
+        return H_Unknown;
+    }
+    // Turn a raw opcode into a handler plus operands. Doesn't touch machine state.
+    static DecodedOp decode(unsigned short opcode);
+    // Run a decoded instruction (does not update timers)
+    void execute(const DecodedOp &);
+    
+    /* Predecode cache: each memory address is decoded the first time pc lands on it.
+     * Turn it off to decode every cycle (only useful for benchmarking).
+     * Anything that writes to memory after loadGame must call invalidateDecoded on the range,
+     * this includes tests poking memory[] directly.
+     */
+    bool predecode;
+    DecodedOp decoded[4096];
+    void invalidateDecoded(unsigned short address, unsigned short length);
+    void invalidateAllDecoded();
+    // bumped whenever code in a 256 byte page may have changed, so translated code can check it's still good
+    unsigned int codeGeneration[16];
+    /* Bit p is set when the 1K of memory from p << 10 may have been written since it was last
+     * cleared (an instruction or invalidateAllDecoded). The core only ever sets bits, a
+     * Chip8Checkpoint clears them (see snapshot.hpp).
+     */
+    uint64_t writtenPages;
+    
+#ifdef CHIP8_PROFILE
+    // set to collect per address / per opcode counts in emulateCycle (see profiler.hpp), NULL by default
+    Chip8Profile *profile;
+#endif
+    
+    // count both timers down by one, the scheduler calls this at 60 Hz
+    void tickTimers() { tickTimers(cycles); }
+    // the same, for a tick that belongs at cycle at (the sound going off gets stamped with it)
+    void tickTimers(unsigned long long at);
+    
+    // set to get the sound timer's on / off edges (see audio.hpp), NULL by default
+    SoundRing *audio;
+    // set to record unknown opcodes, calls, returns or draws (see trace.hpp), NULL by default
+    Chip8Trace *trace;
+    
+    // F000 NNNN starts at address: the one four byte instruction, skips have to jump all of it
+    bool longInstructionAt(unsigned short address) const
+    {
+        return memory[address & 0x0FFF] == 0xF0 && memory[(address + 1) & 0x0FFF] == 0x00;
+    }
+    
+#define CHIP8_DECLARE(name) void op##name(const DecodedOp &);
+    CHIP8_HANDLERS(CHIP8_DECLARE)
+#undef CHIP8_DECLARE
+    
+private:
+    // DXYN / DXY0 anywhere but 64x32 on plane 0 alone: width 8 or 16
+    void drawSprite(unsigned int x, unsigned int y, int width, int rows);
+    void scrolled(); // every visible row changed
+    void soundEdge(bool on, unsigned long long at);
 };
 
 #endif /* chip8_hpp */
@@ -0,0 +1,85 @@
+//
+//  chip8aot.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/26/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "chip8aot.hpp"
+#include <string.h>
+#include <vector>
+
+// Filled in by the generated files' AotRegistrations before main, function static so it exists by then
+static std::vector<const AotModule *> &modules()
+{
+    static std::vector<const AotModule *> registered;
+    return registered;
+}
+
+AotRegistration::AotRegistration(const AotModule &module)
+{
+    modules().push_back(&module);
+}
+
+const AotModule *findAotModule(uint64_t romHash)
+{
+    for(size_t i = 0; i < modules().size(); ++i)
+        if(modules()[i]->romHash == romHash)
+            return modules()[i];
+    return NULL;
+}
+
+Chip8Aot::Chip8Aot(Chip8 &chip, const AotModule &aot) : Chip8Backend(chip), module(aot)
+{
+    compiledInstructions = interpretedInstructions = modifiedBlocks = 0;
+    memset(entries, 0, sizeof(entries));
+    for(size_t i = 0; i < module.blockCount; ++i)
+    {
+        const AotBlock &block = module.blocks[i];
+        // only blocks that lie inside the ROM image can be checked against it
+        if(block.start < 0x200 || block.end > 0x1000 || block.end > 0x200 + module.romSize || block.end <= block.start)
+            continue;
+        entries[block.start].block = &block;
+    }
+}
+
+bool Chip8Aot::check(Entry &entry)
+{
+    const AotBlock &block = *entry.block;
+    unsigned int first = c8.codeGeneration[block.start >> 8];
+    unsigned int last = c8.codeGeneration[(block.end - 1) >> 8];
+    if(entry.checked && first == entry.firstGeneration && last == entry.lastGeneration)
+        return entry.matches;
+
+    bool matched = entry.matches;
+    entry.matches = !memcmp(&c8.memory[block.start], &module.rom[block.start - 0x200], block.end - block.start);
+    if(entry.checked && matched && !entry.matches)
+        ++modifiedBlocks;
+    entry.checked = true;
+    entry.firstGeneration = first;
+    entry.lastGeneration = last;
+    return entry.matches;
+}
+
+int Chip8Aot::step(unsigned long limit)
+{
+    if(c8.waitingForKey)
+        return 0;
+
+    unsigned short pc = c8.pc;
+    Entry *entry = pc < 0x1000 ? &entries[pc] : NULL;
+    if(!entry || !entry->block || entry->block->count > limit || !check(*entry))
+    {
+        c8.emulateCycle();
+        ++interpretedInstructions;
+        return 1;
+    }
+
+    const AotBlock &block = *entry->block;
+    c8.pc = block.code(c8);
+    c8.opcode = block.lastOpcode;
+    c8.cycles += block.count;
+    compiledInstructions += block.count;
+    return block.count;
+}
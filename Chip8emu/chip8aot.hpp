@@ -0,0 +1,84 @@
+//
+//  chip8aot.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/26/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef chip8aot_hpp
+#define chip8aot_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.hpp"
+
+/* Code from the ahead-of-time recompiler (recompiler.hpp). Each ROM it's run on becomes a C++ file
+ * with one function per basic block, compiled into the program like any other source. The file
+ * registers itself when the program starts, and Chip8Aot runs it on an ordinary Chip8.
+ */
+
+// One basic block of recompiled code
+struct AotBlock
+{
+    unsigned short start; // address of its first instruction
+    unsigned short end; // one past the last byte it was built from (the instruction after a final skip included)
+    unsigned short count; // instructions
+    unsigned short lastOpcode;
+    unsigned int (*code)(Chip8 &); // runs the block, returns the new pc
+};
+
+// Everything recompiled from one ROM
+struct AotModule
+{
+    const char *name;
+    uint64_t romHash; // RomStore::hash of the ROM file
+    const unsigned char *rom; // the ROM as it was recompiled, loaded at 0x200
+    size_t romSize;
+    const AotBlock *blocks;
+    size_t blockCount;
+};
+
+// A generated file has one of these at file scope, so its module can be found by ROM hash
+struct AotRegistration
+{
+    AotRegistration(const AotModule &);
+};
+
+// The module recompiled from the ROM with this hash, NULL if none is linked in
+const AotModule *findAotModule(uint64_t romHash);
+
+/* Backend that runs recompiled blocks. The interpreter (Chip8::emulateCycle) runs whatever has no
+ * block: addresses the recompiler never saw as code, like where a BNNN lands outside its jump
+ * table, and blocks whose bytes in memory are no longer what was recompiled (self-modifying
+ * code). A block is compared with memory again whenever one of its pages' codeGeneration moves.
+ */
+class Chip8Aot : public Chip8Backend
+{
+public:
+    // The module should be the one for the ROM the machine has loaded
+    Chip8Aot(Chip8 &, const AotModule &);
+
+    int step(unsigned long limit = ~0UL) override;
+
+    // stats
+    unsigned long compiledInstructions;
+    unsigned long interpretedInstructions;
+    unsigned long modifiedBlocks; // times a block was found changed in memory
+
+private:
+    struct Entry
+    {
+        const AotBlock *block; // starting at this address, NULL for none
+        unsigned int firstGeneration, lastGeneration;
+        bool checked; // compared with memory at those generations
+        bool matches;
+    };
+
+    const AotModule &module;
+    Entry entries[4096];
+
+    bool check(Entry &);
+};
+
+#endif /* chip8aot_hpp */
@@ -0,0 +1,344 @@
+//
+//  chip8jit.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/6/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "chip8jit.hpp"
+
+#if CHIP8_JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__APPLE__) && defined(MAP_JIT)
+#include <pthread.h>
+#define CHIP8_MAP_JIT 1
+#endif
+#endif
+
+#define ARENA_SIZE (1 << 20)
+#define MAX_BLOCK_INSTRUCTIONS 64
+#define MAX_BLOCK_BYTES (MAX_BLOCK_INSTRUCTIONS * 48)
+
+// x86 register numbers we use. rdi always holds the Chip8 pointer.
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define RDI 7
+
+Chip8Jit::Chip8Jit(Chip8 &chip) : Chip8Backend(chip)
+{
+    blocksCompiled = jitInstructions = interpretedInstructions = 0;
+    offsetV = (int)((unsigned char *)&c8.V[0] - (unsigned char *)&c8);
+    offsetI = (int)((unsigned char *)&c8.I - (unsigned char *)&c8);
+    arena = NULL;
+    arenaUsed = 0;
+#if CHIP8_MAP_JIT
+    // macOS hands out MAP_JIT memory that each thread flips between writable and executable
+    void *mem = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON | MAP_JIT, -1, 0);
+    if(mem != MAP_FAILED)
+        arena = (unsigned char *)mem;
+#elif CHIP8_JIT_SUPPORTED
+    // Never writable and executable at once: the pages a block goes in are made writable while
+    // it's emitted and executable after, ROMs aren't trusted
+    void *mem = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if(mem != MAP_FAILED)
+        arena = (unsigned char *)mem;
+#endif
+    flush();
+}
+
+Chip8Jit::~Chip8Jit()
+{
+#if CHIP8_JIT_SUPPORTED
+    if(arena)
+        munmap(arena, ARENA_SIZE);
+#endif
+}
+
+void Chip8Jit::flush()
+{
+    for(int i = 0; i < 4096; ++i)
+        blocks[i].valid = false;
+    arenaUsed = 0;
+}
+
+bool Chip8Jit::protect(unsigned char *start, size_t bytes, bool writable)
+{
+#if CHIP8_MAP_JIT
+    (void)start;
+    (void)bytes;
+    pthread_jit_write_protect_np(!writable);
+    return true;
+#elif CHIP8_JIT_SUPPORTED
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t first = (size_t)(start - arena) & ~(page - 1);
+    size_t end = ((size_t)(start - arena) + bytes + page - 1) & ~(page - 1);
+    if(end > ARENA_SIZE)
+        end = ARENA_SIZE;
+    return mprotect(arena + first, end - first, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#else
+    (void)start;
+    (void)bytes;
+    (void)writable;
+    return false;
+#endif
+}
+
+int Chip8Jit::step(unsigned long limit)
+{
+    if(c8.waitingForKey)
+        return 0;
+    
+    unsigned short pc = c8.pc;
+    // no arena (or not x86-64), or pc is off the end of memory: let the interpreter deal with it
+    if(!arena || pc > 0x0FFE)
+    {
+        c8.emulateCycle();
+        ++interpretedInstructions;
+        return 1;
+    }
+
+    Block *block = &blocks[pc];
+    if(!block->valid
+       || c8.codeGeneration[block->firstPage] != block->firstGeneration
+       || c8.codeGeneration[block->lastPage] != block->lastGeneration)
+        block = &compile(pc);
+
+    if(!block->code || (unsigned long)block->count > limit)
+    {
+        c8.emulateCycle();
+        ++interpretedInstructions;
+        return 1;
+    }
+
+    c8.pc = block->code(&c8);
+    c8.opcode = block->lastOpcode;
+    c8.cycles += block->count;
+    jitInstructions += block->count;
+    return block->count;
+}
+
+Chip8Jit::Block &Chip8Jit::compile(unsigned short address)
+{
+    if(arenaUsed + MAX_BLOCK_BYTES > ARENA_SIZE)
+        flush(); // out of room, start over
+
+    Block &block = blocks[address];
+    block.valid = true;
+    block.code = NULL;
+    block.count = 0;
+
+    unsigned char *start = arena + arenaUsed;
+    // the pages may hold finished blocks too, nothing runs them until they're executable again
+    if(!protect(start, MAX_BLOCK_BYTES, true))
+    {
+        block.valid = false; // interpret it and try again next time
+        return block;
+    }
+    out = start;
+    unsigned short pc = address;
+    bool endsBlock = false;
+    bool skips = false;
+    while(!endsBlock && block.count < MAX_BLOCK_INSTRUCTIONS && pc <= 0x0FFE)
+    {
+        DecodedOp op = Chip8::decode(c8.memory[pc] << 8 | c8.memory[pc + 1]);
+        unsigned char *before = out;
+        if(!translate(op, pc, endsBlock))
+        {
+            out = before;
+            break;
+        }
+        block.lastOpcode = op.opcode;
+        skips = endsBlock && op.handler != Chip8::H_Jump;
+        ++block.count;
+        pc += 2;
+    }
+
+    unsigned short last = block.count ? pc - 1 : address + 1;
+    if(skips)
+        last = (pc + 1) & 0x0FFF; // where a skip lands depends on the next instruction being F000 NNNN
+    block.firstPage = address >> 8;
+    block.lastPage = last >> 8;
+    block.firstGeneration = c8.codeGeneration[block.firstPage];
+    block.lastGeneration = c8.codeGeneration[block.lastPage];
+
+    if(block.count != 0 && !endsBlock)
+        emitReturn(pc); // stopped before something we don't translate, carry on from there
+    if(!protect(start, MAX_BLOCK_BYTES, false) || block.count == 0)
+        return block;
+
+    block.code = (BlockFn)start;
+    arenaUsed += out - start;
+    ++blocksCompiled;
+    return block;
+}
+
+void Chip8Jit::emit(unsigned char b)
+{
+    *out++ = b;
+}
+
+void Chip8Jit::emit32(unsigned int v)
+{
+    for(int i = 0; i < 4; ++i)
+        emit((v >> (i * 8)) & 0xFF);
+}
+
+// ModRM + disp32 for [rdi + offset]
+void Chip8Jit::emitModRM(int reg, int offset)
+{
+    emit(0x80 | (reg << 3) | RDI);
+    emit32(offset);
+}
+
+// movzx reg, byte [rdi + V + index]
+void Chip8Jit::loadV(int reg, int index)
+{
+    emit(0x0F); emit(0xB6);
+    emitModRM(reg, offsetV + index);
+}
+
+// mov byte [rdi + V + index], reg8
+void Chip8Jit::storeV(int reg, int index)
+{
+    emit(0x88);
+    emitModRM(reg, offsetV + index);
+}
+
+// mov eax, pc; ret
+void Chip8Jit::emitReturn(unsigned int pc)
+{
+    emit(0xB8); emit32(pc & 0xFFFF);
+    emit(0xC3);
+}
+
+/* Emits code for one instruction. Returns false if we don't translate it.
+ * Register and flag update order follows the interpreter exactly, including the cases where
+ * X or Y is F and VF gets written before the result is computed.
+ */
+bool Chip8Jit::translate(const DecodedOp &op, unsigned short pc, bool &endsBlock)
+{
+    unsigned int next = (pc + 2) & 0xFFFF;
+    unsigned int skip = (pc + (c8.longInstructionAt(pc + 2) ? 6 : 4)) & 0xFFFF;
+
+    switch(op.handler)
+    {
+        case Chip8::H_SetImm: // mov byte [V+x], imm8
+            emit(0xC6); emitModRM(0, offsetV + op.x); emit(op.imm);
+            return true;
+
+        case Chip8::H_AddImm: // add byte [V+x], imm8
+            emit(0x80); emitModRM(0, offsetV + op.x); emit(op.imm);
+            return true;
+
+        case Chip8::H_Mov:
+            loadV(EAX, op.y);
+            storeV(EAX, op.x);
+            return true;
+
+        case Chip8::H_Or:
+        case Chip8::H_And:
+        case Chip8::H_Xor:
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(op.handler == Chip8::H_Or ? 0x08 : op.handler == Chip8::H_And ? 0x20 : 0x30);
+            emit(0xC8); // op al, cl
+            storeV(EAX, op.x);
+            return true;
+
+        case Chip8::H_AddReg: // VF = carry, then VX += VY
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x00); emit(0xC8); // add al, cl
+            emit(0x0F); emit(0x92); emit(0xC2); // setc dl
+            storeV(EDX, 0xF);
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x00); emit(0xC8); // add al, cl
+            storeV(EAX, op.x);
+            return true;
+
+        case Chip8::H_SubReg: // VF = VX > VY, then VX -= VY
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x38); emit(0xC8); // cmp al, cl
+            emit(0x0F); emit(0x97); emit(0xC2); // seta dl
+            storeV(EDX, 0xF);
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x28); emit(0xC8); // sub al, cl
+            storeV(EAX, op.x);
+            return true;
+
+        case Chip8::H_SubnReg: // VF = VX < VY, then VX = VY - VX
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x38); emit(0xC8); // cmp al, cl
+            emit(0x0F); emit(0x92); emit(0xC2); // setb dl
+            storeV(EDX, 0xF);
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x28); emit(0xC1); // sub cl, al
+            storeV(ECX, op.x);
+            return true;
+
+        case Chip8::H_ShiftRight: // VF = VX & 1, then VX >>= 1
+            loadV(EAX, op.x);
+            emit(0x24); emit(0x01); // and al, 1
+            storeV(EAX, 0xF);
+            loadV(EAX, op.x);
+            emit(0xD0); emit(0xE8); // shr al, 1
+            storeV(EAX, op.x);
+            return true;
+
+        case Chip8::H_ShiftLeft: // VF = VX >> 7, then VX <<= 1
+            loadV(EAX, op.x);
+            emit(0xC0); emit(0xE8); emit(7); // shr al, 7
+            storeV(EAX, 0xF);
+            loadV(EAX, op.x);
+            emit(0xD0); emit(0xE0); // shl al, 1
+            storeV(EAX, op.x);
+            return true;
+
+        case Chip8::H_SetIndex: // mov word [I], imm16
+            emit(0x66); emit(0xC7); emitModRM(0, offsetI);
+            emit(op.imm & 0xFF); emit(op.imm >> 8);
+            return true;
+
+        case Chip8::H_AddIndex: // add word [I], ax
+            loadV(EAX, op.x);
+            emit(0x66); emit(0x01); emitModRM(EAX, offsetI);
+            return true;
+
+        case Chip8::H_Jump:
+            emitReturn(op.imm);
+            endsBlock = true;
+            return true;
+
+        case Chip8::H_SkipEqImm:
+        case Chip8::H_SkipNeImm:
+            emit(0x80); emitModRM(7, offsetV + op.x); emit(op.imm); // cmp byte [V+x], imm8
+            break;
+
+        case Chip8::H_SkipEqReg:
+        case Chip8::H_SkipNeReg:
+            loadV(EAX, op.x);
+            loadV(ECX, op.y);
+            emit(0x38); emit(0xC8); // cmp al, cl
+            break;
+
+        default:
+            return false;
+    }
+
+    // the skips fall through to here with flags set: pick pc + 2 or pc + 4 (pc + 6 over F000 NNNN)
+    emit(0xB8); emit32(next); // mov eax, next
+    emit(0xBA); emit32(skip); // mov edx, skip
+    bool skipIfEqual = op.handler == Chip8::H_SkipEqImm || op.handler == Chip8::H_SkipEqReg;
+    emit(0x0F); emit(skipIfEqual ? 0x44 : 0x45); emit(0xC2); // cmove / cmovne eax, edx
+    emit(0xC3);
+    endsBlock = true;
+    return true;
+}
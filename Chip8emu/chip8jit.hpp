@@ -0,0 +1,77 @@
+//
+//  chip8jit.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/6/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef chip8jit_hpp
+#define chip8jit_hpp
+
+#include "chip8.hpp"
+
+// Only x86-64 with the System V calling convention (Linux, macOS) gets native code
+#if defined(__x86_64__) && !defined(_WIN32)
+#define CHIP8_JIT_SUPPORTED 1
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+/* Optional backend that translates basic blocks of CHIP-8 code into x86-64.
+ * A block starts at pc and runs until a jump or skip (or an opcode we don't translate),
+ * blocks are cached by start address. Anything we don't translate (draws, calls, key and
+ * timer ops...) runs through Chip8::emulateCycle, which stays the reference.
+ * If a write lands in a page a block was built from, the block gets rebuilt.
+ */
+class Chip8Jit : public Chip8Backend
+{
+public:
+    Chip8Jit(Chip8 &);
+    ~Chip8Jit();
+
+    int step(unsigned long limit = ~0UL) override;
+    // Throw away all translated code
+    void flush();
+
+    // stats
+    unsigned long blocksCompiled;
+    unsigned long jitInstructions;
+    unsigned long interpretedInstructions;
+
+private:
+    typedef unsigned int (*BlockFn)(Chip8 *); // returns the new pc
+
+    struct Block
+    {
+        BlockFn code; // null means the first instruction isn't translated, interpret it
+        int count; // number of instructions in the block
+        unsigned short lastOpcode;
+        unsigned short firstPage, lastPage;
+        unsigned int firstGeneration, lastGeneration;
+        bool valid;
+    };
+
+    Block blocks[4096];
+    unsigned char *arena;
+    size_t arenaUsed;
+
+    // offsets of the machine state inside Chip8, for addressing off the Chip8 pointer
+    int offsetV, offsetI;
+
+    Block &compile(unsigned short address);
+    // Makes the arena pages bytes from start cover writable or executable, false if it can't
+    bool protect(unsigned char *start, size_t bytes, bool writable);
+
+    // code emitters
+    unsigned char *out;
+    void emit(unsigned char);
+    void emit32(unsigned int);
+    void emitModRM(int reg, int offset);
+    void loadV(int reg, int index);
+    void storeV(int reg, int index);
+    void emitReturn(unsigned int pc);
+    bool translate(const DecodedOp &, unsigned short pc, bool &endsBlock);
+};
+
+#endif /* chip8jit_hpp */
@@ -0,0 +1,105 @@
+//
+//  delta.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "delta.hpp"
+
+void putVarint(std::vector<unsigned char> &out, uint64_t v)
+{
+    while(v >= 0x80)
+    {
+        out.push_back((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+bool getVarint(const unsigned char *&p, const unsigned char *end, uint64_t &v)
+{
+    v = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *p++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+unsigned char *putLE(unsigned char *p, uint64_t v, int bytes)
+{
+    for(int i = 0; i < bytes; ++i)
+        p[i] = v >> 8 * i;
+    return p + bytes;
+}
+
+void putLE(std::vector<unsigned char> &out, uint64_t v, int bytes)
+{
+    for(int i = 0; i < bytes; ++i)
+        out.push_back(v >> 8 * i);
+}
+
+uint64_t getLE(const unsigned char *&p, int bytes)
+{
+    uint64_t v = 0;
+    for(int i = bytes - 1; i >= 0; --i)
+        v = v << 8 | p[i];
+    p += bytes;
+    return v;
+}
+
+void deltaEncode(const unsigned char *state, const unsigned char *base, size_t size, std::vector<unsigned char> &out)
+{
+    size_t i = 0;
+    while(i < size)
+    {
+        size_t zeros = i;
+        while(zeros < size && (state[zeros] ^ (base ? base[zeros] : 0)) == 0)
+            ++zeros;
+        size_t literal = zeros;
+        // a literal run ends at the next run of 3+ zeros (shorter ones are cheaper inline)
+        while(literal < size)
+        {
+            if((state[literal] ^ (base ? base[literal] : 0)) == 0)
+            {
+                size_t z = literal;
+                while(z < size && z < literal + 3 && (state[z] ^ (base ? base[z] : 0)) == 0)
+                    ++z;
+                if(z == size || z == literal + 3)
+                    break;
+                literal = z;
+            }
+            else
+                ++literal;
+        }
+        putVarint(out, zeros - i);
+        putVarint(out, literal - zeros);
+        for(size_t j = zeros; j < literal; ++j)
+            out.push_back(state[j] ^ (base ? base[j] : 0));
+        i = literal;
+    }
+}
+
+size_t deltaDecode(const unsigned char *in, size_t inSize, unsigned char *state, size_t size)
+{
+    const unsigned char *p = in;
+    const unsigned char *end = in + inSize;
+    size_t i = 0;
+    while(i < size)
+    {
+        uint64_t zeros, literal;
+        if(!getVarint(p, end, zeros) || !getVarint(p, end, literal))
+            return 0;
+        if(zeros > size - i || literal > size - i - zeros || literal > (uint64_t)(end - p))
+            return 0; // corrupt
+        i += zeros;
+        for(uint64_t j = 0; j < literal; ++j)
+            state[i++] ^= *p++;
+    }
+    return p - in;
+}
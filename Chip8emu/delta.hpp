@@ -0,0 +1,38 @@
+//
+//  delta.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef delta_hpp
+#define delta_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* XOR delta + zero run length encoding, shared by the rewind buffer and the frame stream.
+ * The XOR of two nearly identical buffers is nearly all zeros, which we store as
+ * (zero run, literal count, literal bytes) pairs of varints until size bytes are covered.
+ */
+
+// Appends the encoding of state XOR base to out (base NULL means against zeros)
+void deltaEncode(const unsigned char *state, const unsigned char *base, size_t size, std::vector<unsigned char> &out);
+// XORs an encoded delta into state. Returns how many bytes of in it used, 0 if in is cut short.
+size_t deltaDecode(const unsigned char *in, size_t inSize, unsigned char *state, size_t size);
+
+// LEB128 style: 7 bits per byte, top bit set on all but the last
+void putVarint(std::vector<unsigned char> &out, uint64_t v);
+// Returns false if the varint runs past end
+bool getVarint(const unsigned char *&p, const unsigned char *end, uint64_t &v);
+
+// Fixed width fields in the file formats: the low bytes of v, lowest first whatever the host is.
+// Returns p + bytes.
+unsigned char *putLE(unsigned char *p, uint64_t v, int bytes);
+void putLE(std::vector<unsigned char> &out, uint64_t v, int bytes);
+// Reads what putLE wrote and moves p past it
+uint64_t getLE(const unsigned char *&p, int bytes);
+
+#endif /* delta_hpp */
@@ -0,0 +1,173 @@
+//
+//  emuthread.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/21/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "emuthread.hpp"
+#include <string.h>
+#include <chrono>
+
+uint64_t inputClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameMailbox::FrameMailbox() : backIndex(0), frontIndex(1), middle(2), published(0), received(0)
+{
+    memset(frames, 0, sizeof(frames));
+    memset(drawn, 0, sizeof(drawn));
+}
+
+void FrameMailbox::publish()
+{
+    Frame &frame = frames[backIndex];
+    frame.number = ++published;
+    drawn[published % HISTORY] = frame.dirtyRows;
+    /* Add the rows of the frames since the one the consumer has, it may never see them. If it
+     * picks up another one meanwhile this covers more than needed, never less.
+     */
+    unsigned long long since = received.load(std::memory_order_acquire);
+    if(published - since >= HISTORY)
+        frame.dirtyRows = ~0ULL;
+    else
+        for(unsigned long long n = since + 1; n < published; ++n)
+            frame.dirtyRows |= drawn[n % HISTORY];
+    // hand the finished frame over and take whatever was in the middle to fill next
+    backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & 3;
+}
+
+bool FrameMailbox::receive()
+{
+    if(!(middle.load(std::memory_order_relaxed) & FRESH))
+        return false;
+    frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & 3;
+    received.store(frames[frontIndex].number, std::memory_order_release);
+    return true;
+}
+
+EmulationThread::EmulationThread(Chip8 &chip, Scheduler &s) : events(0), totalLatency(0), maxLatency(0), dropped(0),
+    recording(NULL), runAhead(chip, s),
+    c8(chip), scheduler(s), rewinding(false), running(false)
+{
+}
+
+EmulationThread::~EmulationThread()
+{
+    stop();
+}
+
+void EmulationThread::start()
+{
+    if(running)
+        return;
+    running = true;
+    scheduler.resync();
+    thread = std::thread(&EmulationThread::run, this);
+}
+
+void EmulationThread::stop()
+{
+    running = false;
+    if(thread.joinable())
+        thread.join();
+}
+
+bool EmulationThread::send(InputEvent::Type type, unsigned char key)
+{
+    InputEvent event;
+    event.type = type;
+    event.key = key;
+    event.time = inputClock();
+    if(input.push(event))
+        return true;
+    ++dropped;
+    return false;
+}
+
+void EmulationThread::apply(const InputEvent &event)
+{
+    switch(event.type)
+    {
+        case InputEvent::KEY_DOWN:
+            c8.keyDown(event.key); // also wakes up FX0A
+            if(recording)
+                recording->keyDown(c8, event.key);
+            break;
+        case InputEvent::KEY_UP:
+            c8.keyUp(event.key);
+            if(recording)
+                recording->keyUp(c8, event.key);
+            break;
+        case InputEvent::REWIND_START: rewinding = true; break;
+        case InputEvent::REWIND_STOP:
+            rewinding = false;
+            c8.dirtyRows = ~0ULL; // the screen ahead goes back up in place of the rewound one
+            break;
+    }
+    unsigned long long waited = inputClock() - event.time;
+    ++events;
+    totalLatency += waited;
+    if(waited > maxLatency)
+        maxLatency = waited;
+}
+
+void EmulationThread::run()
+{
+    while(running)
+    {
+        // input first, so it's seen by this batch rather than the next (at most a frame late)
+        InputEvent event;
+        while(input.pop(event))
+            apply(event);
+
+        if(rewinding)
+        {
+            // one frame back per frame, keep the oldest one once we run out
+            if(rewindBuffer.frames() > 1)
+            {
+                rewindBuffer.rewind(c8, 1);
+                if(recording)
+                    recording->rewound(c8);
+            }
+            c8.drawFlag = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 60));
+            scheduler.resync();
+        }
+        else
+        {
+            scheduler.update(); // emulate whatever is due, sleeps if it's too early
+            rewindBuffer.push(c8);
+        }
+
+        if(runAhead.frames && !rewinding)
+        {
+            // a real draw goes out too, it may be what a rewind left on screen
+            if(runAhead.step() || c8.drawFlag)
+            {
+                Frame &frame = frames.back();
+                memcpy(frame.gfx, runAhead.gfx, sizeof(frame.gfx));
+                frame.hires = runAhead.hires;
+                frame.dirtyRows = runAhead.dirtyRows | c8.dirtyRows;
+                frame.cycles = runAhead.cycles;
+                frames.publish();
+            }
+            c8.drawFlag = false;
+            c8.dirtyRows = 0;
+        }
+        // every draw since the last frame goes out in this one
+        else if(c8.drawFlag)
+        {
+            Frame &frame = frames.back();
+            memcpy(frame.gfx, c8.gfx, sizeof(frame.gfx));
+            frame.hires = c8.hires;
+            frame.dirtyRows = c8.dirtyRows;
+            frame.cycles = c8.cycles;
+            frames.publish();
+            c8.drawFlag = false;
+            c8.dirtyRows = 0;
+        }
+    }
+}
@@ -0,0 +1,121 @@
+//
+//  emuthread.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/21/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef emuthread_hpp
+#define emuthread_hpp
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include "snapshot.hpp"
+#include "inputlog.hpp"
+#include "runahead.hpp"
+#include "spscring.hpp"
+
+/* Running the emulator on its own thread, away from the window. The window thread sends input
+ * through an InputRing and picks up finished screens from a FrameMailbox, neither side ever
+ * waits on the other. Nothing in here needs GLUT.
+ */
+
+// Something the user did, stamped with when the window thread saw it
+struct InputEvent
+{
+    enum Type { KEY_DOWN, KEY_UP, REWIND_START, REWIND_STOP };
+    unsigned char type;
+    unsigned char key; // keypad key for KEY_DOWN / KEY_UP
+    uint64_t time; // steady_clock nanoseconds
+};
+
+// Input from the window thread to the emulation thread
+typedef SpscRing<InputEvent, 256> InputRing;
+
+// A finished screen
+struct Frame
+{
+    uint64_t gfx[DISPLAY_PLANES * 2 * DISPLAY_ROWS]; // as Chip8::gfx
+    bool hires;
+    // Rows drawn since the frame before (Chip8::dirtyRows). publish() widens it to every row drawn
+    // since the frame the consumer last received, so skipped frames don't lose any.
+    uint64_t dirtyRows;
+    unsigned long long cycles; // Chip8::cycles when it was taken
+    unsigned long long number; // counts up from 1 with every publish
+};
+
+/* Triple buffer: the producer always has a frame of its own to fill and the consumer one to show,
+ * the third is the latest finished one. Publishing and picking up are a single atomic exchange,
+ * so the producer never waits for a slow present and the consumer always gets the newest frame
+ * (frames it was too slow for are simply replaced).
+ */
+class FrameMailbox
+{
+public:
+    FrameMailbox();
+    // Producer: the frame to fill, then publish() it
+    Frame &back() { return frames[backIndex]; }
+    void publish();
+    // Consumer: true if a new frame came in since last time, front() is then the newest one.
+    // front() stays valid and untouched until the next call.
+    bool receive();
+    const Frame &front() const { return frames[frontIndex]; }
+
+private:
+    enum { FRESH = 4 }; // set in middle when it holds a frame the consumer hasn't seen
+    enum { HISTORY = 64 }; // frames of dirty rows kept, further behind than that redraws everything
+    Frame frames[3];
+    unsigned char backIndex, frontIndex;
+    std::atomic<unsigned char> middle; // index of the latest finished frame, plus FRESH
+    unsigned long long published;
+    uint64_t drawn[HISTORY]; // each frame's own dirty rows, by number
+    std::atomic<unsigned long long> received; // number of the frame the consumer last picked up
+};
+
+/* Owns the emulation loop: applies queued input, runs the scheduler (throttled to the target ips),
+ * keeps the rewind history and publishes a frame whenever the screen changed. With run-ahead on
+ * the frames published are the ones runAhead.frames ahead (not while rewinding).
+ * The Chip8 and Scheduler belong to the emulation thread between start() and stop().
+ */
+class EmulationThread
+{
+public:
+    EmulationThread(Chip8 &, Scheduler &);
+    ~EmulationThread(); // stops the thread
+    void start();
+    void stop();
+
+    // Called from the window thread. False if the queue was full and the event got dropped.
+    bool send(InputEvent::Type, unsigned char key = 0);
+    FrameMailbox frames;
+
+    // How long events waited between send() and the emulation thread acting on them, nanoseconds
+    std::atomic<unsigned long long> events, totalLatency, maxLatency;
+    std::atomic<unsigned long long> dropped; // events lost to a full queue
+
+    // Key presses also go in here when set (before start()), rewinds take back what they undo
+    InputLog *recording;
+    // Set runAhead.frames before start(), read what it cost after stop()
+    RunAhead runAhead;
+
+private:
+    Chip8 &c8;
+    Scheduler &scheduler;
+    RewindBuffer rewindBuffer; // last few minutes of frames
+    bool rewinding;
+    InputRing input;
+    std::thread thread;
+    std::atomic<bool> running;
+
+    void run();
+    void apply(const InputEvent &);
+};
+
+// steady_clock now in nanoseconds, what InputEvent::time holds
+uint64_t inputClock();
+
+#endif /* emuthread_hpp */
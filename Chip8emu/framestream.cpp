@@ -0,0 +1,287 @@
+//
+//  framestream.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "framestream.hpp"
+#include <string.h>
+#include "delta.hpp"
+#include "pixels.hpp"
+
+#define HEADER_SIZE 12
+// frames are written out in chunks of about this much, rather than one fwrite per frame
+#define FLUSH_SIZE (64 * 1024)
+// biggest a frame record can get: cycle varint plus a worst case delta of a whole screen
+#define MAX_FRAME (4 * FRAMESTREAM_SCREEN)
+// a version 1 screen: 32 rows of 8 bytes
+#define SCREEN_V1 256
+
+// Screen words as big endian bytes, so the leftmost pixel comes first in the file
+static void packScreen(const uint64_t *gfx, int words, unsigned char *out)
+{
+    for(int y = 0; y < words; ++y)
+        for(int b = 0; b < 8; ++b)
+            *out++ = gfx[y] >> (56 - b * 8);
+}
+
+static void unpackScreen(const unsigned char *in, int words, uint64_t *gfx)
+{
+    for(int y = 0; y < words; ++y)
+    {
+        uint64_t row = 0;
+        for(int b = 0; b < 8; ++b)
+            row = row << 8 | *in++;
+        gfx[y] = row;
+    }
+}
+
+FrameWriter::FrameWriter() : file(NULL), ownsFile(false), failed(false)
+{
+    buffer.reserve(FLUSH_SIZE + MAX_FRAME);
+}
+
+FrameWriter::~FrameWriter()
+{
+    close();
+}
+
+bool FrameWriter::open(const char *filename, unsigned int ips)
+{
+    if(!strcmp(filename, "-"))
+        return open(stdout, ips);
+    FILE *f = fopen(filename, "wb");
+    if(!f)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", filename);
+        return false;
+    }
+    open(f, ips);
+    ownsFile = true;
+    return true;
+}
+
+bool FrameWriter::open(FILE *f, unsigned int ips)
+{
+    close();
+    file = f;
+    ownsFile = false;
+    failed = false;
+    frames = 0;
+    bytes = HEADER_SIZE;
+    lastCycle = 0;
+    memset(previous, 0, sizeof(previous));
+
+    buffer.clear();
+    const unsigned char header[HEADER_SIZE] = {'C', '8', 'F', 'S', FRAMESTREAM_VERSION, 128, 64, DISPLAY_PLANES,
+        (unsigned char)ips, (unsigned char)(ips >> 8), (unsigned char)(ips >> 16), (unsigned char)(ips >> 24)};
+    for(int i = 0; i < HEADER_SIZE; ++i)
+        buffer.push_back(header[i]);
+    return true;
+}
+
+void FrameWriter::close()
+{
+    if(!file)
+        return;
+    flush();
+    if(ownsFile)
+        fclose(file);
+    else
+        fflush(file);
+    file = NULL;
+}
+
+bool FrameWriter::capture(Chip8 &c8)
+{
+    if(!file || !c8.drawFlag)
+        return false;
+    c8.drawFlag = false;
+
+    current[0] = c8.hires;
+    packScreen(c8.gfx, DISPLAY_PLANES * 2 * DISPLAY_ROWS, current + 1);
+    if(memcmp(current, previous, sizeof(current)) == 0)
+        return false; // drew something and erased it again
+
+    size_t before = buffer.size();
+    putVarint(buffer, c8.cycles - lastCycle);
+    deltaEncode(current, previous, sizeof(current), buffer);
+    bytes += buffer.size() - before;
+    memcpy(previous, current, sizeof(previous));
+    lastCycle = c8.cycles;
+    ++frames;
+
+    if(buffer.size() >= FLUSH_SIZE)
+        flush();
+    return true;
+}
+
+bool FrameWriter::flush()
+{
+    if(!file)
+        return false;
+    if(!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size() && !failed)
+    {
+        fprintf(stderr, "Problem writing frame stream\n");
+        failed = true;
+    }
+    buffer.clear(); // keeps its capacity
+    return !failed;
+}
+
+FrameReader::FrameReader() : file(NULL), ownsFile(false), pos(0), end(0)
+{
+    buffer.resize(FLUSH_SIZE);
+}
+
+FrameReader::~FrameReader()
+{
+    close();
+}
+
+bool FrameReader::open(const char *filename)
+{
+    if(!strcmp(filename, "-"))
+        return open(stdin);
+    FILE *f = fopen(filename, "rb");
+    if(!f)
+    {
+        fprintf(stderr, "Could not open file %s\n", filename);
+        return false;
+    }
+    if(!open(f))
+    {
+        fclose(f);
+        return false;
+    }
+    ownsFile = true;
+    return true;
+}
+
+bool FrameReader::open(FILE *f)
+{
+    close();
+    file = f;
+    ownsFile = false;
+    pos = end = 0;
+    cycle = 0;
+    frames = 0;
+    memset(screen, 0, sizeof(screen));
+    memset(gfx, 0, sizeof(gfx));
+    hires = false;
+    if(!readHeader())
+    {
+        fprintf(stderr, "Not a frame stream\n");
+        file = NULL;
+        return false;
+    }
+    return true;
+}
+
+void FrameReader::close()
+{
+    if(file && ownsFile)
+        fclose(file);
+    file = NULL;
+}
+
+bool FrameReader::fill(size_t wanted)
+{
+    if(end - pos >= wanted)
+        return true;
+    memmove(&buffer[0], &buffer[pos], end - pos);
+    end -= pos;
+    pos = 0;
+    if(file)
+        end += fread(&buffer[end], 1, buffer.size() - end, file);
+    return end - pos >= wanted;
+}
+
+bool FrameReader::readHeader()
+{
+    if(!fill(HEADER_SIZE))
+        return false;
+    const unsigned char *h = &buffer[pos];
+    if(memcmp(h, "C8FS", 4) != 0)
+        return false;
+    version = h[4];
+    if(version == 1 && h[5] == 64 && h[6] == 32)
+        screenSize = SCREEN_V1;
+    else if(version == FRAMESTREAM_VERSION && h[5] == 128 && h[6] == 64 && h[7] == DISPLAY_PLANES)
+        screenSize = FRAMESTREAM_SCREEN;
+    else
+        return false;
+    ips = h[8] | h[9] << 8 | h[10] << 16 | (unsigned int)h[11] << 24;
+    pos += HEADER_SIZE;
+    return true;
+}
+
+bool FrameReader::next()
+{
+    fill(MAX_FRAME); // a short read just means we're near the end
+    if(pos == end)
+        return false;
+
+    const unsigned char *p = &buffer[pos];
+    const unsigned char *stop = &buffer[0] + end;
+    uint64_t delta;
+    if(!getVarint(p, stop, delta))
+        return false;
+    size_t used = deltaDecode(p, stop - p, screen, screenSize);
+    if(!used)
+        return false;
+    pos = (p + used) - &buffer[0];
+
+    cycle += delta;
+    if(screenSize == SCREEN_V1)
+        unpackScreen(screen, 32, gfx);
+    else
+    {
+        hires = screen[0] != 0;
+        unpackScreen(screen + 1, DISPLAY_PLANES * 2 * DISPLAY_ROWS, gfx);
+    }
+    ++frames;
+    return true;
+}
+
+long exportGrayVideo(const char *streamFile, const char *videoFile)
+{
+    FrameReader reader;
+    if(!reader.open(streamFile))
+        return -1;
+    FILE *out = !strcmp(videoFile, "-") ? stdout : fopen(videoFile, "wb");
+    if(!out)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", videoFile);
+        return -1;
+    }
+    unsigned int ips = reader.ips ? reader.ips : 1;
+
+    // the stream only has changes, video needs every 60th of a second so we repeat frames
+    unsigned char image[128 * 64] = { };
+    PixelOptions options;
+    options.format = PIXEL_GRAY8;
+    long written = 0;
+    bool ok = true;
+    while(ok && reader.next())
+    {
+        long shownAt = (long)(reader.cycle * 60 / ips);
+        for(; ok && written < shownAt; ++written)
+            ok = fwrite(image, 1, sizeof(image), out) == sizeof(image);
+        options.scale = reader.hires ? 1 : 2;
+        renderPixels(reader.gfx, reader.hires, options, image);
+    }
+    ok = ok && fwrite(image, 1, sizeof(image), out) == sizeof(image); // and the last one
+    ++written;
+
+    // a full disk may only show up when the buffer goes out
+    ok &= (out == stdout ? fflush(out) : fclose(out)) == 0;
+    if(!ok)
+    {
+        fprintf(stderr, "Could not write %s\n", videoFile);
+        return -1;
+    }
+    return written;
+}
@@ -0,0 +1,100 @@
+//
+//  framestream.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef framestream_hpp
+#define framestream_hpp
+
+#include <stdio.h>
+#include <vector>
+#include "chip8.hpp"
+
+/* Headless recording of what the screen showed, for QA and offline analysis.
+ *
+ * Stream layout: "C8FS", version byte, width, height, planes, ips (4 bytes little endian), then
+ * one record per frame: varint cycles since the previous frame, then the screen XORed against the
+ * previous frame and zero run encoded (see delta.hpp). The first frame is against a blank screen.
+ * The screen is a mode byte (1 for 128x64, 0 for 64x32) and Chip8::gfx as big endian bytes, so
+ * the leftmost pixel is the top bit of the first byte of its row. Width and height are the
+ * biggest the screen gets, the mode byte says what it is in each frame.
+ * Version 1 streams (64x32, one plane, no mode byte) can still be read.
+ */
+
+#define FRAMESTREAM_VERSION 2
+// a version 2 screen: the mode byte and the whole of Chip8::gfx
+#define FRAMESTREAM_SCREEN (1 + DISPLAY_PLANES * 2 * DISPLAY_ROWS * 8)
+
+class FrameWriter
+{
+public:
+    FrameWriter();
+    ~FrameWriter(); // flushes and closes
+
+    // "-" writes to stdout. ips goes in the header so the exporter knows the frame timing.
+    bool open(const char *filename, unsigned int ips);
+    // Takes over an already open file, doesn't close it
+    bool open(FILE *, unsigned int ips);
+    void close();
+
+    /* Call after each chunk of emulation. Writes a frame if drawFlag is set and the screen
+     * actually changed since the last one, and clears drawFlag like the GL frontend does.
+     * Returns true if a frame was written.
+     */
+    bool capture(Chip8 &);
+    // Pushes buffered frames out to the file
+    bool flush();
+
+    unsigned long long frames; // frames written
+    unsigned long long bytes; // stream size so far, header included
+
+private:
+    FILE *file;
+    bool ownsFile;
+    bool failed;
+    unsigned long long lastCycle;
+    unsigned char previous[FRAMESTREAM_SCREEN];
+    unsigned char current[FRAMESTREAM_SCREEN];
+    std::vector<unsigned char> buffer; // frames waiting to be written, reserved once
+};
+
+class FrameReader
+{
+public:
+    FrameReader();
+    ~FrameReader();
+
+    bool open(const char *filename); // "-" reads stdin
+    bool open(FILE *); // doesn't close it
+    void close();
+
+    // Reads the next frame into gfx/cycle. Returns false at the end of the stream or on bad data.
+    bool next();
+
+    unsigned int ips;
+    unsigned int version;
+    unsigned long long cycle; // emulated cycle the frame was captured at
+    uint64_t gfx[DISPLAY_PLANES * 2 * DISPLAY_ROWS]; // same layout as Chip8::gfx
+    bool hires;
+    unsigned long long frames; // frames read so far
+
+private:
+    FILE *file;
+    bool ownsFile;
+    unsigned char screen[FRAMESTREAM_SCREEN];
+    size_t screenSize; // depends on the version
+    std::vector<unsigned char> buffer;
+    size_t pos, end;
+
+    bool fill(size_t wanted); // make sure at least wanted bytes are buffered, if the file has them
+    bool readHeader();
+};
+
+// Converts a stream to raw 8 bit grayscale video at 60 fps (128x64, 64x32 screens doubled, shades from
+// grayPalette in pixels.hpp), e.g. for ffmpeg -f rawvideo -pix_fmt gray -s 128x64 -r 60. Returns the video frame count, -1 on error.
+long exportGrayVideo(const char *streamFile, const char *videoFile);
+
+#endif /* framestream_hpp */
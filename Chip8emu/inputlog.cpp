@@ -0,0 +1,185 @@
+//
+//  inputlog.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/22/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "inputlog.hpp"
+#include <stdio.h>
+#include <string.h>
+#include "delta.hpp"
+
+#define HEADER_SIZE 25
+
+InputLog::InputLog() : ips(DEFAULT_IPS), romHash(0), seed(0), finalHash(0)
+{
+}
+
+void InputLog::add(unsigned long long cycle, unsigned char type, unsigned char key)
+{
+    InputLogEvent event;
+    event.cycle = cycle;
+    event.type = type;
+    event.key = key & 0xF;
+    events.push_back(event);
+}
+
+void InputLog::keyDown(const Chip8 &c8, unsigned char key)
+{
+    add(c8.cycles, InputLogEvent::KEY_DOWN, key);
+}
+
+void InputLog::keyUp(const Chip8 &c8, unsigned char key)
+{
+    add(c8.cycles, InputLogEvent::KEY_UP, key);
+}
+
+void InputLog::rewound(const Chip8 &c8)
+{
+    // a snapshot is taken after a batch runs, before the next batch's input, so input at its cycle came later
+    while(!events.empty() && events.back().cycle >= c8.cycles)
+        events.pop_back();
+}
+
+void InputLog::finish(const Chip8 &c8)
+{
+    if(length())
+        events.pop_back();
+    add(c8.cycles, InputLogEvent::END, 0);
+    finalHash = c8.displayHash();
+}
+
+unsigned long long InputLog::length() const
+{
+    return !events.empty() && events.back().type == InputLogEvent::END ? events.back().cycle : 0;
+}
+
+bool InputLog::save(const char *filename) const
+{
+    std::vector<unsigned char> out(5);
+    memcpy(&out[0], "C8IN", 4);
+    out[4] = INPUTLOG_VERSION;
+    putLE(out, ips, 4);
+    putLE(out, romHash, 8);
+    putLE(out, seed, 8);
+    unsigned long long last = 0;
+    for(size_t i = 0; i < events.size(); ++i)
+    {
+        putVarint(out, (events[i].cycle - last) << 6 | events[i].type << 4 | events[i].key);
+        last = events[i].cycle;
+    }
+    if(length())
+        putLE(out, finalHash, 8);
+
+    FILE *file = fopen(filename, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", filename);
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok &= fclose(file) == 0;
+    if(!ok)
+        fprintf(stderr, "Problem writing input log %s\n", filename);
+    return ok;
+}
+
+bool InputLog::load(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open input log %s\n", filename);
+        return false;
+    }
+    std::vector<unsigned char> in;
+    unsigned char chunk[4096];
+    size_t got;
+    while((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        in.insert(in.end(), chunk, chunk + got);
+    fclose(file);
+
+    events.clear();
+    finalHash = 0;
+    if(in.size() < HEADER_SIZE || memcmp(in.data(), "C8IN", 4) || in[4] != INPUTLOG_VERSION)
+    {
+        fprintf(stderr, "%s is not an input log (or from another version)\n", filename);
+        return false;
+    }
+    const unsigned char *p = in.data() + 5, *end = in.data() + in.size();
+    ips = (unsigned int)getLE(p, 4);
+    romHash = getLE(p, 8);
+    seed = getLE(p, 8);
+
+    unsigned long long cycle = 0;
+    while(p < end && !length())
+    {
+        uint64_t record;
+        if(!getVarint(p, end, record) || (record >> 4 & 3) > InputLogEvent::END)
+        {
+            fprintf(stderr, "Bad record in input log %s\n", filename);
+            return false;
+        }
+        cycle += record >> 6;
+        add(cycle, record >> 4 & 3, record & 0xF);
+    }
+    if(length())
+    {
+        if(end - p < 8)
+        {
+            fprintf(stderr, "Input log %s is cut short\n", filename);
+            return false;
+        }
+        finalHash = getLE(p, 8);
+    }
+    return true;
+}
+
+InputReplay::InputReplay(const InputLog &l) : log(l), next(0)
+{
+}
+
+void InputReplay::prepare(Chip8 &c8, Scheduler &scheduler) const
+{
+    c8.seedRandom(log.seed);
+    scheduler.setIPS(log.ips);
+}
+
+unsigned long InputReplay::run(Chip8 &c8, Scheduler &scheduler, unsigned long n)
+{
+    unsigned long long start = c8.cycles, end = start + n;
+    if(log.length() && end > log.length())
+        end = log.length();
+    while(c8.cycles < end)
+    {
+        // the live loop takes input between batches, before running the next one
+        for(; next < log.events.size() && log.events[next].cycle <= c8.cycles; ++next)
+        {
+            const InputLogEvent &event = log.events[next];
+            if(event.type == InputLogEvent::KEY_DOWN)
+                c8.keyDown(event.key);
+            else if(event.type == InputLogEvent::KEY_UP)
+                c8.keyUp(event.key);
+        }
+        unsigned long long stop = end;
+        if(next < log.events.size() && log.events[next].cycle < stop)
+            stop = log.events[next].cycle;
+        scheduler.runInstructions((unsigned long)(stop - c8.cycles));
+        // parked on FX0A: the time passes until the next key, as it did live
+        if(c8.waitingForKey)
+            scheduler.idle(stop - c8.cycles);
+    }
+    return (unsigned long)(c8.cycles - start);
+}
+
+bool InputReplay::finished(const Chip8 &c8) const
+{
+    return log.length() && c8.cycles >= log.length();
+}
+
+bool InputReplay::matches(const Chip8 &c8) const
+{
+    return finished(c8) && c8.displayHash() == log.finalHash;
+}
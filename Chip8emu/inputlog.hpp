@@ -0,0 +1,92 @@
+//
+//  inputlog.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/22/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef inputlog_hpp
+#define inputlog_hpp
+
+#include <stdint.h>
+#include <vector>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+
+/* Recording a session's input so it can be replayed exactly, headless and as fast as the host goes.
+ * Everything else a run depends on is in the header: the ROM (by hash), the random seed and the ips.
+ *
+ * File layout: "C8IN", version byte, ips (4 bytes), ROM hash (8), seed (8), all little endian, then
+ * one varint per event: cycles since the previous event << 6 | type << 4 | key. The last record
+ * is an END (key 0) at the cycle the session stopped, followed by the display hash it stopped on
+ * (8 bytes), so a replay can check it got the same picture.
+ */
+
+#define INPUTLOG_VERSION 1
+
+struct InputLogEvent
+{
+    enum Type { KEY_UP, KEY_DOWN, END };
+    unsigned long long cycle; // Chip8::cycles when it happened
+    unsigned char type;
+    unsigned char key;
+};
+
+/* A whole log, in memory (a few bytes per key press). Recording appends to it, save() writes it out,
+ * load() reads one back.
+ */
+class InputLog
+{
+public:
+    InputLog();
+
+    unsigned int ips;
+    uint64_t romHash; // RomStore::hash of the ROM file
+    uint64_t seed; // Chip8::randomSeed
+    std::vector<InputLogEvent> events; // in cycle order, END last once finished
+    unsigned long long finalHash; // display hash at END
+
+    // Recording: the event happened at the machine's current cycle
+    void keyDown(const Chip8 &, unsigned char key);
+    void keyUp(const Chip8 &, unsigned char key);
+    /* After a rewind: the machine went back to an earlier cycle, so whatever was recorded from
+     * there on never happened
+     */
+    void rewound(const Chip8 &);
+    // Closes the log with an END at the current cycle and screen
+    void finish(const Chip8 &);
+    // Cycle count the session stopped at, 0 if there's no END yet
+    unsigned long long length() const;
+
+    bool save(const char *filename) const;
+    bool load(const char *filename);
+
+private:
+    void add(unsigned long long cycle, unsigned char type, unsigned char key);
+};
+
+/* Plays a log into a machine: presses and releases keys at exactly the recorded cycles and,
+ * while the machine waits for a key, lets the time pass like the live Scheduler does.
+ * Start from a fresh machine with the log's ROM loaded, then prepare() it.
+ */
+class InputReplay
+{
+public:
+    InputReplay(const InputLog &);
+
+    // Seeds the machine with the log's seed and sets the scheduler to its ips
+    void prepare(Chip8 &, Scheduler &) const;
+    // Runs n more cycles (stops at the END), returns how many passed
+    unsigned long run(Chip8 &, Scheduler &, unsigned long n);
+    // Reached the END
+    bool finished(const Chip8 &) const;
+    // Finished on the same screen as the recording
+    bool matches(const Chip8 &) const;
+
+private:
+    const InputLog &log;
+    size_t next; // next event to apply
+};
+
+#endif /* inputlog_hpp */
@@ -0,0 +1,679 @@
+//
+//  lanes.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "lanes.hpp"
+#include <string.h>
+#include "scheduler.hpp"
+#include "trace.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/* A row is one byte per lane. With AVX2 that's exactly one register, without it the same
+ * helpers are loops over 32 bytes.
+ */
+#if defined(__AVX2__)
+typedef __m256i Row;
+
+static inline Row loadRow(const unsigned char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline Row splat(unsigned char b) { return _mm256_set1_epi8((char)b); }
+static inline Row add(Row a, Row b) { return _mm256_add_epi8(a, b); }
+static inline Row sub(Row a, Row b) { return _mm256_sub_epi8(a, b); }
+static inline Row andRow(Row a, Row b) { return _mm256_and_si256(a, b); }
+static inline Row orRow(Row a, Row b) { return _mm256_or_si256(a, b); }
+static inline Row xorRow(Row a, Row b) { return _mm256_xor_si256(a, b); }
+// there are no byte shifts, shift words and drop what crossed over from the neighbour
+static inline Row shr(Row a, int n) { return _mm256_and_si256(_mm256_srli_epi16(a, n), splat(0xFF >> n)); }
+static inline Row shl1(Row a) { return _mm256_add_epi8(a, a); }
+static inline Row dec(Row a) { return _mm256_subs_epu8(a, splat(1)); } // stops at zero
+// lanes where a == b / a > b (unsigned), as a lane mask
+static inline uint32_t eq(Row a, Row b) { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)); }
+static inline uint32_t gtu(Row a, Row b)
+{
+    return _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_xor_si256(a, splat(0x80)), _mm256_xor_si256(b, splat(0x80))));
+}
+// 0 or 1 per lane
+static inline Row flag(uint32_t m)
+{
+    // byte i gets byte i / 8 of the mask, then each byte keeps its own bit
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bit = _mm256_set1_epi64x(0x8040201008040201LL);
+    __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(m), spread);
+    return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(bytes, bit), bit), splat(1));
+}
+// writes r into the lanes in m only
+static inline void storeRow(unsigned char *p, Row r, uint32_t m)
+{
+    __m256i keep = _mm256_cmpeq_epi8(flag(m), _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i *)p, _mm256_blendv_epi8(r, loadRow(p), keep));
+}
+
+// value into the lanes in m of a row of 16 bit words
+static inline void setWords(unsigned short *w, uint32_t m, unsigned short value)
+{
+    const __m256i bit = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+    __m256i v = _mm256_set1_epi16((short)value);
+    for(int half = 0; half < 2; ++half)
+    {
+        __m256i sel = _mm256_and_si256(_mm256_set1_epi16((short)(m >> (16 * half))), bit);
+        __m256i *p = (__m256i *)(w + 16 * half);
+        _mm256_storeu_si256(p, _mm256_blendv_epi8(_mm256_loadu_si256(p), v, _mm256_cmpeq_epi16(sel, bit)));
+    }
+}
+
+// lanes in m that are on the lowest pc of any of them, and that pc
+static inline uint32_t lowest(const unsigned short *pc, uint32_t m, unsigned short *at)
+{
+    const __m256i bit = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+    __m256i ones = _mm256_set1_epi16(-1);
+    __m256i sel = _mm256_and_si256(_mm256_set1_epi16((short)m), bit);
+    __m256i lo = _mm256_blendv_epi8(ones, _mm256_loadu_si256((const __m256i *)pc), _mm256_cmpeq_epi16(sel, bit));
+    sel = _mm256_and_si256(_mm256_set1_epi16((short)(m >> 16)), bit);
+    __m256i hi = _mm256_blendv_epi8(ones, _mm256_loadu_si256((const __m256i *)(pc + 16)), _mm256_cmpeq_epi16(sel, bit));
+    __m256i low = _mm256_min_epu16(lo, hi);
+    __m128i low128 = _mm_min_epu16(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1));
+    *at = (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(low128));
+    __m256i target = _mm256_set1_epi16((short)*at);
+    // packing interleaves the 128 bit halves, put them back in lane order
+    __m256i hits = _mm256_packs_epi16(_mm256_cmpeq_epi16(lo, target), _mm256_cmpeq_epi16(hi, target));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_permute4x64_epi64(hits, 0xD8)) & m;
+}
+#else
+struct Row { unsigned char b[32]; };
+
+static inline Row loadRow(const unsigned char *p) { Row r; memcpy(r.b, p, 32); return r; }
+static inline Row splat(unsigned char v) { Row r; memset(r.b, v, 32); return r; }
+#define CHIP8_ROW_OP(name, expr) \
+    static inline Row name(Row a, Row b) { Row r; for(int l = 0; l < 32; ++l) r.b[l] = (expr); return r; }
+CHIP8_ROW_OP(add, a.b[l] + b.b[l])
+CHIP8_ROW_OP(sub, a.b[l] - b.b[l])
+CHIP8_ROW_OP(andRow, a.b[l] & b.b[l])
+CHIP8_ROW_OP(orRow, a.b[l] | b.b[l])
+CHIP8_ROW_OP(xorRow, a.b[l] ^ b.b[l])
+#undef CHIP8_ROW_OP
+static inline Row shr(Row a, int n) { for(int l = 0; l < 32; ++l) a.b[l] >>= n; return a; }
+static inline Row shl1(Row a) { for(int l = 0; l < 32; ++l) a.b[l] <<= 1; return a; }
+static inline Row dec(Row a) { for(int l = 0; l < 32; ++l) a.b[l] -= a.b[l] > 0; return a; }
+static inline uint32_t eq(Row a, Row b)
+{
+    uint32_t m = 0;
+    for(int l = 0; l < 32; ++l)
+        m |= (uint32_t)(a.b[l] == b.b[l]) << l;
+    return m;
+}
+static inline uint32_t gtu(Row a, Row b)
+{
+    uint32_t m = 0;
+    for(int l = 0; l < 32; ++l)
+        m |= (uint32_t)(a.b[l] > b.b[l]) << l;
+    return m;
+}
+static inline Row flag(uint32_t m) { Row r; for(int l = 0; l < 32; ++l) r.b[l] = (m >> l) & 1; return r; }
+static inline void storeRow(unsigned char *p, Row r, uint32_t m)
+{
+    for(int l = 0; l < 32; ++l)
+        if(m >> l & 1)
+            p[l] = r.b[l];
+}
+
+static inline void setWords(unsigned short *w, uint32_t m, unsigned short value)
+{
+    for(int l = 0; l < 32; ++l)
+        if(m >> l & 1)
+            w[l] = value;
+}
+
+static inline uint32_t lowest(const unsigned short *pc, uint32_t m, unsigned short *at)
+{
+    unsigned int low = 0xFFFF;
+    for(int l = 0; l < 32; ++l)
+        if(m >> l & 1 && pc[l] < low)
+            low = pc[l];
+    *at = low;
+    uint32_t hits = 0;
+    for(int l = 0; l < 32; ++l)
+        hits |= (uint32_t)(pc[l] == low) << l;
+    return hits & m;
+}
+#endif
+
+// for walking the lanes in a mask
+#define FOR_LANES(l, mask) for(uint32_t bits_ = (mask); bits_; bits_ &= bits_ - 1) for(int l = __builtin_ctz(bits_), once_ = 1; once_; once_ = 0)
+
+Chip8Lanes::Chip8Lanes()
+{
+    memset(this, 0, sizeof(*this)); // nothing in here but plain arrays
+    ips = DEFAULT_IPS;
+}
+
+void Chip8Lanes::load(int lane, const Chip8 &c8)
+{
+    uint32_t bit = 1u << lane;
+    if(!active)
+    {
+        // first lane in, its memory is the code everybody shares
+        memcpy(image, c8.memory, sizeof(image));
+        for(int i = 0; i < 4096; ++i)
+            decoded[i].handler = Chip8::H_Undecoded;
+        memset(imageDiffers, 0, sizeof(imageDiffers));
+    }
+    active |= bit;
+    fallback = c8.hires || c8.planes != 1 ? fallback | bit : fallback & ~bit;
+
+    memcpy(memory[lane], c8.memory, 4096);
+    for(int page = 0; page < 16; ++page)
+    {
+        if(memcmp(&memory[lane][page << 8], &image[page << 8], 256))
+            imageDiffers[page] |= bit;
+        else
+            imageDiffers[page] &= ~bit;
+    }
+    for(int r = 0; r < 16; ++r)
+    {
+        V[r][lane] = c8.V[r];
+        stack[r][lane] = c8.stack[r];
+    }
+    pc[lane] = c8.pc;
+    I[lane] = c8.I;
+    sp[lane] = c8.sp & 0xF;
+    delay_timer[lane] = c8.delay_timer;
+    sound_timer[lane] = c8.sound_timer;
+    rng[lane] = c8.rng;
+    keys[lane] = 0;
+    for(int k = 0; k < 16; ++k)
+        keys[lane] |= (c8.key[k] != 0) << k;
+    waiting = c8.waitingForKey ? waiting | bit : waiting & ~bit;
+    waitRegister[lane] = c8.waitRegister;
+    cycles[lane] = c8.cycles;
+    memcpy(gfx[lane], c8.gfx, sizeof(gfx[lane]));
+    dirtyRows[lane] = c8.dirtyRows;
+    drawn = c8.drawFlag ? drawn | bit : drawn & ~bit;
+    budget[lane] = 0;
+}
+
+void Chip8Lanes::store(int lane, Chip8 &c8) const
+{
+    uint32_t bit = 1u << lane;
+    memcpy(c8.memory, memory[lane], 4096);
+    for(int r = 0; r < 16; ++r)
+    {
+        c8.V[r] = V[r][lane];
+        c8.stack[r] = stack[r][lane];
+    }
+    c8.pc = pc[lane];
+    c8.I = I[lane];
+    c8.sp = sp[lane];
+    c8.delay_timer = delay_timer[lane];
+    c8.sound_timer = sound_timer[lane];
+    c8.rng = rng[lane];
+    for(int k = 0; k < 16; ++k)
+        c8.key[k] = (keys[lane] >> k) & 1;
+    c8.waitingForKey = (waiting & bit) != 0;
+    c8.waitRegister = waitRegister[lane];
+    c8.cycles = cycles[lane];
+    memcpy(c8.gfx, gfx[lane], sizeof(gfx[lane]));
+    c8.dirtyRows = (c8.dirtyRows & ~0xFFFFFFFFULL) | dirtyRows[lane];
+    c8.drawFlag = (drawn & bit) != 0;
+    c8.invalidateAllDecoded();
+}
+
+void Chip8Lanes::keyDown(int lane, unsigned char k)
+{
+    keys[lane] |= 1 << (k & 0xF);
+    if(waiting & (1u << lane))
+    {
+        V[waitRegister[lane]][lane] = k & 0xF;
+        waiting &= ~(1u << lane);
+        pc[lane] += 2;
+    }
+}
+
+void Chip8Lanes::keyUp(int lane, unsigned char k)
+{
+    keys[lane] &= ~(1 << (k & 0xF));
+}
+
+unsigned long long Chip8Lanes::tickCycle(unsigned long long k) const
+{
+    // tick k happens once cycles reaches ceil(k * ips / 60), as in Scheduler
+    return (k * ips + 59) / 60;
+}
+
+void Chip8Lanes::tickTimers(uint32_t lanes)
+{
+    // Chip8::tickTimers on every lane in the mask. Lanes have no sound to switch off.
+    storeRow(delay_timer, dec(loadRow(delay_timer)), lanes);
+    storeRow(sound_timer, dec(loadRow(sound_timer)), lanes);
+}
+
+bool Chip8Lanes::advance(Progress &p, unsigned long long &laneCycles, unsigned long long &laneBudget,
+                         unsigned long long clock, uint32_t lanes)
+{
+    uint32_t ran = p.chunk - (uint32_t)(p.eventAt - clock);
+    laneCycles += ran;
+    laneBudget -= ran;
+    unsigned long long tickAt = tickCycle(p.nextTick);
+    while(laneCycles >= tickAt)
+    {
+        tickTimers(lanes);
+        tickAt = tickCycle(++p.nextTick);
+    }
+
+    // next event, whichever comes first
+    unsigned long long next = tickAt - laneCycles;
+    if(laneBudget < next)
+        next = laneBudget;
+    if(next > 0xFFFFFFFF)
+        next = 0xFFFFFFFF;
+    p.chunk = (uint32_t)next;
+    p.eventAt = clock + next;
+    return next != 0;
+}
+
+void Chip8Lanes::joinCohort(uint32_t lanes)
+{
+    FOR_LANES(l, lanes)
+    {
+        if(!cohort)
+        {
+            cohort = 1u << l;
+            cohortProgress = progress[l];
+            cohortCycles = cycles[l];
+            cohortBudget = budget[l];
+        }
+        else if(cycles[l] == cohortCycles && budget[l] == cohortBudget &&
+                progress[l].eventAt == cohortProgress.eventAt && progress[l].nextTick == cohortProgress.nextTick)
+            cohort |= 1u << l;
+    }
+}
+
+void Chip8Lanes::leaveCohort(uint32_t lanes)
+{
+    FOR_LANES(l, lanes & cohort)
+    {
+        progress[l] = cohortProgress;
+        cycles[l] = cohortCycles;
+        budget[l] = cohortBudget;
+    }
+    cohort &= ~lanes;
+}
+
+unsigned long long Chip8Lanes::earliestEvent(uint32_t running) const
+{
+    unsigned long long earliest = cohort ? cohortProgress.eventAt : ~0ULL;
+    FOR_LANES(l, running & ~cohort)
+        if(progress[l].eventAt < earliest)
+            earliest = progress[l].eventAt;
+    return earliest;
+}
+
+unsigned long long Chip8Lanes::run(unsigned long n)
+{
+    FOR_LANES(l, active)
+        budget[l] += n;
+    return run();
+}
+
+unsigned long long Chip8Lanes::run()
+{
+    unsigned long long before = 0, after = 0;
+    /* clock counts steps. A lane that runs in every step reaches its next event at eventAt,
+     * a lane that sits a step out has its eventAt pushed back by one. So while the lanes are
+     * together a step costs the same however many there are, and so does an event for the cohort.
+     */
+    unsigned long long clock = 0;
+    uint32_t running = 0;
+    cohort = 0;
+    FOR_LANES(l, active)
+    {
+        before += budget[l];
+        progress[l].nextTick = cycles[l] * 60 / ips + 1;
+        progress[l].chunk = 0;
+        progress[l].eventAt = 0;
+        if(advance(progress[l], cycles[l], budget[l], 0, 1u << l) && !((waiting | fallback) >> l & 1))
+            running |= 1u << l;
+    }
+    joinCohort(running);
+    unsigned long long nextEvent = earliestEvent(running);
+    int together = -1; // the pc every running lane is on, if they're all on the same one
+
+    while(running)
+    {
+        unsigned short now;
+        uint32_t group;
+        if(together >= 0)
+        {
+            group = running;
+            now = together;
+        }
+        else
+            group = lowest(pc, running, &now);
+        unsigned short at = now & 0x0FFF;
+        unsigned short next = (at + 1) & 0x0FFF;
+        unsigned short word = image[at] << 8 | image[next];
+
+        DecodedOp *cached = &decoded[at];
+        if(cached->handler == Chip8::H_Undecoded)
+            *cached = Chip8::decode(word);
+        DecodedOp op = *cached;
+
+        uint32_t differs = (imageDiffers[at >> 8] | imageDiffers[next >> 8]) & group;
+        if(differs)
+        {
+            // somebody wrote over this code, only lanes holding the same bytes as the first one go now
+            int first = __builtin_ctz(group);
+            unsigned short leader = memory[first][at] << 8 | memory[first][next];
+            FOR_LANES(l, group)
+            {
+                unsigned short mine = differs >> l & 1 ? memory[l][at] << 8 | memory[l][next] : word;
+                if(mine != leader)
+                    group &= ~(1u << l);
+            }
+            if(leader != word)
+                op = Chip8::decode(leader);
+        }
+
+        uint32_t out = leaving(op, group);
+        if(out)
+        {
+            // they stop before this instruction, account for what they ran up to here
+            leaveCohort(out);
+            FOR_LANES(l, out)
+                advance(progress[l], cycles[l], budget[l], clock, 1u << l);
+            fallback |= out;
+            running &= ~out;
+            group &= ~out;
+            nextEvent = earliestEvent(running);
+            if(!group)
+            {
+                together = -1;
+                continue;
+            }
+        }
+
+        int then = execute(op, group, now);
+        ++steps;
+        laneInstructions += __builtin_popcount(group);
+        ++clock;
+
+        // lanes that sat this step out are a step later for everything
+        uint32_t behind = running & ~group;
+        if(behind & cohort)
+        {
+            if(cohort & group)
+                leaveCohort(behind);
+            else
+                ++cohortProgress.eventAt;
+        }
+        FOR_LANES(l, behind & ~cohort)
+            ++progress[l].eventAt;
+
+        // lanes that just parked on FX0A stopped partway, they get accounted for on their own
+        uint32_t stopped = waiting & group;
+        if(stopped & cohort)
+            leaveCohort(stopped);
+        if(clock >= nextEvent)
+        {
+            if(cohort && cohortProgress.eventAt == clock &&
+               !advance(cohortProgress, cohortCycles, cohortBudget, clock, cohort))
+            {
+                // out of budget
+                running &= ~cohort;
+                leaveCohort(cohort);
+            }
+            FOR_LANES(l, running & ~cohort)
+                if(progress[l].eventAt == clock)
+                    stopped |= 1u << l;
+        }
+        if(stopped)
+        {
+            uint32_t carryOn = 0;
+            FOR_LANES(l, stopped)
+            {
+                if(advance(progress[l], cycles[l], budget[l], clock, 1u << l) && !(waiting >> l & 1))
+                    carryOn |= 1u << l;
+                else
+                    running &= ~(1u << l);
+            }
+            joinCohort(carryOn);
+        }
+        if(stopped || clock >= nextEvent)
+            nextEvent = earliestEvent(running);
+
+        together = (running & ~group) ? -1 : then;
+    }
+    leaveCohort(cohort);
+
+    FOR_LANES(l, active)
+        after += budget[l];
+    return before - after;
+}
+
+uint32_t Chip8Lanes::leaving(const DecodedOp &op, uint32_t lanes) const
+{
+    // lanes about to run something that needs a whole Chip8: a SUPER-CHIP / XO-CHIP instruction,
+    // or memory past 4K (the lanes' memory wraps there, Chip8's goes on)
+    if(Chip8::isExtended(op.handler))
+        return lanes;
+    int length;
+    switch(op.handler)
+    {
+        case Chip8::H_Draw: length = op.imm; break;
+        case Chip8::H_StoreBCD: length = 3; break;
+        case Chip8::H_StoreRegs: case Chip8::H_LoadRegs: length = op.x + 1; break;
+        default: return 0;
+    }
+    uint32_t out = 0;
+    FOR_LANES(l, lanes)
+        if(I[l] + length > 4096)
+            out |= 1u << l;
+    return out;
+}
+
+void Chip8Lanes::wrote(int lane, unsigned short address, int length)
+{
+    // writes are at most 16 bytes, so they touch the first and last page only
+    imageDiffers[(address & 0x0FFF) >> 8] |= 1u << lane;
+    imageDiffers[((address + length - 1) & 0x0FFF) >> 8] |= 1u << lane;
+}
+
+void Chip8Lanes::draw(int lane, const DecodedOp &op)
+{
+    // Chip8::opDraw one row at a time
+    unsigned int x = V[op.x][lane] & 63;
+    unsigned int y = V[op.y][lane] & 31;
+    int height = op.imm;
+    if(y + height > 32)
+        height = 32 - y;
+
+    uint64_t collision = 0;
+    for(int row = 0; row < height; ++row)
+    {
+        uint64_t sprite = ((uint64_t)memory[lane][(I[lane] + row) & 0x0FFF] << 56) >> x;
+        collision |= gfx[lane][y + row] & sprite;
+        gfx[lane][y + row] ^= sprite;
+    }
+
+    V[0xF][lane] = collision != 0;
+    if(height > 0)
+        dirtyRows[lane] |= (uint32_t)(((1ULL << height) - 1) << y);
+    drawn |= 1u << lane;
+}
+
+int Chip8Lanes::execute(const DecodedOp &op, uint32_t m, unsigned short at)
+{
+    unsigned char *vx = V[op.x];
+    unsigned char *vy = V[op.y];
+    unsigned char *vf = V[0xF];
+    uint32_t skip = 0; // lanes that skip the next instruction
+
+    switch(op.handler)
+    {
+        // register ops: the same few vector instructions whatever the number of lanes
+        case Chip8::H_SetImm: storeRow(vx, splat(op.imm), m); break;
+        case Chip8::H_AddImm: storeRow(vx, add(loadRow(vx), splat(op.imm)), m); break;
+        case Chip8::H_Mov: storeRow(vx, loadRow(vy), m); break;
+        case Chip8::H_Or: storeRow(vx, orRow(loadRow(vx), loadRow(vy)), m); break;
+        case Chip8::H_And: storeRow(vx, andRow(loadRow(vx), loadRow(vy)), m); break;
+        case Chip8::H_Xor: storeRow(vx, xorRow(loadRow(vx), loadRow(vy)), m); break;
+        // VF goes first and X or Y can be F, so reload after writing it (as the interpreter does)
+        case Chip8::H_AddReg:
+            storeRow(vf, flag(gtu(loadRow(vx), sub(splat(0xFF), loadRow(vy)))), m);
+            storeRow(vx, add(loadRow(vx), loadRow(vy)), m);
+            break;
+        case Chip8::H_SubReg:
+            storeRow(vf, flag(gtu(loadRow(vx), loadRow(vy))), m);
+            storeRow(vx, sub(loadRow(vx), loadRow(vy)), m);
+            break;
+        case Chip8::H_SubnReg:
+            storeRow(vf, flag(gtu(loadRow(vy), loadRow(vx))), m);
+            storeRow(vx, sub(loadRow(vy), loadRow(vx)), m);
+            break;
+        case Chip8::H_ShiftRight:
+            storeRow(vf, andRow(loadRow(vx), splat(1)), m);
+            storeRow(vx, shr(loadRow(vx), 1), m);
+            break;
+        case Chip8::H_ShiftLeft:
+            storeRow(vf, shr(loadRow(vx), 7), m);
+            storeRow(vx, shl1(loadRow(vx)), m);
+            break;
+        case Chip8::H_SkipEqImm: skip = eq(loadRow(vx), splat(op.imm)) & m; break;
+        case Chip8::H_SkipNeImm: skip = ~eq(loadRow(vx), splat(op.imm)) & m; break;
+        case Chip8::H_SkipEqReg: skip = eq(loadRow(vx), loadRow(vy)) & m; break;
+        case Chip8::H_SkipNeReg: skip = ~eq(loadRow(vx), loadRow(vy)) & m; break;
+        case Chip8::H_GetDelay: storeRow(vx, loadRow(delay_timer), m); break;
+        case Chip8::H_SetDelay: storeRow(delay_timer, loadRow(vx), m); break;
+        case Chip8::H_SetSound: storeRow(sound_timer, loadRow(vx), m); break;
+        case Chip8::H_SetIndex: setWords(I, m, op.imm); break;
+
+        // control flow that's the same for every lane here
+        case Chip8::H_Jump:
+            setWords(pc, m, op.imm);
+            return op.imm;
+        case Chip8::H_Call:
+            FOR_LANES(l, m)
+            {
+                stack[sp[l]][l] = at;
+                sp[l] = (sp[l] + 1) & 0xF; // wraps like Chip8::opCall
+            }
+            setWords(pc, m, op.imm);
+            return op.imm;
+        case Chip8::H_Unknown:
+            FOR_LANES(l, m)
+                if(trace[l] && trace[l]->wants(TRACE_UNKNOWN))
+                {
+                    unsigned char v[16];
+                    for(int r = 0; r < 16; ++r)
+                        v[r] = V[r][l];
+                    trace[l]->record(TRACE_UNKNOWN, cycles[l], at, op.opcode, I[l], sp[l], v);
+                }
+            return at; // pc stays put, like the interpreter
+
+        // everything else depends on per lane memory, keys or addresses
+        case Chip8::H_Return:
+            FOR_LANES(l, m)
+            {
+                sp[l] = (sp[l] - 1) & 0xF; // wraps like Chip8::opReturn
+                pc[l] = stack[sp[l]][l] + 2;
+            }
+            return -1;
+        case Chip8::H_JumpV0:
+            FOR_LANES(l, m)
+                pc[l] = V[0][l] + op.imm;
+            return -1;
+        case Chip8::H_ClearScreen:
+            FOR_LANES(l, m)
+            {
+                uint32_t lit = 0;
+                for(int y = 0; y < 32; ++y)
+                    lit |= (uint32_t)(gfx[l][y] != 0) << y;
+                memset(gfx[l], 0, sizeof(gfx[l]));
+                if(lit)
+                {
+                    dirtyRows[l] |= lit;
+                    drawn |= 1u << l;
+                }
+            }
+            break;
+        case Chip8::H_Draw:
+            FOR_LANES(l, m)
+                draw(l, op);
+            break;
+        case Chip8::H_SkipKey:
+            FOR_LANES(l, m)
+                skip |= (uint32_t)(keys[l] >> (vx[l] & 0xF) & 1) << l;
+            break;
+        case Chip8::H_SkipNotKey:
+            FOR_LANES(l, m)
+                skip |= (uint32_t)(~keys[l] >> (vx[l] & 0xF) & 1) << l;
+            break;
+        case Chip8::H_WaitKey:
+            FOR_LANES(l, m)
+            {
+                if(keys[l])
+                    vx[l] = __builtin_ctz(keys[l]); // a key that's already held counts
+                else
+                {
+                    waiting |= 1u << l;
+                    waitRegister[l] = op.x;
+                }
+            }
+            setWords(pc, m & ~waiting, at + 2);
+            return (unsigned short)(at + 2); // the ones left waiting stop running anyway
+        case Chip8::H_Random:
+            FOR_LANES(l, m)
+                vx[l] = Chip8::nextRandom(rng[l]) & op.imm;
+            break;
+        case Chip8::H_AddIndex:
+            FOR_LANES(l, m)
+                I[l] += vx[l];
+            break;
+        case Chip8::H_FontChar:
+            FOR_LANES(l, m)
+                I[l] = vx[l] * 0x5;
+            break;
+        case Chip8::H_StoreBCD:
+            FOR_LANES(l, m)
+            {
+                memory[l][I[l] & 0x0FFF] = vx[l] / 100;
+                memory[l][(I[l] + 1) & 0x0FFF] = (vx[l] / 10) % 10;
+                memory[l][(I[l] + 2) & 0x0FFF] = (vx[l] % 100) % 10;
+                wrote(l, I[l], 3);
+            }
+            break;
+        case Chip8::H_StoreRegs:
+            FOR_LANES(l, m)
+            {
+                for(int i = 0; i <= op.x; ++i)
+                    memory[l][(I[l] + i) & 0x0FFF] = V[i][l];
+                wrote(l, I[l], op.x + 1);
+            }
+            break;
+        case Chip8::H_LoadRegs:
+            FOR_LANES(l, m)
+                for(int i = 0; i <= op.x; ++i)
+                    V[i][l] = memory[l][(I[l] + i) & 0x0FFF];
+            break;
+    }
+
+    // the lanes all came from the same pc, so the next one is the same too (or two further on a skip,
+    // four over F000 NNNN)
+    setWords(pc, m & ~skip, at + 2);
+    if(!skip)
+        return (unsigned short)(at + 2);
+    uint32_t overLong = 0;
+    FOR_LANES(l, skip)
+        if(memory[l][(at + 2) & 0x0FFF] == 0xF0 && memory[l][(at + 3) & 0x0FFF] == 0x00)
+            overLong |= 1u << l;
+    setWords(pc, skip & ~overLong, at + 4);
+    setWords(pc, overLong, at + 6);
+    if(skip != m)
+        return -1;
+    return !overLong ? (unsigned short)(at + 4) : overLong == m ? (unsigned short)(at + 6) : -1;
+}
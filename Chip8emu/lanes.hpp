@@ -0,0 +1,132 @@
+//
+//  lanes.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/18/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef lanes_hpp
+#define lanes_hpp
+
+#include <stdint.h>
+#include "chip8.hpp"
+
+/* Runs up to 32 copies of the same ROM side by side, one per vector lane.
+ * The state is stored structure of arrays: V[x] is a row of 32 bytes, one per lane, so an
+ * instruction like 8XY4 is a handful of AVX2 ops for every lane at once. Each step picks the
+ * lowest pc any lane is on and runs that instruction for every lane sitting there. Lanes that
+ * branched off just wait, lanes that are behind get picked first, so they tend to meet up again.
+ *
+ * Every lane behaves exactly like a Chip8 run through a Scheduler at the same ips (timers
+ * included), load() and store() move a machine in and out of a lane. Lanes only hold a CHIP-8
+ * machine (4K, 64x32): a lane that gets to a SUPER-CHIP / XO-CHIP instruction or an access past
+ * 4K stops there and is marked in fallback, for a Chip8 to carry on with.
+ * Built without AVX2 the same code runs on plain loops.
+ */
+class Chip8Lanes
+{
+public:
+    enum { LANES = 32 };
+
+    Chip8Lanes();
+
+    /* Copies a machine into a lane and makes it active. Lanes should all hold the same ROM:
+     * the first one loaded becomes the shared code image, which is decoded once for everybody.
+     * A lane whose memory is different still works, it just can't share those pages' decoding.
+     */
+    void load(int lane, const Chip8 &);
+    /* Copies a lane back out into a machine. Only what a lane holds is written, the machine's
+     * memory past 4K and screen past 64x32 stay as they were (a lane never touches them).
+     */
+    void store(int lane, Chip8 &) const;
+    // Lanes taking part, one bit per lane
+    uint32_t active;
+
+    // instructions per emulated second, decides when each lane's timers tick (as in Scheduler)
+    unsigned int ips;
+
+    /* Runs every active lane until it has used up its budget or stops on FX0A.
+     * Returns the instructions run over all lanes.
+     */
+    unsigned long long run();
+    // Gives every active lane n more instructions and runs them
+    unsigned long long run(unsigned long n);
+    // instructions each lane still has to run
+    unsigned long long budget[LANES];
+
+    // Like Chip8::keyDown / keyUp for one lane
+    void keyDown(int lane, unsigned char k);
+    void keyUp(int lane, unsigned char k);
+    uint32_t waiting; // lanes parked on FX0A
+    /* Lanes stopped before an instruction only Chip8 runs (or loaded in a mode lanes don't do).
+     * They stay out of run() until loaded again: store() them and finish in a Scheduler.
+     */
+    uint32_t fallback;
+    /* Like Chip8::trace, per lane. Lanes only record unknown opcodes, and stamp them with the lane's
+     * cycle count as of its last timer tick (lanes don't keep it any closer than that).
+     */
+    Chip8Trace *trace[LANES];
+
+    // how many lockstep steps ran and how many lane instructions they covered, lanes per step = instructions / steps
+    unsigned long long steps;
+    unsigned long long laneInstructions;
+
+    // machine state, rows are indexed by lane
+    unsigned char V[16][LANES];
+    unsigned char delay_timer[LANES];
+    unsigned char sound_timer[LANES];
+    unsigned short pc[LANES];
+    unsigned short I[LANES];
+    unsigned short sp[LANES];
+    unsigned short stack[16][LANES];
+    uint64_t rng[LANES];
+    unsigned short keys[LANES]; // bit k set while key k is down
+    unsigned char waitRegister[LANES];
+    unsigned long long cycles[LANES];
+    uint64_t gfx[LANES][32];
+    uint32_t dirtyRows[LANES];
+    uint32_t drawn; // lanes with drawFlag set
+    unsigned char memory[LANES][4096];
+
+private:
+    unsigned char image[4096]; // shared code, copied from the first lane loaded
+    DecodedOp decoded[4096]; // decoded from image
+    uint32_t imageDiffers[16]; // per 256 byte page, lanes whose memory may not match image
+
+    /* Where a lane is between events. Its next event is whichever comes first of its budget
+     * running out or its timers ticking, counted in run()'s steps. Between events the lanes need
+     * no bookkeeping at all.
+     */
+    struct Progress
+    {
+        unsigned long long eventAt; // step the next event happens at, if the lane runs every step
+        unsigned long long nextTick; // number of the lane's next timer tick
+        uint32_t chunk; // instructions from the last event to eventAt
+    };
+    Progress progress[LANES];
+    /* Lanes that have run exactly as many instructions as each other share one set of counters,
+     * so an event for all of them is handled once, with row ops for the timers. Their own
+     * counters are out of date until they leave.
+     */
+    uint32_t cohort;
+    Progress cohortProgress;
+    unsigned long long cohortCycles, cohortBudget;
+
+    // accounts for what ran up to clock and sets the next event, false if the budget is used up
+    bool advance(Progress &, unsigned long long &laneCycles, unsigned long long &laneBudget,
+                 unsigned long long clock, uint32_t lanes);
+    void joinCohort(uint32_t lanes); // lanes that just had their event
+    void leaveCohort(uint32_t lanes);
+    unsigned long long earliestEvent(uint32_t running) const;
+    void tickTimers(uint32_t lanes);
+    unsigned long long tickCycle(unsigned long long k) const; // when tick k is due
+
+    // returns the pc all the lanes went on to, -1 if they went different ways
+    int execute(const DecodedOp &, uint32_t lanes, unsigned short at);
+    uint32_t leaving(const DecodedOp &, uint32_t lanes) const; // lanes that have to fall back before op
+    void wrote(int lane, unsigned short address, int length);
+    void draw(int lane, const DecodedOp &);
+};
+
+#endif /* lanes_hpp */
@@ -7,17 +7,41 @@
 //
 
 #include <iostream>
+#include <string.h>
+#include <thread>
+#include <chrono>
 #include <GLUT/GLUT.h> // OpenGL graphics and input
 #include "chip8.hpp" // Your cpu core implementation
+#include "scheduler.hpp"
+#include "emuthread.hpp"
+#include "render.hpp"
+#include "romstore.hpp"
+#include "inputlog.hpp"
+#include "trace.hpp"
 
-// Display size
-#define SCREEN_WIDTH 64
-#define SCREEN_HEIGHT 32
+// Display size, the largest there is (SUPER-CHIP's 128x64), CHIP-8's 64x32 gets each pixel doubled
+#define SCREEN_WIDTH 128
+#define SCREEN_HEIGHT 64
 
 // class to handle opcodes
 Chip8 myChip8;
+// decides how many opcodes to run per wakeup and ticks the timers at 60 Hz
+Scheduler scheduler(myChip8);
+// runs the two above on its own thread (rewind included), GLUT only sends input and shows frames
+EmulationThread emulator(myChip8, scheduler);
+// with --record, the session's key presses, saved on exit
+InputLog recording;
+const char *recordFile = NULL;
+// unknown opcodes (or what --trace-filter says), saved on exit with --trace
+Chip8Trace trace;
+const char *traceFile = NULL;
+// when emulation started, what the run-ahead cost is measured against
+std::chrono::steady_clock::time_point started;
+// rows the frames received since the last present changed, the texture is behind on those
+uint64_t pendingRows = ~0ULL;
+bool shownHires = false;
 // modifier is likely to make the resolution actually seeable
-int modifier = 10;
+int modifier = 5;
 
 
 // window size
@@ -25,6 +49,7 @@ int display_width = SCREEN_WIDTH * modifier;
 int display_height = SCREEN_HEIGHT * modifier;
 
 void display();
+void idle();
 void reshape_window(GLsizei, GLsizei); // GLsizei is OPENGL int (to maintain 32 bits)
 void keyboardUp(unsigned char, int, int);
 void keyboardDown(unsigned char, int, int);
@@ -32,20 +57,55 @@ void keyboardDown(unsigned char, int, int);
 // Use new drawing method
 #define DRAWWITHTEXTURE
 typedef unsigned char u8; // define u8 as unsigned char
-u8 screenData[SCREEN_HEIGHT][SCREEN_WIDTH][3];
+u8 screenData[SCREEN_HEIGHT][SCREEN_WIDTH]; // one luminance byte per pixel, the palette colours it (rows packed at the current width)
+// off and on colours (RGBA)
+const GLfloat palette[2][4] = { {0.0f, 0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f} };
 void setupTexture();
 
 int main(int argc, char * argv[])
 {
     if(argc < 2)
     {
-        printf("Usage: ./Chip8emu chip8application\n\n");
+        printf("Usage: ./Chip8emu chip8application [instructions per second] [--record file] [--seed n]\n");
+        printf("                [--trace file] [--trace-filter unknown,calls,returns,draws] [--run-ahead frames]\n\n");
         return 1;
     }
+    // random numbers differ every run unless asked otherwise, a recording keeps whichever it got
+    uint64_t seed = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(int i = 2; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "--record") && i + 1 < argc)
+            recordFile = argv[++i];
+        else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if(!strcmp(argv[i], "--trace") && i + 1 < argc)
+            traceFile = argv[++i];
+        else if(!strcmp(argv[i], "--trace-filter") && i + 1 < argc)
+            trace.filter = parseTraceFilter(argv[++i]);
+        else if(!strcmp(argv[i], "--run-ahead") && i + 1 < argc)
+            emulator.runAhead.frames = atoi(argv[++i]);
+        else
+            scheduler.setIPS(atoi(argv[i]));
+    }
+    myChip8.seedRandom(seed);
+    myChip8.trace = &trace;
     
     // Load game
-    if(myChip8.loadGame(argv[1]))
+    RomStore store;
+    const Rom *rom = store.get(argv[1]);
+    if(!rom)
+    {
+        printf("Could not open file %s\n", argv[1]);
         return 1;
+    }
+    myChip8.loadRom(rom->data, rom->size);
+    if(recordFile)
+    {
+        recording.ips = scheduler.getIPS();
+        recording.romHash = rom->hash;
+        recording.seed = seed;
+        emulator.recording = &recording;
+    }
     
     
     // Setup OPENGL
@@ -58,7 +118,7 @@ int main(int argc, char * argv[])
     glutDisplayFunc(display); // display callback.
                             // called when window is to be redisplayed, normal plane is use
                             // must displayFunc before any window is shown
-    glutIdleFunc(display); // callback for background processing tasks or continous animation
+    glutIdleFunc(idle); // callback for background processing tasks or continous animation
     glutReshapeFunc(reshape_window); // callback when window reshaped or when first shown
     glutKeyboardFunc(keyboardDown); // callback for when user presses button on keyboard
     glutKeyboardUpFunc(keyboardUp); // callback for when user releases key press
@@ -67,7 +127,9 @@ int main(int argc, char * argv[])
     setupTexture(); // setup the new graphics method if can handle
 #endif
     
-    glutMainLoop(); // starts event processing loop, emulation loop
+    started = std::chrono::steady_clock::now();
+    emulator.start();
+    glutMainLoop(); // starts event processing loop
     return 0;
 }
 
@@ -77,7 +139,7 @@ void setupTexture()
     // Clear screen
     for(int y = 0; y < SCREEN_HEIGHT; ++y)
         for(int x = 0; x < SCREEN_WIDTH; ++x)
-            screenData[y][x][0] = screenData[y][x][1] = screenData[y][x][2] = 0;
+            screenData[y][x] = 0;
     
     // Create a texture
     // specifices target texture
@@ -88,7 +150,9 @@ void setupTexture()
     // specifies format of pixel data
     // specifies data type of pixel
     // specifies pointer to image data in memory. GLvoid is void.
-    glTexImage2D(GL_TEXTURE_2D, 0, 3, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)screenData);
+    // Single channel, a third of the bytes to convert and upload compared to RGB
+    // starts at 64x32, updateTexture makes a new one when the program switches resolution
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*)screenData);
     
     // Set up the texture
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); // sets GL_TEXTURE_MAG_FILTER = GL_NEAREST for
@@ -97,25 +161,53 @@ void setupTexture()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
     
+    /* The palette: GL_BLEND mixes the vertex colour (off) and the env colour (on) by the
+     * texel's luminance, so 0 comes out as palette[0] and 255 as palette[1]
+     */
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_BLEND);
+    glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, palette[1]);
+    
     // Enable textures
     glEnable(GL_TEXTURE_2D); // enable texture mode if computer supports
 }
 
 /* new drawing method */
-void updateTexture(const Chip8& c8)
+void updateTexture(const Frame& frame)
 {
-    // Update pixels
-    for(int y = 0; y < 32; ++y)
-        for(int x = 0; x < 64; ++x)
-            if(c8.gfx[(y * 64) + x] == 0)
-                screenData[y][x][0] = screenData[y][x][1] = screenData[y][x][2] = 0;    // Disabled
-            else
-                screenData[y][x][0] = screenData[y][x][1] = screenData[y][x][2] = 255;  // Enabled
+    int width = frame.hires ? SCREEN_WIDTH : SCREEN_WIDTH / 2;
+    int height = frame.hires ? SCREEN_HEIGHT : SCREEN_HEIGHT / 2;
+    u8 *pixels = &screenData[0][0];
+    
+    // Update pixels, only the rows that changed since the last present (all of them on a resolution change)
+    uint64_t dirty = pendingRows;
+    pendingRows = 0;
+    if(frame.hires != shownHires)
+    {
+        dirty = ~0ULL;
+        shownHires = frame.hires;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+    }
+    renderGrayRows(frame.gfx, frame.hires, dirty, pixels);
     
     // Update Texture
     // specifies texture subimage
     // same args as create texture except for x and y offset but no magic number
-    glTexSubImage2D(GL_TEXTURE_2D, 0 ,0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)screenData);
+    // one upload per run of dirty rows rather than the whole screen
+    for(int y = 0; y < height; )
+    {
+        if(!(dirty >> y & 1))
+        {
+            ++y;
+            continue;
+        }
+        int end = y;
+        while(end < height && (dirty >> end & 1))
+            ++end;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, end - y, GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*)(pixels + y * width));
+        y = end;
+    }
+    
+    glColor4fv(palette[0]);
     
     // draw the window or actual pixels for sprite
     glBegin( GL_QUADS ); // specifies primitives created from vertices
@@ -128,63 +220,67 @@ void updateTexture(const Chip8& c8)
 }
 
 // Old gfx code
-void drawPixel(int x, int y)
+void drawPixel(int x, int y, int size)
 {
     glBegin(GL_QUADS);
-        glVertex3f((x * modifier) + 0.0f,     (y * modifier) + 0.0f,     0.0f);
-        glVertex3f((x * modifier) + 0.0f,     (y * modifier) + modifier, 0.0f);
-        glVertex3f((x * modifier) + modifier, (y * modifier) + modifier, 0.0f);
-        glVertex3f((x * modifier) + modifier, (y * modifier) + 0.0f,     0.0f);
+        glVertex3f((x * size) + 0.0f, (y * size) + 0.0f, 0.0f);
+        glVertex3f((x * size) + 0.0f, (y * size) + size, 0.0f);
+        glVertex3f((x * size) + size, (y * size) + size, 0.0f);
+        glVertex3f((x * size) + size, (y * size) + 0.0f, 0.0f);
     glEnd();
 }
 
 /* Old drawing method */
-void updateQuads(const Chip8& c8)
+void updateQuads(const Frame& frame)
 {
+    int width = frame.hires ? SCREEN_WIDTH : SCREEN_WIDTH / 2;
+    int height = frame.hires ? SCREEN_HEIGHT : SCREEN_HEIGHT / 2;
+    int size = frame.hires ? modifier : modifier * 2;
     // Loop through graphics array
-    for(int y = 0; y < 32; ++y)
-        for(int x = 0; x < 64; ++x)
+    for(int y = 0; y < height; ++y)
+        for(int x = 0; x < width; ++x)
         {
-            if(c8.gfx[(y*64) + x] == 0)
-                glColor3f(0.0f,0.0f,0.0f); // set color of pixel (RGB)
-            else
-                glColor3f(1.0f,1.0f,1.0f);
+            const uint64_t *column = &frame.gfx[(x >> 6) * DISPLAY_ROWS + y];
+            int value = (column[0] >> (63 - (x & 63)) & 1) | (column[2 * DISPLAY_ROWS] >> (63 - (x & 63)) & 1) << 1;
+            float shade = pixelShades[value] / 255.0f;
+            glColor3f(shade, shade, shade); // set color of pixel (RGB)
             
-            drawPixel(x, y);
+            drawPixel(x, y, size);
         }
 }
 
-/* This seems to be the emulation loop body */
-void display()
+/* Emulation lives on its own thread now, this just checks for a new frame */
+void idle()
 {
-    myChip8.emulateCycle(); // emulate one cycle
-    /* If drawFlag is set, update screen
-      * because does not draw every cycle
-      * only 2 opcodes set flag
-      * 0x00E0 - clears screen
-      * 0xDXYN - draws sprite on screen
-      */
-    if (myChip8.drawFlag)
+    if(emulator.frames.receive())
     {
-        // draw graphics
-        
-        // Clear framebuffer
-        glClear(GL_COLOR_BUFFER_BIT); // sets buffer to glClearColor values.
-        
+        // GLUT may take more than one before it presents
+        pendingRows |= emulator.frames.front().dirtyRows;
+        glutPostRedisplay();
+    }
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(1)); // nothing new, don't spin
+}
+
+/* Presents the newest frame. Also called by GLUT when the window needs redrawing. */
+void display()
+{
+    const Frame &frame = emulator.frames.front();
+    
+    // Clear framebuffer
+    glClear(GL_COLOR_BUFFER_BIT); // sets buffer to glClearColor values.
+    
 #ifdef DRAWWITHTEXTURE
-        updateTexture(myChip8); // draw with textures
+    updateTexture(frame); // draw with textures
 #else
-        updateQuads(myChip8); // draw with old api
+    updateQuads(frame); // draw with old api
 #endif
-        
-        // Swap buffers!
-        glutSwapBuffers(); // swap back layer with front layer if double buffered
-                        // contents of back buffer is undefined
-                        // in other words, buffer is frame so current frame is done with, work on next frame
-        
-        // Processed frame (reset drawFlag until switched on)
-        myChip8.drawFlag = false;
-    }
+    
+    // Swap buffers!
+    glutSwapBuffers(); // swap back layer with front layer if double buffered
+                    // contents of back buffer is undefined
+                    // in other words, buffer is frame so current frame is done with, work on next frame
+                    // with vsync this can block, the emulation thread doesn't care
 }
 
 void reshape_window(GLsizei w, GLsizei h)
@@ -211,45 +307,87 @@ void reshape_window(GLsizei w, GLsizei h)
     display_height = h;
 }
 
-/* Store key press (setKeys part 1) */
-void keyboardDown(unsigned char key, int x, int y)
+// Key mapping:
+/*
+ Keypad                   Keyboard
+ +-+-+-+-+                +-+-+-+-+
+ |1|2|3|C|                |1|2|3|4|
+ +-+-+-+-+                +-+-+-+-+
+ |4|5|6|D|                |Q|W|E|R|
+ +-+-+-+-+       =>       +-+-+-+-+
+ |7|8|9|E|                |A|S|D|F|
+ +-+-+-+-+                +-+-+-+-+
+ |A|0|B|F|                |Z|X|C|V|
+ +-+-+-+-+                +-+-+-+-+
+ */
+// Returns the keypad key for a keyboard key, or -1 if it isn't mapped
+int keypadIndex(unsigned char key)
 {
-    if(key == 27)    // esc
-        exit(0);
+    if(key == '1')         return 0x1;
+    else if(key == '2')    return 0x2;
+    else if(key == '3')    return 0x3;
+    else if(key == '4')    return 0xC;
     
-    // Key mapping:
-    /*
-     Keypad                   Keyboard
-     +-+-+-+-+                +-+-+-+-+
-     |1|2|3|C|                |1|2|3|4|
-     +-+-+-+-+                +-+-+-+-+
-     |4|5|6|D|                |Q|W|E|R|
-     +-+-+-+-+       =>       +-+-+-+-+
-     |7|8|9|E|                |A|S|D|F|
-     +-+-+-+-+                +-+-+-+-+
-     |A|0|B|F|                |Z|X|C|V|
-     +-+-+-+-+                +-+-+-+-+
-     */
+    else if(key == 'q')    return 0x4;
+    else if(key == 'w')    return 0x5;
+    else if(key == 'e')    return 0x6;
+    else if(key == 'r')    return 0xD;
     
-    if(key == '1')         myChip8.key[0x1] = 1;
-    else if(key == '2')    myChip8.key[0x2] = 1;
-    else if(key == '3')    myChip8.key[0x3] = 1;
-    else if(key == '4')    myChip8.key[0xC] = 1;
+    else if(key == 'a')    return 0x7;
+    else if(key == 's')    return 0x8;
+    else if(key == 'd')    return 0x9;
+    else if(key == 'f')    return 0xE;
     
-    else if(key == 'q')    myChip8.key[0x4] = 1;
-    else if(key == 'w')    myChip8.key[0x5] = 1;
-    else if(key == 'e')    myChip8.key[0x6] = 1;
-    else if(key == 'r')    myChip8.key[0xD] = 1;
+    else if(key == 'z')    return 0xA;
+    else if(key == 'x')    return 0x0;
+    else if(key == 'c')    return 0xB;
+    else if(key == 'v')    return 0xF;
     
-    else if(key == 'a')    myChip8.key[0x7] = 1;
-    else if(key == 's')    myChip8.key[0x8] = 1;
-    else if(key == 'd')    myChip8.key[0x9] = 1;
-    else if(key == 'f')    myChip8.key[0xE] = 1;
+    return -1;
+}
+
+/* Store key press (setKeys part 1) */
+void keyboardDown(unsigned char key, int x, int y)
+{
+    if(key == 27)    // esc
+    {
+        emulator.stop();
+        printf("Max drift %.1f ms, %llu instructions dropped\n", scheduler.maxDrift * 1000, scheduler.droppedInstructions);
+        unsigned long long events = emulator.events;
+        if(events)
+            printf("Input latency %.2f ms average, %.2f ms max over %llu events\n",
+                   emulator.totalLatency / 1e6 / events, emulator.maxLatency / 1e6, events);
+        const RunAhead &ahead = emulator.runAhead;
+        if(ahead.steps)
+        {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            printf("Run-ahead %d frames: %.1f us per frame (%.2f us saving and restoring), %.2f%% of a core\n",
+                   ahead.frames, ahead.nanoseconds / 1e3 / ahead.steps, ahead.checkpointNanoseconds / 1e3 / ahead.steps,
+                   ahead.nanoseconds / 1e7 / elapsed);
+        }
+        if(trace.count(TRACE_UNKNOWN))
+            printf("%llu unknown opcodes\n", trace.count(TRACE_UNKNOWN));
+        if(traceFile && trace.save(traceFile))
+            printf("Traced %llu events to %s\n", trace.recorded, traceFile);
+        if(recordFile)
+        {
+            recording.finish(myChip8);
+            if(recording.save(recordFile))
+                printf("Recorded %zu key events over %llu instructions to %s\n",
+                       recording.events.size() - 1, recording.length(), recordFile);
+        }
+        exit(0);
+    }
+    if(key == 8)    // backspace
+    {
+        emulator.send(InputEvent::REWIND_START);
+        return;
+    }
     
-    else if(key == 'z')    myChip8.key[0xA] = 1;
-    else if(key == 'x')    myChip8.key[0x0] = 1;
-    else if(key == 'c')    myChip8.key[0xB] = 1;
-    else if(key == 'v')    myChip8.key[0xF] = 1;
+    // keyDown also wakes the emulator up if it's sitting on FX0A
+    int k = keypadIndex(key);
+    if(k >= 0)
+        emulator.send(InputEvent::KEY_DOWN, k);
     
     //printf("Press key %c\n", key);
 }
@@ -257,25 +395,11 @@ void keyboardDown(unsigned char key, int x, int y)
 /* Release key press (setKeys part 2) */
 void keyboardUp(unsigned char key, int x, int y)
 {
-    if(key == '1')         myChip8.key[0x1] = 0;
-    else if(key == '2')    myChip8.key[0x2] = 0;
-    else if(key == '3')    myChip8.key[0x3] = 0;
-    else if(key == '4')    myChip8.key[0xC] = 0;
-    
-    else if(key == 'q')    myChip8.key[0x4] = 0;
-    else if(key == 'w')    myChip8.key[0x5] = 0;
-    else if(key == 'e')    myChip8.key[0x6] = 0;
-    else if(key == 'r')    myChip8.key[0xD] = 0;
-    
-    else if(key == 'a')    myChip8.key[0x7] = 0;
-    else if(key == 's')    myChip8.key[0x8] = 0;
-    else if(key == 'd')    myChip8.key[0x9] = 0;
-    else if(key == 'f')    myChip8.key[0xE] = 0;
-    
-    else if(key == 'z')    myChip8.key[0xA] = 0;
-    else if(key == 'x')    myChip8.key[0x0] = 0;
-    else if(key == 'c')    myChip8.key[0xB] = 0;
-    else if(key == 'v')    myChip8.key[0xF] = 0;
+    if(key == 8)
+        emulator.send(InputEvent::REWIND_STOP);
+    int k = keypadIndex(key);
+    if(k >= 0)
+        emulator.send(InputEvent::KEY_UP, k);
 }
 
 
@@ -0,0 +1,441 @@
+//
+//  pixels.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/29/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "pixels.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// room past the widened row for the broadcast stores to run over into
+#define PIXEL_SLACK 64
+
+const Palette grayPalette = {{0xFF000000, 0xFFFFFFFF, 0xFF606060, 0xFFB0B0B0}};
+const Palette greenPalette = {{0xFF0F380F, 0xFF9BBC0F, 0xFF306230, 0xFF8BAC0F}};
+const Palette amberPalette = {{0xFF1A0F00, 0xFFFFB000, 0xFF7A4A00, 0xFFCC8C00}};
+
+const Palette *findPalette(const char *name)
+{
+    if(!strcmp(name, "gray"))
+        return &grayPalette;
+    if(!strcmp(name, "green"))
+        return &greenPalette;
+    if(!strcmp(name, "amber"))
+        return &amberPalette;
+    return NULL;
+}
+
+PixelOptions::PixelOptions() : format(PIXEL_RGBA8), palette(&grayPalette), scale(1), filter(PIXEL_SHARP), pitch(0),
+                               path(bestPixelPath())
+{
+}
+
+PixelPath bestPixelPath()
+{
+#if defined(__AVX2__)
+    return PIXEL_AVX2;
+#elif defined(__SSE2__)
+    return PIXEL_SSE2;
+#else
+    return PIXEL_SCALAR;
+#endif
+}
+
+int bytesPerPixel(PixelFormat format)
+{
+    return format == PIXEL_GRAY8 ? 1 : 4;
+}
+
+int pixelWidth(bool hires, int scale)
+{
+    return (hires ? 128 : 64) * scale;
+}
+
+int pixelHeight(bool hires, int scale)
+{
+    return (hires ? 64 : 32) * scale;
+}
+
+// A palette colour as it's stored in the format, gray is the luma (exact for grays)
+static uint32_t convert(uint32_t argb, PixelFormat format)
+{
+    unsigned char r = argb >> 16, g = argb >> 8, b = argb, a = argb >> 24;
+    if(format == PIXEL_GRAY8)
+        return (77 * r + 150 * g + 29 * b + 128) >> 8;
+    if(format == PIXEL_ARGB32)
+        return argb;
+    unsigned char bytes[4] = {r, g, b, a};
+    uint32_t rgba;
+    memcpy(&rgba, bytes, 4);
+    return rgba;
+}
+
+// Which byte of a 32 bit pixel is alpha: 3 for RGBA8, for ARGB32 it depends on the host
+static int alphaByte(PixelFormat format)
+{
+    uint32_t probe = 0xFF000000;
+    unsigned char bytes[4];
+    memcpy(bytes, &probe, 4);
+    return format == PIXEL_ARGB32 && bytes[0] == 0xFF ? 0 : 3;
+}
+
+static inline unsigned char average(unsigned int a, unsigned int b)
+{
+    return (a + b + 1) >> 1; // rounds like pavgb
+}
+
+/* The plain versions, what the SIMD ones have to match.
+ * expand: 64 pixels from a word of each plane. widen: every pixel scale times.
+ * halve: half brightness, alpha kept. average3: avg(avg(a, b), mid) per byte, the 1 2 1 blur.
+ */
+static void expandScalar(uint64_t low, uint64_t high, const uint32_t *colors, int bpp, unsigned char *out)
+{
+    for(int x = 0; x < 64; ++x)
+    {
+        int value = (low >> (63 - x) & 1) | (high >> (63 - x) & 1) << 1;
+        if(bpp == 1)
+            out[x] = colors[value];
+        else
+            memcpy(out + x * 4, &colors[value], 4);
+    }
+}
+
+static void widenScalar(const unsigned char *in, int pixels, int bpp, int scale, unsigned char *out)
+{
+    for(int x = 0; x < pixels; ++x)
+        for(int k = 0; k < scale; ++k)
+            memcpy(out + (x * scale + k) * bpp, in + x * bpp, bpp);
+}
+
+static void halveScalar(unsigned char *p, size_t bytes, int bpp, int alpha, size_t from = 0)
+{
+    for(size_t i = from; i < bytes; ++i)
+        if(bpp == 1 || (int)(i & 3) != alpha)
+            p[i] >>= 1;
+}
+
+static void average3Scalar(const unsigned char *a, const unsigned char *mid, const unsigned char *b, unsigned char *out,
+                           size_t bytes, size_t from = 0)
+{
+    for(size_t i = from; i < bytes; ++i)
+        out[i] = average(average(a[i], b[i]), mid[i]);
+}
+
+#if defined(__SSE2__)
+static inline __m128i select128(__m128i mask, __m128i yes, __m128i no)
+{
+    return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+
+static void expandSSE2(uint64_t low, uint64_t high, const uint32_t *colors, int bpp, unsigned char *out)
+{
+    if(bpp == 4)
+    {
+        // 4 pixels a vector: the byte in every lane, each lane tests its own bit
+        const __m128i first = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10), second = _mm_setr_epi32(8, 4, 2, 1);
+        const __m128i c0 = _mm_set1_epi32(colors[0]), c1 = _mm_set1_epi32(colors[1]);
+        const __m128i c2 = _mm_set1_epi32(colors[2]), c3 = _mm_set1_epi32(colors[3]);
+        for(int k = 0; k < 8; ++k)
+        {
+            __m128i b0 = _mm_set1_epi32(low >> (56 - 8 * k) & 0xFF), b1 = _mm_set1_epi32(high >> (56 - 8 * k) & 0xFF);
+            for(int half = 0; half < 2; ++half)
+            {
+                __m128i bits = half ? second : first;
+                __m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(b0, bits), bits);
+                __m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(b1, bits), bits);
+                __m128i px = select128(m1, select128(m0, c3, c2), select128(m0, c1, c0));
+                _mm_storeu_si128((__m128i *)(out + k * 32 + half * 16), px);
+            }
+        }
+        return;
+    }
+    // 16 pixels a vector: two bytes spread over 8 lanes each
+    const __m128i bits = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    const __m128i c0 = _mm_set1_epi8(colors[0]), c1 = _mm_set1_epi8(colors[1]);
+    const __m128i c2 = _mm_set1_epi8(colors[2]), c3 = _mm_set1_epi8(colors[3]);
+    for(int k = 0; k < 4; ++k)
+    {
+        int shift = 48 - 16 * k;
+        unsigned int p0 = low >> shift & 0xFFFF, p1 = high >> shift & 0xFFFF;
+        __m128i b0 = _mm_cvtsi32_si128(p0 >> 8 | (p0 & 0xFF) << 8), b1 = _mm_cvtsi32_si128(p1 >> 8 | (p1 & 0xFF) << 8);
+        b0 = _mm_unpacklo_epi8(b0, b0);
+        b0 = _mm_unpacklo_epi16(b0, b0);
+        b0 = _mm_unpacklo_epi32(b0, b0);
+        b1 = _mm_unpacklo_epi8(b1, b1);
+        b1 = _mm_unpacklo_epi16(b1, b1);
+        b1 = _mm_unpacklo_epi32(b1, b1);
+        __m128i m0 = _mm_cmpeq_epi8(_mm_and_si128(b0, bits), bits);
+        __m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(b1, bits), bits);
+        _mm_storeu_si128((__m128i *)(out + k * 16), select128(m1, select128(m0, c3, c2), select128(m0, c1, c0)));
+    }
+}
+
+// scale 2 is the common one (64x32 in a 128x64 window), the other scales broadcast each pixel
+static void widenSSE2(const unsigned char *in, int pixels, int bpp, int scale, unsigned char *out)
+{
+    size_t bytes = (size_t)pixels * bpp; // a multiple of 64
+    if(scale == 1)
+        memcpy(out, in, bytes);
+    else if(scale == 2)
+        for(size_t i = 0; i < bytes; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            __m128i lo = bpp == 1 ? _mm_unpacklo_epi8(v, v) : _mm_unpacklo_epi32(v, v);
+            __m128i hi = bpp == 1 ? _mm_unpackhi_epi8(v, v) : _mm_unpackhi_epi32(v, v);
+            _mm_storeu_si128((__m128i *)(out + i * 2), lo);
+            _mm_storeu_si128((__m128i *)(out + i * 2 + 16), hi);
+        }
+    else
+    {
+        int run = scale * bpp;
+        for(int x = 0; x < pixels; ++x)
+        {
+            uint32_t pixel;
+            memcpy(&pixel, in + x * bpp, 4); // in has slack after it too
+            __m128i v = bpp == 1 ? _mm_set1_epi8((char)pixel) : _mm_set1_epi32(pixel);
+            for(int k = 0; k < run; k += 16)
+                _mm_storeu_si128((__m128i *)(out + x * run + k), v);
+        }
+    }
+}
+
+static void halveSSE2(unsigned char *p, size_t bytes, int bpp, int alpha)
+{
+    const __m128i keep = bpp == 1 ? _mm_set1_epi8(0x7F) : _mm_set1_epi32(0x7F7F7F7F & ~(0xFFu << alpha * 8));
+    const __m128i alphaMask = bpp == 1 ? _mm_setzero_si128() : _mm_set1_epi32(0xFFu << alpha * 8);
+    size_t i = 0;
+    for(; i + 16 <= bytes; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 1), keep), _mm_and_si128(v, alphaMask));
+        _mm_storeu_si128((__m128i *)(p + i), v);
+    }
+    halveScalar(p, bytes, bpp, alpha, i);
+}
+
+static void average3SSE2(const unsigned char *a, const unsigned char *mid, const unsigned char *b, unsigned char *out,
+                         size_t bytes)
+{
+    size_t i = 0;
+    for(; i + 16 <= bytes; i += 16)
+    {
+        __m128i ab = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_avg_epu8(ab, _mm_loadu_si128((const __m128i *)(mid + i))));
+    }
+    average3Scalar(a, mid, b, out, bytes, i);
+}
+#endif
+
+#if defined(__AVX2__)
+static void expandAVX2(uint64_t low, uint64_t high, const uint32_t *colors, int bpp, unsigned char *out)
+{
+    if(bpp == 4)
+    {
+        // 8 pixels a vector: each lane shifts its bit down, the two planes make an index into the palette
+        const __m256i shifts = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i palette = _mm256_setr_epi32(colors[0], colors[1], colors[2], colors[3],
+                                                  colors[0], colors[1], colors[2], colors[3]);
+        for(int k = 0; k < 8; ++k)
+        {
+            __m256i i0 = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(low >> (56 - 8 * k) & 0xFF), shifts), one);
+            __m256i i1 = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(high >> (56 - 8 * k) & 0xFF), shifts), one);
+            __m256i index = _mm256_or_si256(i0, _mm256_slli_epi32(i1, 1));
+            _mm256_storeu_si256((__m256i *)(out + k * 32), _mm256_permutevar8x32_epi32(palette, index));
+        }
+        return;
+    }
+    // 32 pixels a vector: four bytes spread over 8 lanes each, the index looked up with a byte shuffle
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(0x0102040810204080LL);
+    const __m256i table = _mm256_setr_epi8(colors[0], colors[1], colors[2], colors[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           colors[0], colors[1], colors[2], colors[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i one = _mm256_set1_epi8(1), two = _mm256_set1_epi8(2);
+    for(int half = 0; half < 2; ++half)
+    {
+        // first byte in memory = leftmost 8 pixels
+        uint32_t w0 = __builtin_bswap32((uint32_t)(low >> (32 - 32 * half)));
+        uint32_t w1 = __builtin_bswap32((uint32_t)(high >> (32 - 32 * half)));
+        __m256i b0 = _mm256_shuffle_epi8(_mm256_set1_epi32(w0), spread);
+        __m256i b1 = _mm256_shuffle_epi8(_mm256_set1_epi32(w1), spread);
+        __m256i m0 = _mm256_cmpeq_epi8(_mm256_and_si256(b0, bits), bits);
+        __m256i m1 = _mm256_cmpeq_epi8(_mm256_and_si256(b1, bits), bits);
+        __m256i index = _mm256_or_si256(_mm256_and_si256(m0, one), _mm256_and_si256(m1, two));
+        _mm256_storeu_si256((__m256i *)(out + half * 32), _mm256_shuffle_epi8(table, index));
+    }
+}
+
+static void widenAVX2(const unsigned char *in, int pixels, int bpp, int scale, unsigned char *out)
+{
+    if(scale <= 2 || scale * bpp < 32)
+    {
+        widenSSE2(in, pixels, bpp, scale, out); // unpacks, or runs too short for a 32 byte store
+        return;
+    }
+    int run = scale * bpp;
+    for(int x = 0; x < pixels; ++x)
+    {
+        uint32_t pixel;
+        memcpy(&pixel, in + x * bpp, 4);
+        __m256i v = bpp == 1 ? _mm256_set1_epi8((char)pixel) : _mm256_set1_epi32(pixel);
+        for(int k = 0; k < run; k += 32)
+            _mm256_storeu_si256((__m256i *)(out + x * run + k), v);
+    }
+}
+
+static void halveAVX2(unsigned char *p, size_t bytes, int bpp, int alpha)
+{
+    const __m256i keep = bpp == 1 ? _mm256_set1_epi8(0x7F) : _mm256_set1_epi32(0x7F7F7F7F & ~(0xFFu << alpha * 8));
+    const __m256i alphaMask = bpp == 1 ? _mm256_setzero_si256() : _mm256_set1_epi32(0xFFu << alpha * 8);
+    size_t i = 0;
+    for(; i + 32 <= bytes; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 1), keep), _mm256_and_si256(v, alphaMask));
+        _mm256_storeu_si256((__m256i *)(p + i), v);
+    }
+    halveScalar(p, bytes, bpp, alpha, i);
+}
+
+static void average3AVX2(const unsigned char *a, const unsigned char *mid, const unsigned char *b, unsigned char *out,
+                         size_t bytes)
+{
+    size_t i = 0;
+    for(; i + 32 <= bytes; i += 32)
+    {
+        __m256i ab = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                     _mm256_loadu_si256((const __m256i *)(b + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_avg_epu8(ab, _mm256_loadu_si256((const __m256i *)(mid + i))));
+    }
+    average3Scalar(a, mid, b, out, bytes, i);
+}
+#endif
+
+// The kernels for one path
+struct PixelKernels
+{
+    void (*expand)(uint64_t, uint64_t, const uint32_t *, int, unsigned char *);
+    void (*widen)(const unsigned char *, int, int, int, unsigned char *);
+    void (*halve)(unsigned char *, size_t, int, int);
+    void (*average3)(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, size_t);
+};
+
+static void halvePlain(unsigned char *p, size_t bytes, int bpp, int alpha)
+{
+    halveScalar(p, bytes, bpp, alpha);
+}
+
+static void average3Plain(const unsigned char *a, const unsigned char *mid, const unsigned char *b, unsigned char *out,
+                          size_t bytes)
+{
+    average3Scalar(a, mid, b, out, bytes);
+}
+
+static PixelKernels kernelsFor(PixelPath path)
+{
+    if(path > bestPixelPath())
+        path = bestPixelPath();
+    PixelKernels k = {expandScalar, widenScalar, halvePlain, average3Plain};
+#if defined(__SSE2__)
+    if(path == PIXEL_SSE2)
+        k = {expandSSE2, widenSSE2, halveSSE2, average3SSE2};
+#endif
+#if defined(__AVX2__)
+    if(path == PIXEL_AVX2)
+        k = {expandAVX2, widenAVX2, halveAVX2, average3AVX2};
+#endif
+    return k;
+}
+
+/* 1 2 1 across every row, then down every column. Rows are averaged against copies so nothing
+ * reads a pixel that's already been blurred, the end pixels count as their own neighbours.
+ */
+static void smooth(const PixelKernels &k, unsigned char *image, size_t rowBytes, int rows, size_t pitch, int bpp)
+{
+    static thread_local std::vector<unsigned char> copies;
+    copies.resize(3 * rowBytes + 2 * bpp);
+    unsigned char *padded = copies.data();
+    unsigned char *above = padded + rowBytes + 2 * bpp, *current = above + rowBytes;
+    for(int r = 0; r < rows; ++r)
+    {
+        unsigned char *row = image + r * pitch;
+        memcpy(padded, row, bpp);
+        memcpy(padded + bpp, row, rowBytes);
+        memcpy(padded + bpp + rowBytes, row + rowBytes - bpp, bpp);
+        k.average3(padded, padded + bpp, padded + 2 * bpp, row, rowBytes);
+    }
+    for(int r = 0; r < rows; ++r)
+    {
+        unsigned char *row = image + r * pitch;
+        memcpy(current, row, rowBytes);
+        const unsigned char *up = r ? above : current;
+        const unsigned char *down = r + 1 < rows ? row + pitch : current;
+        k.average3(up, current, down, row, rowBytes);
+        std::swap(above, current);
+    }
+}
+
+void renderPixels(const uint64_t *gfx, bool hires, const PixelOptions &options, unsigned char *out)
+{
+    PixelKernels k = kernelsFor(options.path);
+    int bpp = bytesPerPixel(options.format);
+    int alpha = alphaByte(options.format);
+    int scale = options.scale < 1 ? 1 : options.scale;
+    int columns = hires ? 2 : 1;
+    int width = columns * 64, height = hires ? DISPLAY_ROWS : 32;
+    size_t rowBytes = (size_t)width * scale * bpp;
+    size_t pitch = options.pitch ? options.pitch : rowBytes;
+    uint32_t colors[4];
+    for(int i = 0; i < 4; ++i)
+        colors[i] = convert(options.palette->colors[i], options.format);
+
+    // one source row at a time: expanded, then widened, then copied out scale times
+    static thread_local std::vector<unsigned char> buffer;
+    buffer.resize(width * bpp + PIXEL_SLACK + rowBytes + PIXEL_SLACK);
+    unsigned char *source = buffer.data(), *wide = source + width * bpp + PIXEL_SLACK;
+    bool scanlines = options.filter == PIXEL_SCANLINES && scale > 1;
+    for(int y = 0; y < height; ++y)
+    {
+        for(int c = 0; c < columns; ++c)
+            k.expand(gfx[c * DISPLAY_ROWS + y], gfx[(2 + c) * DISPLAY_ROWS + y], colors, bpp, source + c * 64 * bpp);
+        k.widen(source, width, bpp, scale, wide);
+        for(int r = 0; r < scale; ++r)
+            memcpy(out + ((size_t)y * scale + r) * pitch, wide, rowBytes);
+        if(scanlines)
+            k.halve(out + ((size_t)y * scale + scale - 1) * pitch, rowBytes, bpp, alpha);
+    }
+    if(options.filter == PIXEL_SMOOTH)
+        smooth(k, out, rowBytes, height * scale, pitch, bpp);
+}
+
+bool saveScreenshot(const char *filename, const uint64_t *gfx, bool hires, const PixelOptions &options)
+{
+    PixelOptions rgba = options;
+    rgba.format = PIXEL_RGBA8;
+    rgba.pitch = 0;
+    if(rgba.scale < 1)
+        rgba.scale = 1;
+    int width = pixelWidth(hires, rgba.scale), height = pixelHeight(hires, rgba.scale);
+    std::vector<unsigned char> image((size_t)width * height * 4);
+    renderPixels(gfx, hires, rgba, image.data());
+
+    FILE *file = fopen(filename, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", filename);
+        return false;
+    }
+    fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+    bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+    ok &= fclose(file) == 0;
+    return ok;
+}
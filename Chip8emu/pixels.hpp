@@ -0,0 +1,92 @@
+//
+//  pixels.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/29/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef pixels_hpp
+#define pixels_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.hpp"
+
+/* Software output: the packed screen straight to an image in memory, for headless capture and
+ * thumbnails (no GL). One pass per source row expands the bits through a palette, widens each
+ * pixel to scale copies and writes the row out scale times, then the filter (if any) runs over
+ * the result. There are SSE2 and AVX2 versions of every step and a plain one they all have to
+ * agree with byte for byte (Chip8PixelsTest).
+ */
+
+enum PixelFormat
+{
+    PIXEL_GRAY8, // one byte per pixel
+    PIXEL_RGBA8, // bytes R, G, B, A
+    PIXEL_ARGB32 // 32 bit words 0xAARRGGBB in host order (B, G, R, A bytes on x86)
+};
+
+enum PixelFilter
+{
+    PIXEL_SHARP, // plain nearest neighbour
+    PIXEL_SCANLINES, // the last output row of every source row at half brightness, needs scale 2 or more
+    PIXEL_SMOOTH // a 1 2 1 blur across and then down, on the scaled image
+};
+
+// What the SIMD paths are built for, the best one compiled in is the default
+enum PixelPath
+{
+    PIXEL_SCALAR,
+    PIXEL_SSE2,
+    PIXEL_AVX2
+};
+
+// Colour per pixel value (Chip8::pixel: off, plane 0, plane 1, both) as 0xAARRGGBB
+struct Palette
+{
+    uint32_t colors[4];
+};
+// the shades renderGrayRows uses (pixelShades), so gray output matches it
+extern const Palette grayPalette;
+extern const Palette greenPalette; // green screen LCD
+extern const Palette amberPalette; // amber monitor
+// "gray", "green" or "amber", NULL for anything else
+const Palette *findPalette(const char *name);
+
+struct PixelOptions
+{
+    PixelFormat format;
+    const Palette *palette;
+    int scale; // output pixels per screen pixel each way, 1 or more
+    PixelFilter filter;
+    size_t pitch; // bytes from one output row to the next, 0 for exactly a row's worth
+    PixelPath path;
+
+    PixelOptions();
+};
+
+// The best path this build has
+PixelPath bestPixelPath();
+int bytesPerPixel(PixelFormat);
+// How big the image is at this scale
+int pixelWidth(bool hires, int scale);
+int pixelHeight(bool hires, int scale);
+// The scale that fills a window of 128 x 64 times modifier (as main.cpp does), whichever resolution
+inline int displayScale(bool hires, int modifier) { return hires ? modifier : modifier * 2; }
+
+/* Renders a packed screen laid out like Chip8::gfx. out needs pixelHeight rows of pitch bytes.
+ * A path the build doesn't have falls back to the best one it does.
+ */
+void renderPixels(const uint64_t *gfx, bool hires, const PixelOptions &, unsigned char *out);
+inline void renderPixels(const Chip8 &c8, const PixelOptions &options, unsigned char *out)
+{
+    renderPixels(c8.gfx, c8.hires, options, out);
+}
+
+/* Writes the screen as a PAM image (netpbm's RGBA format, P7), in the options' palette, scale and
+ * filter, whatever their format says. False if it couldn't be written.
+ */
+bool saveScreenshot(const char *filename, const uint64_t *gfx, bool hires, const PixelOptions &);
+
+#endif /* pixels_hpp */
@@ -0,0 +1,110 @@
+//
+//  profiler.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/20/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "profiler.hpp"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+void Chip8Profile::reset()
+{
+    memset(pcCount, 0, sizeof(pcCount));
+    memset(handlerCount, 0, sizeof(handlerCount));
+    memset(skipTaken, 0, sizeof(skipTaken));
+    memset(backJumps, 0, sizeof(backJumps));
+    memset(backTarget, 0, sizeof(backTarget));
+}
+
+void Chip8Profile::merge(const Chip8Profile &other)
+{
+    for(int i = 0; i < 4096; ++i)
+    {
+        pcCount[i] += other.pcCount[i];
+        skipTaken[i] += other.skipTaken[i];
+        if(other.backJumps[i])
+        {
+            backJumps[i] += other.backJumps[i];
+            backTarget[i] = other.backTarget[i];
+        }
+    }
+    for(int h = 0; h < Chip8::H_Undecoded; ++h)
+        handlerCount[h] += other.handlerCount[h];
+}
+
+unsigned long long Chip8Profile::total() const
+{
+    unsigned long long sum = 0;
+    for(int h = 0; h < Chip8::H_Undecoded; ++h)
+        sum += handlerCount[h];
+    return sum;
+}
+
+static unsigned short opcodeAt(const unsigned char *memory, int address)
+{
+    return memory ? (memory[address] << 8 | memory[(address + 1) & 0x0FFF]) : 0;
+}
+
+void Chip8Profile::report(FILE *out, const unsigned char *memory, int top) const
+{
+    unsigned long long all = total();
+    double scale = all ? 100.0 / all : 0;
+    fprintf(out, "%llu instructions profiled\n", all);
+
+    // opcode families, busiest first
+    std::vector<int> order;
+    for(int h = 0; h < Chip8::H_Undecoded; ++h)
+        if(handlerCount[h])
+            order.push_back(h);
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return handlerCount[a] > handlerCount[b]; });
+    fprintf(out, "\nOpcode families:\n");
+    for(size_t i = 0; i < order.size(); ++i)
+        fprintf(out, "  %-12s %14llu %6.2f%%\n", Chip8::handlerName(order[i]), handlerCount[order[i]], handlerCount[order[i]] * scale);
+
+    // hot spots
+    std::vector<int> hot;
+    for(int a = 0; a < 4096; ++a)
+        if(pcCount[a])
+            hot.push_back(a);
+    std::sort(hot.begin(), hot.end(), [this](int a, int b) { return pcCount[a] > pcCount[b]; });
+    fprintf(out, "\nHot spots:\n");
+    for(size_t i = 0; i < hot.size() && (int)i < top; ++i)
+        fprintf(out, "  0x%03X  %04X %14llu %6.2f%%\n", hot[i], opcodeAt(memory, hot[i]), pcCount[hot[i]], pcCount[hot[i]] * scale);
+
+    // skips and how often they go each way
+    fprintf(out, "\nSkips:\n");
+    int shown = 0;
+    for(size_t i = 0; i < hot.size() && shown < top; ++i)
+    {
+        int a = hot[i];
+        bool skip = memory ? Chip8::isSkip(Chip8::decode(opcodeAt(memory, a)).handler) : skipTaken[a] != 0;
+        if(!skip)
+            continue;
+        fprintf(out, "  0x%03X  %04X %14llu run %14llu taken %6.2f%%\n", a, opcodeAt(memory, a), pcCount[a], skipTaken[a],
+                100.0 * skipTaken[a] / pcCount[a]);
+        ++shown;
+    }
+
+    // loops: a backward jump and everything between its target and itself
+    struct Loop { int from, to; unsigned long long iterations, instructions; };
+    std::vector<Loop> loops;
+    for(int a = 0; a < 4096; ++a)
+    {
+        if(!backJumps[a])
+            continue;
+        Loop loop = { a, backTarget[a], backJumps[a], 0 };
+        for(int b = loop.to; b <= loop.from; ++b)
+            loop.instructions += pcCount[b];
+        loops.push_back(loop);
+    }
+    std::sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b) { return a.instructions > b.instructions; });
+    fprintf(out, "\nLoops:\n");
+    for(size_t i = 0; i < loops.size() && (int)i < top; ++i)
+        fprintf(out, "  0x%03X-0x%03X %14llu iterations %14llu instructions %6.2f%%  (%.1f per iteration)\n",
+                loops[i].to, loops[i].from, loops[i].iterations, loops[i].instructions, loops[i].instructions * scale,
+                (double)loops[i].instructions / loops[i].iterations);
+}
@@ -0,0 +1,58 @@
+//
+//  profiler.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/20/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef profiler_hpp
+#define profiler_hpp
+
+#include <stdio.h>
+#include "chip8.hpp"
+
+/* Where a ROM spends its cycles. Build with CHIP8_PROFILE defined and point Chip8::profile at one
+ * of these; emulateCycle then counts every instruction it runs. Without CHIP8_PROFILE none of
+ * the hooks exist. Only the interpreter is profiled, run with the JIT off.
+ *
+ * The hot path is two increments per instruction, skips and jumps add one more when taken.
+ * Everything else (loops, ratios, sorting) is worked out when the report is printed.
+ */
+struct Chip8Profile
+{
+    unsigned long long pcCount[4096]; // instructions run at each address
+    unsigned long long handlerCount[Chip8::H_Undecoded]; // by opcode family
+    unsigned long long skipTaken[4096]; // how often the skip at this address skipped
+    unsigned long long backJumps[4096]; // 1NNN at this address jumping backwards, i.e. a loop
+    unsigned short backTarget[4096]; // where it jumped to
+
+    Chip8Profile() { reset(); }
+    void reset();
+    // Adds another machine's counts in, e.g. every job in a batch running the same ROM
+    void merge(const Chip8Profile &);
+
+    // hooks, called from emulateCycle and the skip and jump instructions
+    inline void count(unsigned short pc, unsigned char handler)
+    {
+        ++pcCount[pc & 0x0FFF];
+        ++handlerCount[handler];
+    }
+    inline void skipped(unsigned short pc) { ++skipTaken[pc & 0x0FFF]; }
+    inline void jumped(unsigned short from, unsigned short to)
+    {
+        if(to <= from)
+        {
+            ++backJumps[from & 0x0FFF];
+            backTarget[from & 0x0FFF] = to;
+        }
+    }
+
+    unsigned long long total() const;
+    /* Human readable report: opcode families, the top hot addresses, skips and loops.
+     * memory is only used to show the opcode at each address, pass NULL to leave it out.
+     */
+    void report(FILE *, const unsigned char *memory, int top = 20) const;
+};
+
+#endif /* profiler_hpp */
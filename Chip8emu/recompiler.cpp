@@ -0,0 +1,330 @@
+//
+//  recompiler.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/26/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "recompiler.hpp"
+#include <stdio.h>
+#include "romstore.hpp"
+
+// Blocks are cut at this many bytes, so one never spans more than two pages
+#define AOT_MAX_BLOCK_BYTES 128
+
+static std::string hex(unsigned int value, int digits)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "0x%0*X", digits, value);
+    return text;
+}
+
+static std::string reg(int x)
+{
+    return "c8.V[" + hex(x, 1) + "]";
+}
+
+// Instructions after which the block can't go on: pc comes from somewhere else
+static bool isControl(unsigned char handler)
+{
+    switch(handler)
+    {
+        case Chip8::H_Jump: case Chip8::H_Call: case Chip8::H_Return: case Chip8::H_JumpV0: case Chip8::H_Exit:
+            return true;
+    }
+    return Chip8::isSkip(handler);
+}
+
+/* FX0A may park the machine, FX18 only goes first (its sound edge is stamped with Chip8::cycles,
+ * which is only right at the start of a block), the rest write memory that could be code
+ */
+static bool endsBlock(unsigned char handler)
+{
+    switch(handler)
+    {
+        case Chip8::H_WaitKey: case Chip8::H_SetSound:
+        case Chip8::H_StoreBCD: case Chip8::H_StoreRegs: case Chip8::H_SaveRange:
+            return true;
+    }
+    return false;
+}
+
+Recompiler::Recompiler(const unsigned char *image, size_t size) : code(size, false), rom(image, image + size)
+{
+    limit = size < 0x1000 - 0x200 ? 0x200 + size : 0x1000;
+    indirectJumps = 0;
+    std::vector<bool> leader(0x1000, false);
+    findCode(leader);
+    buildBlocks(leader);
+
+    codeBytes = 0;
+    for(size_t i = 0; i < size; ++i)
+        codeBytes += code[i];
+    dataBytes = size - codeBytes;
+}
+
+bool Recompiler::longInstructionAt(unsigned short address) const
+{
+    return address + 1 < limit && opcodeAt(address) == 0xF000;
+}
+
+void Recompiler::findCode(std::vector<bool> &leader)
+{
+    std::vector<bool> walked(0x1000, false);
+    std::vector<unsigned short> work(1, 0x200);
+    while(!work.empty())
+    {
+        unsigned short pc = work.back();
+        work.pop_back();
+        if(pc < 0x200 || pc + 1 >= limit)
+            continue; // outside the ROM, left to the interpreter
+        leader[pc] = true;
+
+        // straight on from pc until something that doesn't fall through, or code already walked
+        while(pc + 1 < limit && !walked[pc])
+        {
+            walked[pc] = true;
+            DecodedOp op = Chip8::decode(opcodeAt(pc));
+            unsigned short next = pc + (op.handler == Chip8::H_LongIndex ? 4 : 2);
+            for(unsigned short a = pc; a < next && a < limit; ++a)
+                code[a - 0x200] = true;
+
+            if(op.handler == Chip8::H_Jump)
+                work.push_back(op.imm);
+            else if(op.handler == Chip8::H_Call)
+            {
+                work.push_back(op.imm);
+                work.push_back(next); // where 00EE comes back to
+            }
+            else if(Chip8::isSkip(op.handler))
+            {
+                work.push_back(next);
+                work.push_back(next + (longInstructionAt(next) ? 4 : 2));
+            }
+            else if(op.handler == Chip8::H_JumpV0)
+            {
+                // a jump table usually sits right at the base: 1NNNs one after another
+                ++indirectJumps;
+                for(unsigned int a = op.imm; a >= 0x200 && a + 1 < limit && a < op.imm + 0x100u; a += 2)
+                {
+                    if((opcodeAt(a) & 0xF000) != 0x1000)
+                        break;
+                    work.push_back(a);
+                }
+            }
+            else if(op.handler == Chip8::H_Return)
+                ++indirectJumps;
+            if(isControl(op.handler) || op.handler == Chip8::H_Unknown)
+                break;
+            pc = next;
+        }
+    }
+}
+
+void Recompiler::buildBlocks(std::vector<bool> &leader)
+{
+    std::vector<unsigned short> work;
+    for(unsigned short a = 0x200; a < limit; ++a)
+        if(leader[a])
+            work.push_back(a);
+
+    while(!work.empty())
+    {
+        unsigned short start = work.back();
+        work.pop_back();
+        if(blocks.count(start))
+            continue;
+
+        Block block;
+        block.start = start;
+        unsigned short pc = start;
+        bool ended = false, skips = false;
+        while(pc + 1 < limit && (pc == start || !leader[pc]))
+        {
+            DecodedOp op = Chip8::decode(opcodeAt(pc));
+            unsigned short length = op.handler == Chip8::H_LongIndex ? 4 : 2;
+            if(op.handler == Chip8::H_Unknown || pc + length > limit || pc + length - start > AOT_MAX_BLOCK_BYTES)
+                break;
+            if(Chip8::isSkip(op.handler) && pc + 4 > limit)
+                break; // where it lands depends on bytes past the ROM
+            if(op.handler == Chip8::H_SetSound && pc != start)
+                break;
+            block.addresses.push_back(pc);
+            block.ops.push_back(op);
+            pc += length;
+            if(isControl(op.handler))
+            {
+                ended = true;
+                skips = Chip8::isSkip(op.handler);
+                break;
+            }
+            if(endsBlock(op.handler))
+                break;
+        }
+        if(block.ops.empty())
+            continue; // the interpreter gets this one
+
+        block.next = pc;
+        block.end = skips ? pc + 2 : pc;
+        blocks[start] = block;
+        // cut short: whatever comes next needs a block of its own
+        if(!ended && pc + 1 < limit && !leader[pc])
+        {
+            leader[pc] = true;
+            work.push_back(pc);
+        }
+    }
+}
+
+void Recompiler::emitBlock(std::ostream &out, const Block &block) const
+{
+    out << "// " << hex(block.start, 3) << "-" << hex(block.end - 1, 3) << "\n";
+    out << "unsigned int block_" << hex(block.start, 3).substr(2) << "(Chip8 &c8)\n{\n";
+    bool returned = false;
+    for(size_t i = 0; i < block.ops.size(); ++i)
+    {
+        const DecodedOp &op = block.ops[i];
+        unsigned short pc = block.addresses[i];
+        unsigned short next = pc + (op.handler == Chip8::H_LongIndex ? 4 : 2);
+        std::string x = reg(op.x), y = reg(op.y), vf = reg(0xF);
+        std::string nn = hex(op.imm, 2), nnn = hex(op.imm, 3);
+        out << "    // " << hex(pc, 3).substr(2) << ": " << hex(op.opcode, 4).substr(2) << "\n";
+        switch(op.handler)
+        {
+            case Chip8::H_SetImm:     out << "    " << x << " = " << nn << ";\n"; break;
+            case Chip8::H_AddImm:     out << "    " << x << " += " << nn << ";\n"; break;
+            case Chip8::H_Mov:        out << "    " << x << " = " << y << ";\n"; break;
+            case Chip8::H_Or:         out << "    " << x << " |= " << y << ";\n"; break;
+            case Chip8::H_And:        out << "    " << x << " &= " << y << ";\n"; break;
+            case Chip8::H_Xor:        out << "    " << x << " ^= " << y << ";\n"; break;
+            // VF goes first, the same as emulateCycle, which matters when X or Y is F
+            case Chip8::H_AddReg:
+                out << "    " << vf << " = " << x << " > 0xFF - " << y << ";\n";
+                out << "    " << x << " += " << y << ";\n";
+                break;
+            case Chip8::H_SubReg:
+                out << "    " << vf << " = " << x << " > " << y << ";\n";
+                out << "    " << x << " -= " << y << ";\n";
+                break;
+            case Chip8::H_ShiftRight:
+                out << "    " << vf << " = " << x << " & 1;\n";
+                out << "    " << x << " >>= 1;\n";
+                break;
+            case Chip8::H_SubnReg:
+                out << "    " << vf << " = " << x << " < " << y << ";\n";
+                out << "    " << x << " = " << y << " - " << x << ";\n";
+                break;
+            case Chip8::H_ShiftLeft:
+                out << "    " << vf << " = " << x << " >> 7;\n";
+                out << "    " << x << " <<= 1;\n";
+                break;
+            case Chip8::H_SetIndex:   out << "    c8.I = " << nnn << ";\n"; break;
+            case Chip8::H_LongIndex:  out << "    c8.I = " << hex(opcodeAt(pc + 2), 4) << ";\n"; break;
+            case Chip8::H_AddIndex:   out << "    c8.I += " << x << ";\n"; break;
+            case Chip8::H_FontChar:   out << "    c8.I = " << x << " * 5;\n"; break;
+            case Chip8::H_Random:     out << "    " << x << " = Chip8::nextRandom(c8.rng) & " << nn << ";\n"; break;
+            case Chip8::H_GetDelay:   out << "    " << x << " = c8.delay_timer;\n"; break;
+            case Chip8::H_SetDelay:   out << "    c8.delay_timer = " << x << ";\n"; break;
+            case Chip8::H_Planes:     out << "    c8.planes = " << (op.x & 3) << ";\n"; break;
+            case Chip8::H_Pitch:      out << "    c8.pitch = " << x << ";\n"; break;
+            case Chip8::H_LoadRegs:
+                out << "    for(int i = 0; i <= " << (int)op.x << "; ++i)\n";
+                out << "        c8.V[i] = c8.memory[(c8.I + i) & 0xFFFF];\n";
+                break;
+            case Chip8::H_Jump:
+                out << "    return " << nnn << ";\n";
+                returned = true;
+                break;
+            case Chip8::H_Call:
+                out << "    c8.stack[c8.sp] = " << hex(pc, 3) << ";\n";
+                out << "    c8.sp = (c8.sp + 1) & 0xF;\n"; // wraps like Chip8::opCall
+                out << "    return " << nnn << ";\n";
+                returned = true;
+                break;
+            case Chip8::H_Return:
+                out << "    c8.sp = (c8.sp - 1) & 0xF;\n"; // wraps like Chip8::opReturn
+                out << "    return (unsigned short)(c8.stack[c8.sp] + 2);\n";
+                returned = true;
+                break;
+            case Chip8::H_JumpV0:
+                out << "    return (unsigned short)(c8.V[0x0] + " << nnn << ");\n";
+                returned = true;
+                break;
+            case Chip8::H_Exit:
+                out << "    return " << hex(pc, 3) << ";\n";
+                returned = true;
+                break;
+            case Chip8::H_SkipEqImm: case Chip8::H_SkipNeImm: case Chip8::H_SkipEqReg: case Chip8::H_SkipNeReg:
+            case Chip8::H_SkipKey: case Chip8::H_SkipNotKey:
+            {
+                std::string condition;
+                if(op.handler == Chip8::H_SkipEqImm)
+                    condition = x + " == " + nn;
+                else if(op.handler == Chip8::H_SkipNeImm)
+                    condition = x + " != " + nn;
+                else if(op.handler == Chip8::H_SkipEqReg)
+                    condition = x + " == " + y;
+                else if(op.handler == Chip8::H_SkipNeReg)
+                    condition = x + " != " + y;
+                else
+                    condition = "c8.key[" + x + " & 0xF]" + (op.handler == Chip8::H_SkipKey ? " != 0" : " == 0");
+                out << "    if(" << condition << ")\n";
+                out << "        return " << hex(next + (longInstructionAt(next) ? 4 : 2), 3) << ";\n";
+                out << "    return " << hex(next, 3) << ";\n";
+                returned = true;
+                break;
+            }
+            default:
+            {
+                // draws, key waits, sound, memory writes and the rest go through the interpreter's handler
+                std::string name = "op_" + hex(pc, 3).substr(2);
+                out << "    static const DecodedOp " << name << " = {Chip8::H_" << Chip8::handlerName(op.handler) << ", "
+                    << hex(op.x, 1) << ", " << hex(op.y, 1) << ", " << hex(op.imm, 3) << ", " << hex(op.opcode, 4) << "};\n";
+                if(op.handler == Chip8::H_WaitKey)
+                {
+                    out << "    c8.pc = " << hex(pc, 3) << ";\n";
+                    out << "    c8.opWaitKey(" << name << ");\n";
+                    out << "    return c8.pc; // stays put if it parked\n";
+                    returned = true;
+                }
+                else
+                    out << "    c8.op" << Chip8::handlerName(op.handler) << "(" << name << ");\n";
+            }
+        }
+    }
+    if(!returned)
+        out << "    return " << hex(block.next, 3) << ";\n";
+    out << "}\n\n";
+}
+
+void Recompiler::emit(std::ostream &out, const std::string &name) const
+{
+    out << "// Generated by Chip8Batch --recompile, don't edit.\n";
+    out << "// " << name << ": " << rom.size() << " bytes, " << codeBytes << " of code and " << dataBytes << " of data, "
+        << blocks.size() << " blocks, " << indirectJumps << " indirect jumps\n\n";
+    out << "#include \"chip8aot.hpp\"\n\nnamespace {\n\n";
+
+    out << "const unsigned char rom[] =\n{";
+    for(size_t i = 0; i < rom.size(); ++i)
+        out << (i % 12 ? " " : "\n    ") << hex(rom[i], 2) << (i + 1 < rom.size() ? "," : "");
+    out << "\n};\n\n";
+
+    for(std::map<unsigned short, Block>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+        emitBlock(out, it->second);
+
+    out << "const AotBlock blocks[] =\n{\n";
+    for(std::map<unsigned short, Block>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        const Block &block = it->second;
+        out << "    {" << hex(block.start, 3) << ", " << hex(block.end, 3) << ", " << block.ops.size() << ", "
+            << hex(block.ops.back().opcode, 4) << ", block_" << hex(block.start, 3).substr(2) << "},\n";
+    }
+    out << "};\n\n";
+
+    char hash[32];
+    snprintf(hash, sizeof(hash), "0x%016llXULL", (unsigned long long)RomStore::hash(rom.data(), rom.size()));
+    out << "const AotModule module = {\"" << name << "\", " << hash << ", rom, sizeof(rom), blocks, sizeof(blocks) / sizeof(blocks[0])};\n";
+    out << "AotRegistration registration(module);\n\n";
+    out << "}  // namespace\n";
+}
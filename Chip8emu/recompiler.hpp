@@ -0,0 +1,64 @@
+//
+//  recompiler.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/26/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef recompiler_hpp
+#define recompiler_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+
+/* Ahead-of-time recompiler: turns a ROM into C++ with one function per basic block, for Chip8Aot
+ * (chip8aot.hpp) to run once it's compiled in.
+ *
+ * Code is found by following control flow from 0x200: jumps, calls and where they come back to,
+ * both ways out of every skip, and the 1NNN entries of a jump table right at a BNNN's base.
+ * Anything that's never reached is data (sprites, tables, room for variables) and gets no code.
+ * 00EE and BNNN go wherever the stack or V0 say, so they end a path, and the runtime looks up the
+ * block where they land. Blocks also end after FX0A and after anything that writes memory, so
+ * code a write may have changed is checked again before it runs.
+ */
+class Recompiler
+{
+public:
+    struct Block
+    {
+        unsigned short start;
+        unsigned short end; // one past the last byte it depends on
+        unsigned short next; // where it goes when it doesn't end in a jump, call, return or skip
+        std::vector<unsigned short> addresses; // of each instruction
+        std::vector<DecodedOp> ops;
+    };
+
+    // Analyses a ROM that gets loaded at 0x200. Only the first 4K can hold code.
+    Recompiler(const unsigned char *rom, size_t size);
+
+    std::map<unsigned short, Block> blocks; // by start address
+    std::vector<bool> code; // per ROM byte, part of an instruction that can be reached
+    size_t codeBytes, dataBytes;
+    int indirectJumps; // 00EE and BNNN
+
+    // Writes the module as a C++ source file. name is just for the AotModule.
+    void emit(std::ostream &, const std::string &name) const;
+
+private:
+    std::vector<unsigned char> rom;
+    unsigned short limit; // one past the last byte code can be in
+
+    unsigned short opcodeAt(unsigned short address) const { return rom[address - 0x200] << 8 | rom[address - 0x200 + 1]; }
+    bool longInstructionAt(unsigned short address) const;
+    void findCode(std::vector<bool> &leader);
+    void buildBlocks(std::vector<bool> &leader);
+    void emitBlock(std::ostream &, const Block &) const;
+};
+
+#endif /* recompiler_hpp */
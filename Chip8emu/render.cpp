@@ -0,0 +1,50 @@
+//
+//  render.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/17/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "render.hpp"
+
+const unsigned char pixelShades[4] = { 0, 255, 96, 176 };
+
+void renderRGB(const Chip8 &c8, unsigned char *out)
+{
+    for(int y = 0; y < c8.height(); ++y)
+        for(int x = 0; x < c8.width(); ++x)
+        {
+            unsigned char value = pixelShades[c8.pixel(x, y)];
+            *out++ = value;
+            *out++ = value;
+            *out++ = value;
+        }
+}
+
+void renderGrayRows(const Chip8 &c8, uint64_t rows, unsigned char *out)
+{
+    renderGrayRows(c8.gfx, c8.hires, rows, out);
+}
+
+void renderGrayRows(const uint64_t *gfx, bool hires, uint64_t rows, unsigned char *out)
+{
+    int columns = hires ? 2 : 1;
+    int height = hires ? DISPLAY_ROWS : 32;
+    for(int y = 0; y < height; ++y)
+    {
+        if(!(rows >> y & 1))
+            continue;
+        unsigned char *line = out + y * columns * 64;
+        for(int c = 0; c < columns; ++c, line += 64)
+        {
+            uint64_t low = gfx[c * DISPLAY_ROWS + y], high = gfx[(2 + c) * DISPLAY_ROWS + y];
+            if(!high)
+                for(int x = 0; x < 64; ++x)
+                    line[x] = -(unsigned char)((low >> (63 - x)) & 1); // plain CHIP-8, no lookups
+            else
+                for(int x = 0; x < 64; ++x)
+                    line[x] = pixelShades[((low >> (63 - x)) & 1) | ((high >> (63 - x)) & 1) << 1];
+        }
+    }
+}
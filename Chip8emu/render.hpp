@@ -0,0 +1,33 @@
+//
+//  render.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/17/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef render_hpp
+#define render_hpp
+
+#include "chip8.hpp"
+
+/* Turning the framebuffer into pixels, kept out of main.cpp so it doesn't need GLUT
+ * and can be benchmarked on its own.
+ */
+
+/* The four shades a pixel can be (Chip8::pixel): off = black, plane 0 = white, so a CHIP-8
+ * screen looks like it always did, plane 1 and both planes are grays in between.
+ */
+extern const unsigned char pixelShades[4];
+
+// out is height() rows of width() RGB pixels
+void renderRGB(const Chip8 &, unsigned char *out);
+
+/* out is height() rows of width() bytes, one shade per pixel. Only the rows set in the rows
+ * mask are written (see Chip8::dirtyRows), the rest are left alone.
+ */
+void renderGrayRows(const Chip8 &, uint64_t rows, unsigned char *out);
+// Same from a copy of the packed screen (e.g. a Frame from the emulation thread), laid out like Chip8::gfx
+void renderGrayRows(const uint64_t *gfx, bool hires, uint64_t rows, unsigned char *out);
+
+#endif /* render_hpp */
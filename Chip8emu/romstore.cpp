@@ -0,0 +1,73 @@
+//
+//  romstore.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/19/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "romstore.hpp"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RomStore::~RomStore()
+{
+    for(std::map<std::string, Rom *>::iterator it = roms.begin(); it != roms.end(); ++it)
+    {
+        munmap((void *)it->second->data, it->second->size);
+        delete it->second;
+    }
+}
+
+uint64_t RomStore::hash(const unsigned char *data, size_t size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; ++i)
+    {
+        h ^= data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+const Rom *RomStore::get(const char *path)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Rom *>::iterator found = roms.find(path);
+    if(found != roms.end())
+        return found->second;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        fprintf(stderr, "Could not open file %s\n", path);
+        return NULL;
+    }
+    struct stat info;
+    void *map = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+        map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if(map == MAP_FAILED)
+    {
+        fprintf(stderr, "Problem reading file %s\n", path);
+        return NULL;
+    }
+
+    Rom *rom = new Rom();
+    rom->path = path;
+    rom->data = (const unsigned char *)map;
+    rom->size = info.st_size;
+    rom->hash = hash(rom->data, rom->size);
+    roms[path] = rom;
+    return rom;
+}
+
+size_t RomStore::size()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return roms.size();
+}
@@ -0,0 +1,51 @@
+//
+//  romstore.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/19/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef romstore_hpp
+#define romstore_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+// A ROM file mapped into memory. Read only and shared by every machine running it.
+struct Rom
+{
+    std::string path;
+    const unsigned char *data;
+    size_t size; // the file's real length
+    uint64_t hash; // 64 bit FNV-1a of the contents, good as a cache key
+};
+
+/* Maps each ROM file once, however many machines load it. Starting an instance is then
+ * initialize() plus one memcpy (Chip8::loadRom) instead of an open and a read each time.
+ * Safe to use from several threads. ROMs stay mapped until the store goes away.
+ */
+class RomStore
+{
+public:
+    RomStore() { }
+    ~RomStore();
+
+    // Maps the file the first time it's asked for, after that returns the same Rom. NULL if it can't be read.
+    const Rom *get(const char *path);
+    size_t size();
+
+    static uint64_t hash(const unsigned char *data, size_t size);
+
+private:
+    RomStore(const RomStore &); // owns mappings, no copying
+    RomStore &operator=(const RomStore &);
+
+    std::mutex lock;
+    std::map<std::string, Rom *> roms;
+};
+
+#endif /* romstore_hpp */
@@ -0,0 +1,78 @@
+//
+//  runahead.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/30/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "runahead.hpp"
+#include <string.h>
+#include <chrono>
+
+static unsigned long long since(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+RunAhead::RunAhead(Chip8 &chip, Scheduler &s) : frames(0), hires(false), dirtyRows(0), cycles(0), steps(0), instructions(0),
+    nanoseconds(0), checkpointNanoseconds(0), c8(chip), scheduler(s)
+{
+    memset(gfx, 0, sizeof(gfx));
+}
+
+bool RunAhead::step()
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t before[DISPLAY_PLANES * 2 * DISPLAY_ROWS];
+    memcpy(before, gfx, sizeof(before));
+    bool wasHires = hires;
+
+    if(frames <= 0)
+    {
+        memcpy(gfx, c8.gfx, sizeof(gfx));
+        hires = c8.hires;
+        cycles = c8.cycles;
+    }
+    else
+    {
+        // what happens ahead didn't happen yet
+        SoundRing *audio = c8.audio;
+        Chip8Trace *trace = c8.trace;
+        c8.audio = NULL;
+        c8.trace = NULL;
+#ifdef CHIP8_PROFILE
+        Chip8Profile *profile = c8.profile;
+        c8.profile = NULL;
+#endif
+        checkpoint.save(c8);
+        auto saved = std::chrono::steady_clock::now();
+
+        // timers tick off cycles, so the ahead frames tick exactly when the real ones will
+        instructions += scheduler.runInstructions((unsigned long)((unsigned long long)frames * scheduler.getIPS() / 60));
+        memcpy(gfx, c8.gfx, sizeof(gfx));
+        hires = c8.hires;
+        cycles = c8.cycles;
+
+        auto restoring = std::chrono::steady_clock::now();
+        checkpoint.restore(c8);
+        c8.audio = audio;
+        c8.trace = trace;
+#ifdef CHIP8_PROFILE
+        c8.profile = profile;
+#endif
+        checkpointNanoseconds += since(start, saved) + since(restoring, std::chrono::steady_clock::now());
+    }
+
+    // compared rather than going by drawFlag: a key can stop a draw the last step ran into
+    dirtyRows = 0;
+    if(!steps || hires != wasHires)
+        dirtyRows = ~0ULL;
+    else
+        for(int word = 0; word < DISPLAY_PLANES * 2 * DISPLAY_ROWS; ++word)
+            if(before[word] != gfx[word])
+                dirtyRows |= 1ULL << (word & (DISPLAY_ROWS - 1));
+    ++steps;
+    nanoseconds += since(start, std::chrono::steady_clock::now());
+    return dirtyRows != 0;
+}
@@ -0,0 +1,49 @@
+//
+//  runahead.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/30/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef runahead_hpp
+#define runahead_hpp
+
+#include <stdint.h>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include "snapshot.hpp"
+
+/* Run-ahead: hides the frames a game takes to react to a key. After every real frame step()
+ * saves the machine, runs it frames more frames with the keys as they are now, keeps the screen
+ * that gets to and puts the machine back exactly as it was (Chip8Checkpoint). Showing that screen
+ * instead of the real one, a key press shows up frames sooner, for frames times the emulation.
+ * The frames run ahead make no sound and aren't traced or profiled.
+ */
+class RunAhead
+{
+public:
+    RunAhead(Chip8 &, Scheduler &);
+
+    int frames; // how far ahead, 0 for off (step() then just copies the real screen)
+
+    // After each real frame. True if the screen ahead isn't the one the last step() got to.
+    bool step();
+    uint64_t gfx[DISPLAY_PLANES * 2 * DISPLAY_ROWS]; // the screen ahead, as Chip8::gfx
+    bool hires;
+    uint64_t dirtyRows; // rows that differ from the last step()'s screen, all of them the first time
+    unsigned long long cycles; // Chip8::cycles of the screen ahead
+
+    // What it has cost so far
+    unsigned long long steps;
+    unsigned long long instructions; // run ahead, on top of the real ones
+    unsigned long long nanoseconds; // in step() altogether
+    unsigned long long checkpointNanoseconds; // of that, saving and restoring
+
+private:
+    Chip8 &c8;
+    Scheduler &scheduler;
+    Chip8Checkpoint checkpoint;
+};
+
+#endif /* runahead_hpp */
@@ -0,0 +1,176 @@
+//
+//  scheduler.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/13/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "scheduler.hpp"
+#include <thread>
+#include "audio.hpp"
+
+// Longest a Scheduler waits before looking for a wait loop again after not finding one, in instructions
+#define IDLE_BACKOFF_MAX 256
+
+// If the host stalls for longer than this (seconds) we drop the backlog instead of racing to catch up
+#define MAX_LAG 0.25
+
+Scheduler::Scheduler(Chip8 &chip, Chip8Backend *b) : c8(chip), backend(b)
+{
+    throttle = true;
+    skipIdleLoops = true;
+    settling = 0;
+    backoff = 0;
+    setIPS(DEFAULT_IPS);
+}
+
+void Scheduler::setIPS(unsigned int newIPS)
+{
+    ips = newIPS ? newIPS : 1;
+    batch = ips / 60 ? ips / 60 : 1;
+    resync();
+}
+
+void Scheduler::resync()
+{
+    start = std::chrono::steady_clock::now();
+    executed = 0;
+    maxDrift = 0;
+    droppedInstructions = 0;
+}
+
+unsigned long long Scheduler::nextTick() const
+{
+    // tick k happens once cycles reaches ceil(k * ips / 60)
+    unsigned long long k = c8.cycles * 60 / ips + 1;
+    return (k * ips + 59) / 60;
+}
+
+unsigned long Scheduler::runInstructions(unsigned long n)
+{
+    unsigned long done = 0;
+    while(done < n)
+    {
+        unsigned long long before = c8.cycles;
+        unsigned long long untilTick = nextTick() - before;
+        unsigned long chunk = n - done < untilTick ? n - done : (unsigned long)untilTick;
+
+        unsigned long ran = skipIdleLoops && !settling ? skipIdle(n - done) : 0;
+        if(!ran)
+        {
+            ran = backend ? backend->run(chunk) : c8.run(chunk);
+            settling -= ran < settling ? ran : settling;
+        }
+        done += ran;
+
+        // tick k is due at cycle ceil(k * ips / 60), a skipped wait loop can pass many of them.
+        // Once both timers are at zero the rest do nothing.
+        unsigned long long tick = before * 60 / ips;
+        unsigned long long ticks = c8.cycles * 60 / ips - tick;
+        for(; ticks && (c8.delay_timer || c8.sound_timer); --ticks)
+            c8.tickTimers((++tick * ips + 59) / 60);
+        if(c8.waitingForKey)
+            break;
+    }
+    if(c8.audio)
+        c8.audio->advance(c8.cycles);
+    return done;
+}
+
+unsigned long Scheduler::skipIdle(unsigned long n)
+{
+    IdleLoop loop;
+    if(!c8.findIdleLoop(loop))
+    {
+        // busy code: look less and less often, so the checks cost next to nothing
+        backoff = backoff ? (backoff * 2 < IDLE_BACKOFF_MAX ? backoff * 2 : IDLE_BACKOFF_MAX) : 1;
+        settling = backoff;
+        return 0;
+    }
+    backoff = 0;
+    unsigned long long end = c8.cycles + n;
+    if(loop.readsDelay)
+    {
+        // the first instruction to see the delay drop below minDelay
+        if(c8.delay_timer && loop.minDelay)
+        {
+            unsigned long long k = c8.cycles * 60 / ips + (c8.delay_timer - loop.minDelay) + 1;
+            unsigned long long change = (k * ips + 59) / 60;
+            end = change < end ? change : end;
+        }
+        /* The registers holding delay readings aren't updated while skipping, so one trip has to
+         * run for real afterwards to fill them in, still before the delay gets that low.
+         */
+        if(end < c8.cycles + 2 * loop.length)
+            return 0;
+        end -= loop.length;
+    }
+    unsigned long long trips = (end - c8.cycles) / loop.length;
+    if(!trips)
+        return 0;
+    c8.cycles += trips * loop.length;
+    c8.opcode = loop.last;
+    if(loop.readsDelay)
+        settling = loop.length;
+    return (unsigned long)(trips * loop.length);
+}
+
+void Scheduler::idle(unsigned long long n)
+{
+    unsigned long long end = c8.cycles + n;
+    for(unsigned long long tickAt = nextTick(); tickAt <= end; tickAt = nextTick())
+    {
+        c8.cycles = tickAt;
+        c8.tickTimers();
+    }
+    c8.cycles = end;
+    if(c8.audio)
+        c8.audio->advance(c8.cycles);
+}
+
+double Scheduler::drift() const
+{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return elapsed - (double)executed / ips;
+}
+
+unsigned long long Scheduler::instructionsDue() const
+{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    unsigned long long target = (unsigned long long)(elapsed * ips);
+    return target > executed ? target - executed : 0;
+}
+
+unsigned long Scheduler::update()
+{
+    if(!throttle)
+        return runInstructions(batch);
+
+    unsigned long long due = instructionsDue();
+    if(due < batch)
+    {
+        // not worth waking up for yet, sleep until a whole batch is due
+        std::this_thread::sleep_for(std::chrono::duration<double>((double)(batch - due) / ips));
+        due = instructionsDue();
+    }
+
+    double lag = drift();
+    if(lag > maxDrift)
+        maxDrift = lag;
+    if(lag > MAX_LAG && due > batch)
+    {
+        // we were stalled (debugger, window drag...), don't fast forward through it
+        unsigned long long keep = batch;
+        droppedInstructions += due - keep;
+        executed += due - keep;
+        due = keep;
+    }
+
+    unsigned long ran = runInstructions((unsigned long)due);
+    // blocked on FX0A: the rest of the time still passes for the timers
+    if(ran < due)
+        idle(due - ran);
+    executed += due;
+    return ran;
+}
@@ -0,0 +1,77 @@
+//
+//  scheduler.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/13/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef scheduler_hpp
+#define scheduler_hpp
+
+#include <chrono>
+#include "chip8.hpp"
+
+// Speed most games were written for
+#define DEFAULT_IPS 600
+
+/* Decides how many instructions to run and when, and ticks the timers.
+ * Timers tick at exactly 60 Hz of emulated time: once every ips / 60 instructions, counted off
+ * Chip8::cycles, so the same run always ticks at the same instructions no matter how fast the host is.
+ *
+ * Throttled, update() paces emulation to wall clock time at the target ips, running a batch of
+ * instructions per wakeup rather than one. Unthrottled it just runs a batch as fast as it can.
+ */
+class Scheduler
+{
+public:
+    Scheduler(Chip8 &, Chip8Backend *backend = NULL);
+
+    // instructions per emulated second, also resets the pacing
+    void setIPS(unsigned int ips);
+    unsigned int getIPS() const { return ips; }
+
+    bool throttle; // false runs as fast as possible
+    /* Fast-forward through wait loops (see Chip8::findIdleLoop), on by default. A loop waiting
+     * on the delay timer is skipped up to the tick where it might go another way, one waiting on
+     * a key for as long as runInstructions was asked to run. The machine ends up exactly as if
+     * every instruction had run.
+     */
+    bool skipIdleLoops;
+    unsigned int batch; // instructions per wakeup, defaults to one frame's worth (ips / 60)
+
+    // Throttled: sleeps until a batch is due then runs everything due, time spent waiting for a key
+    // passes idle. Unthrottled: runs one batch, or less if it blocks on a key.
+    // Returns how many instructions ran.
+    unsigned long update();
+    // Runs n instructions right now, ticking the timers on the way. Ignores pacing.
+    // Stops early if the machine starts waiting for a key (FX0A), check c8.waitingForKey.
+    unsigned long runInstructions(unsigned long n);
+    // Lets n cycles of emulated time pass without running anything (timers still tick),
+    // what the machine does while it waits for a key
+    void idle(unsigned long long n);
+    // Start pacing over from now, e.g. after the emulator was paused
+    void resync();
+
+    // How far emulated time is behind wall clock time, in seconds (negative if ahead)
+    double drift() const;
+    double maxDrift; // worst drift seen by update()
+    // instructions we gave up on because the host fell too far behind (see MAX_LAG)
+    unsigned long long droppedInstructions;
+
+private:
+    Chip8 &c8;
+    Chip8Backend *backend;
+    unsigned int ips;
+
+    std::chrono::steady_clock::time_point start;
+    unsigned long long executed; // instructions run by update() since start
+
+    unsigned long long nextTick() const; // cycle count the next timer tick happens at
+    unsigned long skipIdle(unsigned long n); // skips up to n instructions of a wait loop
+    unsigned long settling; // instructions to run before looking for a wait loop again
+    unsigned long backoff; // how long settling was after the last miss
+    unsigned long long instructionsDue() const;
+};
+
+#endif /* scheduler_hpp */
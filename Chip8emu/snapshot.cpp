@@ -0,0 +1,299 @@
+//
+//  snapshot.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/16/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "snapshot.hpp"
+#include "delta.hpp"
+#include <string.h>
+#include <algorithm>
+
+#define HEADER_SIZE 6 // magic + version
+
+size_t snapshotSize()
+{
+    return HEADER_SIZE
+        + 2 * 4        // opcode, I, pc, sp
+        + MEMORY_SIZE  // memory
+        + 16           // V
+        + 2 * 16       // stack
+        + 2            // delay, sound timers
+        + 8            // rng
+        + 8 * DISPLAY_PLANES * 2 * DISPLAY_ROWS // gfx
+        + 16           // keys
+        + 8            // cycles
+        + 3            // drawFlag, waitingForKey, waitRegister
+        + 2            // hires, planes
+        + 16 + 16 + 1; // flags, audioPattern, pitch
+}
+
+void saveSnapshot(const Chip8 &c8, unsigned char *buf)
+{
+    unsigned char *p = buf;
+    memcpy(p, "C8SS", 4);
+    p = putLE(p + 4, SNAPSHOT_VERSION, 2);
+
+    p = putLE(p, c8.opcode, 2);
+    p = putLE(p, c8.I, 2);
+    p = putLE(p, c8.pc, 2);
+    p = putLE(p, c8.sp, 2);
+    memcpy(p, c8.memory, MEMORY_SIZE);
+    p += MEMORY_SIZE;
+    memcpy(p, c8.V, 16);
+    p += 16;
+    for(int i = 0; i < 16; ++i)
+        p = putLE(p, c8.stack[i], 2);
+    *p++ = c8.delay_timer;
+    *p++ = c8.sound_timer;
+    p = putLE(p, c8.rng, 8);
+    for(int i = 0; i < DISPLAY_PLANES * 2 * DISPLAY_ROWS; ++i)
+        p = putLE(p, c8.gfx[i], 8);
+    memcpy(p, c8.key, 16);
+    p += 16;
+    p = putLE(p, c8.cycles, 8);
+    *p++ = c8.drawFlag;
+    *p++ = c8.waitingForKey;
+    *p++ = c8.waitRegister;
+    *p++ = c8.hires;
+    *p++ = c8.planes;
+    memcpy(p, c8.flags, 16);
+    p += 16;
+    memcpy(p, c8.audioPattern, 16);
+    p += 16;
+    *p++ = c8.pitch;
+}
+
+bool loadSnapshot(Chip8 &c8, const unsigned char *buf, size_t size)
+{
+    if(size != snapshotSize() || memcmp(buf, "C8SS", 4) != 0)
+        return false;
+    const unsigned char *p = buf + 4;
+    if(getLE(p, 2) != SNAPSHOT_VERSION)
+        return false;
+
+    c8.opcode = getLE(p, 2);
+    c8.I = getLE(p, 2);
+    c8.pc = getLE(p, 2);
+    c8.sp = getLE(p, 2) & 0xF;
+    memcpy(c8.memory, p, MEMORY_SIZE);
+    p += MEMORY_SIZE;
+    memcpy(c8.V, p, 16);
+    p += 16;
+    for(int i = 0; i < 16; ++i)
+        c8.stack[i] = getLE(p, 2);
+    c8.delay_timer = *p++;
+    c8.sound_timer = *p++;
+    c8.rng = getLE(p, 8);
+    for(int i = 0; i < DISPLAY_PLANES * 2 * DISPLAY_ROWS; ++i)
+        c8.gfx[i] = getLE(p, 8);
+    memcpy(c8.key, p, 16);
+    p += 16;
+    c8.cycles = getLE(p, 8);
+    c8.drawFlag = *p++ != 0;
+    c8.waitingForKey = *p++ != 0;
+    c8.waitRegister = *p++ & 0xF;
+    c8.hires = *p++ != 0;
+    c8.planes = *p++ & 3;
+    memcpy(c8.flags, p, 16);
+    p += 16;
+    memcpy(c8.audioPattern, p, 16);
+    p += 16;
+    c8.pitch = *p++;
+    // the whole screen may be different from what's displayed
+    c8.dirtyRows = ~0ULL;
+    c8.drawFlag = true;
+
+    // all of memory may have changed under the predecode cache and any translated code
+    c8.invalidateAllDecoded();
+    return true;
+}
+
+#define CHECKPOINT_PAGE 1024 // what a bit of Chip8::writtenPages covers
+#define CHECKPOINT_LINE 64 // restore compares and copies back this much at a time
+
+Chip8Checkpoint::Chip8Checkpoint() : owner(NULL), memory(MEMORY_SIZE)
+{
+}
+
+void Chip8Checkpoint::save(Chip8 &c8)
+{
+    for(uint64_t pages = &c8 == owner ? c8.writtenPages : ~0ULL; pages; pages &= pages - 1)
+    {
+        size_t at = (size_t)__builtin_ctzll(pages) * CHECKPOINT_PAGE;
+        memcpy(&memory[at], &c8.memory[at], CHECKPOINT_PAGE);
+    }
+    c8.writtenPages = 0;
+    owner = &c8;
+
+    opcode = c8.opcode;
+    I = c8.I;
+    pc = c8.pc;
+    sp = c8.sp;
+    memcpy(V, c8.V, sizeof(V));
+    memcpy(stack, c8.stack, sizeof(stack));
+    memcpy(flags, c8.flags, sizeof(flags));
+    delay_timer = c8.delay_timer;
+    sound_timer = c8.sound_timer;
+    rng = c8.rng;
+    memcpy(gfx, c8.gfx, sizeof(gfx));
+    hires = c8.hires;
+    planes = c8.planes;
+    dirtyRows = c8.dirtyRows;
+    drawFlag = c8.drawFlag;
+    memcpy(audioPattern, c8.audioPattern, sizeof(audioPattern));
+    pitch = c8.pitch;
+    memcpy(key, c8.key, sizeof(key));
+    waitingForKey = c8.waitingForKey;
+    waitRegister = c8.waitRegister;
+    cycles = c8.cycles;
+}
+
+bool Chip8Checkpoint::restore(Chip8 &c8)
+{
+    if(!owner)
+        return false;
+    for(uint64_t pages = &c8 == owner ? c8.writtenPages : ~0ULL; pages; pages &= pages - 1)
+    {
+        size_t page = (size_t)__builtin_ctzll(pages) * CHECKPOINT_PAGE;
+        for(size_t at = page; at < page + CHECKPOINT_PAGE; at += CHECKPOINT_LINE)
+        {
+            if(!memcmp(&c8.memory[at], &memory[at], CHECKPOINT_LINE))
+                continue;
+            memcpy(&c8.memory[at], &memory[at], CHECKPOINT_LINE);
+            if(at >= 0x1000)
+                continue; // XO-CHIP data, never decoded
+            // as invalidateDecoded, the instruction starting just before the line included
+            for(int i = (int)at - 1; i < (int)at + CHECKPOINT_LINE; ++i)
+                c8.decoded[i & 0x0FFF].handler = Chip8::H_Undecoded;
+            ++c8.codeGeneration[at >> 8];
+        }
+    }
+    c8.writtenPages = 0;
+    owner = &c8;
+
+    c8.opcode = opcode;
+    c8.I = I;
+    c8.pc = pc;
+    c8.sp = sp;
+    memcpy(c8.V, V, sizeof(V));
+    memcpy(c8.stack, stack, sizeof(stack));
+    memcpy(c8.flags, flags, sizeof(flags));
+    c8.delay_timer = delay_timer;
+    c8.sound_timer = sound_timer;
+    c8.rng = rng;
+    memcpy(c8.gfx, gfx, sizeof(gfx));
+    c8.hires = hires;
+    c8.planes = planes;
+    c8.dirtyRows = dirtyRows;
+    c8.drawFlag = drawFlag;
+    memcpy(c8.audioPattern, audioPattern, sizeof(audioPattern));
+    c8.pitch = pitch;
+    memcpy(c8.key, key, sizeof(key));
+    c8.waitingForKey = waitingForKey;
+    c8.waitRegister = waitRegister;
+    c8.cycles = cycles;
+    return true;
+}
+
+RewindBuffer::RewindBuffer(size_t frames, int interval) : maxFrames(frames ? frames : 1), keyframeInterval(interval > 0 ? interval : 1)
+{
+    current.resize(snapshotSize());
+    keyframe.resize(snapshotSize());
+    clear();
+}
+
+void RewindBuffer::clear()
+{
+    while(!entries.empty())
+    {
+        spare.push_back(std::vector<unsigned char>());
+        spare.back().swap(entries.front().data);
+        entries.pop_front();
+    }
+    sinceKeyframe = 0;
+    bytes = 0;
+}
+
+void RewindBuffer::push(const Chip8 &c8)
+{
+    if(entries.size() >= maxFrames)
+        dropOldestGroup();
+
+    saveSnapshot(c8, &current[0]);
+
+    Entry entry;
+    if(!spare.empty())
+    {
+        entry.data.swap(spare.back());
+        entry.data.clear();
+        spare.pop_back();
+    }
+    entry.keyframe = entries.empty() || sinceKeyframe >= keyframeInterval;
+    if(entry.keyframe)
+    {
+        keyframe.swap(current);
+        sinceKeyframe = 0;
+        deltaEncode(&keyframe[0], NULL, keyframe.size(), entry.data);
+    }
+    else
+        deltaEncode(&current[0], &keyframe[0], current.size(), entry.data);
+    ++sinceKeyframe;
+
+    bytes += entry.data.size();
+    entries.push_back(Entry());
+    entries.back().keyframe = entry.keyframe;
+    entries.back().data.swap(entry.data);
+}
+
+// Deltas only make sense with their keyframe, so old frames go a keyframe group at a time
+void RewindBuffer::dropOldestGroup()
+{
+    do
+    {
+        bytes -= entries.front().data.size();
+        spare.push_back(std::vector<unsigned char>());
+        spare.back().swap(entries.front().data);
+        entries.pop_front();
+    } while(!entries.empty() && !entries.front().keyframe);
+}
+
+bool RewindBuffer::rewind(Chip8 &c8, size_t framesBack)
+{
+    if(framesBack >= entries.size())
+        return false;
+    size_t target = entries.size() - 1 - framesBack;
+
+    // find its keyframe
+    size_t key = target;
+    while(!entries[key].keyframe)
+        --key;
+
+    // current is only scratch between pushes, build the state in it rather than allocating
+    std::fill(current.begin(), current.end(), 0);
+    decode(entries[key].data, &current[0]);
+    if(key != target)
+        decode(entries[target].data, &current[0]);
+    if(!loadSnapshot(c8, &current[0], current.size()))
+        return false;
+
+    // forget everything after the frame we went back to, carry on deltas from its keyframe
+    while(entries.size() > target + 1)
+    {
+        bytes -= entries.back().data.size();
+        spare.push_back(std::vector<unsigned char>());
+        spare.back().swap(entries.back().data);
+        entries.pop_back();
+    }
+    std::fill(keyframe.begin(), keyframe.end(), 0);
+    decode(entries[key].data, &keyframe[0]);
+    sinceKeyframe = (int)(target - key + 1);
+    return true;
+}
+
+void RewindBuffer::decode(const std::vector<unsigned char> &in, unsigned char *state)
+{
+    deltaDecode(in.data(), in.size(), state, snapshotSize());
+}
@@ -0,0 +1,108 @@
+//
+//  snapshot.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/16/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef snapshot_hpp
+#define snapshot_hpp
+
+#include <deque>
+#include <vector>
+#include "chip8.hpp"
+
+// Bump this whenever the layout below changes, old snapshots get rejected instead of misread
+#define SNAPSHOT_VERSION 3
+
+/* Binary snapshot of the whole machine: "C8SS", version, then every register, memory,
+ * the stack, timers, random generator, screen, keys and the cycle count, then the SUPER-CHIP /
+ * XO-CHIP state (resolution, planes, flag registers, audio pattern and pitch), little endian.
+ * The predecode cache isn't saved, it gets rebuilt after a restore.
+ */
+size_t snapshotSize();
+// buf must hold snapshotSize() bytes
+void saveSnapshot(const Chip8 &, unsigned char *buf);
+// Returns false (and leaves the machine alone) if buf isn't a snapshot of this version
+bool loadSnapshot(Chip8 &, const unsigned char *buf, size_t size);
+
+/* Save and restore within one process, for run-ahead: a copy of the machine in its own layout,
+ * not a file format. Only the 1K pages of memory written since the last save or restore get
+ * copied (Chip8::writtenPages), and a restore only throws away the predecoded instructions where
+ * bytes actually changed back, so both usually cost well under a microsecond.
+ * A machine's writtenPages can only follow one checkpoint, don't save it into two.
+ */
+class Chip8Checkpoint
+{
+public:
+    Chip8Checkpoint();
+
+    // Clears the machine's writtenPages, so it isn't const
+    void save(Chip8 &);
+    // Puts back exactly what save() took (the first restore onto another machine copies everything).
+    // False if nothing was saved yet.
+    bool restore(Chip8 &);
+
+private:
+    const Chip8 *owner; // the machine whose writtenPages say what differs from memory below
+    std::vector<unsigned char> memory;
+    unsigned short opcode, I, pc, sp;
+    unsigned char V[16];
+    unsigned short stack[16];
+    unsigned char flags[16];
+    unsigned char delay_timer, sound_timer;
+    uint64_t rng;
+    uint64_t gfx[DISPLAY_PLANES * 2 * DISPLAY_ROWS];
+    bool hires;
+    unsigned char planes;
+    uint64_t dirtyRows;
+    bool drawFlag;
+    unsigned char audioPattern[16];
+    unsigned char pitch;
+    unsigned char key[16];
+    bool waitingForKey;
+    unsigned char waitRegister;
+    unsigned long long cycles;
+};
+
+/* Keeps the last few minutes of snapshots for rewinding.
+ * Every keyframeInterval frames a keyframe is stored, the frames in between are stored as the
+ * XOR against their keyframe, run length encoded. Nearly all of the machine is the same from
+ * one frame to the next, so a frame usually costs a few dozen bytes.
+ */
+class RewindBuffer
+{
+public:
+    RewindBuffer(size_t maxFrames = 60 * 60 * 5, int keyframeInterval = 60);
+
+    // Capture the machine as the newest frame (call once per frame)
+    void push(const Chip8 &);
+    // Restore the state from framesBack frames ago (0 = newest) and forget everything newer.
+    // Returns false if we don't have that much history.
+    bool rewind(Chip8 &, size_t framesBack);
+
+    size_t frames() const { return entries.size(); }
+    size_t bytesUsed() const { return bytes; }
+    void clear();
+
+private:
+    struct Entry
+    {
+        bool keyframe;
+        std::vector<unsigned char> data; // encoded XOR against the keyframe (against zeros for a keyframe)
+    };
+
+    size_t maxFrames;
+    int keyframeInterval;
+    int sinceKeyframe;
+    size_t bytes;
+    std::deque<Entry> entries;
+    std::vector<std::vector<unsigned char> > spare; // recycled buffers, so steady state doesn't allocate
+    std::vector<unsigned char> current, keyframe; // raw snapshots, current is scratch for push() and rewind()
+
+    void dropOldestGroup();
+    static void decode(const std::vector<unsigned char> &in, unsigned char *state); // XORs a frame into state
+};
+
+#endif /* snapshot_hpp */
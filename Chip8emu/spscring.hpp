@@ -0,0 +1,56 @@
+//
+//  spscring.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/21/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef spscring_hpp
+#define spscring_hpp
+
+#include <atomic>
+
+/* Fixed size queue for exactly one producer thread and one consumer thread, lock free.
+ * Each side only writes its own index, so all it takes is an acquire / release pair per item.
+ * N has to be a power of two.
+ */
+template <typename T, unsigned int N>
+class SpscRing
+{
+public:
+    enum { CAPACITY = N };
+    SpscRing() : head(0), tail(0) {}
+
+    // Producer side, false if the ring is full
+    bool push(const T &item)
+    {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if(h - tail.load(std::memory_order_acquire) == N)
+            return false;
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release); // the item is written before the consumer can see it
+        return true;
+    }
+
+    // Consumer side, false if there's nothing
+    bool pop(T &item)
+    {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if(t == head.load(std::memory_order_acquire))
+            return false;
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release); // done reading before the producer can reuse the slot
+        return true;
+    }
+
+private:
+    static_assert((N & (N - 1)) == 0, "SpscRing size has to be a power of two");
+
+    T items[N];
+    std::atomic<unsigned int> head; // next slot to write, only the producer moves it
+    char padding[64]; // keeps head and tail on separate cache lines
+    std::atomic<unsigned int> tail; // next slot to read, only the consumer moves it
+};
+
+#endif /* spscring_hpp */
@@ -0,0 +1,192 @@
+//
+//  trace.cpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/28/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#include "trace.hpp"
+#include <string.h>
+#include <string>
+#include "delta.hpp"
+
+#define TRACE_VERSION 1
+#define TRACE_HEADER 18
+#define TRACE_EVENT 32
+
+static const char *typeNames[TRACE_TYPES] = {"unknown", "call", "return", "draw"};
+
+Chip8Trace::Chip8Trace(unsigned int capacity, unsigned int f) : filter(f)
+{
+    size_t size = 1;
+    while(size < capacity)
+        size <<= 1;
+    events.resize(size);
+    mask = size - 1;
+    clear();
+}
+
+void Chip8Trace::clear()
+{
+    recorded = 0;
+    first = 0;
+    for(int i = 0; i < TRACE_TYPES; ++i)
+        counts[i] = 0;
+}
+
+unsigned long long Chip8Trace::count(unsigned int type) const
+{
+    unsigned long long total = 0;
+    for(int i = 0; i < TRACE_TYPES; ++i)
+        if(type & 1 << i)
+            total += counts[i];
+    return total;
+}
+
+bool Chip8Trace::save(const char *filename) const
+{
+    FILE *file = fopen(filename, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", filename);
+        return false;
+    }
+    unsigned char header[TRACE_HEADER];
+    memcpy(header, "C8TR", 4);
+    header[4] = TRACE_VERSION;
+    header[5] = filter;
+    putLE(header + 6, recorded, 8);
+    putLE(header + 14, size(), 4);
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+    for(size_t i = 0; i < size() && ok; ++i)
+    {
+        const TraceEvent &event = at(i);
+        unsigned char out[TRACE_EVENT];
+        unsigned char *p = putLE(out, event.cycle, 8);
+        p = putLE(p, event.pc, 2);
+        p = putLE(p, event.opcode, 2);
+        putLE(p, event.I, 2);
+        out[14] = event.type;
+        out[15] = event.sp;
+        memcpy(out + 16, event.V, 16);
+        ok = fwrite(out, sizeof(out), 1, file) == 1;
+    }
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+bool Chip8Trace::load(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return false;
+    }
+    unsigned char header[TRACE_HEADER];
+    if(fread(header, sizeof(header), 1, file) != 1 || memcmp(header, "C8TR", 4) || header[4] != TRACE_VERSION)
+    {
+        fprintf(stderr, "%s is not a trace\n", filename);
+        fclose(file);
+        return false;
+    }
+    const unsigned char *p = header + 6;
+    unsigned long long total = getLE(p, 8);
+    size_t kept = (size_t)getLE(p, 4);
+    // check the count against the file before growing the ring for it
+    long length = -1;
+    if(!fseek(file, 0, SEEK_END))
+        length = ftell(file);
+    if(kept > total || length < 0 || (unsigned long)length < TRACE_HEADER + (unsigned long long)kept * TRACE_EVENT
+       || fseek(file, TRACE_HEADER, SEEK_SET))
+    {
+        fprintf(stderr, "%s is cut short\n", filename);
+        fclose(file);
+        return false;
+    }
+    if(kept > events.size())
+    {
+        size_t size = events.size();
+        while(size < kept)
+            size <<= 1;
+        events.resize(size);
+        mask = size - 1;
+    }
+    clear();
+    filter = header[5];
+    // the counts only cover what was kept, recorded ends up at the real total and the ring holds
+    // just the kept events whatever its size
+    recorded = first = total - kept;
+    bool ok = true;
+    for(size_t i = 0; i < kept; ++i)
+    {
+        unsigned char in[TRACE_EVENT];
+        if(fread(in, sizeof(in), 1, file) != 1)
+        {
+            fprintf(stderr, "%s is cut short\n", filename);
+            ok = false;
+            break;
+        }
+        p = in;
+        unsigned long long cycle = getLE(p, 8);
+        uint16_t pc = (uint16_t)getLE(p, 2);
+        uint16_t opcode = (uint16_t)getLE(p, 2);
+        uint16_t I = (uint16_t)getLE(p, 2);
+        record(in[14], cycle, pc, opcode, I, in[15], in + 16);
+    }
+    fclose(file);
+    return ok;
+}
+
+unsigned int parseTraceFilter(const char *names)
+{
+    unsigned int filter = 0;
+    std::string list = names;
+    size_t start = 0;
+    while(start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        if(comma == std::string::npos)
+            comma = list.size();
+        std::string name = list.substr(start, comma - start);
+        if(name == "all")
+            filter |= TRACE_ALL;
+        else if(name == "unknown")
+            filter |= TRACE_UNKNOWN;
+        else if(name == "calls")
+            filter |= TRACE_CALL;
+        else if(name == "returns")
+            filter |= TRACE_RETURN;
+        else if(name == "draws")
+            filter |= TRACE_DRAW;
+        else
+            return 0;
+        start = comma + 1;
+    }
+    return filter;
+}
+
+void printTraceEvent(FILE *out, const TraceEvent &event)
+{
+    const char *name = "?";
+    for(int i = 0; i < TRACE_TYPES; ++i)
+        if(event.type == 1u << i)
+            name = typeNames[i];
+    fprintf(out, "%llu pc=0x%03X op=%04X %-7s I=0x%03X sp=%u V=", (unsigned long long)event.cycle, event.pc,
+            event.opcode, name, event.I, event.sp);
+    for(int i = 0; i < 16; ++i)
+        fprintf(out, "%02X%s", event.V[i], i < 15 ? " " : "\n");
+}
+
+long dumpTrace(const char *filename, FILE *out)
+{
+    Chip8Trace trace(1);
+    if(!trace.load(filename))
+        return -1;
+    if(trace.recorded > trace.size())
+        fprintf(out, "# %llu events recorded, the last %zu kept\n", trace.recorded, trace.size());
+    for(size_t i = 0; i < trace.size(); ++i)
+        printTraceEvent(out, trace.at(i));
+    return (long)trace.size();
+}
@@ -0,0 +1,113 @@
+//
+//  trace.hpp
+//  Chip8emu
+//
+//  Created by Ruijing Li on 10/28/18.
+//  Copyright © 2018 Ruijing. All rights reserved.
+//
+
+#ifndef trace_hpp
+#define trace_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "chip8.hpp"
+
+/* Flight recorder for diagnostics, instead of printf from the hot loop. Point Chip8::trace at one
+ * and the interpreter writes a fixed size binary event for each instruction the filter picks
+ * (unknown opcodes by default), into a ring that keeps the newest ones. A ROM that runs off into
+ * data costs a 32 byte store per instruction instead of a line on stdout.
+ *
+ * A trace belongs to one machine and only that machine's thread writes it, so nothing is shared
+ * and there are no locks: in a batch every job has its own. Read it (or save() it) once the
+ * machine has stopped, and decode the file offline with dumpTrace (Chip8Batch --dump-trace).
+ *
+ * The hooks are in the interpreter's handlers, which the JIT uses for everything it doesn't
+ * compile (all four types here). Recompiled blocks inline calls and returns, so those aren't seen.
+ */
+
+// Event types, also the filter bits
+enum TraceType
+{
+    TRACE_UNKNOWN = 1, // an opcode nothing decodes to
+    TRACE_CALL = 2, // 2NNN
+    TRACE_RETURN = 4, // 00EE
+    TRACE_DRAW = 8, // DXYN, DXY0
+    TRACE_ALL = 15
+};
+#define TRACE_TYPES 4
+// events a trace keeps by default, 32K of memory at 32 bytes each
+#define TRACE_CAPACITY 1024
+
+// Machine state as the instruction started, 32 bytes
+struct TraceEvent
+{
+    uint64_t cycle; // Chip8::cycles, the instruction's number
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint8_t type; // one TraceType
+    uint8_t sp;
+    uint8_t V[16];
+};
+
+class Chip8Trace
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit Chip8Trace(unsigned int capacity = TRACE_CAPACITY, unsigned int filter = TRACE_UNKNOWN);
+
+    bool wants(unsigned int type) const { return filter & type; }
+    // Overwrites the oldest event once the ring is full
+    inline void record(unsigned int type, const Chip8 &c8, unsigned short opcode)
+    {
+        record(type, c8.cycles, c8.pc, opcode, c8.I, (uint8_t)c8.sp, c8.V);
+    }
+    inline void record(unsigned int type, uint64_t cycle, uint16_t pc, uint16_t opcode, uint16_t I, uint8_t sp,
+                       const uint8_t *V)
+    {
+        TraceEvent &event = events[recorded++ & mask];
+        event.cycle = cycle;
+        event.pc = pc;
+        event.opcode = opcode;
+        event.I = I;
+        event.type = type;
+        event.sp = sp;
+        for(int i = 0; i < 16; ++i)
+            event.V[i] = V[i];
+        ++counts[type == TRACE_UNKNOWN ? 0 : type == TRACE_CALL ? 1 : type == TRACE_RETURN ? 2 : 3];
+    }
+    void clear();
+
+    // Events still in the ring, oldest first
+    size_t size() const { return recorded - first < events.size() ? (size_t)(recorded - first) : events.size(); }
+    const TraceEvent &at(size_t i) const { return events[(recorded - size() + i) & mask]; }
+    unsigned long long count(unsigned int type) const; // recorded of one type, kept or not
+
+    /* File layout: "C8TR", version byte, filter byte, events recorded in all (8 bytes), events
+     * kept (4 bytes), then the kept events oldest first: cycle (8), pc, opcode, I (2 each), type,
+     * sp, V0-VF. Everything little endian. Returns false if it couldn't be written.
+     */
+    bool save(const char *filename) const;
+    // Replaces what's in the ring with a saved trace, growing it if need be
+    bool load(const char *filename);
+
+    unsigned int filter; // TraceType bits to record
+    unsigned long long recorded; // events ever recorded, the ring keeps the last size() of them
+
+private:
+    std::vector<TraceEvent> events;
+    size_t mask;
+    unsigned long long first; // number of the oldest event the ring has seen, past 0 after a load
+    unsigned long long counts[TRACE_TYPES];
+};
+
+// "unknown,calls,returns,draws" or "all" to filter bits, 0 if a name isn't one of those
+unsigned int parseTraceFilter(const char *);
+// One line per event: cycle, pc, opcode, type, I, sp and the registers
+void printTraceEvent(FILE *, const TraceEvent &);
+// Decodes a saved trace to out. Returns the number of events, -1 if the file isn't a trace.
+long dumpTrace(const char *filename, FILE *out);
+
+#endif /* trace_hpp */